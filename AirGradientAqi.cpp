@@ -0,0 +1,165 @@
+/*
+  AirGradientAqi.cpp - Table driven air quality indices for the AirGradient library
+*/
+
+#include "AirGradientAqi.h"
+
+#define AQI_MAX_SEGMENTS 10
+#define AQI_TABLE(segments, resolution, roundUp) \
+  { segments, sizeof(segments) / sizeof(segments[0]), resolution, roundUp }
+
+// US EPA, PM2.5 revised 2024-02-07: C truncated to 0.1 ug/m3
+static const AQI_Segment usEpaPm25[] = {
+  { 0, 90, 0, 50 }, { 91, 354, 51, 100 }, { 355, 554, 101, 150 },
+  { 555, 1254, 151, 200 }, { 1255, 2254, 201, 300 }, { 2255, 3254, 301, 500 }
+};
+// US EPA, PM10: C truncated to 1 ug/m3
+static const AQI_Segment usEpaPm10[] = {
+  { 0, 540, 0, 50 }, { 550, 1540, 51, 100 }, { 1550, 2540, 101, 150 },
+  { 2550, 3540, 151, 200 }, { 3550, 4240, 201, 300 }, { 4250, 6040, 301, 500 }
+};
+
+// EU CAQI, hourly, continuous grid; values above the grid are "> 100"
+static const AQI_Segment euCaqiPm25[] = {
+  { 0, 150, 0, 25 }, { 150, 300, 25, 50 }, { 300, 550, 50, 75 }, { 550, 1100, 75, 100 }
+};
+static const AQI_Segment euCaqiPm10[] = {
+  { 0, 250, 0, 25 }, { 250, 500, 25, 50 }, { 500, 900, 50, 75 }, { 900, 1800, 75, 100 }
+};
+
+// UK DAQI bands 1..10 on whole ug/m3
+static const AQI_Segment ukDaqiPm25[] = {
+  { 0, 110, 1, 1 }, { 120, 230, 2, 2 }, { 240, 350, 3, 3 }, { 360, 410, 4, 4 },
+  { 420, 470, 5, 5 }, { 480, 530, 6, 6 }, { 540, 580, 7, 7 }, { 590, 640, 8, 8 },
+  { 650, 700, 9, 9 }, { 710, 65530, 10, 10 }
+};
+static const AQI_Segment ukDaqiPm10[] = {
+  { 0, 160, 1, 1 }, { 170, 330, 2, 2 }, { 340, 500, 3, 3 }, { 510, 580, 4, 4 },
+  { 590, 660, 5, 5 }, { 670, 750, 6, 6 }, { 760, 830, 7, 7 }, { 840, 910, 8, 8 },
+  { 920, 1000, 9, 9 }, { 1010, 65530, 10, 10 }
+};
+
+// India NAQI (CPCB) on whole ug/m3
+static const AQI_Segment inNaqiPm25[] = {
+  { 0, 300, 0, 50 }, { 310, 600, 51, 100 }, { 610, 900, 101, 200 },
+  { 910, 1200, 201, 300 }, { 1210, 2500, 301, 400 }, { 2510, 3800, 401, 500 }
+};
+static const AQI_Segment inNaqiPm10[] = {
+  { 0, 500, 0, 50 }, { 510, 1000, 51, 100 }, { 1010, 2500, 101, 200 },
+  { 2510, 3500, 201, 300 }, { 3510, 4300, 301, 400 }, { 4310, 5100, 401, 500 }
+};
+
+// China IAQI (HJ 633-2012), 24 h limits on whole ug/m3, IAQI rounded up
+static const AQI_Segment cnIaqiPm25[] = {
+  { 0, 350, 0, 50 }, { 350, 750, 50, 100 }, { 750, 1150, 100, 150 }, { 1150, 1500, 150, 200 },
+  { 1500, 2500, 200, 300 }, { 2500, 3500, 300, 400 }, { 3500, 5000, 400, 500 }
+};
+static const AQI_Segment cnIaqiPm10[] = {
+  { 0, 500, 0, 50 }, { 500, 1500, 50, 100 }, { 1500, 2500, 100, 150 }, { 2500, 3500, 150, 200 },
+  { 3500, 4200, 200, 300 }, { 4200, 5000, 300, 400 }, { 5000, 6000, 400, 500 }
+};
+
+static const AQI_Table aqiTables[AQI_STANDARD_COUNT][AQI_POLLUTANT_COUNT] = {
+  { AQI_TABLE(usEpaPm25, 1, false), AQI_TABLE(usEpaPm10, 10, false) },
+  { AQI_TABLE(euCaqiPm25, 1, false), AQI_TABLE(euCaqiPm10, 1, false) },
+  { AQI_TABLE(ukDaqiPm25, 10, false), AQI_TABLE(ukDaqiPm10, 10, false) },
+  { AQI_TABLE(inNaqiPm25, 10, false), AQI_TABLE(inNaqiPm10, 10, false) },
+  { AQI_TABLE(cnIaqiPm25, 10, true), AQI_TABLE(cnIaqiPm10, 10, true) }
+};
+
+const AQI_Table& AQI_table(AQI_Standard standard, AQI_Pollutant pollutant)
+{
+  if (standard >= AQI_STANDARD_COUNT || pollutant >= AQI_POLLUTANT_COUNT) {
+    return aqiTables[AQI_US_EPA][AQI_PM2_5];
+  }
+  return aqiTables[standard][pollutant];
+}
+
+// Truncate to the table's resolution and clamp to its highest breakpoint.
+static inline uint32_t normalize(const AQI_Table& table, uint32_t c)
+{
+  uint32_t top = table.segments[table.count - 1].cHigh;
+  c -= c % table.resolution;
+  return c > top ? top : c;
+}
+
+// Segments are sorted, so the index is the number of upper bounds below c.
+static inline uint8_t findSegment(const AQI_Table& table, uint32_t c)
+{
+  uint8_t k = 0;
+  for (uint8_t i = 0; i + 1 < table.count; i++) {
+    k += c > table.segments[i].cHigh;
+  }
+  return k;
+}
+
+int16_t AQI_fromTenths(const AQI_Table& table, int32_t tenths)
+{
+  if (tenths < 0) {
+    return -1;
+  }
+  uint32_t c = normalize(table, tenths);
+  const AQI_Segment& s = table.segments[findSegment(table, c)];
+
+  // I = (Ihi - Ilo) / (Chi - Clo) * (C - Clo) + Ilo
+  uint32_t num = (uint32_t)(s.iHigh - s.iLow) * (c - s.cLow);
+  uint32_t den = s.cHigh - s.cLow;
+  return s.iLow + (table.roundUp ? (num + den - 1) / den : (num + den / 2) / den);
+}
+
+int16_t AQI_compute(AQI_Standard standard, AQI_Pollutant pollutant, int32_t tenths)
+{
+  return AQI_fromTenths(AQI_table(standard, pollutant), tenths);
+}
+
+// The per segment division is replaced by a multiplication with a 37 bit
+// reciprocal, which is exact here: the numerator stays below 2^23 (index
+// span <= 500, concentration span < 2^14) and so does every divisor,
+// except in the banded tables where the numerator is only the bias.
+template <uint32_t RESOLUTION>
+static void computeBatch(const AQI_Table& table, const uint16_t* tenths, int16_t* index, size_t count)
+{
+  uint32_t cHigh[AQI_MAX_SEGMENTS];
+  uint32_t cLow[AQI_MAX_SEGMENTS];
+  uint32_t iLow[AQI_MAX_SEGMENTS];
+  uint32_t span[AQI_MAX_SEGMENTS];
+  uint32_t bias[AQI_MAX_SEGMENTS];
+  uint64_t reciprocal[AQI_MAX_SEGMENTS];
+  uint8_t segments = table.count > AQI_MAX_SEGMENTS ? AQI_MAX_SEGMENTS : table.count;
+
+  for (uint8_t k = 0; k < segments; k++) {
+    const AQI_Segment& s = table.segments[k];
+    uint32_t den = s.cHigh - s.cLow;
+    cHigh[k] = s.cHigh;
+    cLow[k] = s.cLow;
+    iLow[k] = s.iLow;
+    span[k] = s.iHigh - s.iLow;
+    bias[k] = table.roundUp ? den - 1 : den / 2;
+    reciprocal[k] = ((1ULL << 37) + den - 1) / den;
+  }
+  uint32_t top = cHigh[segments - 1];
+
+  for (size_t n = 0; n < count; n++) {
+    uint32_t c = tenths[n];
+    c -= c % RESOLUTION;
+    c = c > top ? top : c;
+
+    uint32_t k = 0;
+    for (uint8_t i = 0; i + 1 < segments; i++) {
+      k += c > cHigh[i];
+    }
+
+    uint64_t num = span[k] * (c - cLow[k]) + bias[k];
+    index[n] = iLow[k] + (uint32_t)((num * reciprocal[k]) >> 37);
+  }
+}
+
+void AQI_computeBatch(const AQI_Table& table, const uint16_t* tenths, int16_t* index, size_t count)
+{
+  // a constant resolution turns the truncation into a multiplication
+  if (table.resolution == 10) {
+    computeBatch<10>(table, tenths, index, count);
+  } else {
+    computeBatch<1>(table, tenths, index, count);
+  }
+}
@@ -0,0 +1,69 @@
+/*
+  AirGradientAqi.h - Table driven air quality indices for the AirGradient library
+
+  Every standard is a table of piecewise linear segments over the
+  concentration in tenths of ug/m3, evaluated with integer arithmetic:
+
+    AQI_US_EPA   US EPA AQI, 2024 PM2.5 revision (0..500)
+    AQI_EU_CAQI  European Common Air Quality Index, hourly (0..100)
+    AQI_UK_DAQI  UK Daily Air Quality Index, banded (1..10)
+    AQI_IN_NAQI  India National AQI (0..500)
+    AQI_CN_IAQI  China individual AQI, HJ 633-2012 (0..500)
+
+  Each table truncates the concentration to the resolution its standard
+  reports in, rounds the index as the standard does, and clamps above
+  its highest breakpoint. Negative concentrations (no reading) give -1.
+
+    int aqi = AQI_compute(AQI_US_EPA, AQI_PM2_5, pm25 * 10);
+
+  AQI_computeBatch() converts a whole array against one table without
+  branches in the inner loop, e.g. to recompute stored history after the
+  user switched the standard.
+*/
+
+#ifndef AirGradientAqi_h
+#define AirGradientAqi_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+  AQI_US_EPA,
+  AQI_EU_CAQI,
+  AQI_UK_DAQI,
+  AQI_IN_NAQI,
+  AQI_CN_IAQI,
+  AQI_STANDARD_COUNT
+} AQI_Standard;
+
+typedef enum {
+  AQI_PM2_5,
+  AQI_PM10,
+  AQI_POLLUTANT_COUNT
+} AQI_Pollutant;
+
+// Concentrations in tenths of ug/m3. Banded indices have iLow == iHigh.
+struct AQI_Segment {
+  uint16_t cLow;
+  uint16_t cHigh;
+  uint16_t iLow;
+  uint16_t iHigh;
+};
+
+struct AQI_Table {
+  const AQI_Segment* segments;
+  uint8_t count;
+  // tenths per reporting step: 1 for 0.1 ug/m3, 10 for whole ug/m3
+  uint8_t resolution;
+  // round the index up (China) instead of to nearest
+  bool roundUp;
+};
+
+const AQI_Table& AQI_table(AQI_Standard standard, AQI_Pollutant pollutant);
+
+int16_t AQI_fromTenths(const AQI_Table& table, int32_t tenths);
+int16_t AQI_compute(AQI_Standard standard, AQI_Pollutant pollutant, int32_t tenths);
+
+void AQI_computeBatch(const AQI_Table& table, const uint16_t* tenths, int16_t* index, size_t count);
+
+#endif
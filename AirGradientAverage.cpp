@@ -0,0 +1,194 @@
+/*
+  AirGradientAverage.cpp - Rolling hourly averages and NowCast for the AirGradient library
+*/
+
+#include "AirGradientAverage.h"
+
+static bool reached(uint32_t now, uint32_t deadline)
+{
+  return (int32_t)(now - deadline) >= 0;
+}
+
+static int32_t roundedMean(int64_t sum, uint16_t count)
+{
+  return (sum + count / 2) / count;
+}
+
+void RollingAverage::begin(uint32_t now)
+{
+  for (uint8_t i = 0; i < HOURS; i++) {
+    _hours[i] = NO_VALUE;
+  }
+  _newest = 0;
+  _closed = 0;
+  _sum8 = 0;
+  _valid8 = 0;
+  _sum24 = 0;
+  _valid24 = 0;
+  _nowCast = NO_VALUE;
+
+  _started = true;
+  _hourStart = now;
+  _partialSum = 0;
+  _partialCount = 0;
+}
+
+bool RollingAverage::add(int32_t value, uint32_t now)
+{
+  bool closed = update(now);
+  // negative values are failed reads
+  if (value >= 0 && _partialCount < 0xFFFF) {
+    _partialSum += value;
+    _partialCount++;
+  }
+  return closed;
+}
+
+bool RollingAverage::update(uint32_t now)
+{
+  if (!_started) {
+    begin(now);
+    return false;
+  }
+  if (!reached(now, _hourStart + HOUR)) {
+    return false;
+  }
+
+  // after a whole day without update() nothing of the history is left
+  if (now - _hourStart >= (uint32_t)(HOURS + 1) * HOUR) {
+    begin(now);
+    return true;
+  }
+
+  while (reached(now, _hourStart + HOUR)) {
+    closeHour(_partialCount > 0 ? roundedMean((int64_t)_partialSum * 10, _partialCount) : NO_VALUE);
+    _partialSum = 0;
+    _partialCount = 0;
+    _hourStart += HOUR;
+  }
+  computeNowCast();
+  return true;
+}
+
+void RollingAverage::closeHour(int32_t mean)
+{
+  // the hours leaving the 8 h and 24 h windows; the slot of the latter is
+  // the one overwritten below
+  int32_t leaving8 = getHour(7);
+  int32_t leaving24 = getHour(HOURS - 1);
+  if (leaving8 != NO_VALUE) {
+    _sum8 -= leaving8;
+    _valid8--;
+  }
+  if (leaving24 != NO_VALUE) {
+    _sum24 -= leaving24;
+    _valid24--;
+  }
+
+  _newest = (_newest + 1) % HOURS;
+  _hours[_newest] = mean;
+  if (_closed < HOURS) {
+    _closed++;
+  }
+
+  if (mean != NO_VALUE) {
+    _sum8 += mean;
+    _valid8++;
+    _sum24 += mean;
+    _valid24++;
+  }
+}
+
+// c = sum(w^i * c_i) / sum(w^i) over the valid hours, i = 0 for the last
+// hour, with w = min / max of the valid hours but not below 0.5. Bounded
+// by the 12 hour window, and only run when an hour closes.
+void RollingAverage::computeNowCast()
+{
+  uint8_t recent = 0;
+  for (uint8_t i = 0; i < 3; i++) {
+    recent += getHour(i) != NO_VALUE;
+  }
+  if (recent < 2) {
+    _nowCast = NO_VALUE;
+    return;
+  }
+
+  int32_t lowest = INT32_MAX;
+  int32_t highest = 0;
+  for (uint8_t i = 0; i < NOWCAST_HOURS; i++) {
+    int32_t c = getHour(i);
+    if (c != NO_VALUE) {
+      lowest = c < lowest ? c : lowest;
+      highest = c > highest ? c : highest;
+    }
+  }
+  if (highest == 0) {
+    _nowCast = 0;
+    return;
+  }
+
+  double weight = (double)lowest / highest;
+  weight = weight < 0.5 ? 0.5 : weight;
+
+  double factor = 1;
+  double sum = 0;
+  double weights = 0;
+  for (uint8_t i = 0; i < NOWCAST_HOURS; i++) {
+    int32_t c = getHour(i);
+    if (c != NO_VALUE) {
+      sum += factor * c;
+      weights += factor;
+    }
+    factor *= weight;
+  }
+  // truncated like the concentration the AQI is computed from; the small
+  // offset keeps float error from dropping a whole tenth
+  _nowCast = sum / weights + 1e-6;
+}
+
+int32_t RollingAverage::getPartial() const
+{
+  return _partialCount > 0 ? roundedMean((int64_t)_partialSum * 10, _partialCount) : NO_VALUE;
+}
+
+int32_t RollingAverage::getHour(uint8_t hoursAgo) const
+{
+  if (hoursAgo >= _closed) {
+    return NO_VALUE;
+  }
+  return _hours[(_newest + HOURS - hoursAgo) % HOURS];
+}
+
+int32_t RollingAverage::getRollingHour(uint32_t now) const
+{
+  int32_t partial = getPartial();
+  int32_t last = getHour(0);
+  if (last == NO_VALUE || partial == NO_VALUE) {
+    return partial == NO_VALUE ? last : partial;
+  }
+
+  uint32_t elapsed = now - _hourStart;
+  elapsed = elapsed > HOUR ? HOUR : elapsed;
+  int64_t weighted = (int64_t)partial * elapsed + (int64_t)last * (HOUR - elapsed);
+  return (weighted + HOUR / 2) / HOUR;
+}
+
+int32_t RollingAverage::getMean8() const
+{
+  return _valid8 >= 6 ? roundedMean(_sum8, _valid8) : NO_VALUE;
+}
+
+int32_t RollingAverage::getMean24() const
+{
+  return _valid24 >= 18 ? roundedMean(_sum24, _valid24) : NO_VALUE;
+}
+
+int32_t RollingAverage::getNowCast() const
+{
+  return _nowCast;
+}
+
+uint8_t RollingAverage::getClosedHours() const
+{
+  return _closed;
+}
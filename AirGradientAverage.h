@@ -0,0 +1,82 @@
+/*
+  AirGradientAverage.h - Rolling hourly averages and NowCast for the AirGradient library
+
+  Samples of the current clock hour (counted from the first sample) are
+  summed into a partial bucket; when the hour is over its mean is pushed
+  into a ring of the last 24 hourly means. Closing an hour updates the 8 h
+  and 24 h running sums and the NowCast in constant time, and every getter
+  only reads cached values, so no raw history is kept or rescanned.
+
+    RollingAverage pm25Average;
+
+    void loop() {
+      pm25Average.add(pm25);   // any rate, negative values are ignored
+      int32_t nowCast = pm25Average.getNowCast();
+      if (nowCast >= 0) {
+        aqi = AQI_compute(AQI_US_EPA, AQI_PM2_5, nowCast);
+      }
+    }
+
+  All results are in tenths of the sample unit, or NO_VALUE while there is
+  not enough data:
+
+    getNowCast()       EPA NowCast over 12 h, weight factor at least 0.5
+                       (PM2.5 and PM10); needs 2 of the last 3 hours
+    getMean8/24()      8 h / 24 h means; need 75 % of the hours
+    getRollingHour()   last 60 minutes, e.g. for CO2; the closed hour is
+                       weighted by the part of it still inside the window
+*/
+
+#ifndef AirGradientAverage_h
+#define AirGradientAverage_h
+
+#include "Arduino.h"
+
+class RollingAverage
+{
+  public:
+    static const uint32_t HOUR = 3600000UL;
+    static const uint8_t HOURS = 24;
+    static const uint8_t NOWCAST_HOURS = 12;
+    static const int32_t NO_VALUE = -1;
+
+    // Optional, the first add() starts the first hour otherwise.
+    void begin(uint32_t now = millis());
+
+    // Returns true if one or more hours were closed.
+    bool add(int32_t value, uint32_t now = millis());
+    // Closes elapsed hours without adding a sample.
+    bool update(uint32_t now = millis());
+
+    int32_t getPartial() const;
+    // Mean of a closed hour, 0 is the last one.
+    int32_t getHour(uint8_t hoursAgo) const;
+    int32_t getRollingHour(uint32_t now = millis()) const;
+    int32_t getMean8() const;
+    int32_t getMean24() const;
+    int32_t getNowCast() const;
+
+    uint8_t getClosedHours() const;
+
+  private:
+    int32_t _hours[HOURS];
+    uint8_t _newest = 0;
+    uint8_t _closed = 0;
+
+    int32_t _sum8 = 0;
+    uint8_t _valid8 = 0;
+    int32_t _sum24 = 0;
+    uint8_t _valid24 = 0;
+    int32_t _nowCast = NO_VALUE;
+
+    bool _started = false;
+    uint32_t _hourStart = 0;
+    // whole units, at most 0xFFFF samples per hour
+    uint32_t _partialSum = 0;
+    uint16_t _partialCount = 0;
+
+    void closeHour(int32_t mean);
+    void computeNowCast();
+};
+
+#endif
@@ -0,0 +1,40 @@
+/*
+  AirGradientBoard.h - Compile-time composition of AirGradient sensor drivers
+
+  Only the drivers listed as template arguments end up in the sketch. A CO2
+  only sketch does not carry the PMS frame buffer, the SHT3x code or any
+  SoftwareSerial instance, and nothing is allocated with new: the drivers
+  live inside the board object, the streams are owned by the sketch.
+
+    SoftwareSerial co2Serial(D4, D3);
+    AirGradientBoard<S8Driver> board;
+
+    void setup() {
+      co2Serial.begin(9600);
+      board.get<S8Driver>().begin(co2Serial);
+    }
+
+  Every driver type may be listed once; use a second board (or a plain
+  driver object) for a second sensor of the same type.
+*/
+
+#ifndef AirGradientBoard_h
+#define AirGradientBoard_h
+
+#include "AirGradientPms.h"
+#include "AirGradientS8.h"
+#include "AirGradientSht3x.h"
+#include "AirGradientMhz19.h"
+
+template <class... Drivers>
+class AirGradientBoard : public Drivers...
+{
+  public:
+    template <class Driver>
+    Driver& get() { return *this; }
+
+    template <class Driver>
+    const Driver& get() const { return *this; }
+};
+
+#endif
@@ -0,0 +1,312 @@
+/*
+  AirGradientCapture.cpp - Sensor bus capture and replay for the AirGradient library
+*/
+
+#include "AirGradientCapture.h"
+
+#include <string.h>
+
+static const uint8_t CAPTURE_MAGIC[] = { 'A', 'G', 'C', CAPTURE_VERSION };
+
+static uint8_t encodeVarint(uint8_t* buf, uint32_t value)
+{
+  uint8_t n = 0;
+  while (value >= 0x80) {
+    buf[n++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  buf[n++] = value;
+  return n;
+}
+
+CaptureWriter::CaptureWriter(Print& out)
+{
+  _out = &out;
+}
+
+void CaptureWriter::begin(uint32_t nowUs)
+{
+  _out->write(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+  _bytes += sizeof(CAPTURE_MAGIC);
+  _lastUs = nowUs;
+  _length = 0;
+}
+
+void CaptureWriter::record(uint8_t channel, CAPTURE_Type type, const uint8_t* data, size_t length,
+                           uint32_t nowUs)
+{
+  uint8_t tag = (type << 4) | (channel & 0x0F);
+  if (_length > 0 && (tag != _tag || nowUs - _lastByteUs > COALESCE_US)) {
+    flush();
+  }
+
+  while (length > 0) {
+    if (_length == 0) {
+      _tag = tag;
+      _startUs = nowUs;
+    }
+    uint8_t n = length < (size_t)(CAPTURE_RECORD_SIZE - _length) ? length : CAPTURE_RECORD_SIZE - _length;
+    memcpy(_pending + _length, data, n);
+    _length += n;
+    data += n;
+    length -= n;
+    if (_length == CAPTURE_RECORD_SIZE) {
+      flush();
+    }
+  }
+  _lastByteUs = nowUs;
+}
+
+void CaptureWriter::i2c(uint8_t address, const I2C_Transaction& transaction, uint32_t nowUs)
+{
+  flush();
+
+  uint8_t data[CAPTURE_RECORD_SIZE];
+  uint8_t txLen = transaction.txLen < CAPTURE_RECORD_SIZE - 3 ? transaction.txLen : CAPTURE_RECORD_SIZE - 3;
+  uint8_t rxLen = transaction.status != I2C_OK ? 0 : transaction.rxLen;
+  if (rxLen > CAPTURE_RECORD_SIZE - 3 - txLen) {
+    rxLen = CAPTURE_RECORD_SIZE - 3 - txLen;
+  }
+
+  data[0] = address;
+  data[1] = -transaction.status;
+  data[2] = txLen;
+  memcpy(data + 3, transaction.txData, txLen);
+  memcpy(data + 3 + txLen, transaction.rxData, rxLen);
+  writeRecord(CAPTURE_I2C << 4, nowUs, data, 3 + txLen + rxLen);
+}
+
+void CaptureWriter::flush()
+{
+  if (_length > 0) {
+    writeRecord(_tag, _startUs, _pending, _length);
+    _length = 0;
+  }
+}
+
+uint32_t CaptureWriter::getRecords() const
+{
+  return _records;
+}
+
+uint32_t CaptureWriter::getBytes() const
+{
+  return _bytes;
+}
+
+void CaptureWriter::writeRecord(uint8_t tag, uint32_t timeUs, const uint8_t* data, uint8_t length)
+{
+  uint8_t header[1 + 5 + 2];
+  uint8_t n = 0;
+  header[n++] = tag;
+  n += encodeVarint(header + n, timeUs - _lastUs);
+  n += encodeVarint(header + n, length);
+  _lastUs = timeUs;
+
+  _out->write(header, n);
+  _out->write(data, length);
+  _records++;
+  _bytes += n + length;
+}
+
+RecordingStream::RecordingStream(Stream& stream, CaptureWriter& capture, uint8_t channel)
+{
+  _stream = &stream;
+  _capture = &capture;
+  _channel = channel;
+}
+
+int RecordingStream::available()
+{
+  return _stream->available();
+}
+
+int RecordingStream::read()
+{
+  int c = _stream->read();
+  if (c >= 0) {
+    uint8_t b = c;
+    _capture->record(_channel, CAPTURE_RX, &b, 1);
+  }
+  return c;
+}
+
+int RecordingStream::peek()
+{
+  return _stream->peek();
+}
+
+void RecordingStream::flush()
+{
+  _stream->flush();
+}
+
+size_t RecordingStream::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t RecordingStream::write(const uint8_t* buffer, size_t size)
+{
+  size_t written = _stream->write(buffer, size);
+  _capture->record(_channel, CAPTURE_TX, buffer, written);
+  return written;
+}
+
+CaptureReader::CaptureReader(Stream& in)
+{
+  _in = &in;
+}
+
+CAPTURE_Status CaptureReader::next(CaptureRecord& record)
+{
+  if (!_started) {
+    _started = true;
+    for (uint8_t i = 0; i < sizeof(CAPTURE_MAGIC); i++) {
+      if (_in->read() != CAPTURE_MAGIC[i]) {
+        return CAPTURE_BAD_FORMAT;
+      }
+    }
+  }
+
+  int tag = _in->read();
+  if (tag < 0) {
+    return CAPTURE_END;
+  }
+  uint32_t delta;
+  uint32_t length;
+  if (!readVarint(delta) || !readVarint(length) || length > CAPTURE_RECORD_SIZE) {
+    return CAPTURE_BAD_FORMAT;
+  }
+  uint8_t type = tag >> 4;
+  if (type < CAPTURE_RX || type > CAPTURE_I2C) {
+    return CAPTURE_BAD_FORMAT;
+  }
+
+  _timeUs += delta;
+  record.type = (CAPTURE_Type)type;
+  record.channel = tag & 0x0F;
+  record.timeUs = _timeUs;
+  record.length = length;
+  for (uint8_t i = 0; i < length; i++) {
+    int c = _in->read();
+    if (c < 0) {
+      return CAPTURE_BAD_FORMAT;
+    }
+    record.data[i] = c;
+  }
+  return CAPTURE_OK;
+}
+
+bool CaptureReader::readVarint(uint32_t& value)
+{
+  value = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+    int c = _in->read();
+    if (c < 0) {
+      return false;
+    }
+    value |= (uint32_t)(c & 0x7F) << shift;
+    if (!(c & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+ReplayStream::ReplayStream(CaptureReader& reader, uint8_t channel, bool realTime)
+{
+  _reader = &reader;
+  _channel = channel;
+  _realTime = realTime;
+  _record.length = 0;
+}
+
+int ReplayStream::available()
+{
+  if (!fill()) {
+    return 0;
+  }
+  if (_realTime && micros() - _startUs < _record.timeUs) {
+    return 0;
+  }
+  return _record.length - _position;
+}
+
+int ReplayStream::read()
+{
+  if (available() <= 0) {
+    return -1;
+  }
+  _bytesRead++;
+  return _record.data[_position++];
+}
+
+int ReplayStream::peek()
+{
+  if (available() <= 0) {
+    return -1;
+  }
+  return _record.data[_position];
+}
+
+void ReplayStream::flush()
+{
+}
+
+size_t ReplayStream::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t ReplayStream::write(const uint8_t* buffer, size_t size)
+{
+  (void)buffer;
+  _bytesWritten += size;
+  return size;
+}
+
+bool ReplayStream::isFinished()
+{
+  return !fill();
+}
+
+CAPTURE_Status ReplayStream::getStatus() const
+{
+  return _status;
+}
+
+uint32_t ReplayStream::getBytesRead() const
+{
+  return _bytesRead;
+}
+
+uint32_t ReplayStream::getBytesWritten() const
+{
+  return _bytesWritten;
+}
+
+// Makes sure a record with unread bytes is loaded; false at the end of the
+// capture or on a broken one.
+bool ReplayStream::fill()
+{
+  if (!_started) {
+    _started = true;
+    _startUs = micros();
+  }
+  while (_position >= _record.length) {
+    if (_status != CAPTURE_OK) {
+      return false;
+    }
+    _status = _reader->next(_record);
+    _position = 0;
+    if (_status != CAPTURE_OK) {
+      _record.length = 0;
+      return false;
+    }
+    if (_record.type != CAPTURE_RX || _record.channel != _channel) {
+      _record.length = 0;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,191 @@
+/*
+  AirGradientCapture.h - Sensor bus capture and replay for the AirGradient library
+
+  Records what the drivers exchange with their sensors so field failures
+  (garbled PMS frames, MH-Z19 resyncs, SHT3x CRC errors) can be replayed
+  later through the same parsers. A RecordingStream sits between a driver
+  and its serial port; I2C transactions come in through the I2CBus trace
+  callback. Both end up in a CaptureWriter, which writes to any Print,
+  e.g. a LittleFS file.
+
+    File file = LittleFS.open("/pms.agc", "w");
+    CaptureWriter capture(file);
+    RecordingStream pmsCapture(Serial0, capture, 0);
+
+    void traceI2C(uint8_t address, const I2C_Transaction& transaction) {
+      capture.i2c(address, transaction);
+    }
+
+    void setup() {
+      capture.begin();
+      pms.begin(pmsCapture);
+      i2c.setTraceCallback(traceI2C);
+    }
+
+  A ReplayStream serves the bytes one channel received from a capture,
+  either at the pace they were recorded or as fast as the driver reads
+  them:
+
+    File file = LittleFS.open("/pms.agc", "r");
+    CaptureReader reader(file);
+    ReplayStream replay(reader, 0);
+    pms.begin(replay);
+    while (!replay.isFinished()) pms.read(data);
+
+  Format, delta and length as little endian base 128 varints:
+
+    header  "AGC" version
+    record  tag delta length data
+            tag     type << 4 | channel
+            delta   microseconds since the previous record
+            length  bytes of data, at most CAPTURE_RECORD_SIZE
+
+  CAPTURE_RX and CAPTURE_TX hold the bytes read and written on a Stream;
+  bytes that follow each other within COALESCE_US share a record, stamped
+  with the time of the first one. CAPTURE_I2C holds one transaction:
+  address, -status, tx length, tx bytes, then the rx bytes.
+*/
+
+#ifndef AirGradientCapture_h
+#define AirGradientCapture_h
+
+#include "Arduino.h"
+#include "Stream.h"
+#include "AirGradientI2C.h"
+
+typedef enum {
+  CAPTURE_RX = 1,
+  CAPTURE_TX = 2,
+  CAPTURE_I2C = 3
+} CAPTURE_Type;
+
+typedef enum {
+  CAPTURE_OK = 0,
+  CAPTURE_END = 1,
+  CAPTURE_BAD_FORMAT = -1
+} CAPTURE_Status;
+
+#define CAPTURE_VERSION 1
+#define CAPTURE_RECORD_SIZE 64
+
+struct CaptureRecord {
+  CAPTURE_Type type;
+  uint8_t channel;
+  // since the start of the capture
+  uint32_t timeUs;
+  uint8_t length;
+  uint8_t data[CAPTURE_RECORD_SIZE];
+};
+
+class CaptureWriter
+{
+  public:
+    static const uint16_t COALESCE_US = 2000;
+
+    CaptureWriter(Print& out);
+
+    // Writes the header; the capture's clock starts here.
+    void begin(uint32_t nowUs = micros());
+    void record(uint8_t channel, CAPTURE_Type type, const uint8_t* data, size_t length,
+                uint32_t nowUs = micros());
+    // Longer transactions are cut to fit one record.
+    void i2c(uint8_t address, const I2C_Transaction& transaction, uint32_t nowUs = micros());
+    // Writes the record still collecting bytes.
+    void flush();
+
+    uint32_t getRecords() const;
+    uint32_t getBytes() const;
+
+  private:
+    Print* _out;
+    uint32_t _lastUs = 0;
+
+    // record still collecting bytes
+    uint8_t _tag = 0;
+    uint32_t _startUs = 0;
+    uint32_t _lastByteUs = 0;
+    uint8_t _pending[CAPTURE_RECORD_SIZE];
+    uint8_t _length = 0;
+
+    uint32_t _records = 0;
+    uint32_t _bytes = 0;
+
+    void writeRecord(uint8_t tag, uint32_t timeUs, const uint8_t* data, uint8_t length);
+};
+
+// Passes everything through to the wrapped stream and records it.
+class RecordingStream : public Stream
+{
+  public:
+    RecordingStream(Stream& stream, CaptureWriter& capture, uint8_t channel);
+
+    int available();
+    int read();
+    int peek();
+    void flush();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+
+  private:
+    Stream* _stream;
+    CaptureWriter* _capture;
+    uint8_t _channel;
+};
+
+class CaptureReader
+{
+  public:
+    CaptureReader(Stream& in);
+
+    // Reads the header on the first call, CAPTURE_END after the last record.
+    CAPTURE_Status next(CaptureRecord& record);
+
+  private:
+    Stream* _in;
+    bool _started = false;
+    uint32_t _timeUs = 0;
+
+    bool readVarint(uint32_t& value);
+};
+
+// The CAPTURE_RX bytes of one channel as a Stream. Writes are accepted
+// and counted but not compared with the capture.
+class ReplayStream : public Stream
+{
+  public:
+    // realTime: bytes become available when they did while recording,
+    // otherwise all at once
+    ReplayStream(CaptureReader& reader, uint8_t channel, bool realTime = false);
+
+    int available();
+    int read();
+    int peek();
+    void flush();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+
+    bool isFinished();
+    CAPTURE_Status getStatus() const;
+    uint32_t getBytesRead() const;
+    uint32_t getBytesWritten() const;
+
+  private:
+    CaptureReader* _reader;
+    uint8_t _channel;
+    bool _realTime;
+    bool _started = false;
+    uint32_t _startUs = 0;
+
+    CaptureRecord _record;
+    uint8_t _position = 0;
+    CAPTURE_Status _status = CAPTURE_OK;
+
+    uint32_t _bytesRead = 0;
+    uint32_t _bytesWritten = 0;
+
+    bool fill();
+};
+
+#endif
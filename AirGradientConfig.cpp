@@ -0,0 +1,228 @@
+/*
+  AirGradientConfig.cpp - Versioned, CRC checked settings store for the AirGradient library
+*/
+
+#include "AirGradientConfig.h"
+#include "AirGradientModbus.h"
+
+#include <EEPROM.h>
+#include <string.h>
+#ifndef ARDUINO
+#include <stdio.h>
+#include <stdlib.h>
+#endif
+
+#define CONFIG_MAGIC 0xC5
+
+uint8_t EepromConfigStorage::read(uint16_t address)
+{
+  return EEPROM.read(address);
+}
+
+void EepromConfigStorage::write(uint16_t address, uint8_t value)
+{
+  EEPROM.write(address, value);
+}
+
+bool EepromConfigStorage::commit()
+{
+#if defined(ESP8266) || defined(ESP32)
+  return EEPROM.commit();
+#else
+  return true;
+#endif
+}
+
+uint16_t EepromConfigStorage::length()
+{
+  return EEPROM.length();
+}
+
+#ifndef ARDUINO
+FileConfigStorage::FileConfigStorage(const char* path, uint16_t length)
+{
+  _path = path;
+  _length = length;
+  _data = (uint8_t*)malloc(length);
+  memset(_data, 0xFF, length);
+  FILE* file = fopen(path, "rb");
+  if (file != NULL) {
+    size_t n = fread(_data, 1, length, file);
+    (void)n;
+    fclose(file);
+  }
+}
+
+FileConfigStorage::~FileConfigStorage()
+{
+  free(_data);
+}
+
+uint8_t FileConfigStorage::read(uint16_t address)
+{
+  return address < _length ? _data[address] : 0xFF;
+}
+
+void FileConfigStorage::write(uint16_t address, uint8_t value)
+{
+  if (address < _length) {
+    _data[address] = value;
+  }
+}
+
+bool FileConfigStorage::commit()
+{
+  FILE* file = fopen(_path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+  bool ok = fwrite(_data, 1, _length, file) == _length;
+  return fclose(file) == 0 && ok;
+}
+
+uint16_t FileConfigStorage::length()
+{
+  return _length;
+}
+#endif
+
+ConfigStore::ConfigStore(ConfigStorage& storage, uint16_t start, uint16_t length)
+{
+  _storage = &storage;
+  _start = start;
+  _length = length;
+}
+
+bool ConfigStore::begin()
+{
+  if (_length == 0) {
+    uint16_t end = _storage->length();
+    _length = end > _start ? end - _start : 0;
+  }
+
+  // One pass: a valid record is skipped as a whole, anything else a byte
+  // at a time, so records of different sizes and laps are all found.
+  _found = false;
+  uint16_t offset = 0;
+  while (offset + CONFIG_OVERHEAD <= _length) {
+    uint8_t size;
+    if (!valid(offset, size)) {
+      offset++;
+      continue;
+    }
+    uint16_t seq = _storage->read(_start + offset + 1) | (_storage->read(_start + offset + 2) << 8);
+    if (!_found || (int16_t)(seq - _seq) > 0) {
+      _found = true;
+      _newest = offset;
+      _seq = seq;
+      _version = _storage->read(_start + offset + 3);
+      _size = size;
+    }
+    offset += CONFIG_OVERHEAD + size;
+  }
+  return _found;
+}
+
+bool ConfigStore::valid(uint16_t offset, uint8_t& size)
+{
+  if (_storage->read(_start + offset) != CONFIG_MAGIC) {
+    return false;
+  }
+  size = _storage->read(_start + offset + 4);
+  if (size > CONFIG_MAX_SIZE || offset + CONFIG_OVERHEAD + size > _length) {
+    return false;
+  }
+
+  uint8_t record[CONFIG_OVERHEAD + CONFIG_MAX_SIZE];
+  uint8_t n = CONFIG_OVERHEAD + size;
+  for (uint8_t i = 0; i < n; i++) {
+    record[i] = _storage->read(_start + offset + i);
+  }
+  return Modbus_crc16(record, n - 2) == (record[n - 2] | (record[n - 1] << 8));
+}
+
+bool ConfigStore::load(void* config, uint8_t size)
+{
+  if (!_found) {
+    return false;
+  }
+  uint8_t* bytes = (uint8_t*)config;
+  uint8_t n = size < _size ? size : _size;
+  for (uint8_t i = 0; i < n; i++) {
+    bytes[i] = _storage->read(_start + _newest + 5 + i);
+  }
+  return true;
+}
+
+CONFIG_Status ConfigStore::save(const void* config, uint8_t size, uint8_t version)
+{
+  uint16_t length = CONFIG_OVERHEAD + size;
+  if (size > CONFIG_MAX_SIZE || 3 * length > _length) {
+    return CONFIG_TOO_LARGE;
+  }
+
+  const uint8_t* bytes = (const uint8_t*)config;
+  if (_found && version == _version && size == _size) {
+    bool same = true;
+    for (uint8_t i = 0; i < size && same; i++) {
+      same = _storage->read(_start + _newest + 5 + i) == bytes[i];
+    }
+    if (same) {
+      return CONFIG_UNCHANGED;
+    }
+  }
+
+  uint16_t seq = _found ? _seq + 1 : 0;
+  uint16_t offset = _found ? _newest + CONFIG_OVERHEAD + _size : 0;
+  if (offset + length > _length) {
+    offset = 0;
+  }
+
+  uint8_t record[CONFIG_OVERHEAD + CONFIG_MAX_SIZE];
+  record[0] = CONFIG_MAGIC;
+  record[1] = seq & 0xFF;
+  record[2] = seq >> 8;
+  record[3] = version;
+  record[4] = size;
+  memcpy(record + 5, bytes, size);
+  uint16_t crc = Modbus_crc16(record, length - 2);
+  record[length - 2] = crc & 0xFF;
+  record[length - 1] = crc >> 8;
+
+  // Unchanged bytes are left alone, they cost wear on real EEPROM
+  for (uint16_t i = 0; i < length; i++) {
+    if (_storage->read(_start + offset + i) != record[i]) {
+      _storage->write(_start + offset + i, record[i]);
+      _bytesWritten++;
+    }
+  }
+  if (!_storage->commit()) {
+    return CONFIG_WRITE_FAILED;
+  }
+  uint8_t stored;
+  if (!valid(offset, stored)) {
+    return CONFIG_WRITE_FAILED;
+  }
+
+  _found = true;
+  _newest = offset;
+  _seq = seq;
+  _version = version;
+  _size = size;
+  return CONFIG_OK;
+}
+
+uint8_t ConfigStore::getVersion() const
+{
+  return _found ? _version : 0;
+}
+
+uint16_t ConfigStore::getSequence() const
+{
+  return _seq;
+}
+
+uint32_t ConfigStore::getBytesWritten() const
+{
+  return _bytesWritten;
+}
@@ -0,0 +1,152 @@
+/*
+  AirGradientConfig.h - Versioned, CRC checked settings store for the AirGradient library
+
+  Keeps a settings struct in EEPROM (or the flash sector the ESP cores
+  emulate it with) as a log of records instead of rewriting the same
+  bytes on every save:
+
+    struct Settings {
+      uint8_t buttonConfig = 0;
+      // new fields go at the end
+    };
+
+    EepromConfigStorage storage;
+    ConfigStore config(storage, 8);    // bytes 8 up to the end
+    Settings settings;
+
+    EEPROM.begin(512);                 // ESP8266 / ESP32 only
+    config.begin();
+    config.load(settings);             // keeps the defaults if nothing is stored
+    ...
+    config.save(settings, 1);          // 1 = layout version of Settings
+
+  Record, integers little endian:
+
+    magic  seq (2)  version  length  payload (length)  crc (2)
+
+  crc is Modbus_crc16() over everything before it. Each save appends a
+  record after the newest one and wraps to the start of the region when
+  it does not fit, so writes spread over the whole region. begin() finds
+  the newest valid record in one pass; a record torn by a power cut fails
+  its CRC and the one before it is used. A record may take at most a
+  third of the region, so a new record never overwrites the newest one.
+
+  save() writes nothing if the settings did not change, and otherwise
+  only the bytes that differ from what the region already holds. A newer
+  firmware that appends fields still loads the shorter records of an
+  older one; the fields they lack keep their defaults and getVersion()
+  tells which layout was stored.
+*/
+
+#ifndef AirGradientConfig_h
+#define AirGradientConfig_h
+
+#include "Arduino.h"
+
+typedef enum {
+  CONFIG_OK = 0,
+  CONFIG_UNCHANGED = 1,
+  CONFIG_TOO_LARGE = -1,
+  CONFIG_WRITE_FAILED = -2
+} CONFIG_Status;
+
+// magic, seq, version, length, crc
+#define CONFIG_OVERHEAD 7
+#define CONFIG_MAX_SIZE 64
+
+// Byte addressed storage under a ConfigStore
+class ConfigStorage
+{
+  public:
+    virtual ~ConfigStorage() {}
+    virtual uint8_t read(uint16_t address) = 0;
+    virtual void write(uint16_t address, uint8_t value) = 0;
+    // Makes the writes durable
+    virtual bool commit() = 0;
+    virtual uint16_t length() = 0;
+};
+
+// The EEPROM library of the core; on the ESP cores call EEPROM.begin() first.
+class EepromConfigStorage : public ConfigStorage
+{
+  public:
+    uint8_t read(uint16_t address);
+    void write(uint16_t address, uint8_t value);
+    bool commit();
+    uint16_t length();
+};
+
+#ifndef ARDUINO
+// Host builds: an EEPROM image in a file, read at construction and
+// written back by commit(). A missing file reads as erased (0xFF).
+class FileConfigStorage : public ConfigStorage
+{
+  public:
+    FileConfigStorage(const char* path, uint16_t length);
+    ~FileConfigStorage();
+
+    uint8_t read(uint16_t address);
+    void write(uint16_t address, uint8_t value);
+    bool commit();
+    uint16_t length();
+
+  private:
+    const char* _path;
+    uint8_t* _data;
+    uint16_t _length;
+};
+#endif
+
+class ConfigStore
+{
+  public:
+    // length 0 takes the storage up to its end
+    ConfigStore(ConfigStorage& storage, uint16_t start = 0, uint16_t length = 0);
+
+    // Finds the newest valid record; false if there is none.
+    bool begin();
+
+    // Copies the newest record into config, at most size bytes; bytes it
+    // lacks are left alone. False if there is none.
+    bool load(void* config, uint8_t size);
+    template <typename T>
+    bool load(T& config);
+
+    CONFIG_Status save(const void* config, uint8_t size, uint8_t version);
+    template <typename T>
+    CONFIG_Status save(const T& config, uint8_t version);
+
+    // Of the newest record; 0 if there is none
+    uint8_t getVersion() const;
+    uint16_t getSequence() const;
+    // Bytes actually changed by save() since construction
+    uint32_t getBytesWritten() const;
+
+  private:
+    ConfigStorage* _storage;
+    uint16_t _start;
+    uint16_t _length;
+
+    bool _found = false;
+    uint16_t _newest = 0;
+    uint16_t _seq = 0;
+    uint8_t _version = 0;
+    uint8_t _size = 0;
+    uint32_t _bytesWritten = 0;
+
+    bool valid(uint16_t offset, uint8_t& size);
+};
+
+template <typename T>
+bool ConfigStore::load(T& config)
+{
+  return load(&config, sizeof(T));
+}
+
+template <typename T>
+CONFIG_Status ConfigStore::save(const T& config, uint8_t version)
+{
+  return save(&config, sizeof(T), version);
+}
+
+#endif
@@ -0,0 +1,283 @@
+/*
+  AirGradientDisplay.h - Non-blocking LED bar and change driven OLED rendering
+
+  Both classes are templates over the display libraries the examples
+  already use, so the library itself does not depend on them:
+
+  LedBarAnimator<Adafruit_NeoPixel> wipes the bar to a new color one pixel
+  per step and fades its brightness BRIGHTNESS_STEP per step. update() is
+  called from loop() and does at most one show() per step; setting the
+  color or brightness the bar already has or is heading to is free. It
+  drives the first MAX_PIXELS pixels and keeps their colors, so the
+  brightness is applied to those and not with the lossy
+  Adafruit_NeoPixel::setBrightness().
+
+    Adafruit_NeoPixel pixels(11, 10, NEO_GRB + NEO_KHZ800);
+    LedBarAnimator<Adafruit_NeoPixel> ledBar(pixels);
+
+    ledBar.setColor(pixels.Color(0, 255, 0));
+    ledBar.setBrightness(night ? 32 : 255);
+    ...
+    ledBar.update();
+
+  OledRenderer<U8G2> splits the screen into regions, each showing one
+  value. set() only marks a region dirty if its value changed; render()
+  redraws just the dirty regions into the frame buffer and sends only
+  the 8x8 tiles they cover. This needs a full buffer (_F_) U8g2
+  constructor.
+
+    OledRenderer<U8G2> oled(u8g2);
+    int8_t co2Region = oled.addRegion(0, 14, 45, 50, drawCo2);
+    oled.setBackground(drawFrame);
+    ...
+    oled.set(co2Region, Co2);
+    oled.render();
+*/
+
+#ifndef AirGradientDisplay_h
+#define AirGradientDisplay_h
+
+#include "Arduino.h"
+
+template <class Pixels, uint8_t MAX_PIXELS = 16>
+class LedBarAnimator
+{
+  public:
+    static const uint8_t BRIGHTNESS_STEP = 16;
+
+    LedBarAnimator(Pixels& pixels, uint16_t stepMs = 100)
+    {
+      _pixels = &pixels;
+      _stepMs = stepMs;
+    }
+
+    void setColor(uint32_t color)
+    {
+      if (_hasTarget && color == _target) {
+        return;
+      }
+      _target = color;
+      _hasTarget = true;
+      _next = 0;
+      _starting = true;
+    }
+
+    void setBrightness(uint8_t brightness)
+    {
+      if (brightness == _targetBrightness) {
+        return;
+      }
+      _targetBrightness = brightness;
+      _starting = true;
+    }
+
+    // Returns true while a transition is still running.
+    bool update(uint32_t now = millis())
+    {
+      if (!isAnimating()) {
+        return false;
+      }
+      if (!_starting && now - _lastStep < _stepMs) {
+        return true;
+      }
+      uint8_t count = pixelCount();
+      if (_brightness != _targetBrightness) {
+        int16_t delta = (int16_t)_targetBrightness - _brightness;
+        _brightness += delta > BRIGHTNESS_STEP ? BRIGHTNESS_STEP :
+                       delta < -BRIGHTNESS_STEP ? -BRIGHTNESS_STEP : delta;
+        for (uint8_t i = 0; i < count; i++) {
+          _pixels->setPixelColor(i, scale(_colors[i]));
+        }
+      }
+      if (_hasTarget && _next < count) {
+        _colors[_next] = _target;
+        _pixels->setPixelColor(_next, scale(_target));
+        _next++;
+      }
+      _pixels->show();
+      _lastStep = now;
+      _starting = false;
+      _shows++;
+      return isAnimating();
+    }
+
+    bool isAnimating() const
+    {
+      return (_hasTarget && _next < pixelCount()) || _brightness != _targetBrightness;
+    }
+
+    uint8_t getBrightness() const
+    {
+      return _brightness;
+    }
+
+    uint32_t getShowCount() const
+    {
+      return _shows;
+    }
+
+  private:
+    Pixels* _pixels;
+    uint16_t _stepMs;
+    uint32_t _colors[MAX_PIXELS] = {};
+    uint32_t _target = 0;
+    bool _hasTarget = false;
+    bool _starting = false;
+    uint8_t _next = 0;
+    uint8_t _brightness = 255;
+    uint8_t _targetBrightness = 255;
+    uint32_t _lastStep = 0;
+    uint32_t _shows = 0;
+
+    uint8_t pixelCount() const
+    {
+      uint16_t count = _pixels->numPixels();
+      return count < MAX_PIXELS ? count : MAX_PIXELS;
+    }
+
+    // Each 8 bit channel of a packed (W)RGB color
+    uint32_t scale(uint32_t color) const
+    {
+      uint32_t scaled = 0;
+      for (uint8_t shift = 0; shift < 32; shift += 8) {
+        scaled |= (((color >> shift) & 0xFF) * _brightness / 255) << shift;
+      }
+      return scaled;
+    }
+};
+
+template <class Display, uint8_t MAX_REGIONS = 8>
+class OledRenderer
+{
+  public:
+    typedef void (*DrawFunction)(Display& display, int32_t value);
+    typedef void (*BackgroundFunction)(Display& display);
+
+    OledRenderer(Display& display)
+    {
+      _display = &display;
+    }
+
+    // Region in pixels. draw() must stay inside it; it is cleared before.
+    int8_t addRegion(uint8_t x, uint8_t y, uint8_t w, uint8_t h, DrawFunction draw)
+    {
+      if (_count >= MAX_REGIONS) {
+        return -1;
+      }
+      Region& region = _regions[_count];
+      region.x = x;
+      region.y = y;
+      region.w = w;
+      region.h = h;
+      region.draw = draw;
+      region.dirty = true;
+      _full = true;
+      return _count++;
+    }
+
+    // Static parts (lines, labels) drawn on a full redraw only
+    void setBackground(BackgroundFunction background)
+    {
+      _background = background;
+      _full = true;
+    }
+
+    void set(int8_t region, int32_t value)
+    {
+      if (region < 0 || region >= _count) {
+        return;
+      }
+      if (!_regions[region].valid || _regions[region].value != value) {
+        _regions[region].value = value;
+        _regions[region].valid = true;
+        _regions[region].dirty = true;
+      }
+    }
+
+    // Redraw everything on the next render(), e.g. after a unit change
+    void invalidate()
+    {
+      _full = true;
+    }
+
+    // Returns the number of regions drawn, 0 if nothing changed.
+    uint8_t render()
+    {
+      uint8_t drawn = 0;
+
+      if (_full) {
+        _display->clearBuffer();
+        if (_background != NULL) {
+          _background(*_display);
+        }
+        for (uint8_t i = 0; i < _count; i++) {
+          drawRegion(_regions[i]);
+          drawn++;
+        }
+        _display->sendBuffer();
+        _tilesSent += _display->getBufferTileWidth() * _display->getBufferTileHeight();
+        _full = false;
+        return drawn;
+      }
+
+      for (uint8_t i = 0; i < _count; i++) {
+        Region& region = _regions[i];
+        if (!region.dirty) {
+          continue;
+        }
+        _display->setDrawColor(0);
+        _display->drawBox(region.x, region.y, region.w, region.h);
+        _display->setDrawColor(1);
+        drawRegion(region);
+
+        // round out to whole tiles; neighbours sharing a tile are intact in
+        // the buffer and are simply sent again
+        uint8_t tx = region.x / 8;
+        uint8_t ty = region.y / 8;
+        uint8_t tw = (region.x + region.w + 7) / 8 - tx;
+        uint8_t th = (region.y + region.h + 7) / 8 - ty;
+        _display->updateDisplayArea(tx, ty, tw, th);
+        _tilesSent += tw * th;
+        drawn++;
+      }
+      if (drawn == 0) {
+        _skipped++;
+      }
+      return drawn;
+    }
+
+    uint32_t getTilesSent() const
+    {
+      return _tilesSent;
+    }
+
+    uint32_t getSkippedRenders() const
+    {
+      return _skipped;
+    }
+
+  private:
+    struct Region {
+      uint8_t x, y, w, h;
+      DrawFunction draw;
+      int32_t value = 0;
+      bool valid = false;
+      bool dirty = true;
+    };
+
+    Display* _display;
+    Region _regions[MAX_REGIONS];
+    uint8_t _count = 0;
+    BackgroundFunction _background = NULL;
+    bool _full = true;
+    uint32_t _tilesSent = 0;
+    uint32_t _skipped = 0;
+
+    void drawRegion(Region& region)
+    {
+      region.draw(*_display, region.value);
+      region.dirty = false;
+    }
+};
+
+#endif
@@ -0,0 +1,589 @@
+/*
+  AirGradientEmulator.cpp - Emulated sensors for the AirGradient library
+*/
+
+#include "AirGradientEmulator.h"
+#include "AirGradientFixed.h"
+
+#include <string.h>
+
+#define PMS_COMMAND_READ 0xE2
+#define PMS_COMMAND_MODE 0xE1
+#define PMS_COMMAND_SLEEP 0xE4
+
+static void putWord(uint8_t* payload, uint8_t index, uint16_t value)
+{
+  payload[2 * index] = value >> 8;
+  payload[2 * index + 1] = value & 0xFF;
+}
+
+PmsEmulator::PmsEmulator(PMS_Variant variant)
+{
+  _variant = variant == PMS_VARIANT_AUTO ? PMS_VARIANT_PMS5003 : variant;
+  memset(&_data, 0, sizeof(_data));
+}
+
+void PmsEmulator::setData(const PmsDriver::DATA& data)
+{
+  _data = data;
+}
+
+void PmsEmulator::setPm(uint16_t pm25)
+{
+  _data.PM_AE_UG_1_0 = pm25 * 2 / 3;
+  _data.PM_AE_UG_2_5 = pm25;
+  _data.PM_AE_UG_10_0 = pm25 * 4 / 3;
+  // CF=1 values match the atmospheric ones below 30 ug/m3
+  _data.PM_SP_UG_1_0 = pm25 < 30 ? _data.PM_AE_UG_1_0 : _data.PM_AE_UG_1_0 * 3 / 2;
+  _data.PM_SP_UG_2_5 = pm25 < 30 ? _data.PM_AE_UG_2_5 : _data.PM_AE_UG_2_5 * 3 / 2;
+  _data.PM_SP_UG_10_0 = pm25 < 30 ? _data.PM_AE_UG_10_0 : _data.PM_AE_UG_10_0 * 3 / 2;
+  // cumulative counts, so they only decrease with size
+  _data.PM_RAW_0_3 = 150 + pm25 * 60;
+  _data.PM_RAW_0_5 = 40 + pm25 * 18;
+  _data.PM_RAW_1_0 = 5 + pm25 * 3;
+  _data.PM_RAW_2_5 = pm25 / 3;
+  _data.PM_RAW_5_0 = pm25 / 20;
+  _data.PM_RAW_10_0 = pm25 / 50;
+}
+
+void PmsEmulator::setCorruptEvery(uint16_t frames)
+{
+  _corruptEvery = frames;
+}
+
+void PmsEmulator::setSettling(uint32_t ms)
+{
+  _settlingMs = ms;
+}
+
+void PmsEmulator::update(uint32_t now)
+{
+  if (!_started || _waking) {
+    _started = true;
+    _waking = false;
+    _lastFrame = now;
+    _wokenAt = now;
+  }
+  if (_sleeping) {
+    _lastFrame = now;
+    return;
+  }
+  if (_passive) {
+    if (_requested) {
+      _requested = false;
+      sendFrame(now);
+    }
+    _lastFrame = now;
+    return;
+  }
+  // at most one frame per call, like a sensor that was not listened to
+  if (now - _lastFrame >= FRAME_INTERVAL_MS) {
+    _lastFrame += FRAME_INTERVAL_MS;
+    if (now - _lastFrame >= FRAME_INTERVAL_MS) {
+      _lastFrame = now;
+    }
+    sendFrame(now);
+  }
+}
+
+bool PmsEmulator::isSleeping() const
+{
+  return _sleeping;
+}
+
+bool PmsEmulator::isPassive() const
+{
+  return _passive;
+}
+
+uint32_t PmsEmulator::getFrames() const
+{
+  return _frames;
+}
+
+// Polling drivers such as readUntil() see new frames without an update()
+int PmsEmulator::available()
+{
+  update();
+  return _outCount;
+}
+
+int PmsEmulator::read()
+{
+  if (_outCount == 0) {
+    return -1;
+  }
+  uint8_t c = _out[_outHead];
+  _outHead = (_outHead + 1) % sizeof(_out);
+  _outCount--;
+  return c;
+}
+
+int PmsEmulator::peek()
+{
+  update();
+  return _outCount > 0 ? _out[_outHead] : -1;
+}
+
+void PmsEmulator::flush()
+{
+}
+
+// Collects the 7 byte commands: 42 4D command dataH dataL checksumH checksumL
+size_t PmsEmulator::write(uint8_t c)
+{
+  if ((_commandLength == 0 && c != 0x42) || (_commandLength == 1 && c != 0x4D)) {
+    _commandLength = c == 0x42 ? 1 : 0;
+    return 1;
+  }
+  _command[_commandLength++] = c;
+  if (_commandLength == sizeof(_command)) {
+    _commandLength = 0;
+    handleCommand();
+  }
+  return 1;
+}
+
+void PmsEmulator::sendFrame(uint32_t now)
+{
+  const PmsLayout layout = pmsLayout(_variant);
+  uint8_t frame[FRAME_SIZE];
+  uint8_t* payload = frame + 4;
+  uint8_t length = 4 + layout.frameLen;
+
+  memset(frame, 0, sizeof(frame));
+  frame[0] = 0x42;
+  frame[1] = 0x4D;
+  frame[2] = layout.frameLen >> 8;
+  frame[3] = layout.frameLen & 0xFF;
+
+  // the particle words, while the fan is not up to speed
+  uint32_t settled = now - _wokenAt;
+  const uint16_t* words = &_data.PM_SP_UG_1_0;
+  for (uint8_t i = 0; i < layout.bulkWords; i++) {
+    putWord(payload, i, settled >= _settlingMs ? words[i] : (uint64_t)words[i] * settled / _settlingMs);
+  }
+  if (layout.hcho != PMS_NO_FIELD) {
+    putWord(payload, layout.hcho, _data.AMB_HCHO * 1000);
+  }
+  if (layout.temperature != PMS_NO_FIELD) {
+    putWord(payload, layout.temperature, _data.PM_TMP * 10);
+  }
+  if (layout.humidity != PMS_NO_FIELD) {
+    putWord(payload, layout.humidity, _data.PM_HUM * 10);
+  }
+
+  uint16_t checksum = 0;
+  for (uint8_t i = 0; i < length - 2; i++) {
+    checksum += frame[i];
+  }
+  _frames++;
+  if (_corruptEvery > 0 && _frames % _corruptEvery == 0) {
+    checksum++;
+  }
+  frame[length - 2] = checksum >> 8;
+  frame[length - 1] = checksum & 0xFF;
+
+  for (uint8_t i = 0; i < length; i++) {
+    if (_outCount == sizeof(_out)) {
+      _outHead = (_outHead + 1) % sizeof(_out);
+      _outCount--;
+    }
+    _out[(_outHead + _outCount) % sizeof(_out)] = frame[i];
+    _outCount++;
+  }
+}
+
+void PmsEmulator::handleCommand()
+{
+  uint16_t checksum = 0;
+  for (uint8_t i = 0; i < 5; i++) {
+    checksum += _command[i];
+  }
+  if (_command[5] != checksum >> 8 || _command[6] != (checksum & 0xFF)) {
+    return;
+  }
+
+  bool on = _command[4] != 0;
+  switch (_command[2]) {
+    case PMS_COMMAND_SLEEP:
+      if (on && _sleeping) {
+        _waking = true;
+        _passive = false;
+      }
+      _sleeping = !on;
+      break;
+    case PMS_COMMAND_MODE:
+      _passive = !on;
+      break;
+    case PMS_COMMAND_READ:
+      _requested = !_sleeping;
+      break;
+  }
+}
+
+S8Emulator::S8Emulator()
+{
+}
+
+void S8Emulator::setCo2(uint16_t ppm)
+{
+  _co2 = ppm;
+}
+
+void S8Emulator::setMeterStatus(uint16_t status)
+{
+  _meterStatus = status;
+}
+
+void S8Emulator::setAbcPeriod(uint16_t hours)
+{
+  _abcPeriod = hours;
+}
+
+void S8Emulator::setFailEvery(uint16_t requests)
+{
+  _failEvery = requests;
+}
+
+uint32_t S8Emulator::getRequests() const
+{
+  return _requests;
+}
+
+int S8Emulator::available()
+{
+  return _responseLength - _position;
+}
+
+int S8Emulator::read()
+{
+  return _position < _responseLength ? _response[_position++] : -1;
+}
+
+int S8Emulator::peek()
+{
+  return _position < _responseLength ? _response[_position] : -1;
+}
+
+void S8Emulator::flush()
+{
+}
+
+size_t S8Emulator::write(uint8_t c)
+{
+  _request[_requestLength++] = c;
+  if (_requestLength == MODBUS_REQUEST_SIZE) {
+    _requestLength = 0;
+    answer();
+  }
+  return 1;
+}
+
+void S8Emulator::answer()
+{
+  uint16_t crc = Modbus_crc16(_request, 6);
+  if (_request[6] != (crc & 0xFF) || _request[7] != (crc >> 8)) {
+    return;
+  }
+  _requests++;
+  _responseLength = 0;
+  _position = 0;
+  if (_failEvery > 0 && _requests % _failEvery == 0) {
+    return;
+  }
+
+  uint8_t function = _request[1];
+  uint16_t start = (_request[2] << 8) | _request[3];
+  uint16_t count = (_request[4] << 8) | _request[5];
+  uint8_t n = 0;
+  _response[n++] = _request[0];
+
+  if ((function != MODBUS_READ_INPUT_REGISTERS && function != MODBUS_READ_HOLDING_REGISTERS) ||
+      count == 0 || count > S8Driver::MAX_REGISTERS) {
+    // illegal function or data value
+    _response[n++] = function | 0x80;
+    _response[n++] = count > S8Driver::MAX_REGISTERS ? 0x03 : 0x01;
+  } else {
+    _response[n++] = function;
+    _response[n++] = 2 * count;
+    for (uint16_t i = 0; i < count; i++) {
+      uint16_t reg = start + i;
+      uint16_t value = 0;
+      if (function == MODBUS_READ_INPUT_REGISTERS) {
+        value = reg == S8Driver::IR_METER_STATUS ? _meterStatus :
+                reg == S8Driver::IR_SPACE_CO2 ? _co2 : 0;
+      } else if (reg == S8Driver::HR_ABC_PERIOD) {
+        value = _abcPeriod;
+      }
+      _response[n++] = value >> 8;
+      _response[n++] = value & 0xFF;
+    }
+  }
+
+  crc = Modbus_crc16(_response, n);
+  _response[n++] = crc & 0xFF;
+  _response[n++] = crc >> 8;
+  _responseLength = n;
+}
+
+// CRC-8 of an SHT3x word: polynomial 0x31, initial value 0xFF
+static uint8_t sht3xCrc(uint16_t value)
+{
+  uint8_t crc = 0xFF;
+  uint8_t bytes[2] = { (uint8_t)(value >> 8), (uint8_t)(value & 0xFF) };
+  for (uint8_t i = 0; i < 2; i++) {
+    crc ^= bytes[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+Sht3xEmulator::Sht3xEmulator()
+{
+  setTemperature(2000);
+  setHumidity(5000);
+}
+
+// The SHT3x words use the same scaling as the SGP41 compensation ticks
+void Sht3xEmulator::setTemperature(int16_t centiCelsius)
+{
+  _temperature = SGP41_temperatureTicks(centiCelsius);
+}
+
+void Sht3xEmulator::setHumidity(uint16_t centiPercent)
+{
+  _humidity = SGP41_humidityTicks(centiPercent);
+}
+
+void Sht3xEmulator::setCorruptEvery(uint16_t readings)
+{
+  _corruptEvery = readings;
+}
+
+bool Sht3xEmulator::isPeriodic() const
+{
+  return _periodMs > 0;
+}
+
+uint32_t Sht3xEmulator::getReadings() const
+{
+  return _readings;
+}
+
+bool Sht3xEmulator::receive(const uint8_t* data, uint8_t len)
+{
+  if (len < 2) {
+    return false;
+  }
+  uint16_t command = (data[0] << 8) | data[1];
+  _outLength = 0;
+
+  // periodic mode, 0.5 to 10 measurements per second
+  uint8_t rate = data[0];
+  if (rate == 0x20 || rate == 0x21 || rate == 0x22 || rate == 0x23 || rate == 0x27) {
+    _periodMs = rate == 0x20 ? 2000 : rate == 0x21 ? 1000 : rate == 0x22 ? 500 : rate == 0x23 ? 250 : 100;
+    _periodStart = millis();
+    _fetched = 0;
+    return true;
+  }
+
+  switch (command) {
+    case SHT3XD_CMD_FETCH_DATA:
+      if (_periodMs > 0) {
+        uint32_t measured = (millis() - _periodStart) / _periodMs;
+        if (measured > _fetched) {
+          _fetched = measured;
+          putReading();
+        }
+      }
+      return true;
+    case SHT3XD_CMD_CLOCK_STRETCH_H:
+    case SHT3XD_CMD_CLOCK_STRETCH_M:
+    case SHT3XD_CMD_CLOCK_STRETCH_L:
+    case SHT3XD_CMD_POLLING_H:
+    case SHT3XD_CMD_POLLING_M:
+    case SHT3XD_CMD_POLLING_L:
+      // single shot, not accepted while measuring periodically
+      if (_periodMs > 0) {
+        return false;
+      }
+      putReading();
+      return true;
+    case SHT3XD_CMD_STOP_PERIODIC:
+    case SHT3XD_CMD_SOFT_RESET:
+      _periodMs = 0;
+      return true;
+    case SHT3XD_CMD_READ_SERIAL_NUMBER:
+      putWord(0, 0x1234);
+      putWord(1, 0x5678);
+      return true;
+    case SHT3XD_CMD_READ_STATUS:
+      putWord(0, 0);
+      return true;
+    default:
+      return true;
+  }
+}
+
+uint8_t Sht3xEmulator::send(uint8_t* data, uint8_t len)
+{
+  uint8_t n = len < _outLength ? len : _outLength;
+  memcpy(data, _out, n);
+  _outLength = 0;
+  return n;
+}
+
+void Sht3xEmulator::putWord(uint8_t index, uint16_t value)
+{
+  _out[3 * index] = value >> 8;
+  _out[3 * index + 1] = value & 0xFF;
+  _out[3 * index + 2] = sht3xCrc(value);
+  _outLength = 3 * index + 3;
+}
+
+void Sht3xEmulator::putReading()
+{
+  putWord(0, _temperature);
+  putWord(1, _humidity);
+  _readings++;
+  if (_corruptEvery > 0 && _readings % _corruptEvery == 0) {
+    _out[5] ^= 0x01;
+  }
+}
+
+bool I2CEmulator::attach(uint8_t address, I2CDeviceEmulator& device)
+{
+  if (_count == MAX_DEVICES) {
+    return false;
+  }
+  Slot& slot = _slots[_count++];
+  slot.address = address;
+  slot.device = &device;
+  slot.failCount = 0;
+  slot.failError = 0;
+  slot.stretchCount = 0;
+  slot.stretchMs = 0;
+  return true;
+}
+
+void I2CEmulator::failNext(uint8_t address, uint8_t error, uint8_t count)
+{
+  Slot* slot = find(address);
+  if (slot != NULL) {
+    slot->failError = error;
+    slot->failCount = count;
+  }
+}
+
+void I2CEmulator::stretchNext(uint8_t address, uint16_t ms, uint8_t count)
+{
+  Slot* slot = find(address);
+  if (slot != NULL) {
+    slot->stretchMs = ms;
+    slot->stretchCount = count;
+  }
+}
+
+void I2CEmulator::holdSda(uint8_t pulses)
+{
+  _held = pulses;
+}
+
+uint32_t I2CEmulator::getTransfers() const
+{
+  return _transfers;
+}
+
+uint32_t I2CEmulator::getPulses() const
+{
+  return _pulses;
+}
+
+void I2CEmulator::setTimeout(uint16_t timeoutMs)
+{
+  _timeoutMs = timeoutMs;
+}
+
+uint8_t I2CEmulator::transmit(uint8_t address, const uint8_t* data, uint8_t len)
+{
+  _transfers++;
+  if (_held > 0) {
+    return 4;
+  }
+  Slot* slot = find(address);
+  if (slot == NULL) {
+    return 2;
+  }
+  uint8_t error = fault(*slot);
+  if (error != 0) {
+    return error;
+  }
+  return slot->device->receive(data, len) ? 0 : 3;
+}
+
+uint8_t I2CEmulator::receive(uint8_t address, uint8_t* data, uint8_t len)
+{
+  _transfers++;
+  if (_held > 0) {
+    return 0;
+  }
+  Slot* slot = find(address);
+  if (slot == NULL || fault(*slot) != 0) {
+    return 0;
+  }
+  return slot->device->send(data, len);
+}
+
+bool I2CEmulator::canRecover()
+{
+  return true;
+}
+
+bool I2CEmulator::sdaLow()
+{
+  return _held > 0;
+}
+
+void I2CEmulator::pulseScl()
+{
+  _pulses++;
+  if (_held > 0) {
+    _held--;
+  }
+}
+
+void I2CEmulator::stop()
+{
+}
+
+I2CEmulator::Slot* I2CEmulator::find(uint8_t address)
+{
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_slots[i].address == address) {
+      return &_slots[i];
+    }
+  }
+  return NULL;
+}
+
+// The clock stretch takes real (or virtual) time, so I2CBus sees it in
+// its latency and timeout checks.
+uint8_t I2CEmulator::fault(Slot& slot)
+{
+  if (slot.failCount > 0) {
+    slot.failCount--;
+    return slot.failError;
+  }
+  if (slot.stretchCount > 0) {
+    slot.stretchCount--;
+    if (_timeoutMs > 0 && slot.stretchMs >= _timeoutMs) {
+      delay(_timeoutMs);
+      return 5;
+    }
+    delay(slot.stretchMs);
+  }
+  return 0;
+}
@@ -0,0 +1,255 @@
+/*
+  AirGradientEmulator.h - Emulated sensors for the AirGradient library
+
+  Streams that behave like a Plantower PMS and a Senseair S8 on the other
+  end of the UART, so the real drivers can run without the hardware, e.g.
+  many virtual devices in one host build (extras/tools/fleet_simulator.cpp)
+  or the host tests.
+
+    PmsEmulator pmsEmulator;
+    S8Emulator co2Emulator;
+
+    void setup() {
+      pmsEmulator.setPm(25);
+      co2Emulator.setCo2(800);
+      ag.PMS_Init(pmsEmulator);
+      ag.CO2_Init(co2Emulator);
+    }
+
+  PmsEmulator sends a frame every FRAME_INTERVAL_MS in active mode, one
+  per request in passive mode and none while asleep; it follows the
+  commands PmsDriver writes and, like the sensor, comes back from sleep
+  in active mode. setSettling() models the fan spinning up after power-on
+  and wake-up: the particle readings ramp up from 0 over that time, which
+  is what PmsDriver::STEADY_RESPONSE_TIME waits out. Time comes from
+  millis() when the driver polls available(), so a host build that stubs
+  millis() gives each device its own virtual clock; update(now) advances
+  it explicitly.
+  S8Emulator answers Modbus read requests for the status, CO2 and ABC
+  period registers as soon as they are written. setCorruptEvery() /
+  setFailEvery() add the faults a real line has.
+
+  I2CEmulator is a bus for I2CBus with emulated devices on it; besides
+  what the devices answer it scripts the faults of a real bus: NACKs,
+  clock stretching past the timeout and a slave that holds SDA low until
+  it gets its clock pulses.
+
+    I2CEmulator wire;
+    I2CBus bus(wire);
+    wire.attach(0x44, myDevice);
+    wire.stretchNext(0x44, 80);    // the next transfer times out
+
+  Sht3xEmulator is an SHT3x on such a bus for Sht3xDriver. In periodic
+  mode it has a measurement every 1/frequency s of millis(); a fetch
+  without a new one gets its read NACKed, as on the sensor.
+
+    Sht3xEmulator shtEmulator;
+    wire.attach(0x44, shtEmulator);
+    shtEmulator.setTemperature(2150);   // 21.50 C
+    sht.begin(0x44, bus);
+*/
+
+#ifndef AirGradientEmulator_h
+#define AirGradientEmulator_h
+
+#include "Arduino.h"
+#include "Stream.h"
+#include "AirGradientPms.h"
+#include "AirGradientS8.h"
+#include "AirGradientI2C.h"
+#include "AirGradientSht3x.h"
+
+class PmsEmulator : public Stream
+{
+  public:
+    static const uint16_t FRAME_INTERVAL_MS = 1000;
+    // longest frame, PMS5003ST
+    static const uint8_t FRAME_SIZE = 4 + 2 * 17 + 2;
+
+    PmsEmulator(PMS_Variant variant = PMS_VARIANT_PMS5003);
+
+    void setData(const PmsDriver::DATA& data);
+    // PM2.5 in ug/m3; PM1.0, PM10 and the counts follow in typical ratios
+    void setPm(uint16_t pm25);
+    // Every n-th frame gets a bad checksum; 0 for none.
+    void setCorruptEvery(uint16_t frames);
+    // Readings ramp up to the set values over ms after waking; 0 for none.
+    void setSettling(uint32_t ms);
+
+    // Sends what is due at now.
+    void update(uint32_t now = millis());
+
+    bool isSleeping() const;
+    bool isPassive() const;
+    uint32_t getFrames() const;
+
+    int available();
+    int read();
+    int peek();
+    void flush();
+    size_t write(uint8_t c);
+    using Print::write;
+
+  private:
+    PMS_Variant _variant;
+    PmsDriver::DATA _data;
+
+    // two frames; an unread older one is overwritten like a UART overrun
+    uint8_t _out[2 * FRAME_SIZE];
+    uint8_t _outHead = 0;
+    uint8_t _outCount = 0;
+
+    uint8_t _command[7];
+    uint8_t _commandLength = 0;
+
+    bool _sleeping = false;
+    bool _passive = false;
+    bool _requested = false;
+    bool _started = false;
+    bool _waking = false;
+    uint32_t _lastFrame = 0;
+    uint32_t _wokenAt = 0;
+    uint32_t _settlingMs = 0;
+    uint16_t _corruptEvery = 0;
+    uint32_t _frames = 0;
+
+    void sendFrame(uint32_t now);
+    void handleCommand();
+};
+
+class S8Emulator : public Stream
+{
+  public:
+    S8Emulator();
+
+    void setCo2(uint16_t ppm);
+    // S8_STATUS_* bits
+    void setMeterStatus(uint16_t status);
+    // hours, 0 disables ABC
+    void setAbcPeriod(uint16_t hours);
+    // Every n-th request goes unanswered; 0 for none.
+    void setFailEvery(uint16_t requests);
+
+    uint32_t getRequests() const;
+
+    int available();
+    int read();
+    int peek();
+    void flush();
+    size_t write(uint8_t c);
+    using Print::write;
+
+  private:
+    uint16_t _co2 = 400;
+    uint16_t _meterStatus = 0;
+    uint16_t _abcPeriod = 180;
+    uint16_t _failEvery = 0;
+    uint32_t _requests = 0;
+
+    uint8_t _request[MODBUS_REQUEST_SIZE];
+    uint8_t _requestLength = 0;
+    uint8_t _response[MODBUS_RESPONSE_SIZE(S8Driver::MAX_REGISTERS)];
+    uint8_t _responseLength = 0;
+    uint8_t _position = 0;
+
+    void answer();
+};
+
+// A device on an I2CEmulator
+class I2CDeviceEmulator
+{
+  public:
+    virtual ~I2CDeviceEmulator() {}
+    // A write transfer addressed to the device; false NACKs the data.
+    virtual bool receive(const uint8_t* data, uint8_t len) = 0;
+    // A read transfer; returns the bytes sent, fewer than len for a NACK.
+    virtual uint8_t send(uint8_t* data, uint8_t len) = 0;
+};
+
+class Sht3xEmulator : public I2CDeviceEmulator
+{
+  public:
+    Sht3xEmulator();
+
+    void setTemperature(int16_t centiCelsius);
+    void setHumidity(uint16_t centiPercent);
+    // Every n-th reading gets a bad CRC; 0 for none.
+    void setCorruptEvery(uint16_t readings);
+
+    bool isPeriodic() const;
+    uint32_t getReadings() const;
+
+    bool receive(const uint8_t* data, uint8_t len);
+    uint8_t send(uint8_t* data, uint8_t len);
+
+  private:
+    uint16_t _temperature;
+    uint16_t _humidity;
+    uint16_t _corruptEvery = 0;
+    uint32_t _readings = 0;
+
+    // 0 outside periodic mode
+    uint16_t _periodMs = 0;
+    uint32_t _periodStart = 0;
+    uint32_t _fetched = 0;
+
+    // what the next read returns; the sensor clears it once read
+    uint8_t _out[6];
+    uint8_t _outLength = 0;
+
+    void putWord(uint8_t index, uint16_t value);
+    void putReading();
+};
+
+class I2CEmulator : public I2CTransport
+{
+  public:
+    static const uint8_t MAX_DEVICES = 8;
+
+    // False if MAX_DEVICES are attached
+    bool attach(uint8_t address, I2CDeviceEmulator& device);
+
+    // The next count transfers to address fail with the endTransmission()
+    // code error; a read gets no bytes.
+    void failNext(uint8_t address, uint8_t error, uint8_t count = 1);
+    // The device stretches the clock for ms in each of the next count
+    // transfers; longer than the timeout fails the transfer with code 5.
+    void stretchNext(uint8_t address, uint16_t ms, uint8_t count = 1);
+    // A slave holds SDA low until it got this many SCL pulses; every
+    // transfer fails until then.
+    void holdSda(uint8_t pulses);
+
+    uint32_t getTransfers() const;
+    uint32_t getPulses() const;
+
+    void setTimeout(uint16_t timeoutMs);
+    uint8_t transmit(uint8_t address, const uint8_t* data, uint8_t len);
+    uint8_t receive(uint8_t address, uint8_t* data, uint8_t len);
+
+    bool canRecover();
+    bool sdaLow();
+    void pulseScl();
+    void stop();
+
+  private:
+    struct Slot {
+      uint8_t address;
+      I2CDeviceEmulator* device;
+      uint8_t failCount;
+      uint8_t failError;
+      uint8_t stretchCount;
+      uint16_t stretchMs;
+    };
+
+    Slot _slots[MAX_DEVICES];
+    uint8_t _count = 0;
+    uint16_t _timeoutMs = 0;
+    uint8_t _held = 0;
+    uint32_t _transfers = 0;
+    uint32_t _pulses = 0;
+
+    Slot* find(uint8_t address);
+    uint8_t fault(Slot& slot);
+};
+
+#endif
@@ -0,0 +1,37 @@
+/*
+  AirGradientFixed.cpp - Integer conversion kernels for targets without an FPU
+*/
+
+#include "AirGradientFixed.h"
+
+// T = -45 + 175 * raw / 65535
+int16_t TMP_RH_rawToCentiCelsius(uint16_t raw)
+{
+  return (int16_t)((17500UL * raw + 32767UL) / 65535UL) - 4500;
+}
+
+// RH = 100 * raw / 65535
+uint16_t TMP_RH_rawToCentiPercent(uint16_t raw)
+{
+  return (uint16_t)((10000UL * raw + 32767UL) / 65535UL);
+}
+
+// ticks = (T + 45) * 65535 / 175
+uint16_t SGP41_temperatureTicks(int32_t centiCelsius)
+{
+  if (centiCelsius <= -4500)
+    return 0;
+  if (centiCelsius >= 13000)
+    return 65535;
+  return (uint16_t)(((uint32_t)(centiCelsius + 4500) * 65535UL + 8750UL) / 17500UL);
+}
+
+// ticks = RH * 65535 / 100
+uint16_t SGP41_humidityTicks(int32_t centiPercent)
+{
+  if (centiPercent <= 0)
+    return 0;
+  if (centiPercent >= 10000)
+    return 65535;
+  return (uint16_t)(((uint32_t)centiPercent * 65535UL + 5000UL) / 10000UL);
+}
@@ -0,0 +1,25 @@
+/*
+  AirGradientFixed.h - Integer conversion kernels for targets without an FPU
+  Fixed-point versions of the float conversions used by the drivers and the
+  examples. All results are rounded to nearest, matching the float formulas
+  evaluated exactly.
+*/
+
+#ifndef AirGradientFixed_h
+#define AirGradientFixed_h
+
+#include <stdint.h>
+
+// SHT3x raw words to hundredths of a degree Celsius / percent RH.
+int16_t TMP_RH_rawToCentiCelsius(uint16_t raw);
+uint16_t TMP_RH_rawToCentiPercent(uint16_t raw);
+
+// SGP41 compensation ticks. The SHT3x raw words use the same scaling as the
+// SGP41 ticks, so a raw reading can be passed on unchanged; these convert
+// from already scaled values and clamp to the valid tick range.
+uint16_t SGP41_temperatureTicks(int32_t centiCelsius);
+uint16_t SGP41_humidityTicks(int32_t centiPercent);
+
+// For the AQI, AQI_compute() in AirGradientAqi.h is integer as well.
+
+#endif
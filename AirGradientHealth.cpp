@@ -0,0 +1,196 @@
+/*
+  AirGradientHealth.cpp - Sensor health supervisor for the AirGradient library
+*/
+
+#include "AirGradientHealth.h"
+
+#include <stdio.h>
+
+HealthSupervisor::HealthSupervisor(uint32_t minBackoffMs, uint32_t maxBackoffMs)
+{
+  _minBackoffMs = minBackoffMs;
+  _maxBackoffMs = maxBackoffMs;
+}
+
+int8_t HealthSupervisor::add(const char* name, uint32_t stuckMs, HealthRecoverCallback recover, uint32_t now)
+{
+  if (_count == MAX_SENSORS) {
+    return -1;
+  }
+  Sensor& sensor = _sensors[_count];
+  sensor.name = name;
+  sensor.stuckMs = stuckMs;
+  sensor.recover = recover;
+  sensor.failed = false;
+  sensor.lastSuccess = now;
+  sensor.nextAttempt = now;
+  sensor.backoffMs = _minBackoffMs;
+  sensor.history = 0;
+  sensor.historyLength = 0;
+  sensor.successes = 0;
+  sensor.failures = 0;
+  sensor.attempts = 0;
+  sensor.recoveries = 0;
+  sensor.recoveryMs = 0;
+  return _count++;
+}
+
+void HealthSupervisor::record(int8_t id, bool ok)
+{
+  Sensor& sensor = _sensors[id];
+  sensor.history = (sensor.history << 1) | (ok ? 0 : 1);
+  if (sensor.historyLength < HISTORY) {
+    sensor.historyLength++;
+  }
+  if (ok) {
+    sensor.successes++;
+  } else {
+    sensor.failures++;
+  }
+}
+
+void HealthSupervisor::success(int8_t id, uint32_t now)
+{
+  if (id < 0 || id >= _count) {
+    return;
+  }
+  record(id, true);
+  Sensor& sensor = _sensors[id];
+  if (sensor.failed) {
+    sensor.failed = false;
+    sensor.recoveries++;
+    sensor.recoveryMs += now - sensor.lastSuccess;
+  }
+  sensor.lastSuccess = now;
+  sensor.backoffMs = _minBackoffMs;
+}
+
+void HealthSupervisor::failure(int8_t id)
+{
+  if (id < 0 || id >= _count) {
+    return;
+  }
+  record(id, false);
+}
+
+void HealthSupervisor::setWatchdog(uint8_t pin, uint16_t pulseMs)
+{
+  _watchdogPin = pin;
+  _pulseMs = pulseMs;
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, LOW);
+}
+
+void HealthSupervisor::feedWatchdog(uint32_t now)
+{
+  if (_watchdogPin < 0 || _pulsing) {
+    return;
+  }
+  digitalWrite(_watchdogPin, HIGH);
+  _pulsing = true;
+  _pulseStart = now;
+  _pulses++;
+}
+
+void HealthSupervisor::update(uint32_t now)
+{
+  if (_pulsing && now - _pulseStart >= _pulseMs) {
+    digitalWrite(_watchdogPin, LOW);
+    _pulsing = false;
+  }
+
+  for (uint8_t i = 0; i < _count; i++) {
+    Sensor& sensor = _sensors[i];
+    if (!sensor.failed) {
+      if (now - sensor.lastSuccess < sensor.stuckMs) {
+        continue;
+      }
+      sensor.failed = true;
+      sensor.nextAttempt = now;
+    }
+    // signed, so an attempt scheduled across the millis() wrap still waits
+    if ((int32_t)(now - sensor.nextAttempt) < 0) {
+      continue;
+    }
+    sensor.attempts++;
+    if (sensor.recover != NULL) {
+      sensor.recover();
+    }
+    sensor.nextAttempt = now + sensor.backoffMs;
+    sensor.backoffMs = sensor.backoffMs > _maxBackoffMs / 2 ? _maxBackoffMs : 2 * sensor.backoffMs;
+  }
+}
+
+HEALTH_State HealthSupervisor::getState(int8_t id) const
+{
+  if (id < 0 || id >= _count) {
+    return HEALTH_FAILED;
+  }
+  if (_sensors[id].failed) {
+    return HEALTH_FAILED;
+  }
+  return getErrorRatePercent(id) >= 50 ? HEALTH_DEGRADED : HEALTH_OK;
+}
+
+const char* HealthSupervisor::getName(int8_t id) const
+{
+  return id >= 0 && id < _count ? _sensors[id].name : "";
+}
+
+uint8_t HealthSupervisor::getErrorRatePercent(int8_t id) const
+{
+  if (id < 0 || id >= _count || _sensors[id].historyLength == 0) {
+    return 0;
+  }
+  const Sensor& sensor = _sensors[id];
+  uint8_t failed = 0;
+  for (uint8_t i = 0; i < sensor.historyLength; i++) {
+    failed += (sensor.history >> i) & 1;
+  }
+  return (100 * failed + sensor.historyLength / 2) / sensor.historyLength;
+}
+
+uint8_t HealthSupervisor::getCompletenessPercent(int8_t id) const
+{
+  if (id < 0 || id >= _count) {
+    return 0;
+  }
+  const Sensor& sensor = _sensors[id];
+  uint32_t reads = sensor.successes + sensor.failures;
+  return reads == 0 ? 100 : (uint8_t)((100ULL * sensor.successes) / reads);
+}
+
+uint32_t HealthSupervisor::getRecoveryAttempts(int8_t id) const
+{
+  return id >= 0 && id < _count ? _sensors[id].attempts : 0;
+}
+
+uint32_t HealthSupervisor::getRecoveries(int8_t id) const
+{
+  return id >= 0 && id < _count ? _sensors[id].recoveries : 0;
+}
+
+uint32_t HealthSupervisor::getMttrMs(int8_t id) const
+{
+  if (id < 0 || id >= _count || _sensors[id].recoveries == 0) {
+    return 0;
+  }
+  return _sensors[id].recoveryMs / _sensors[id].recoveries;
+}
+
+uint32_t HealthSupervisor::getWatchdogPulses() const
+{
+  return _pulses;
+}
+
+void HealthSupervisor::print(Print& out) const
+{
+  static const char* const states[] = { "ok", "degraded", "failed" };
+  char buf[96];
+  for (int8_t i = 0; i < _count; i++) {
+    snprintf(buf, sizeof(buf), "%s %s, %u%% complete, %lu recoveries, mttr %lu s\n",
+             _sensors[i].name, states[getState(i)], getCompletenessPercent(i),
+             (unsigned long)_sensors[i].recoveries, (unsigned long)(getMttrMs(i) / 1000));
+    out.print(buf);
+  }
+}
@@ -0,0 +1,131 @@
+/*
+  AirGradientHealth.h - Sensor health supervisor for the AirGradient library
+
+  Watches the reads of every sensor and brings back the ones that got
+  stuck, e.g. a PMS that stopped sending after a brown-out:
+
+    HealthSupervisor health;
+    int8_t pmsHealth;
+
+    void recoverPms() {
+      Serial0.end();
+      Serial0.begin(9600);
+      pms.wakeUp();
+      pms.activeMode();
+    }
+
+    void setup() {
+      health.setWatchdog(2);
+      pmsHealth = health.add("pms", 30000, recoverPms);
+    }
+
+    void loop() {
+      health.update();
+      if (pms.readUntil(data, 2000)) health.success(pmsHealth);
+      else health.failure(pmsHealth);
+      ...
+      if (uploaded) health.feedWatchdog();
+    }
+
+  A sensor without a successful read for stuckMs is HEALTH_FAILED and its
+  recover callback runs right away, then again after a backoff that
+  doubles from minBackoffMs up to maxBackoffMs until a read succeeds. A
+  sensor that still answers but fails half of its recent reads is
+  HEALTH_DEGRADED; that alone triggers nothing.
+
+  The time to recovery is counted from the last good read before the
+  outage to the first one after it, i.e. the gap in the data.
+
+  feedWatchdog() raises the watchdog pin and update() lowers it again
+  after the pulse, so nothing waits in delay().
+*/
+
+#ifndef AirGradientHealth_h
+#define AirGradientHealth_h
+
+#include "Arduino.h"
+#include "Print.h"
+
+typedef enum {
+  HEALTH_OK,
+  HEALTH_DEGRADED,
+  HEALTH_FAILED
+} HEALTH_State;
+
+// Re-initializes a sensor: reopen its port, wake it, reset it, ...
+typedef void (*HealthRecoverCallback)();
+
+class HealthSupervisor
+{
+  public:
+    static const uint8_t MAX_SENSORS = 6;
+    // reads the error rate is taken over
+    static const uint8_t HISTORY = 32;
+
+    HealthSupervisor(uint32_t minBackoffMs = 5000, uint32_t maxBackoffMs = 300000);
+
+    // Returns the id for the other calls, -1 if MAX_SENSORS are taken.
+    // The time until the first read counts towards stuckMs.
+    int8_t add(const char* name, uint32_t stuckMs, HealthRecoverCallback recover, uint32_t now = millis());
+
+    // The outcome of every read
+    void success(int8_t id, uint32_t now = millis());
+    void failure(int8_t id);
+
+    // Pin of an external watchdog, e.g. a TPL5010, kept LOW between pulses
+    void setWatchdog(uint8_t pin, uint16_t pulseMs = 20);
+    void feedWatchdog(uint32_t now = millis());
+
+    // Call often: detects stuck sensors, runs due recoveries and ends a
+    // watchdog pulse.
+    void update(uint32_t now = millis());
+
+    HEALTH_State getState(int8_t id) const;
+    const char* getName(int8_t id) const;
+    // Of the last HISTORY reads
+    uint8_t getErrorRatePercent(int8_t id) const;
+    // Successful reads of all reads since add()
+    uint8_t getCompletenessPercent(int8_t id) const;
+    uint32_t getRecoveryAttempts(int8_t id) const;
+    uint32_t getRecoveries(int8_t id) const;
+    // Mean time to recovery, 0 before the first one
+    uint32_t getMttrMs(int8_t id) const;
+    uint32_t getWatchdogPulses() const;
+
+    // One line per sensor, e.g. "pms ok, 99% complete, 2 recoveries, mttr 41 s"
+    void print(Print& out) const;
+
+  private:
+    struct Sensor {
+      const char* name;
+      uint32_t stuckMs;
+      HealthRecoverCallback recover;
+      bool failed;
+      uint32_t lastSuccess;
+      uint32_t nextAttempt;
+      uint32_t backoffMs;
+      // bit set per failed read, newest in bit 0
+      uint32_t history;
+      uint8_t historyLength;
+      uint32_t successes;
+      uint32_t failures;
+      uint32_t attempts;
+      uint32_t recoveries;
+      uint32_t recoveryMs;
+    };
+
+    Sensor _sensors[MAX_SENSORS];
+    uint8_t _count = 0;
+    uint32_t _minBackoffMs;
+    uint32_t _maxBackoffMs;
+
+    int _watchdogPin = -1;
+    uint16_t _pulseMs = 20;
+    bool _pulsing = false;
+    uint32_t _pulseStart = 0;
+    uint32_t _pulses = 0;
+
+    void record(int8_t id, bool ok);
+};
+
+#endif
@@ -0,0 +1,371 @@
+/*
+  AirGradientI2C.cpp - Shared I2C bus manager for the AirGradient library
+*/
+
+#include "AirGradientI2C.h"
+
+static I2C_DeviceStats noStats;
+
+WireI2CTransport::WireI2CTransport(TwoWire& wire)
+{
+  _wire = &wire;
+}
+
+void WireI2CTransport::setPins(int sdaPin, int sclPin)
+{
+  _sdaPin = sdaPin;
+  _sclPin = sclPin;
+}
+
+void WireI2CTransport::setTimeout(uint16_t timeoutMs)
+{
+#if defined(ESP8266)
+  _wire->setClockStretchLimit((uint32_t)timeoutMs * 1000);
+#elif defined(ESP32)
+  _wire->setTimeOut(timeoutMs);
+#elif defined(WIRE_HAS_TIMEOUT)
+  _wire->setWireTimeout((uint32_t)timeoutMs * 1000, true);
+#else
+  (void)timeoutMs;
+#endif
+}
+
+uint8_t WireI2CTransport::transmit(uint8_t address, const uint8_t* data, uint8_t len)
+{
+  _wire->beginTransmission(address);
+  _wire->write(data, len);
+  return _wire->endTransmission();
+}
+
+uint8_t WireI2CTransport::receive(uint8_t address, uint8_t* data, uint8_t len)
+{
+  uint8_t received = _wire->requestFrom(address, len);
+  if (received < len) {
+    while (_wire->available()) {
+      _wire->read();
+    }
+    return received;
+  }
+  for (uint8_t i = 0; i < len; i++) {
+    data[i] = _wire->read();
+  }
+  return len;
+}
+
+bool WireI2CTransport::canRecover()
+{
+  return _sdaPin >= 0 && _sclPin >= 0;
+}
+
+bool WireI2CTransport::sdaLow()
+{
+  return digitalRead(_sdaPin) == LOW;
+}
+
+void WireI2CTransport::pulseScl()
+{
+  pinMode(_sdaPin, INPUT_PULLUP);
+  pinMode(_sclPin, OUTPUT);
+  digitalWrite(_sclPin, LOW);
+  delayMicroseconds(5);
+  pinMode(_sclPin, INPUT_PULLUP);
+  delayMicroseconds(5);
+}
+
+void WireI2CTransport::stop()
+{
+  // STOP: SDA goes high while SCL is high
+  pinMode(_sdaPin, OUTPUT);
+  digitalWrite(_sdaPin, LOW);
+  delayMicroseconds(5);
+  pinMode(_sclPin, INPUT_PULLUP);
+  delayMicroseconds(5);
+  pinMode(_sdaPin, INPUT_PULLUP);
+  delayMicroseconds(5);
+
+#if defined(ESP32)
+  _wire->end();
+  _wire->begin(_sdaPin, _sclPin);
+#elif defined(ESP8266)
+  _wire->begin(_sdaPin, _sclPin);
+#else
+  _wire->begin();
+#endif
+}
+
+I2CBus::I2CBus(TwoWire& wire) : _wireTransport(wire)
+{
+  _transport = &_wireTransport;
+}
+
+I2CBus::I2CBus(I2CTransport& transport)
+{
+  _transport = &transport;
+}
+
+void I2CBus::begin(int sdaPin, int sclPin)
+{
+  _wireTransport.setPins(sdaPin, sclPin);
+  if (isStuck()) {
+    recover();
+  }
+}
+
+int8_t I2CBus::addDevice(uint8_t address, uint16_t timeoutMs)
+{
+  for (uint8_t i = 0; i < _deviceCount; i++) {
+    if (_devices[i].address == address) {
+      _devices[i].timeoutMs = timeoutMs;
+      return i;
+    }
+  }
+  if (_deviceCount >= MAX_DEVICES) {
+    return I2C_NO_DEVICE;
+  }
+  Device& device = _devices[_deviceCount];
+  device.address = address;
+  device.timeoutMs = timeoutMs;
+  device.stats = I2C_DeviceStats();
+  return _deviceCount++;
+}
+
+uint8_t I2CBus::address(int8_t device) const
+{
+  return validDevice(device) ? _devices[device].address : 0;
+}
+
+uint8_t I2CBus::getDeviceCount() const
+{
+  return _deviceCount;
+}
+
+I2C_Status I2CBus::write(int8_t device, const uint8_t* data, uint8_t len)
+{
+  return writeRead(device, data, len, NULL, 0);
+}
+
+I2C_Status I2CBus::read(int8_t device, uint8_t* data, uint8_t len)
+{
+  return writeRead(device, NULL, 0, data, len);
+}
+
+I2C_Status I2CBus::writeRead(int8_t device, const uint8_t* txData, uint8_t txLen,
+                             uint8_t* rxData, uint8_t rxLen, uint16_t delayMs)
+{
+  I2C_Transaction transaction;
+  transaction.device = device;
+  transaction.txData = txData;
+  transaction.txLen = txLen;
+  transaction.rxData = rxData;
+  transaction.rxLen = rxLen;
+  transaction.delayMs = delayMs;
+
+  if (!validDevice(device)) {
+    return I2C_NO_DEVICE;
+  }
+
+  uint32_t start = micros();
+  I2C_Status status = writePhase(transaction);
+  uint32_t elapsed = micros() - start;
+
+  if (status == I2C_OK && rxLen > 0) {
+    if (delayMs > 0) {
+      delay(delayMs);
+    }
+    // the wait is the device's conversion time, not bus latency
+    start = micros() - elapsed;
+    status = readPhase(transaction);
+  }
+
+  transaction.status = status;
+  record(transaction, start);
+  handleError(status);
+  return status;
+}
+
+I2C_Status I2CBus::queue(I2C_Transaction& transaction)
+{
+  if (!validDevice(transaction.device)) {
+    transaction.status = I2C_NO_DEVICE;
+    return I2C_NO_DEVICE;
+  }
+  if (_queueCount >= QUEUE_SIZE) {
+    transaction.status = I2C_QUEUE_FULL;
+    return I2C_QUEUE_FULL;
+  }
+  transaction.status = I2C_OK;
+  _queue[_queueCount++] = &transaction;
+  return I2C_OK;
+}
+
+uint8_t I2CBus::pending() const
+{
+  return _queueCount;
+}
+
+uint8_t I2CBus::flush()
+{
+  uint32_t latency[QUEUE_SIZE];
+  uint16_t wait = 0;
+  uint8_t failed = 0;
+
+  for (uint8_t i = 0; i < _queueCount; i++) {
+    I2C_Transaction& transaction = *_queue[i];
+    uint32_t start = micros();
+    transaction.status = writePhase(transaction);
+    latency[i] = micros() - start;
+    if (transaction.status == I2C_OK && transaction.rxLen > 0 && transaction.delayMs > wait) {
+      wait = transaction.delayMs;
+    }
+  }
+
+  if (wait > 0) {
+    delay(wait);
+  }
+
+  for (uint8_t i = 0; i < _queueCount; i++) {
+    I2C_Transaction& transaction = *_queue[i];
+    uint32_t start = micros() - latency[i];
+    if (transaction.status == I2C_OK && transaction.rxLen > 0) {
+      transaction.status = readPhase(transaction);
+    }
+    record(transaction, start);
+    if (transaction.status != I2C_OK) {
+      failed++;
+    }
+  }
+
+  for (uint8_t i = 0; i < _queueCount; i++) {
+    if (_queue[i]->status != I2C_OK) {
+      handleError(_queue[i]->status);
+      break;
+    }
+  }
+
+  _queueCount = 0;
+  return failed;
+}
+
+bool I2CBus::isStuck() const
+{
+  return _transport->canRecover() && _transport->sdaLow();
+}
+
+// A slave that was interrupted mid-byte keeps driving SDA low while it waits
+// for the rest of its clock pulses. Up to nine SCL pulses let it finish the
+// byte (and the ACK bit), after which it releases SDA and a STOP resets it.
+bool I2CBus::recover()
+{
+  if (!_transport->canRecover()) {
+    return false;
+  }
+  _recoveries++;
+
+  for (uint8_t i = 0; i < 9 && _transport->sdaLow(); i++) {
+    _transport->pulseScl();
+  }
+  _transport->stop();
+  return !_transport->sdaLow();
+}
+
+uint32_t I2CBus::getRecoveryCount() const
+{
+  return _recoveries;
+}
+
+const I2C_DeviceStats& I2CBus::getStats(int8_t device) const
+{
+  return validDevice(device) ? _devices[device].stats : noStats;
+}
+
+void I2CBus::resetStats()
+{
+  for (uint8_t i = 0; i < _deviceCount; i++) {
+    _devices[i].stats = I2C_DeviceStats();
+  }
+  _recoveries = 0;
+}
+
+void I2CBus::setTraceCallback(I2C_TraceCallback callback)
+{
+  _trace = callback;
+}
+
+bool I2CBus::validDevice(int8_t device) const
+{
+  return device >= 0 && device < _deviceCount;
+}
+
+I2C_Status I2CBus::writePhase(I2C_Transaction& transaction)
+{
+  if (transaction.txLen == 0) {
+    return I2C_OK;
+  }
+  Device& device = _devices[transaction.device];
+  _transport->setTimeout(device.timeoutMs);
+
+  uint32_t start = millis();
+  uint8_t error = _transport->transmit(device.address, transaction.txData, transaction.txLen);
+
+  if (error == 0) {
+    return I2C_OK;
+  }
+  if (error > 4 || millis() - start >= device.timeoutMs) {
+    return I2C_TIMEOUT;
+  }
+  return (I2C_Status)(-10 * error);
+}
+
+I2C_Status I2CBus::readPhase(I2C_Transaction& transaction)
+{
+  Device& device = _devices[transaction.device];
+  _transport->setTimeout(device.timeoutMs);
+
+  uint32_t start = millis();
+  uint8_t received = _transport->receive(device.address, transaction.rxData, transaction.rxLen);
+
+  if (received < transaction.rxLen) {
+    if (millis() - start >= device.timeoutMs) {
+      return I2C_TIMEOUT;
+    }
+    return received == 0 ? I2C_NACK_ON_ADDRESS : I2C_NACK_ON_DATA;
+  }
+  return I2C_OK;
+}
+
+void I2CBus::record(const I2C_Transaction& transaction, uint32_t startUs)
+{
+  if (!validDevice(transaction.device)) {
+    return;
+  }
+  I2C_Status status = transaction.status;
+  I2C_DeviceStats& stats = _devices[transaction.device].stats;
+  uint32_t latency = micros() - startUs;
+
+  stats.transactions++;
+  stats.lastLatencyUs = latency;
+  stats.totalLatencyUs += latency;
+  if (latency > stats.maxLatencyUs) {
+    stats.maxLatencyUs = latency;
+  }
+  if (status != I2C_OK) {
+    stats.errors++;
+    if (status == I2C_TIMEOUT) {
+      stats.timeouts++;
+    }
+  }
+
+  if (_trace != NULL) {
+    _trace(_devices[transaction.device].address, transaction);
+  }
+}
+
+void I2CBus::handleError(I2C_Status status)
+{
+  if (status == I2C_OK || status == I2C_NO_DEVICE || status == I2C_QUEUE_FULL) {
+    return;
+  }
+  if (isStuck()) {
+    recover();
+  }
+}
@@ -0,0 +1,173 @@
+/*
+  AirGradientI2C.h - Shared I2C bus manager for the AirGradient library
+  Coordinates several devices (SHT3x, SGP41, OLED, ...) on one bus, runs
+  queued transactions in batches, applies per-transaction timeouts and
+  recovers a bus whose SDA line is held low by a stuck slave.
+
+  The bus runs on an I2CTransport: WireI2CTransport for the Wire library
+  of the board, or I2CEmulator (AirGradientEmulator.h) to run the drivers
+  against emulated devices and scripted faults in a host build.
+*/
+
+#ifndef AirGradientI2C_h
+#define AirGradientI2C_h
+
+#include "Arduino.h"
+#include <Wire.h>
+
+// Error codes follow the Wire translation used by the TMP_RH driver
+// (-10 * endTransmission()) so they can be passed through unchanged.
+typedef enum {
+  I2C_OK = 0,
+
+  I2C_DATA_TOO_LONG = -10,
+  I2C_NACK_ON_ADDRESS = -20,
+  I2C_NACK_ON_DATA = -30,
+  I2C_UNKNOWN_ERROR = -40,
+
+  I2C_TIMEOUT = -50,
+  I2C_BUS_STUCK = -60,
+  I2C_QUEUE_FULL = -70,
+  I2C_NO_DEVICE = -80
+} I2C_Status;
+
+struct I2C_DeviceStats {
+  uint32_t transactions = 0;
+  uint32_t errors = 0;
+  uint32_t timeouts = 0;
+  uint32_t lastLatencyUs = 0;
+  uint32_t maxLatencyUs = 0;
+  uint32_t totalLatencyUs = 0;
+};
+
+// One write and/or read against a registered device. The buffers are owned
+// by the caller and must stay valid until the transaction has run.
+struct I2C_Transaction {
+  int8_t device = -1;
+  const uint8_t* txData = NULL;
+  uint8_t txLen = 0;
+  uint8_t* rxData = NULL;
+  uint8_t rxLen = 0;
+  // time the device needs between the write and the read phase
+  uint16_t delayMs = 0;
+  I2C_Status status = I2C_OK;
+};
+
+// Called after every transaction with the device address, e.g. to record
+// bus traffic (see AirGradientCapture.h). rxData is only valid on I2C_OK.
+typedef void (*I2C_TraceCallback)(uint8_t address, const I2C_Transaction& transaction);
+
+// What an I2CBus drives
+class I2CTransport
+{
+  public:
+    virtual ~I2CTransport() {}
+
+    // Bounds how long a device may stretch the clock or stall a transfer
+    virtual void setTimeout(uint16_t timeoutMs) = 0;
+    // One write transfer; returns the endTransmission() code: 0 ok, 1 data
+    // too long, 2 NACK on address, 3 NACK on data, 4 other, 5 timeout.
+    virtual uint8_t transmit(uint8_t address, const uint8_t* data, uint8_t len) = 0;
+    // One read transfer; returns the bytes received, fewer than len on error.
+    virtual uint8_t receive(uint8_t address, uint8_t* data, uint8_t len) = 0;
+
+    // Line access for I2CBus::recover(); canRecover() is false without it.
+    virtual bool canRecover() = 0;
+    virtual bool sdaLow() = 0;
+    // One SCL pulse with SDA released
+    virtual void pulseScl() = 0;
+    // STOP condition, then re-initializes the controller
+    virtual void stop() = 0;
+};
+
+class WireI2CTransport : public I2CTransport
+{
+  public:
+    WireI2CTransport(TwoWire& wire = Wire);
+
+    // Pins are only needed for bus recovery; -1 disables recovery.
+    void setPins(int sdaPin, int sclPin);
+
+    void setTimeout(uint16_t timeoutMs);
+    uint8_t transmit(uint8_t address, const uint8_t* data, uint8_t len);
+    uint8_t receive(uint8_t address, uint8_t* data, uint8_t len);
+
+    bool canRecover();
+    bool sdaLow();
+    void pulseScl();
+    void stop();
+
+  private:
+    TwoWire* _wire;
+    int _sdaPin = -1;
+    int _sclPin = -1;
+};
+
+class I2CBus
+{
+  public:
+    static const uint8_t MAX_DEVICES = 8;
+    static const uint8_t QUEUE_SIZE = 8;
+    static const uint16_t DEFAULT_TIMEOUT_MS = 50;
+
+    I2CBus(TwoWire& wire = Wire);
+    I2CBus(I2CTransport& transport);
+
+    // Pins are only needed for bus recovery with Wire; -1 disables recovery.
+    void begin(int sdaPin = -1, int sclPin = -1);
+
+    // Returns a device handle or I2C_NO_DEVICE if the table is full.
+    int8_t addDevice(uint8_t address, uint16_t timeoutMs = DEFAULT_TIMEOUT_MS);
+    uint8_t address(int8_t device) const;
+    // Handles run from 0 to getDeviceCount() - 1
+    uint8_t getDeviceCount() const;
+
+    I2C_Status write(int8_t device, const uint8_t* data, uint8_t len);
+    I2C_Status read(int8_t device, uint8_t* data, uint8_t len);
+    I2C_Status writeRead(int8_t device, const uint8_t* txData, uint8_t txLen,
+                         uint8_t* rxData, uint8_t rxLen, uint16_t delayMs = 0);
+
+    // Queued transactions are executed together by flush(): all write phases
+    // first, then a single wait for the slowest device, then all read phases.
+    I2C_Status queue(I2C_Transaction& transaction);
+    uint8_t pending() const;
+    uint8_t flush();
+
+    // Clocks SCL up to 9 times until the slave releases SDA, then issues a
+    // STOP condition and re-initializes the controller.
+    bool recover();
+    bool isStuck() const;
+    uint32_t getRecoveryCount() const;
+
+    const I2C_DeviceStats& getStats(int8_t device) const;
+    void resetStats();
+
+    void setTraceCallback(I2C_TraceCallback callback);
+
+  private:
+    struct Device {
+      uint8_t address;
+      uint16_t timeoutMs;
+      I2C_DeviceStats stats;
+    };
+
+    WireI2CTransport _wireTransport;
+    I2CTransport* _transport;
+
+    Device _devices[MAX_DEVICES];
+    uint8_t _deviceCount = 0;
+
+    I2C_Transaction* _queue[QUEUE_SIZE];
+    uint8_t _queueCount = 0;
+
+    uint32_t _recoveries = 0;
+    I2C_TraceCallback _trace = NULL;
+
+    bool validDevice(int8_t device) const;
+    I2C_Status writePhase(I2C_Transaction& transaction);
+    I2C_Status readPhase(I2C_Transaction& transaction);
+    void record(const I2C_Transaction& transaction, uint32_t startUs);
+    void handleError(I2C_Status status);
+};
+
+#endif
@@ -0,0 +1,475 @@
+/*
+  AirGradientJson.cpp - Streaming JSON field extractor for the AirGradient library
+*/
+
+#include "AirGradientJson.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool isWhitespace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Finds segment n of a path: a key up to the next '.' or '[', or an array
+// element including its brackets.
+static bool segmentAt(const char* path, uint8_t n, const char** start, uint8_t* length)
+{
+  const char* p = path;
+  for (uint8_t i = 0; ; i++) {
+    if (*p == '\0') {
+      return false;
+    }
+    const char* begin = p;
+    if (*p == '[') {
+      while (*p != '\0' && *p != ']') {
+        p++;
+      }
+      if (*p == ']') {
+        p++;
+      }
+    } else {
+      while (*p != '\0' && *p != '.' && *p != '[') {
+        p++;
+      }
+    }
+    if (i == n) {
+      *start = begin;
+      *length = p - begin;
+      return true;
+    }
+    if (*p == '.') {
+      p++;
+    }
+  }
+}
+
+JsonExtractor::JsonExtractor(const JsonField* fields, uint8_t count)
+{
+  _fields = fields;
+  _count = count > MAX_FIELDS ? MAX_FIELDS : count;
+  reset();
+}
+
+void JsonExtractor::reset()
+{
+  _state = STATE_VALUE;
+  _error = JSON_MORE;
+  _depth = 0;
+  _arrays = 0;
+  _targets = _count == 32 ? 0xFFFFFFFF : ((uint32_t)1 << _count) - 1;
+  _found = 0;
+  _bytes = 0;
+  _length = 0;
+  _escape = false;
+  _unicode = 0;
+}
+
+JSON_Status JsonExtractor::feed(const char* data, size_t length)
+{
+  for (size_t i = 0; i < length && _error == JSON_MORE; i++) {
+    _bytes++;
+    _error = step(data[i]);
+  }
+  return _error;
+}
+
+JSON_Status JsonExtractor::parse(Stream& stream, uint32_t timeoutMs)
+{
+  char buf[64];
+  uint32_t lastData = millis();
+
+  reset();
+  while (_error == JSON_MORE) {
+    int available = stream.available();
+    if (available <= 0) {
+      if (millis() - lastData >= timeoutMs) {
+        _error = JSON_TIMEOUT;
+        break;
+      }
+      yield();
+      continue;
+    }
+    size_t n = stream.readBytes(buf, available < (int)sizeof(buf) ? available : sizeof(buf));
+    feed(buf, n);
+    lastData = millis();
+  }
+  return _error;
+}
+
+bool JsonExtractor::isFound(uint8_t field) const
+{
+  return field < _count && (_found & ((uint32_t)1 << field));
+}
+
+uint32_t JsonExtractor::getFound() const
+{
+  return _found;
+}
+
+uint32_t JsonExtractor::getBytes() const
+{
+  return _bytes;
+}
+
+static uint32_t fnv1a(uint32_t hash, const uint8_t* data, size_t length)
+{
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ data[i]) * 16777619UL;
+  }
+  return hash;
+}
+
+uint32_t JsonExtractor::getHash() const
+{
+  uint32_t hash = fnv1a(2166136261UL, (const uint8_t*)&_found, sizeof(_found));
+  for (uint8_t i = 0; i < _count; i++) {
+    if (!isFound(i)) {
+      continue;
+    }
+    const JsonField& field = _fields[i];
+    size_t length = field.type == JSON_TYPE_STRING ? strlen((const char*)field.value) + 1 : field.size;
+    hash = fnv1a(hash, (const uint8_t*)field.value, length);
+  }
+  return hash;
+}
+
+JSON_Status JsonExtractor::step(char c)
+{
+  switch (_state) {
+    case STATE_VALUE_OR_END:
+      if (c == ']') {
+        close();
+        return _state == STATE_DONE ? JSON_OK : JSON_MORE;
+      }
+    // fall through
+    case STATE_VALUE:
+      if (isWhitespace(c)) {
+        return JSON_MORE;
+      }
+      if (c == '{' || c == '[') {
+        if (!open(c == '[')) {
+          return JSON_TOO_DEEP;
+        }
+        if (c == '[') {
+          selectIndex();
+        }
+        _state = c == '[' ? STATE_VALUE_OR_END : STATE_KEY_OR_END;
+      } else if (c == '"') {
+        startString();
+        _state = STATE_STRING;
+      } else if (c == '-' || (c >= '0' && c <= '9')) {
+        _buffer[0] = c;
+        _length = 1;
+        _state = STATE_NUMBER;
+      } else if (c >= 'a' && c <= 'z') {
+        _buffer[0] = c;
+        _length = 1;
+        _state = STATE_LITERAL;
+      } else {
+        return JSON_SYNTAX_ERROR;
+      }
+      return JSON_MORE;
+
+    case STATE_KEY_OR_END:
+      if (c == '}') {
+        close();
+        return _state == STATE_DONE ? JSON_OK : JSON_MORE;
+      }
+    // fall through
+    case STATE_KEY_START:
+      if (isWhitespace(c)) {
+        return JSON_MORE;
+      }
+      if (c != '"') {
+        return JSON_SYNTAX_ERROR;
+      }
+      _length = 0;
+      _escape = false;
+      _state = STATE_KEY;
+      return JSON_MORE;
+
+    case STATE_KEY:
+      if (!_escape && c == '"') {
+        _state = STATE_COLON;
+      } else if (!_escape && c == '\\') {
+        _escape = true;
+      } else {
+        // a key longer than the buffer can't match any path
+        if (_length < KEY_SIZE) {
+          _buffer[_length++] = c;
+        }
+        _escape = false;
+      }
+      return JSON_MORE;
+
+    case STATE_COLON:
+      if (isWhitespace(c)) {
+        return JSON_MORE;
+      }
+      if (c != ':') {
+        return JSON_SYNTAX_ERROR;
+      }
+      select(_buffer, _length);
+      _state = STATE_VALUE;
+      return JSON_MORE;
+
+    case STATE_STRING:
+      if (_unicode > 0) {
+        uint8_t digit;
+        if (c >= '0' && c <= '9') {
+          digit = c - '0';
+        } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+          digit = (c | 0x20) - 'a' + 10;
+        } else {
+          return JSON_SYNTAX_ERROR;
+        }
+        _codePoint = (_codePoint << 4) | digit;
+        if (--_unicode == 0) {
+          appendCodePoint();
+        }
+      } else if (_escape) {
+        _escape = false;
+        switch (c) {
+          case 'n': appendString('\n'); break;
+          case 't': appendString('\t'); break;
+          case 'r': appendString('\r'); break;
+          case 'b': appendString('\b'); break;
+          case 'f': appendString('\f'); break;
+          case 'u': _unicode = 4; _codePoint = 0; break;
+          default: appendString(c); break;
+        }
+      } else if (c == '\\') {
+        _escape = true;
+      } else if (c == '"') {
+        return endValue();
+      } else {
+        appendString(c);
+      }
+      return JSON_MORE;
+
+    case STATE_NUMBER:
+      if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+        if (_length >= KEY_SIZE - 1) {
+          return JSON_SYNTAX_ERROR;
+        }
+        _buffer[_length++] = c;
+        return JSON_MORE;
+      }
+      if (endScalar(false) == JSON_SYNTAX_ERROR) {
+        return JSON_SYNTAX_ERROR;
+      }
+      return _state == STATE_DONE ? JSON_OK : step(c);
+
+    case STATE_LITERAL:
+      if (c >= 'a' && c <= 'z') {
+        if (_length >= KEY_SIZE - 1) {
+          return JSON_SYNTAX_ERROR;
+        }
+        _buffer[_length++] = c;
+        return JSON_MORE;
+      }
+      if (endScalar(true) == JSON_SYNTAX_ERROR) {
+        return JSON_SYNTAX_ERROR;
+      }
+      return _state == STATE_DONE ? JSON_OK : step(c);
+
+    case STATE_AFTER_VALUE: {
+      if (isWhitespace(c)) {
+        return JSON_MORE;
+      }
+      bool inArray = _arrays & ((uint32_t)1 << (_depth - 1));
+      if (c == ',') {
+        if (inArray) {
+          if (_depth - 1 <= MAX_PATH_DEPTH) {
+            _index[_depth - 1]++;
+          }
+          selectIndex();
+          _state = STATE_VALUE;
+        } else {
+          _state = STATE_KEY_START;
+        }
+        return JSON_MORE;
+      }
+      if (c == (inArray ? ']' : '}')) {
+        close();
+        return _state == STATE_DONE ? JSON_OK : JSON_MORE;
+      }
+      return JSON_SYNTAX_ERROR;
+    }
+
+    case STATE_DONE:
+      return JSON_OK;
+
+    default:
+      return JSON_SYNTAX_ERROR;
+  }
+}
+
+bool JsonExtractor::open(bool array)
+{
+  if (_depth >= MAX_NESTING) {
+    return false;
+  }
+  // the container keeps the fields that matched the path up to it
+  if (_depth <= MAX_PATH_DEPTH) {
+    _masks[_depth] = _targets;
+    _index[_depth] = 0;
+  }
+  if (array) {
+    _arrays |= (uint32_t)1 << _depth;
+  } else {
+    _arrays &= ~((uint32_t)1 << _depth);
+  }
+  _depth++;
+  return true;
+}
+
+void JsonExtractor::close()
+{
+  _depth--;
+  _state = _depth == 0 ? STATE_DONE : STATE_AFTER_VALUE;
+}
+
+uint32_t JsonExtractor::mask() const
+{
+  return _depth > 0 && _depth - 1 <= MAX_PATH_DEPTH ? _masks[_depth - 1] : 0;
+}
+
+// Narrows the fields of the current container to those whose next path
+// segment is the key or array element just read.
+void JsonExtractor::select(const char* segment, uint8_t length)
+{
+  uint32_t candidates = length < KEY_SIZE ? mask() : 0;
+  _targets = 0;
+  for (uint8_t i = 0; candidates != 0; i++, candidates >>= 1) {
+    const char* start;
+    uint8_t segmentLength;
+    if ((candidates & 1) && segmentAt(_fields[i].path, _depth - 1, &start, &segmentLength)
+        && segmentLength == length && memcmp(start, segment, length) == 0) {
+      _targets |= (uint32_t)1 << i;
+    }
+  }
+}
+
+void JsonExtractor::selectIndex()
+{
+  if (mask() == 0) {
+    _targets = 0;
+    return;
+  }
+  char segment[8];
+  uint8_t length = snprintf(segment, sizeof(segment), "[%u]", _index[_depth - 1]);
+  select(segment, length);
+}
+
+bool JsonExtractor::isLeaf(uint8_t field) const
+{
+  const char* start;
+  uint8_t length;
+  return !segmentAt(_fields[field].path, _depth, &start, &length);
+}
+
+void JsonExtractor::startString()
+{
+  _stringLength = 0;
+  _escape = false;
+  _unicode = 0;
+
+  // only string fields that end here are written to
+  uint32_t targets = _targets;
+  _targets = 0;
+  for (uint8_t i = 0; targets != 0; i++, targets >>= 1) {
+    if ((targets & 1) && _fields[i].type == JSON_TYPE_STRING && _fields[i].size > 0 && isLeaf(i)) {
+      _targets |= (uint32_t)1 << i;
+      ((char*)_fields[i].value)[0] = '\0';
+    }
+  }
+}
+
+void JsonExtractor::appendString(char c)
+{
+  uint32_t targets = _targets;
+  for (uint8_t i = 0; targets != 0; i++, targets >>= 1) {
+    if ((targets & 1) && _stringLength + 1u < _fields[i].size) {
+      ((char*)_fields[i].value)[_stringLength] = c;
+    }
+  }
+  _stringLength++;
+}
+
+void JsonExtractor::appendCodePoint()
+{
+  // UTF-8; surrogate pairs are not combined
+  if (_codePoint < 0x80) {
+    appendString(_codePoint);
+  } else if (_codePoint < 0x800) {
+    appendString(0xC0 | (_codePoint >> 6));
+    appendString(0x80 | (_codePoint & 0x3F));
+  } else {
+    appendString(0xE0 | (_codePoint >> 12));
+    appendString(0x80 | ((_codePoint >> 6) & 0x3F));
+    appendString(0x80 | (_codePoint & 0x3F));
+  }
+}
+
+JSON_Status JsonExtractor::endScalar(bool literal)
+{
+  _buffer[_length] = '\0';
+
+  bool isBool = false;
+  bool value = false;
+  double number = 0;
+  if (literal) {
+    if (strcmp(_buffer, "true") == 0 || strcmp(_buffer, "false") == 0) {
+      isBool = true;
+      value = _buffer[0] == 't';
+    } else if (strcmp(_buffer, "null") != 0) {
+      return JSON_SYNTAX_ERROR;
+    }
+  } else {
+    char* end;
+    number = strtod(_buffer, &end);
+    if (end != _buffer + _length) {
+      return JSON_SYNTAX_ERROR;
+    }
+  }
+
+  uint32_t targets = _targets;
+  for (uint8_t i = 0; targets != 0; i++, targets >>= 1) {
+    if (!(targets & 1) || !isLeaf(i)) {
+      continue;
+    }
+    const JsonField& field = _fields[i];
+    if (literal && isBool && field.type == JSON_TYPE_BOOL) {
+      *(bool*)field.value = value;
+    } else if (!literal && field.type == JSON_TYPE_INT) {
+      // truncated, as an assignment from a float would
+      *(int32_t*)field.value = number;
+    } else if (!literal && field.type == JSON_TYPE_FLOAT) {
+      *(float*)field.value = number;
+    } else {
+      continue;
+    }
+    _found |= (uint32_t)1 << i;
+  }
+  return endValue();
+}
+
+JSON_Status JsonExtractor::endValue()
+{
+  if (_state == STATE_STRING) {
+    uint32_t targets = _targets;
+    for (uint8_t i = 0; targets != 0; i++, targets >>= 1) {
+      if (targets & 1) {
+        uint16_t end = _stringLength < _fields[i].size ? _stringLength : _fields[i].size - 1;
+        ((char*)_fields[i].value)[end] = '\0';
+        _found |= (uint32_t)1 << i;
+      }
+    }
+  }
+  _state = _depth == 0 ? STATE_DONE : STATE_AFTER_VALUE;
+  return _state == STATE_DONE ? JSON_OK : JSON_MORE;
+}
@@ -0,0 +1,168 @@
+/*
+  AirGradientJson.h - Streaming JSON field extractor for the AirGradient library
+
+  Pulls a fixed set of values out of a JSON document in one pass while it
+  is read, without holding the document in RAM: the state is the current
+  key, one number and, per nesting level, the set of fields whose path
+  still matches. Strings are copied straight into the caller's buffers,
+  so they stay valid after parsing.
+
+    struct { char name[32]; char policy[24]; int32_t rco2; float atmp; bool offline; } d;
+
+    const JsonField fields[] = {
+      JSON_string("place.name", d.name),
+      JSON_int("indoor.current.rco2", d.rco2),
+      JSON_float("indoor.current.atmp", d.atmp),
+      JSON_bool("indoor.offline", d.offline),
+      JSON_string("outdoor.guidelines[0].title", d.policy)
+    };
+    JsonExtractor json(fields, 5);
+
+    http.useHTTP10(true);           // no chunked transfer encoding
+    if (http.GET() == 200 && json.parse(http.getStream()) == JSON_OK) ...
+
+  Paths are keys separated by '.', array elements are written as [n].
+  Fields that are missing, null or of a different type keep their value;
+  isFound() tells which ones were set. Strings longer than their buffer
+  are truncated. getHash() summarizes the extracted values, so a caller
+  can skip work when a new document carries the same ones.
+*/
+
+#ifndef AirGradientJson_h
+#define AirGradientJson_h
+
+#include "Arduino.h"
+#include "Stream.h"
+
+typedef enum {
+  JSON_OK = 0,
+  // the document is not complete yet, feed() more
+  JSON_MORE = 1,
+  JSON_SYNTAX_ERROR = -1,
+  JSON_TOO_DEEP = -2,
+  JSON_TIMEOUT = -3
+} JSON_Status;
+
+typedef enum {
+  JSON_TYPE_INT,
+  JSON_TYPE_FLOAT,
+  JSON_TYPE_BOOL,
+  JSON_TYPE_STRING
+} JSON_Type;
+
+struct JsonField {
+  const char* path;
+  JSON_Type type;
+  void* value;
+  // buffer size of a string, including the terminator
+  uint16_t size;
+};
+
+inline JsonField JSON_int(const char* path, int32_t& value)
+{
+  JsonField field = { path, JSON_TYPE_INT, &value, sizeof(value) };
+  return field;
+}
+
+inline JsonField JSON_float(const char* path, float& value)
+{
+  JsonField field = { path, JSON_TYPE_FLOAT, &value, sizeof(value) };
+  return field;
+}
+
+inline JsonField JSON_bool(const char* path, bool& value)
+{
+  JsonField field = { path, JSON_TYPE_BOOL, &value, sizeof(value) };
+  return field;
+}
+
+inline JsonField JSON_string(const char* path, char* buffer, uint16_t size)
+{
+  JsonField field = { path, JSON_TYPE_STRING, buffer, size };
+  return field;
+}
+
+template <size_t N>
+inline JsonField JSON_string(const char* path, char (&buffer)[N])
+{
+  return JSON_string(path, buffer, N);
+}
+
+class JsonExtractor
+{
+  public:
+    static const uint8_t MAX_FIELDS = 32;
+    // deepest level a path can reach; the document itself may nest deeper
+    static const uint8_t MAX_PATH_DEPTH = 8;
+    static const uint8_t MAX_NESTING = 32;
+    static const uint8_t KEY_SIZE = 32;
+
+    JsonExtractor(const JsonField* fields, uint8_t count);
+
+    // Starts a new document. Fields keep their values until overwritten.
+    void reset();
+
+    JSON_Status feed(const char* data, size_t length);
+    // Reads until the document is complete, resets first.
+    JSON_Status parse(Stream& stream, uint32_t timeoutMs = 5000);
+
+    bool isFound(uint8_t field) const;
+    uint32_t getFound() const;
+    uint32_t getBytes() const;
+    // FNV-1a over the found fields and their values
+    uint32_t getHash() const;
+
+  private:
+    typedef enum {
+      STATE_VALUE,
+      STATE_VALUE_OR_END,
+      STATE_KEY_OR_END,
+      STATE_KEY_START,
+      STATE_KEY,
+      STATE_COLON,
+      STATE_STRING,
+      STATE_NUMBER,
+      STATE_LITERAL,
+      STATE_AFTER_VALUE,
+      STATE_DONE,
+      STATE_ERROR
+    } State;
+
+    const JsonField* _fields;
+    uint8_t _count;
+
+    State _state;
+    JSON_Status _error;
+    uint8_t _depth;
+    uint32_t _arrays;
+    uint32_t _masks[MAX_PATH_DEPTH + 1];
+    uint16_t _index[MAX_PATH_DEPTH + 1];
+    // fields whose whole path is the value being read
+    uint32_t _targets;
+    uint32_t _found;
+    uint32_t _bytes;
+
+    // the key, number or literal being read
+    char _buffer[KEY_SIZE];
+    uint8_t _length;
+    bool _escape;
+    // hex digits of a unicode escape still to come
+    uint8_t _unicode;
+    uint16_t _codePoint;
+    uint16_t _stringLength;
+
+    JSON_Status step(char c);
+    bool open(bool array);
+    void close();
+    void select(const char* segment, uint8_t length);
+    void selectIndex();
+    void startString();
+    void appendString(char c);
+    void appendCodePoint();
+    JSON_Status endScalar(bool literal);
+    JSON_Status endValue();
+    bool isLeaf(uint8_t field) const;
+    uint32_t mask() const;
+};
+
+#endif
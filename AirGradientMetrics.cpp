@@ -0,0 +1,273 @@
+/*
+  AirGradientMetrics.cpp - OpenMetrics /metrics endpoint for the AirGradient library
+*/
+
+#include "AirGradientMetrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+struct MeasureMetric {
+  const char* name;
+  const char* help;
+  uint8_t decimals;
+};
+
+// In Measure_Field order
+static const MeasureMetric measureMetrics[MEASURE_COUNT] = {
+  { "airgradient_wifi_rssi_dbm", "WiFi signal strength", 0 },
+  { "airgradient_co2_ppm", "CO2 concentration", 0 },
+  { "airgradient_pm1_ugm3", "PM1.0 concentration", 0 },
+  { "airgradient_pm2_5_ugm3", "PM2.5 concentration", 0 },
+  { "airgradient_pm10_ugm3", "PM10 concentration", 0 },
+  { "airgradient_pm0_3_count", "Particles above 0.3 um per 100 ml", 0 },
+  { "airgradient_tvoc_index", "Sensirion VOC index", 0 },
+  { "airgradient_nox_index", "Sensirion NOx index", 0 },
+  { "airgradient_temperature_celsius", "Temperature", 2 },
+  { "airgradient_humidity_percent", "Relative humidity", 0 },
+  { "airgradient_boot", "Measurement cycles since boot", 0 }
+};
+
+static const uint32_t POWERS_OF_TEN[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+MetricsWriter::MetricsWriter(Print& out, char* buffer, size_t size)
+{
+  _out = &out;
+  _buffer = buffer;
+  _size = size;
+}
+
+void MetricsWriter::family(const char* name, const char* type, const char* help)
+{
+  line("# TYPE %s %s\n", name, type);
+  line("# HELP %s %s\n", name, help);
+}
+
+// Formatted from a scaled integer, without printf's float support, which
+// AVR lacks.
+void MetricsWriter::gauge(const char* name, float value, uint8_t decimals, const char* labels)
+{
+  decimals = decimals > 6 ? 6 : decimals;
+  // fewer decimals rather than a scaled value that overflows a 32 bit long
+  while (decimals > 0 && fabs(value) * POWERS_OF_TEN[decimals] >= 2147483647.0) {
+    decimals--;
+  }
+  uint32_t scale = POWERS_OF_TEN[decimals];
+  long scaled = lround(value * scale);
+  unsigned long magnitude = scaled < 0 ? -scaled : scaled;
+
+  // '.', up to 6 digits with leading zeros and the terminator
+  char fraction[8] = "";
+  if (decimals > 0) {
+    unsigned long digits = magnitude % scale;
+    fraction[0] = '.';
+    for (uint8_t i = decimals; i > 0; i--) {
+      fraction[i] = '0' + digits % 10;
+      digits /= 10;
+    }
+    fraction[decimals + 1] = '\0';
+  }
+  line("%s%s%s%s %s%lu%s\n", name, labels ? "{" : "", labels ? labels : "", labels ? "}" : "",
+       scaled < 0 ? "-" : "", magnitude / scale, fraction);
+}
+
+void MetricsWriter::counter(const char* name, uint32_t value, const char* labels)
+{
+  line("%s_total%s%s%s %lu\n", name, labels ? "{" : "", labels ? labels : "", labels ? "}" : "",
+       (unsigned long)value);
+}
+
+void MetricsWriter::finish()
+{
+  line("# EOF\n");
+  flush();
+}
+
+void MetricsWriter::flush()
+{
+  if (_length > 0) {
+    _out->write((const uint8_t*)_buffer, _length);
+    _bytes += _length;
+    _length = 0;
+  }
+}
+
+size_t MetricsWriter::getBytes() const
+{
+  return _bytes + _length;
+}
+
+// Appends one line, sending the buffer first if the line does not fit.
+// Lines longer than the whole buffer are cut.
+void MetricsWriter::line(const char* format, ...)
+{
+  va_list args;
+  for (uint8_t attempt = 0; attempt < 2; attempt++) {
+    va_start(args, format);
+    int n = vsnprintf(_buffer + _length, _size - _length, format, args);
+    va_end(args);
+    if (n < 0) {
+      return;
+    }
+    if (_length + n < _size) {
+      _length += n;
+      return;
+    }
+    if (_length == 0) {
+      // keep the line break so the output stays parseable
+      _length = _size - 1;
+      _buffer[_length - 1] = '\n';
+      return;
+    }
+    flush();
+  }
+}
+
+void MetricsServer::setMeasures(const Measures& measures)
+{
+  _measures = &measures;
+}
+
+void MetricsServer::setI2CBus(const I2CBus& bus)
+{
+  _i2c = &bus;
+}
+
+void MetricsServer::setCallback(MetricsCallback callback)
+{
+  _callback = callback;
+}
+
+int MetricsServer::handle(Client& client)
+{
+  uint32_t start = millis();
+  char line[LINE_SIZE];
+
+  // "GET /metrics HTTP/1.1", then skip the headers
+  if (!readLine(client, line, sizeof(line), start)) {
+    _errors++;
+    client.stop();
+    return 0;
+  }
+  bool isMetrics = strncmp(line, "GET /metrics", 12) == 0 && (line[12] == ' ' || line[12] == '?');
+  char header[LINE_SIZE];
+  do {
+    if (!readLine(client, header, sizeof(header), start)) {
+      _errors++;
+      client.stop();
+      return 0;
+    }
+  } while (header[0] != '\0');
+
+  int status = 200;
+  if (isMetrics) {
+    _requests++;
+    client.print("HTTP/1.0 200 OK\r\n"
+                 "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                 "Connection: close\r\n\r\n");
+    render(client);
+  } else {
+    _errors++;
+    status = 404;
+    client.print("HTTP/1.0 404 Not Found\r\nConnection: close\r\n\r\n");
+  }
+  client.flush();
+  client.stop();
+  return status;
+}
+
+void MetricsServer::render(Print& out)
+{
+  uint32_t startUs = micros();
+  MetricsWriter writer(out, _buffer, sizeof(_buffer));
+
+  if (_measures != NULL) {
+    for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+      Measure_Field field = (Measure_Field)i;
+      if (_measures->has(field)) {
+        const MeasureMetric& metric = measureMetrics[i];
+        writer.family(metric.name, "gauge", metric.help);
+        writer.gauge(metric.name, _measures->get(field), metric.decimals);
+      }
+    }
+  }
+
+  if (_i2c != NULL && _i2c->getDeviceCount() > 0) {
+    static const char* const names[] = {
+      "airgradient_i2c_transactions", "airgradient_i2c_errors", "airgradient_i2c_timeouts"
+    };
+    static const char* const help[] = {
+      "I2C transactions per device", "Failed I2C transactions per device", "Timed out I2C transactions per device"
+    };
+    char labels[24];
+    for (uint8_t k = 0; k < 3; k++) {
+      writer.family(names[k], "counter", help[k]);
+      for (int8_t d = 0; d < _i2c->getDeviceCount(); d++) {
+        const I2C_DeviceStats& stats = _i2c->getStats(d);
+        uint32_t value = k == 0 ? stats.transactions : k == 1 ? stats.errors : stats.timeouts;
+        snprintf(labels, sizeof(labels), "device=\"0x%02x\"", _i2c->address(d));
+        writer.counter(names[k], value, labels);
+      }
+    }
+    writer.family("airgradient_i2c_max_latency_seconds", "gauge", "Slowest I2C transaction per device");
+    for (int8_t d = 0; d < _i2c->getDeviceCount(); d++) {
+      snprintf(labels, sizeof(labels), "device=\"0x%02x\"", _i2c->address(d));
+      writer.gauge("airgradient_i2c_max_latency_seconds", _i2c->getStats(d).maxLatencyUs / 1e6, 6, labels);
+    }
+    writer.family("airgradient_i2c_recoveries", "counter", "I2C bus recoveries");
+    writer.counter("airgradient_i2c_recoveries", _i2c->getRecoveryCount());
+  }
+
+  if (_callback != NULL) {
+    _callback(writer);
+  }
+
+  writer.family("airgradient_uptime_seconds", "gauge", "Time since boot");
+  writer.gauge("airgradient_uptime_seconds", millis() / 1000);
+  writer.family("airgradient_metrics_requests", "counter", "Requests served on /metrics");
+  writer.counter("airgradient_metrics_requests", _requests);
+  writer.family("airgradient_metrics_render_seconds", "gauge", "Time the previous response took to render");
+  writer.gauge("airgradient_metrics_render_seconds", _lastRenderUs / 1e6, 6);
+  writer.finish();
+
+  _lastRenderUs = micros() - startUs;
+}
+
+bool MetricsServer::readLine(Client& client, char* line, uint8_t size, uint32_t start)
+{
+  uint8_t length = 0;
+  while (true) {
+    if (client.available() <= 0) {
+      if (!client.connected() || millis() - start >= REQUEST_TIMEOUT_MS) {
+        return false;
+      }
+      yield();
+      continue;
+    }
+    int c = client.read();
+    if (c == '\n') {
+      break;
+    }
+    if (c != '\r' && length < size - 1) {
+      line[length++] = c;
+    }
+  }
+  line[length] = '\0';
+  return true;
+}
+
+uint32_t MetricsServer::getRequests() const
+{
+  return _requests;
+}
+
+uint32_t MetricsServer::getErrors() const
+{
+  return _errors;
+}
+
+uint32_t MetricsServer::getLastRenderUs() const
+{
+  return _lastRenderUs;
+}
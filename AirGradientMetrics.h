@@ -0,0 +1,106 @@
+/*
+  AirGradientMetrics.h - OpenMetrics /metrics endpoint for the AirGradient library
+
+  Lets Prometheus style monitoring pull the readings a board already
+  has. MetricsServer answers GET /metrics from the cached Measures record
+  and the driver statistics it was given; nothing on the request path
+  talks to a sensor. The response is formatted line by line into a fixed
+  buffer that is written to the client whenever it fills up, so neither
+  the body nor its parts are built as a String.
+
+    WiFiServer server(9926);
+    MetricsServer metrics;
+    Measures latest;   // updated where the sensors are read
+
+    void setup() {
+      server.begin();
+      metrics.setMeasures(latest);
+      metrics.setI2CBus(i2c);
+    }
+
+    void loop() {
+      WiFiClient client = server.available();
+      if (client) {
+        metrics.handle(client);
+      }
+    }
+
+  Further statistics, e.g. of a PmsPowerManager, can be added with a
+  callback that writes them through the MetricsWriter. It must only read
+  cached values as well.
+*/
+
+#ifndef AirGradientMetrics_h
+#define AirGradientMetrics_h
+
+#include "Arduino.h"
+#include "Client.h"
+#include "AirGradientI2C.h"
+#include "AirGradientReport.h"
+
+class MetricsWriter
+{
+  public:
+    MetricsWriter(Print& out, char* buffer, size_t size);
+
+    // The # TYPE and # HELP lines of a metric family; type is "gauge" or
+    // "counter". Counter samples get the _total suffix.
+    void family(const char* name, const char* type, const char* help);
+    // labels are written inside the braces as is, e.g. "device=\"0x59\"";
+    // at most 6 decimals, fewer where the scaled value would overflow
+    void gauge(const char* name, float value, uint8_t decimals = 0, const char* labels = NULL);
+    void counter(const char* name, uint32_t value, const char* labels = NULL);
+
+    // Writes # EOF and sends what is left in the buffer.
+    void finish();
+    void flush();
+
+    size_t getBytes() const;
+
+  private:
+    Print* _out;
+    char* _buffer;
+    size_t _size;
+    size_t _length = 0;
+    size_t _bytes = 0;
+
+    void line(const char* format, ...);
+};
+
+class MetricsServer
+{
+  public:
+    static const uint16_t BUFFER_SIZE = 256;
+    static const uint16_t REQUEST_TIMEOUT_MS = 1000;
+    static const uint8_t LINE_SIZE = 64;
+
+    typedef void (*MetricsCallback)(MetricsWriter& writer);
+
+    void setMeasures(const Measures& measures);
+    void setI2CBus(const I2CBus& bus);
+    void setCallback(MetricsCallback callback);
+
+    // Answers one request and closes the connection. Returns the HTTP
+    // status sent, or 0 if no complete request arrived in time.
+    int handle(Client& client);
+    // Only the OpenMetrics body
+    void render(Print& out);
+
+    uint32_t getRequests() const;
+    uint32_t getErrors() const;
+    uint32_t getLastRenderUs() const;
+
+  private:
+    const Measures* _measures = NULL;
+    const I2CBus* _i2c = NULL;
+    MetricsCallback _callback = NULL;
+
+    char _buffer[BUFFER_SIZE];
+    uint32_t _requests = 0;
+    uint32_t _errors = 0;
+    uint32_t _lastRenderUs = 0;
+
+    bool readLine(Client& client, char* line, uint8_t size, uint32_t start);
+};
+
+#endif
@@ -0,0 +1,256 @@
+/*
+  AirGradientMhz19.cpp - Winsen MH-Z14A/MH-Z19B CO2 driver for the AirGradient library
+*/
+
+#include "AirGradientMhz19.h"
+
+const int MHZ14A = 14;
+const int MHZ19B = 19; // this one we use for AQI whatever
+
+const int MHZ14A_PREHEATING_TIME = 3 * 60 * 1000;
+const int MHZ19B_PREHEATING_TIME = 3 * 60 * 1000;
+
+const int MHZ14A_RESPONSE_TIME = 60 * 1000;
+const int MHZ19B_RESPONSE_TIME = 120 * 1000;
+
+const int STATUS_NO_RESPONSE = -2;
+const int STATUS_CHECKSUM_MISMATCH = -3;
+const int STATUS_INCOMPLETE = -4;
+const int STATUS_NOT_READY = -5;
+const int STATUS_PWM_NOT_CONFIGURED = -6;
+const int STATUS_SERIAL_NOT_CONFIGURED = -7;
+
+Mhz19Driver* Mhz19Driver::_pwmInstance = NULL;
+
+void Mhz19Driver::begin(Stream& stream, uint8_t type)
+{
+  _stream = &stream;
+  _type = type;
+  _serialConfigured = true;
+}
+
+/**
+ * Enables or disables the debug mode (more logging).
+ */
+void Mhz19Driver::setDebug(bool enable) {
+  _debug = enable;
+  if (_debug) {
+    Serial.println(F("MHZ: debug mode ENABLED"));
+  } else {
+    Serial.println(F("MHZ: debug mode DISABLED"));
+  }
+}
+
+bool Mhz19Driver::isPreHeating() {
+  if (_type == MHZ14A) {
+    return millis() < (MHZ14A_PREHEATING_TIME);
+  } else if (_type == MHZ19B) {
+    return millis() < (MHZ19B_PREHEATING_TIME);
+  } else {
+    Serial.println(F("MHZ::isPreHeating() => UNKNOWN SENSOR"));
+    return false;
+  }//
+}
+
+bool Mhz19Driver::isReady() {
+  if (isPreHeating()) return false;
+  if (_type == MHZ14A)
+    return _lastRequest < millis() - MHZ14A_RESPONSE_TIME;
+  else if (_type == MHZ19B)
+    return _lastRequest < millis() - MHZ19B_RESPONSE_TIME;
+  else {
+    Serial.print(F("MHZ::isReady() => UNKNOWN SENSOR \""));
+    Serial.print(_type);
+    Serial.println(F("\""));
+    return true;
+  }
+}
+
+
+int Mhz19Driver::read() { 
+
+  int firstRead = readInternal();
+  int secondRead = readInternal();
+
+  if (abs(secondRead - firstRead) > 50) {
+      // we arrive here sometimes when the CO2 sensor is not connected
+      // could possibly also be fixed with a pull-up resistor on Rx but if we forget this then ...
+      Serial.println("MHZ::read() inconsistent values");
+      return -1;
+  }
+
+  Serial.println("MHZ::read(1) " + String(firstRead));
+  Serial.println("MHZ::read(2) " + String(secondRead));
+
+  // TODO: return average?
+  return secondRead;
+}
+
+int Mhz19Driver::readInternal() {
+  if (!_serialConfigured) {
+    if (_debug) Serial.println(F("-- serial is not configured"));
+    return STATUS_SERIAL_NOT_CONFIGURED;
+  }
+  // if (!isReady()) return STATUS_NOT_READY;
+  if (_debug) Serial.println(F("-- read CO2 uart ---"));
+  byte cmd[9] = {0xFF, 0x01, 0x86, 0x00, 0x00, 0x00, 0x00, 0x00, 0x79};
+  unsigned char response[9];  // for answer
+
+  if (_debug) Serial.print(F("  >> Sending CO2 request"));
+  _stream->write(cmd, 9);  // request PPM CO2
+  _lastRequest = millis();
+
+  // clear the buffer
+  memset(response, 0, 9);
+
+  int waited = 0;
+  while (_stream->available() == 0) {
+    if (_debug) Serial.print(".");
+    delay(100);  // wait a short moment to avoid false reading
+    if (waited++ > 10) {
+      if (_debug) Serial.println(F("No response after 10 seconds"));
+      _stream->flush();
+      return STATUS_NO_RESPONSE;
+    }
+  }
+  if (_debug) Serial.println();
+
+  // The serial stream can get out of sync. The response starts with 0xff, try
+  // to resync.
+  // TODO: I think this might be wrong any only happens during initialization?
+  boolean skip = false;
+  while (_stream->available() > 0 && (unsigned char)_stream->peek() != 0xFF) {
+    if (!skip) {
+      Serial.print(F("MHZ: - skipping unexpected readings:"));
+      skip = true;
+    }
+    Serial.print(" ");
+    Serial.print(_stream->peek(), HEX);
+    _stream->read();
+  }
+  if (skip) Serial.println();
+
+  if (_stream->available() > 0) {
+    int count = _stream->readBytes(response, 9);
+    if (count < 9) {
+      _stream->flush();
+      return STATUS_INCOMPLETE;
+    }
+  } else {
+    _stream->flush();
+    return STATUS_INCOMPLETE;
+  }
+
+  if (_debug) {
+    // print out the response in hexa
+    Serial.print(F("  << "));
+    for (int i = 0; i < 9; i++) {
+      Serial.print(response[i], HEX);
+      Serial.print(F("  "));
+    }
+    Serial.println(F(""));
+  }
+
+  // checksum
+  byte check = getCheckSum(response);
+  if (response[8] != check) {
+    Serial.println(F("MHZ: Checksum not OK!"));
+    Serial.print(F("MHZ: Received: "));
+    Serial.println(response[8], HEX);
+    Serial.print(F("MHZ: Should be: "));
+    Serial.println(check, HEX);
+    _temperature = STATUS_CHECKSUM_MISMATCH;
+    _stream->flush();
+    return STATUS_CHECKSUM_MISMATCH;
+  }
+
+  int ppm_uart = 256 * (unsigned int)response[2] + (unsigned int)response[3];
+
+  _temperature = response[4] - 44;  // - 40;
+
+  byte status = response[5];
+  if (_debug) {
+    Serial.print(F(" # PPM UART: "));
+    Serial.println(ppm_uart);
+    Serial.print(F(" # temperature? "));
+    Serial.println(_temperature);
+  }
+
+  // Is always 0 for version 14a  and 19b
+  // Version 19a?: status != 0x40
+  if (_debug && status != 0) {
+    Serial.print(F(" ! Status maybe not OK ! "));
+    Serial.println(status, HEX);
+  } else if (_debug) {
+    Serial.print(F(" Status  OK: "));
+    Serial.println(status, HEX);
+  }
+
+  _stream->flush();
+  return ppm_uart;
+}
+
+
+
+uint8_t Mhz19Driver::getCheckSum(unsigned char* packet) {
+  if (!_serialConfigured) {
+    if (_debug) Serial.println(F("-- serial is not configured"));
+    return STATUS_SERIAL_NOT_CONFIGURED;
+  }
+  if (_debug) Serial.println(F("  getCheckSum()"));
+  byte i;
+  unsigned char checksum = 0;
+  for (i = 1; i < 8; i++) {
+    checksum += packet[i];
+  }
+  checksum = 0xff - checksum;
+  checksum += 1;
+  return checksum;
+}
+
+void Mhz19Driver::beginPwm(uint8_t pin, uint16_t range) {
+  endPwm();
+  _pwm.setRange(range);
+  _pwm.reset();
+  _pwmPin = pin;
+  _pwmInstance = this;
+  pinMode(pin, INPUT);
+  attachInterrupt(digitalPinToInterrupt(pin), onPwmEdge, CHANGE);
+}
+
+void Mhz19Driver::endPwm() {
+  if (_pwmPin < 0) return;
+  detachInterrupt(digitalPinToInterrupt(_pwmPin));
+  _pwmPin = -1;
+  if (_pwmInstance == this) _pwmInstance = NULL;
+}
+
+void IRAM_ATTR Mhz19Driver::onPwmEdge() {
+  Mhz19Driver* self = _pwmInstance;
+  if (self) {
+    self->_pwm.onEdge(digitalRead(self->_pwmPin) == HIGH, micros());
+  }
+}
+
+// Never blocks: returns the value of the last complete PWM cycle.
+int Mhz19Driver::readPwm() {
+  if (_pwmPin < 0) return STATUS_PWM_NOT_CONFIGURED;
+
+  // micros() too: an edge after it would put the last cycle in its future
+  noInterrupts();
+  int ppm = _pwm.ppm();
+  uint32_t cycles = _pwm.cycles();
+  bool stale = _pwm.isStale(micros());
+  interrupts();
+
+  if (cycles == 0) return STATUS_NOT_READY;
+  if (stale) return STATUS_NO_RESPONSE;
+  return ppm;
+}
+
+uint32_t Mhz19Driver::getPwmCycles() {
+  noInterrupts();
+  uint32_t cycles = _pwm.cycles();
+  interrupts();
+  return cycles;
+}
@@ -0,0 +1,61 @@
+/*
+  AirGradientMhz19.h - Winsen MH-Z14A/MH-Z19B CO2 driver for the AirGradient library
+*/
+
+#ifndef AirGradientMhz19_h
+#define AirGradientMhz19_h
+
+#include "Arduino.h"
+#include "Stream.h"
+#include "AirGradientMhz19Pwm.h"
+
+//MHZ19 CONSTANTS START
+// types of sensors.
+extern const int MHZ14A;
+extern const int MHZ19B;
+
+// status codes
+extern const int STATUS_NO_RESPONSE;
+extern const int STATUS_CHECKSUM_MISMATCH;
+extern const int STATUS_INCOMPLETE;
+extern const int STATUS_NOT_READY;
+extern const int STATUS_PWM_NOT_CONFIGURED;
+//MHZ19 CONSTANTS END
+
+class Mhz19Driver
+{
+  public:
+    void begin(Stream& stream, uint8_t type);
+    void setDebug(bool enable);
+    bool isPreHeating();
+    bool isReady();
+
+    int read();
+
+    // PWM capture: a pin-change interrupt timestamps the edges of the PWM
+    // output and the ppm value is updated once per cycle in the background.
+    // Only one sensor per sketch can use PWM capture.
+    void beginPwm(uint8_t pin, uint16_t range = 5000);
+    void endPwm();
+    int readPwm();
+    uint32_t getPwmCycles();
+
+  private:
+    int readInternal();
+    uint8_t getCheckSum(unsigned char *packet);
+
+    uint8_t _type, _temperature;
+    bool _debug = false;
+    bool _serialConfigured = false;
+    unsigned long _lastRequest = 0;
+
+    Stream* _stream = NULL;
+
+    int8_t _pwmPin = -1;
+    Mhz19PwmDecoder _pwm;
+
+    static Mhz19Driver* _pwmInstance;
+    static void IRAM_ATTR onPwmEdge();
+};
+
+#endif
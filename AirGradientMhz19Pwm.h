@@ -0,0 +1,119 @@
+/*
+  AirGradientMhz19Pwm.h - Edge timing decoder for the MH-Z19 PWM output
+  The sensor repeats a 1004ms cycle: 2ms high, (cycle - 4ms) * ppm / range
+  high, the rest low, ending with 2ms low. The decoder is fed with
+  timestamped edges (from a pin-change interrupt or a recorded trace) and
+  has no Arduino dependencies so it can be exercised on the host.
+
+  onEdge() runs in the interrupt handler; everything else reads what it
+  writes, so call it with interrupts masked.
+*/
+
+#ifndef AirGradientMhz19Pwm_h
+#define AirGradientMhz19Pwm_h
+
+#include <stdint.h>
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+class Mhz19PwmDecoder
+{
+  public:
+    static const uint32_t CYCLE_US = 1004000;
+    // accepted deviation of a measured cycle from the nominal length
+    static const uint32_t CYCLE_TOLERANCE_US = 50000;
+    // no valid cycle for this long: sensor unplugged or output stuck
+    static const uint32_t STALE_US = 3 * CYCLE_US;
+
+    Mhz19PwmDecoder(uint16_t range = 5000) : _range(range) {}
+
+    void setRange(uint16_t range) { _range = range; }
+
+    // Call on every edge with the new pin level and a microsecond timestamp.
+    void IRAM_ATTR onEdge(bool high, uint32_t timestampUs)
+    {
+      if (!high) {
+        _lastFall = timestampUs;
+        _haveFall = _haveRise;
+        return;
+      }
+      if (_haveFall) {
+        uint32_t highUs = _lastFall - _lastRise;
+        uint32_t lowUs = timestampUs - _lastFall;
+        int ppm = ppmFromTiming(highUs, lowUs, _range);
+        if (ppm >= 0) {
+          _ppm = ppm;
+          _cycles++;
+          _lastCycle = timestampUs;
+        } else {
+          _invalidCycles++;
+        }
+      }
+      _lastRise = timestampUs;
+      _haveRise = true;
+      _haveFall = false;
+    }
+
+    // ppm = range * (Th - 2ms) / (Th + Tl - 4ms), -1 if the timing does not
+    // describe a plausible cycle.
+    static int ppmFromTiming(uint32_t highUs, uint32_t lowUs, uint16_t range)
+    {
+      uint32_t cycle = highUs + lowUs;
+      if (cycle + CYCLE_TOLERANCE_US < CYCLE_US || cycle > CYCLE_US + CYCLE_TOLERANCE_US)
+        return -1;
+      if (highUs < 2000)
+        return -1;
+      uint32_t span = cycle - 4000;
+      uint32_t active = highUs - 2000;
+      if (active > span)
+        active = span;
+      // 64 bit product: range * active exceeds 32 bits for long cycles
+      return (int)(((uint64_t)range * active + span / 2) / span);
+    }
+
+    int ppm() const { return _ppm; }
+    uint32_t cycles() const { return _cycles; }
+    uint32_t invalidCycles() const { return _invalidCycles; }
+    uint32_t lastCycleUs() const { return _lastCycle; }
+
+    // True if no valid cycle ended within STALE_US before nowUs. Once stale
+    // it stays so until the next valid cycle: micros() wraps every 71
+    // minutes, after which a stuck line would make the last value look
+    // recent again. Needs a call at least that often to notice.
+    bool isStale(uint32_t nowUs)
+    {
+      if (_stale && _staleCycles == _cycles)
+        return true;
+      _stale = nowUs - _lastCycle > STALE_US;
+      _staleCycles = _cycles;
+      return _stale;
+    }
+
+    void reset()
+    {
+      _haveRise = _haveFall = false;
+      _ppm = -1;
+      _cycles = _invalidCycles = 0;
+      _stale = false;
+    }
+
+  private:
+    uint16_t _range;
+
+    // written by onEdge()
+    volatile uint32_t _lastRise = 0;
+    volatile uint32_t _lastFall = 0;
+    volatile bool _haveRise = false;
+    volatile bool _haveFall = false;
+    volatile int _ppm = -1;
+    volatile uint32_t _cycles = 0;
+    volatile uint32_t _invalidCycles = 0;
+    volatile uint32_t _lastCycle = 0;
+
+    bool _stale = false;
+    uint32_t _staleCycles = 0;
+};
+
+#endif
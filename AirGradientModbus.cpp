@@ -0,0 +1,64 @@
+/*
+  AirGradientModbus.cpp - Minimal Modbus RTU framing for the AirGradient library
+*/
+
+#include "AirGradientModbus.h"
+
+uint16_t Modbus_crc16(const uint8_t* data, size_t len)
+{
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      if (crc & 0x0001)
+        crc = (crc >> 1) ^ 0xA001;
+      else
+        crc >>= 1;
+    }
+  }
+  return crc;
+}
+
+uint8_t Modbus_buildReadRequest(uint8_t address, uint8_t function, uint16_t startRegister,
+                                uint16_t count, uint8_t* frame)
+{
+  frame[0] = address;
+  frame[1] = function;
+  frame[2] = startRegister >> 8;
+  frame[3] = startRegister & 0xFF;
+  frame[4] = count >> 8;
+  frame[5] = count & 0xFF;
+
+  // the CRC is the only little-endian field of the frame
+  uint16_t crc = Modbus_crc16(frame, 6);
+  frame[6] = crc & 0xFF;
+  frame[7] = crc >> 8;
+  return MODBUS_REQUEST_SIZE;
+}
+
+Modbus_Status Modbus_decodeReadResponse(const uint8_t* frame, size_t len, uint8_t address,
+                                        uint8_t function, uint16_t* registers, uint16_t count)
+{
+  if (len < 5 || frame[0] != address)
+    return MODBUS_BAD_RESPONSE;
+
+  if (frame[1] == (function | 0x80)) {
+    uint16_t crc = Modbus_crc16(frame, 3);
+    if (frame[3] != (crc & 0xFF) || frame[4] != (crc >> 8))
+      return MODBUS_CRC_ERROR;
+    return MODBUS_EXCEPTION;
+  }
+
+  size_t expected = MODBUS_RESPONSE_SIZE(count);
+  if (frame[1] != function || frame[2] != 2 * count || len < expected)
+    return MODBUS_BAD_RESPONSE;
+
+  uint16_t crc = Modbus_crc16(frame, expected - 2);
+  if (frame[expected - 2] != (crc & 0xFF) || frame[expected - 1] != (crc >> 8))
+    return MODBUS_CRC_ERROR;
+
+  for (uint16_t i = 0; i < count; i++) {
+    registers[i] = (frame[3 + 2 * i] << 8) | frame[4 + 2 * i];
+  }
+  return MODBUS_OK;
+}
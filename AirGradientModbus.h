@@ -0,0 +1,40 @@
+/*
+  AirGradientModbus.h - Minimal Modbus RTU framing for the AirGradient library
+  Builds read requests and decodes read responses for sensors such as the
+  Senseair S8 that speak Modbus RTU over a UART.
+*/
+
+#ifndef AirGradientModbus_h
+#define AirGradientModbus_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Negative values follow the return codes of S8Driver::getCO2_Raw().
+typedef enum {
+  MODBUS_OK = 0,
+  MODBUS_WRITE_FAILED = -2,
+  MODBUS_TIMEOUT = -3,
+  MODBUS_CRC_ERROR = -4,
+  MODBUS_BAD_RESPONSE = -5,
+  MODBUS_EXCEPTION = -6
+} Modbus_Status;
+
+#define MODBUS_READ_HOLDING_REGISTERS 0x03
+#define MODBUS_READ_INPUT_REGISTERS 0x04
+
+#define MODBUS_REQUEST_SIZE 8
+#define MODBUS_RESPONSE_SIZE(count) (5 + 2 * (count))
+
+uint16_t Modbus_crc16(const uint8_t* data, size_t len);
+
+// Writes an 8 byte read request (function 0x03 or 0x04) into frame.
+uint8_t Modbus_buildReadRequest(uint8_t address, uint8_t function, uint16_t startRegister,
+                                uint16_t count, uint8_t* frame);
+
+// Checks address, function, byte count and CRC of a read response and
+// converts count big-endian registers into host order.
+Modbus_Status Modbus_decodeReadResponse(const uint8_t* frame, size_t len, uint8_t address,
+                                        uint8_t function, uint16_t* registers, uint16_t count);
+
+#endif
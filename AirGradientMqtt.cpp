@@ -0,0 +1,491 @@
+/*
+  AirGradientMqtt.cpp - MQTT 3.1.1 publisher with QoS 1 pipelining for the AirGradient library
+*/
+
+#include "AirGradientMqtt.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const uint8_t MQTT_CONNECT = 0x10;
+static const uint8_t MQTT_CONNACK = 0x20;
+static const uint8_t MQTT_PUBLISH = 0x30;
+static const uint8_t MQTT_PUBACK = 0x40;
+static const uint8_t MQTT_PINGREQ = 0xC0;
+static const uint8_t MQTT_PINGRESP = 0xD0;
+static const uint8_t MQTT_DISCONNECT = 0xE0;
+
+static const uint8_t PUBLISH_QOS1 = 0x02;
+static const uint8_t PUBLISH_DUP = 0x08;
+static const uint8_t PUBLISH_RETAIN = 0x01;
+
+static const uint8_t CONNECT_USER = 0x80;
+static const uint8_t CONNECT_PASSWORD = 0x40;
+
+static uint8_t encodeLength(uint8_t* buf, uint32_t length)
+{
+  uint8_t n = 0;
+  do {
+    uint8_t digit = length % 128;
+    length /= 128;
+    buf[n++] = length > 0 ? digit | 0x80 : digit;
+  } while (length > 0);
+  return n;
+}
+
+MqttPublisher::MqttPublisher(Client& client)
+{
+  _client = &client;
+  _prefix[0] = '\0';
+}
+
+void MqttPublisher::setServer(const char* host, uint16_t port)
+{
+  _host = host;
+  _port = port;
+}
+
+void MqttPublisher::setClientId(const char* clientId)
+{
+  _clientId = clientId;
+}
+
+void MqttPublisher::setCredentials(const char* user, const char* password)
+{
+  _user = user;
+  _password = password;
+}
+
+void MqttPublisher::setKeepAlive(uint16_t seconds)
+{
+  _keepAlive = seconds;
+}
+
+void MqttPublisher::setTopicPrefix(const char* prefix)
+{
+  snprintf(_prefix, sizeof(_prefix), "%s", prefix);
+}
+
+MQTT_Status MqttPublisher::publish(const char* topic, const char* payload, bool retain)
+{
+  size_t topicLength = strlen(topic);
+  size_t payloadLength = strlen(payload);
+  if (topicLength == 0 || topicLength + payloadLength > MESSAGE_SIZE) {
+    return MQTT_TOO_LONG;
+  }
+
+  if (_count == QUEUE_SIZE) {
+    // keep the newest readings
+    if (_inFlight > 0) {
+      _inFlight--;
+    }
+    _head = (_head + 1) % QUEUE_SIZE;
+    _count--;
+    _dropped++;
+  }
+
+  Message& message = at(_count++);
+  message.packetId = 0;
+  message.acked = false;
+  message.retain = retain;
+  message.topicLength = topicLength;
+  message.payloadLength = payloadLength;
+  memcpy(message.data, topic, topicLength);
+  memcpy(message.data + topicLength, payload, payloadLength);
+  return MQTT_OK;
+}
+
+MQTT_Status MqttPublisher::publishMeasures(const Measures& measures, uint8_t topics)
+{
+  char topic[TOPIC_SIZE + 16];
+  char payload[MEASURES_JSON_SIZE];
+  MQTT_Status status = MQTT_OK;
+
+  if (topics & MQTT_TOPICS_COMBINED) {
+    snprintf(topic, sizeof(topic), "%s/measures", _prefix);
+    if (Measures_writeJson(measures, payload, sizeof(payload)) == 0) {
+      status = MQTT_TOO_LONG;
+    } else {
+      status = publish(topic, payload);
+    }
+  }
+
+  if (topics & MQTT_TOPICS_PER_METRIC) {
+    for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+      Measure_Field field = (Measure_Field)i;
+      if (!measures.has(field)) {
+        continue;
+      }
+      snprintf(topic, sizeof(topic), "%s/%s", _prefix, Measures_key(field));
+      MQTT_Status result = Measures_writeValue(measures, field, payload, sizeof(payload)) > 0
+                           ? publish(topic, payload) : MQTT_TOO_LONG;
+      status = status == MQTT_OK ? result : status;
+    }
+  }
+  return status;
+}
+
+MQTT_Status MqttPublisher::update(uint32_t now)
+{
+  if (_host == NULL) {
+    return MQTT_CONNECT_FAILED;
+  }
+
+  switch (_state) {
+    case STATE_DISCONNECTED:
+      if (now - _stateSince < _backoffMs) {
+        break;
+      }
+      _stateSince = now;
+      // next attempt 1 s, 2 s, 4 s ... later, up to a minute
+      _backoffMs = _backoffMs == 0 ? MIN_BACKOFF_MS
+                   : _backoffMs * 2 > MAX_BACKOFF_MS ? MAX_BACKOFF_MS : _backoffMs * 2;
+      if (!_client->connect(_host, _port)) {
+        _error = MQTT_CONNECT_FAILED;
+        break;
+      }
+      _rxStage = 0;
+      _state = STATE_CONNECTING;
+      _awaitSince = now;
+      sendConnect(now);
+      break;
+
+    case STATE_CONNECTING:
+    case STATE_CONNECTED: {
+      MQTT_Status status = receive(now);
+      if (status != MQTT_OK) {
+        lost(status, now);
+        break;
+      }
+      if (!_client->connected()) {
+        lost(MQTT_CONNECT_FAILED, now);
+        break;
+      }
+      bool waiting = _state == STATE_CONNECTING || _inFlight > 0 || _pingPending;
+      if (waiting && now - _awaitSince >= RESPONSE_TIMEOUT_MS) {
+        lost(MQTT_TIMEOUT, now);
+        break;
+      }
+      if (_state != STATE_CONNECTED) {
+        break;
+      }
+
+      sendPending(now);
+      if (_state == STATE_CONNECTED && !_pingPending && _keepAlive > 0 &&
+          now - _lastSent >= _keepAlive * 1000UL / 2) {
+        const uint8_t ping[] = { MQTT_PINGREQ, 0 };
+        if (!waiting) {
+          _awaitSince = now;
+        }
+        _pingPending = true;
+        appendPacket(ping, sizeof(ping));
+        flushTx(now);
+      }
+      break;
+    }
+  }
+  return _error;
+}
+
+bool MqttPublisher::isConnected() const
+{
+  return _state == STATE_CONNECTED;
+}
+
+void MqttPublisher::disconnect()
+{
+  if (_state == STATE_CONNECTED) {
+    const uint8_t packet[] = { MQTT_DISCONNECT, 0 };
+    _client->write(packet, sizeof(packet));
+  }
+  _client->stop();
+  _state = STATE_DISCONNECTED;
+  _inFlight = 0;
+  _pingPending = false;
+}
+
+uint8_t MqttPublisher::getQueued() const
+{
+  return _count;
+}
+
+uint8_t MqttPublisher::getInFlight() const
+{
+  return _inFlight;
+}
+
+uint32_t MqttPublisher::getAcked() const
+{
+  return _acked;
+}
+
+uint32_t MqttPublisher::getDropped() const
+{
+  return _dropped;
+}
+
+uint32_t MqttPublisher::getResent() const
+{
+  return _resent;
+}
+
+uint32_t MqttPublisher::getReconnects() const
+{
+  return _reconnects;
+}
+
+uint32_t MqttPublisher::getLastReconnectMs() const
+{
+  return _lastReconnectMs;
+}
+
+MQTT_Status MqttPublisher::getError() const
+{
+  return _error;
+}
+
+MqttPublisher::Message& MqttPublisher::at(uint8_t index)
+{
+  return _queue[(_head + index) % QUEUE_SIZE];
+}
+
+void MqttPublisher::sendConnect(uint32_t now)
+{
+  uint8_t flags = 0;    // clean session off: the broker keeps the session
+  uint32_t length = 10 + 2 + strlen(_clientId);
+  if (_user != NULL) {
+    flags |= CONNECT_USER;
+    length += 2 + strlen(_user);
+  }
+  if (_password != NULL) {
+    flags |= CONNECT_PASSWORD;
+    length += 2 + strlen(_password);
+  }
+
+  uint8_t header[16];
+  uint8_t n = 0;
+  header[n++] = MQTT_CONNECT;
+  n += encodeLength(header + n, length);
+  header[n++] = 0;
+  header[n++] = 4;
+  memcpy(header + n, "MQTT", 4);
+  n += 4;
+  header[n++] = 4;    // protocol level 3.1.1
+  header[n++] = flags;
+  header[n++] = _keepAlive >> 8;
+  header[n++] = _keepAlive & 0xFF;
+
+  _txLength = 0;
+  appendPacket(header, n);
+  const char* strings[] = { _clientId, _user, _password };
+  for (uint8_t i = 0; i < 3; i++) {
+    if (strings[i] == NULL) {
+      continue;
+    }
+    uint16_t stringLength = strlen(strings[i]);
+    uint8_t prefix[2] = { (uint8_t)(stringLength >> 8), (uint8_t)(stringLength & 0xFF) };
+    appendPacket(prefix, 2);
+    appendPacket((const uint8_t*)strings[i], stringLength);
+  }
+  flushTx(now);
+}
+
+// Fills the window; all PUBLISH packets that fit go out in one write.
+void MqttPublisher::sendPending(uint32_t now)
+{
+  bool wasWaiting = _inFlight > 0 || _pingPending;
+
+  while (_inFlight < WINDOW && _inFlight < _count) {
+    Message& message = at(_inFlight);
+    bool dup = message.packetId != 0;
+    if (!dup) {
+      message.packetId = _nextPacketId;
+      _nextPacketId = _nextPacketId == 0xFFFF ? 1 : _nextPacketId + 1;
+    }
+    if (!appendPublish(message, dup)) {
+      if (!flushTx(now)) {
+        return;
+      }
+      appendPublish(message, dup);
+    }
+    if (dup) {
+      _resent++;
+    }
+    _inFlight++;
+  }
+  if (_txLength > 0) {
+    if (!wasWaiting) {
+      _awaitSince = now;
+    }
+    flushTx(now);
+  }
+}
+
+bool MqttPublisher::appendPublish(Message& message, bool dup)
+{
+  uint8_t header[8];
+  uint8_t n = 0;
+  uint32_t length = 2 + message.topicLength + 2 + message.payloadLength;
+
+  header[n++] = MQTT_PUBLISH | PUBLISH_QOS1 | (dup ? PUBLISH_DUP : 0) | (message.retain ? PUBLISH_RETAIN : 0);
+  n += encodeLength(header + n, length);
+  if (_txLength + n + length > TX_BUFFER_SIZE) {
+    return false;
+  }
+
+  header[n++] = message.topicLength >> 8;
+  header[n++] = message.topicLength & 0xFF;
+  appendPacket(header, n);
+  appendPacket((const uint8_t*)message.data, message.topicLength);
+  uint8_t packetId[2] = { (uint8_t)(message.packetId >> 8), (uint8_t)(message.packetId & 0xFF) };
+  appendPacket(packetId, 2);
+  appendPacket((const uint8_t*)message.data + message.topicLength, message.payloadLength);
+  return true;
+}
+
+bool MqttPublisher::appendPacket(const uint8_t* data, uint16_t length)
+{
+  if (_txLength + length > TX_BUFFER_SIZE) {
+    return false;
+  }
+  memcpy(_tx + _txLength, data, length);
+  _txLength += length;
+  return true;
+}
+
+bool MqttPublisher::flushTx(uint32_t now)
+{
+  uint16_t length = _txLength;
+  _txLength = 0;
+  if (length == 0) {
+    return true;
+  }
+  if (_client->write(_tx, length) != length) {
+    lost(MQTT_CONNECT_FAILED, now);
+    return false;
+  }
+  _lastSent = now;
+  return true;
+}
+
+// Parses what has arrived so far: type byte, remaining length, body. Only
+// the first four body bytes are kept, which is all CONNACK and PUBACK have.
+MQTT_Status MqttPublisher::receive(uint32_t now)
+{
+  while (_client->available() > 0) {
+    int c = _client->read();
+    if (c < 0) {
+      break;
+    }
+    switch (_rxStage) {
+      case 0:
+        _rxType = c;
+        _rxRemaining = 0;
+        _rxShift = 0;
+        _rxLength = 0;
+        _rxStage = 1;
+        continue;
+      case 1:
+        _rxRemaining |= (uint32_t)(c & 0x7F) << _rxShift;
+        _rxShift += 7;
+        if (c & 0x80) {
+          if (_rxShift > 21) {
+            return MQTT_PROTOCOL_ERROR;
+          }
+          continue;
+        }
+        _rxStage = 2;
+        break;
+      default:
+        if (_rxLength < sizeof(_rxBody)) {
+          _rxBody[_rxLength] = c;
+        }
+        _rxLength++;
+        _rxRemaining--;
+        break;
+    }
+    if (_rxStage == 2 && _rxRemaining == 0) {
+      _rxStage = 0;
+      MQTT_Status status = handlePacket(now);
+      if (status != MQTT_OK) {
+        return status;
+      }
+    }
+  }
+  return MQTT_OK;
+}
+
+MQTT_Status MqttPublisher::handlePacket(uint32_t now)
+{
+  _awaitSince = now;
+
+  switch (_rxType & 0xF0) {
+    case MQTT_CONNACK:
+      if (_state != STATE_CONNECTING || _rxLength != 2) {
+        return MQTT_PROTOCOL_ERROR;
+      }
+      if (_rxBody[1] != 0) {
+        return MQTT_REFUSED;
+      }
+      _state = STATE_CONNECTED;
+      _error = MQTT_OK;
+      _backoffMs = 0;
+      _lastSent = now;
+      if (_everConnected) {
+        _reconnects++;
+        _lastReconnectMs = now - _lostAt;
+      }
+      _everConnected = true;
+      // unacknowledged messages are sent again by sendPending(), with DUP
+      break;
+
+    case MQTT_PUBACK:
+      if (_rxLength != 2) {
+        return MQTT_PROTOCOL_ERROR;
+      }
+      acknowledge((_rxBody[0] << 8) | _rxBody[1]);
+      break;
+
+    case MQTT_PINGRESP:
+      _pingPending = false;
+      break;
+
+    default:
+      // nothing is subscribed, anything else is ignored
+      break;
+  }
+  return MQTT_OK;
+}
+
+void MqttPublisher::acknowledge(uint16_t packetId)
+{
+  for (uint8_t i = 0; i < _inFlight; i++) {
+    Message& message = at(i);
+    if (message.packetId == packetId && !message.acked) {
+      message.acked = true;
+      _acked++;
+      break;
+    }
+  }
+  // acks arrive in order, but only a completed head frees a slot
+  while (_inFlight > 0 && at(0).acked) {
+    _head = (_head + 1) % QUEUE_SIZE;
+    _count--;
+    _inFlight--;
+  }
+}
+
+void MqttPublisher::lost(MQTT_Status error, uint32_t now)
+{
+  _client->stop();
+  if (_state == STATE_CONNECTED) {
+    _lostAt = now;
+  }
+  _state = STATE_DISCONNECTED;
+  _stateSince = now;
+  _error = error;
+  _inFlight = 0;
+  _pingPending = false;
+  _txLength = 0;
+  _rxStage = 0;
+}
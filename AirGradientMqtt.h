@@ -0,0 +1,167 @@
+/*
+  AirGradientMqtt.h - MQTT 3.1.1 publisher with QoS 1 pipelining for the AirGradient library
+
+  Publishes the Measures record to a broker instead of, or next to, the
+  HTTP upload. Messages go into a fixed queue; update() keeps the
+  connection, writes queued messages while fewer than WINDOW of them
+  wait for their PUBACK, several per TCP write, and handles the acks.
+
+  The session is persistent (clean session off, fixed client id), so the
+  broker keeps it across reconnects. Unacknowledged messages are sent
+  again with the DUP flag after a reconnect. While disconnected the queue
+  holds the last QUEUE_SIZE messages; older ones are dropped and counted.
+
+    WiFiClient client;
+    MqttPublisher mqtt(client);
+
+    void setup() {
+      mqtt.setServer("192.168.1.10", 1883);
+      mqtt.setClientId("airgradient-abc123");
+      mqtt.setTopicPrefix("airgradient/abc123");
+    }
+
+    void loop() {
+      mqtt.update();
+      ...
+      mqtt.publishMeasures(measures, MQTT_TOPICS_COMBINED | MQTT_TOPICS_PER_METRIC);
+    }
+
+  Combined publishes the JSON payload on <prefix>/measures, per metric
+  publishes each value on <prefix>/<key>, e.g. airgradient/abc123/rco2.
+*/
+
+#ifndef AirGradientMqtt_h
+#define AirGradientMqtt_h
+
+#include "Arduino.h"
+#include "Client.h"
+#include "AirGradientReport.h"
+
+typedef enum {
+  MQTT_OK = 0,
+  MQTT_CONNECT_FAILED = -1,
+  MQTT_REFUSED = -2,
+  MQTT_TIMEOUT = -3,
+  MQTT_PROTOCOL_ERROR = -4,
+  MQTT_TOO_LONG = -5
+} MQTT_Status;
+
+typedef enum {
+  MQTT_TOPICS_COMBINED = 1,
+  MQTT_TOPICS_PER_METRIC = 2
+} MQTT_Topics;
+
+class MqttPublisher
+{
+  public:
+    static const uint8_t QUEUE_SIZE = 16;
+    static const uint8_t WINDOW = 4;
+    static const uint8_t TOPIC_SIZE = 48;
+    // topic and payload of one message: a full record on <prefix>/measures
+    static const uint16_t MESSAGE_SIZE = TOPIC_SIZE + 16 + MEASURES_JSON_SIZE;
+    static const uint16_t TX_BUFFER_SIZE = 512;
+    static const uint16_t RESPONSE_TIMEOUT_MS = 10000;
+    static const uint16_t MIN_BACKOFF_MS = 1000;
+    static const uint16_t MAX_BACKOFF_MS = 60000;
+
+    MqttPublisher(Client& client);
+
+    void setServer(const char* host, uint16_t port = 1883);
+    void setClientId(const char* clientId);
+    void setCredentials(const char* user, const char* password);
+    void setKeepAlive(uint16_t seconds);
+    void setTopicPrefix(const char* prefix);
+
+    // Queues a QoS 1 message; the oldest one is dropped if the queue is full.
+    MQTT_Status publish(const char* topic, const char* payload, bool retain = false);
+    MQTT_Status publishMeasures(const Measures& measures, uint8_t topics = MQTT_TOPICS_COMBINED);
+
+    // Connects, sends and receives; call from loop().
+    MQTT_Status update(uint32_t now = millis());
+    bool isConnected() const;
+    void disconnect();
+
+    uint8_t getQueued() const;
+    uint8_t getInFlight() const;
+    uint32_t getAcked() const;
+    uint32_t getDropped() const;
+    uint32_t getResent() const;
+    uint32_t getReconnects() const;
+    // From noticing the connection was lost to the broker's CONNACK
+    uint32_t getLastReconnectMs() const;
+    MQTT_Status getError() const;
+
+  private:
+    typedef enum {
+      STATE_DISCONNECTED,
+      STATE_CONNECTING,
+      STATE_CONNECTED
+    } State;
+
+    // The first _inFlight messages of the queue have been sent.
+    struct Message {
+      // 0 until the message is sent the first time
+      uint16_t packetId;
+      bool acked;
+      bool retain;
+      uint16_t topicLength;
+      uint16_t payloadLength;
+      char data[MESSAGE_SIZE];
+    };
+
+    Client* _client;
+    const char* _host = NULL;
+    uint16_t _port = 1883;
+    const char* _clientId = "airgradient";
+    const char* _user = NULL;
+    const char* _password = NULL;
+    uint16_t _keepAlive = 60;
+    char _prefix[TOPIC_SIZE];
+
+    Message _queue[QUEUE_SIZE];
+    uint8_t _head = 0;
+    uint8_t _count = 0;
+    uint8_t _inFlight = 0;
+    uint16_t _nextPacketId = 1;
+
+    State _state = STATE_DISCONNECTED;
+    MQTT_Status _error = MQTT_OK;
+    uint32_t _stateSince = 0;
+    uint32_t _lostAt = 0;
+    bool _everConnected = false;
+    uint32_t _backoffMs = 0;
+    uint32_t _lastSent = 0;
+    // since when an answer is expected, reset by every packet received
+    uint32_t _awaitSince = 0;
+    bool _pingPending = false;
+
+    uint8_t _tx[TX_BUFFER_SIZE];
+    uint16_t _txLength = 0;
+
+    // incoming packet being parsed
+    uint8_t _rxType = 0;
+    uint32_t _rxRemaining = 0;
+    uint8_t _rxShift = 0;
+    uint8_t _rxBody[4];
+    uint8_t _rxLength = 0;
+    uint8_t _rxStage = 0;
+
+    uint32_t _acked = 0;
+    uint32_t _dropped = 0;
+    uint32_t _resent = 0;
+    uint32_t _reconnects = 0;
+    uint32_t _lastReconnectMs = 0;
+
+    Message& at(uint8_t index);
+    void sendConnect(uint32_t now);
+    void sendPending(uint32_t now);
+    bool appendPublish(Message& message, bool dup);
+    bool appendPacket(const uint8_t* data, uint16_t length);
+    bool flushTx(uint32_t now);
+    MQTT_Status receive(uint32_t now);
+    MQTT_Status handlePacket(uint32_t now);
+    void acknowledge(uint16_t packetId);
+    void lost(MQTT_Status error, uint32_t now);
+};
+
+#endif
@@ -0,0 +1,244 @@
+/*
+  AirGradientPms.cpp - Plantower PMS driver for the AirGradient library
+*/
+
+#include "AirGradientPms.h"
+
+void PmsDriver::begin(Stream& stream, PMS_Variant variant)
+{
+  this->_stream = &stream;
+  _variant = variant;
+  _detected = variant;
+  _candidate = PMS_VARIANT_AUTO;
+  _votes = 0;
+}
+
+PMS_Variant PmsDriver::getVariant()
+{
+  return _detected;
+}
+
+void PmsDriver::decode(PMS_Variant variant, const uint8_t* payload, DATA& data)
+{
+  switch (variant)
+  {
+  case PMS_VARIANT_PMS3003:
+    decode<PMS_VARIANT_PMS3003>(payload, data);
+    break;
+  case PMS_VARIANT_PMS5003T:
+    decode<PMS_VARIANT_PMS5003T>(payload, data);
+    break;
+  case PMS_VARIANT_PMS5003ST:
+    decode<PMS_VARIANT_PMS5003ST>(payload, data);
+    break;
+  default:
+    decode<PMS_VARIANT_PMS5003>(payload, data);
+    break;
+  }
+}
+
+// Standby mode. For low power consumption and prolong the life of the sensor.
+void PmsDriver::sleep()
+{
+  uint8_t command[] = { 0x42, 0x4D, 0xE4, 0x00, 0x00, 0x01, 0x73 };
+  _stream->write(command, sizeof(command));
+}
+
+// Operating mode. Stable data should be got at least 30 seconds after the sensor wakeup from the sleep mode because of the fan's performance.
+void PmsDriver::wakeUp()
+{
+  uint8_t command[] = { 0x42, 0x4D, 0xE4, 0x00, 0x01, 0x01, 0x74 };
+  _stream->write(command, sizeof(command));
+}
+
+// Active mode. Default mode after power up. In this mode sensor would send serial data to the host automatically.
+void PmsDriver::activeMode()
+{
+  uint8_t command[] = { 0x42, 0x4D, 0xE1, 0x00, 0x01, 0x01, 0x71 };
+  _stream->write(command, sizeof(command));
+  _mode = MODE_ACTIVE;
+}
+
+// Passive mode. In this mode sensor would send serial data to the host only for request.
+void PmsDriver::passiveMode()
+{
+  uint8_t command[] = { 0x42, 0x4D, 0xE1, 0x00, 0x00, 0x01, 0x70 };
+  _stream->write(command, sizeof(command));
+  _mode = MODE_PASSIVE;
+}
+
+// Request read in Passive Mode.
+void PmsDriver::requestRead()
+{
+  if (_mode == MODE_PASSIVE)
+  {
+    uint8_t command[] = { 0x42, 0x4D, 0xE2, 0x00, 0x00, 0x01, 0x71 };
+    _stream->write(command, sizeof(command));
+  }
+}
+
+// Non-blocking function for parse response.
+bool PmsDriver::read(DATA& data)
+{
+  _data = &data;
+  loop();
+
+  return _status == STATUS_OK;
+}
+
+// Blocking function for parse response. Default timeout is 1s.
+bool PmsDriver::readUntil(DATA& data, uint16_t timeout)
+{
+  _data = &data;
+  uint32_t start = millis();
+  do
+  {
+    loop();
+    if (_status == STATUS_OK) break;
+  } while (millis() - start < timeout);
+
+  return _status == STATUS_OK;
+}
+
+void PmsDriver::loop()
+{
+  _status = STATUS_WAITING;
+  if (_stream->available())
+  {
+    uint8_t ch = _stream->read();
+
+    switch (_index)
+    {
+    case 0:
+      if (ch != 0x42)
+      {
+        return;
+      }
+      _calculatedChecksum = ch;
+      break;
+
+    case 1:
+      if (ch != 0x4D)
+      {
+        _index = 0;
+        return;
+      }
+      _calculatedChecksum += ch;
+      break;
+
+    case 2:
+      _calculatedChecksum += ch;
+      _frameLen = ch << 8;
+      break;
+
+    case 3:
+      _frameLen |= ch;
+      // Unsupported sensor, different frame length, transmission error e.t.c.
+      if (!acceptsFrameLen(_frameLen))
+      {
+        _index = 0;
+        return;
+      }
+      _calculatedChecksum += ch;
+      break;
+
+    default:
+      if (_index == _frameLen + 2)
+      {
+        _checksum = ch << 8;
+      }
+      else if (_index == _frameLen + 2 + 1)
+      {
+        _checksum |= ch;
+
+        if (_calculatedChecksum == _checksum)
+        {
+          _status = STATUS_OK;
+          decode(detect(_frameLen), _payload, *_data);
+        }
+
+        _index = 0;
+        return;
+      }
+      else
+      {
+        _calculatedChecksum += ch;
+        uint8_t payloadIndex = _index - 4;
+
+        // Anything beyond the longest known layout is only checksummed.
+        if (payloadIndex < sizeof(_payload))
+        {
+          _payload[payloadIndex] = ch;
+        }
+      }
+
+      break;
+    }
+
+    _index++;
+  }
+}
+
+bool PmsDriver::acceptsFrameLen(uint16_t frameLen)
+{
+  if (_variant != PMS_VARIANT_AUTO)
+    return frameLen == pmsLayout(_variant).frameLen;
+
+  return frameLen == pmsLayout(PMS_VARIANT_PMS3003).frameLen ||
+         frameLen == pmsLayout(PMS_VARIANT_PMS5003).frameLen ||
+         frameLen == pmsLayout(PMS_VARIANT_PMS5003ST).frameLen;
+}
+
+static uint16_t payloadWord(const uint8_t* payload, uint8_t index)
+{
+  return (payload[2 * index] << 8) | payload[2 * index + 1];
+}
+
+// PMS5003 and PMS5003T both send 28 byte frames. On a PMS5003 words 6..11
+// are cumulative particle counts (>0.3um, >0.5um, ... >10um) and can only
+// decrease; on a PMS5003T words 10 and 11 are temperature and humidity in
+// tenths, which breaks that order but stays within the sensor's range.
+// A frame that fits both, counts that decrease into a temperature and
+// humidity in range, says nothing and does not vote. In clean air that
+// is every PMS5003 frame, so a PMS5003 may stay undetected; it is decoded
+// as one all the same.
+PMS_Variant PmsDriver::detect(uint16_t frameLen)
+{
+  if (_variant != PMS_VARIANT_AUTO)
+    return _variant;
+
+  if (frameLen == pmsLayout(PMS_VARIANT_PMS3003).frameLen) {
+    _detected = PMS_VARIANT_PMS3003;
+    return _detected;
+  }
+  if (frameLen == pmsLayout(PMS_VARIANT_PMS5003ST).frameLen) {
+    _detected = PMS_VARIANT_PMS5003ST;
+    return _detected;
+  }
+
+  bool decreasing = true;
+  for (uint8_t i = 6; i < 11; i++) {
+    if (payloadWord(_payload, i) < payloadWord(_payload, i + 1))
+      decreasing = false;
+  }
+  int16_t temperature = (int16_t)payloadWord(_payload, 10);
+  uint16_t humidity = payloadWord(_payload, 11);
+  bool plausibleTRH = temperature >= -400 && temperature <= 1000 && humidity <= 1000;
+
+  PMS_Variant vote = decreasing == plausibleTRH ? PMS_VARIANT_AUTO :
+                     decreasing ? PMS_VARIANT_PMS5003 : PMS_VARIANT_PMS5003T;
+  if (vote != PMS_VARIANT_AUTO) {
+    if (vote == _candidate) {
+      if (_votes < DETECT_FRAMES) _votes++;
+    } else {
+      _candidate = vote;
+      _votes = 1;
+    }
+    if (_votes >= DETECT_FRAMES)
+      _detected = _candidate;
+  }
+
+  // until detection has settled keep the historic PMS5003 decoding
+  return _detected == PMS_VARIANT_AUTO || _detected == PMS_VARIANT_PMS3003 ||
+         _detected == PMS_VARIANT_PMS5003ST ? PMS_VARIANT_PMS5003 : _detected;
+}
@@ -0,0 +1,149 @@
+/*
+  AirGradientPms.h - Plantower PMS driver for the AirGradient library
+*/
+
+#ifndef AirGradientPms_h
+#define AirGradientPms_h
+
+#include "Arduino.h"
+#include "Stream.h"
+
+typedef enum {
+  PMS_VARIANT_AUTO,
+  PMS_VARIANT_PMS3003,
+  PMS_VARIANT_PMS5003,
+  PMS_VARIANT_PMS5003T,
+  PMS_VARIANT_PMS5003ST,
+  PMS_VARIANT_PMS7003
+} PMS_Variant;
+
+// Where each sensor puts its fields, as 16 bit word indices into the frame
+// payload. The first bulkWords words map 1:1 onto the head of DATA; the
+// remaining fields are looked up individually (PMS_NO_FIELD if absent).
+#define PMS_NO_FIELD 0xFF
+
+struct PmsLayout {
+  uint16_t frameLen;
+  uint8_t bulkWords;
+  uint8_t hcho;
+  uint8_t temperature;
+  uint8_t humidity;
+};
+
+constexpr PmsLayout pmsLayout(PMS_Variant variant)
+{
+  return variant == PMS_VARIANT_PMS3003   ? PmsLayout{ 2 * 9 + 2, 6, PMS_NO_FIELD, PMS_NO_FIELD, PMS_NO_FIELD } :
+         variant == PMS_VARIANT_PMS5003T  ? PmsLayout{ 2 * 13 + 2, 10, PMS_NO_FIELD, 10, 11 } :
+         variant == PMS_VARIANT_PMS5003ST ? PmsLayout{ 2 * 17 + 2, 12, 12, 13, 14 } :
+         // PMS5003, PMS7003
+                                            PmsLayout{ 2 * 13 + 2, 12, PMS_NO_FIELD, PMS_NO_FIELD, PMS_NO_FIELD };
+}
+
+class PmsDriver
+{
+  public:
+    static const uint16_t SINGLE_RESPONSE_TIME = 1000;
+    static const uint16_t TOTAL_RESPONSE_TIME = 1000 * 10;
+    static const uint16_t STEADY_RESPONSE_TIME = 1000 * 30;
+
+    static const uint16_t BAUD_RATE = 9600;
+
+    struct DATA {
+      // Standard Particles, CF=1
+      uint16_t PM_SP_UG_1_0;
+      uint16_t PM_SP_UG_2_5;
+      uint16_t PM_SP_UG_10_0;
+
+      // Atmospheric environment
+      uint16_t PM_AE_UG_1_0;
+      uint16_t PM_AE_UG_2_5;
+      uint16_t PM_AE_UG_10_0;
+
+      // Raw particles count (number of particles in 0.1l of air
+      uint16_t PM_RAW_0_3;
+      uint16_t PM_RAW_0_5;
+      uint16_t PM_RAW_1_0;
+      uint16_t PM_RAW_2_5;
+      uint16_t PM_RAW_5_0;
+      uint16_t PM_RAW_10_0;
+
+      // Formaldehyde (HCHO) concentration in mg/m^3 - PMSxxxxST units only
+      uint16_t AMB_HCHO;
+
+      // Temperature & humidity - PMSxxxxT/ST units only
+      int16_t PM_TMP;
+      uint16_t PM_HUM;
+    };
+
+    // With PMS_VARIANT_AUTO the variant is detected from the frame length
+    // and, for the 28 byte frames shared by PMS5003 and PMS5003T, from the
+    // plausibility of the particle counts over several frames. Until that
+    // has settled, 28 byte frames are decoded as PMS5003.
+    void begin(Stream& stream, PMS_Variant variant = PMS_VARIANT_AUTO);
+    PMS_Variant getVariant();
+    void sleep();
+    void wakeUp();
+    void activeMode();
+    void passiveMode();
+
+    void requestRead();
+    bool read(DATA& data);
+    bool readUntil(DATA& data, uint16_t timeout = SINGLE_RESPONSE_TIME);
+
+    // Frames of the same length that must agree before AUTO settles on
+    // PMS5003 or PMS5003T.
+    static const uint8_t DETECT_FRAMES = 3;
+
+    template <PMS_Variant V>
+    static void decode(const uint8_t* payload, DATA& data);
+    static void decode(PMS_Variant variant, const uint8_t* payload, DATA& data);
+
+  private:
+    enum STATUS { STATUS_WAITING, STATUS_OK };
+    enum MODE { MODE_ACTIVE, MODE_PASSIVE };
+
+    uint8_t _payload[2 * 17];
+    PMS_Variant _variant = PMS_VARIANT_AUTO;
+    PMS_Variant _detected = PMS_VARIANT_AUTO;
+    PMS_Variant _candidate = PMS_VARIANT_AUTO;
+    uint8_t _votes = 0;
+    Stream* _stream = NULL;
+    DATA* _data;
+    STATUS _status;
+    MODE _mode = MODE_ACTIVE;
+
+    uint8_t _index = 0;
+    uint16_t _frameLen;
+    uint16_t _checksum;
+    uint16_t _calculatedChecksum;
+
+    void loop();
+    bool acceptsFrameLen(uint16_t frameLen);
+    PMS_Variant detect(uint16_t frameLen);
+};
+
+template <PMS_Variant V>
+void PmsDriver::decode(const uint8_t* payload, DATA& data)
+{
+  constexpr PmsLayout layout = pmsLayout(V);
+  static_assert(offsetof(DATA, PM_RAW_10_0) == 11 * sizeof(uint16_t), "DATA must start with 12 packed words");
+
+  // DATA starts with twelve consecutive words in frame order, so the common
+  // part is one big-endian to host swap.
+  uint16_t* words = &data.PM_SP_UG_1_0;
+  for (uint8_t i = 0; i < 12; i++) {
+    words[i] = i < layout.bulkWords ? (payload[2 * i] << 8) | payload[2 * i + 1] : 0;
+  }
+
+  // Formaldehyde concentration (PMSxxxxST units only)
+  data.AMB_HCHO = layout.hcho == PMS_NO_FIELD ? 0 :
+    ((payload[2 * layout.hcho] << 8) | payload[2 * layout.hcho + 1]) / 1000;
+
+  // Temperature & humidity (PMSxxxxT/ST units only), sent in tenths
+  data.PM_TMP = layout.temperature == PMS_NO_FIELD ? 0 :
+    (int16_t)((payload[2 * layout.temperature] << 8) | payload[2 * layout.temperature + 1]) / 10;
+  data.PM_HUM = layout.humidity == PMS_NO_FIELD ? 0 :
+    ((payload[2 * layout.humidity] << 8) | payload[2 * layout.humidity + 1]) / 10;
+}
+
+#endif
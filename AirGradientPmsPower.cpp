@@ -0,0 +1,207 @@
+/*
+  AirGradientPmsPower.cpp - Duty-cycled power management for Plantower PMS sensors
+*/
+
+#include "AirGradientPmsPower.h"
+
+// Frames requested per window before it is given up.
+static const uint8_t EXTRA_REQUESTS = 3;
+
+// PmsDriver::read() consumes one byte per call; let a single update() take
+// in up to the longest frame (PMS5003ST, 40 bytes including the header).
+static const uint8_t BYTES_PER_UPDATE = 40;
+
+static const uint8_t DATA_WORDS = sizeof(PmsDriver::DATA) / sizeof(uint16_t);
+
+// Word index of the only signed member of PmsDriver::DATA.
+static const uint8_t TMP_WORD = offsetof(PmsDriver::DATA, PM_TMP) / sizeof(uint16_t);
+
+// millis() wraps every ~49 days; compare through the signed difference.
+static bool reached(uint32_t now, uint32_t deadline)
+{
+  return (int32_t)(now - deadline) >= 0;
+}
+
+PmsPowerManager::PmsPowerManager(PmsDriver& pms)
+{
+  _pms = &pms;
+}
+
+void PmsPowerManager::begin(uint32_t intervalMs, uint8_t samples, uint32_t warmUpMs, uint32_t now)
+{
+  _intervalMs = intervalMs;
+  _warmUpMs = warmUpMs;
+  _samples = samples == 0 ? 1 : samples > MAX_SAMPLES ? MAX_SAMPLES : samples;
+
+  _windowStart = now + warmUpMs;
+  _lastUpdate = now;
+  _activeMs = 0;
+  _sleepMs = 0;
+  _failedWindows = 0;
+  _average = PmsDriver::DATA();
+
+  // woken on the first update()
+  _pms->passiveMode();
+  _pms->sleep();
+  _state = PMS_POWER_SLEEPING;
+}
+
+bool PmsPowerManager::update(uint32_t now)
+{
+  uint32_t elapsed = now - _lastUpdate;
+  _lastUpdate = now;
+  if (_state == PMS_POWER_SLEEPING) {
+    _sleepMs += elapsed;
+  } else {
+    _activeMs += elapsed;
+  }
+
+  switch (_state) {
+  case PMS_POWER_SLEEPING:
+    if (reached(now, _windowStart - _warmUpMs)) {
+      _pms->wakeUp();
+      // the sensor comes back in active mode
+      _pms->passiveMode();
+      _wokenAt = now;
+      _state = PMS_POWER_WARMING_UP;
+    }
+    break;
+
+  case PMS_POWER_WARMING_UP:
+    // throw away anything sent before passive mode took effect
+    for (uint8_t i = 0; i < BYTES_PER_UPDATE; i++) {
+      _pms->read(_frame);
+    }
+    if (reached(now, _windowStart) && reached(now, _wokenAt + _warmUpMs)) {
+      startSampling(now);
+    }
+    break;
+
+  case PMS_POWER_SAMPLING:
+    if (readFrame()) {
+      accumulate();
+      if (_count >= _samples) {
+        finishWindow(now);
+        return true;
+      }
+      _pms->requestRead();
+      _requestedAt = now;
+    } else if (reached(now, _requestedAt + PmsDriver::SINGLE_RESPONSE_TIME)) {
+      if (++_retries > EXTRA_REQUESTS) {
+        _failedWindows++;
+        scheduleNext(now);
+        break;
+      }
+      _pms->requestRead();
+      _requestedAt = now;
+    }
+    break;
+  }
+
+  return false;
+}
+
+const PmsDriver::DATA& PmsPowerManager::getAverage() const
+{
+  return _average;
+}
+
+PMS_PowerState PmsPowerManager::getState() const
+{
+  return _state;
+}
+
+uint32_t PmsPowerManager::getFailedWindows() const
+{
+  return _failedWindows;
+}
+
+uint32_t PmsPowerManager::getActiveSeconds() const
+{
+  return _activeMs / 1000;
+}
+
+uint32_t PmsPowerManager::getSleepSeconds() const
+{
+  return _sleepMs / 1000;
+}
+
+uint8_t PmsPowerManager::getDutyCyclePercent() const
+{
+  uint64_t total = _activeMs + _sleepMs;
+  return total == 0 ? 0 : (_activeMs * 100 + total / 2) / total;
+}
+
+// mA * mV * ms / 3.6e9 = mWh
+uint32_t PmsPowerManager::getEnergyMilliwattHours() const
+{
+  uint64_t active = _activeMs * ACTIVE_CURRENT_MA * SUPPLY_MV;
+  uint64_t standby = _sleepMs * STANDBY_CURRENT_UA * SUPPLY_MV / 1000;
+  return (active + standby) / 3600000000ULL;
+}
+
+uint16_t PmsPowerManager::getLaserHoursRemaining() const
+{
+  uint32_t used = _activeMs / 3600000UL;
+  return used >= LASER_LIFE_HOURS ? 0 : LASER_LIFE_HOURS - used;
+}
+
+void PmsPowerManager::startSampling(uint32_t now)
+{
+  for (uint8_t i = 0; i < DATA_WORDS; i++) {
+    _sum[i] = 0;
+  }
+  _count = 0;
+  _retries = 0;
+
+  _pms->requestRead();
+  _requestedAt = now;
+  _state = PMS_POWER_SAMPLING;
+}
+
+bool PmsPowerManager::readFrame()
+{
+  for (uint8_t i = 0; i < BYTES_PER_UPDATE; i++) {
+    if (_pms->read(_frame)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void PmsPowerManager::accumulate()
+{
+  // DATA is a run of 16 bit words
+  const uint16_t* words = &_frame.PM_SP_UG_1_0;
+  for (uint8_t i = 0; i < DATA_WORDS; i++) {
+    _sum[i] += i == TMP_WORD ? (int16_t)words[i] : words[i];
+  }
+  _count++;
+}
+
+void PmsPowerManager::finishWindow(uint32_t now)
+{
+  uint16_t* words = &_average.PM_SP_UG_1_0;
+  int32_t half = _count / 2;
+  for (uint8_t i = 0; i < DATA_WORDS; i++) {
+    words[i] = (_sum[i] + (_sum[i] < 0 ? -half : half)) / _count;
+  }
+  scheduleNext(now);
+}
+
+void PmsPowerManager::scheduleNext(uint32_t now)
+{
+  _windowStart += _intervalMs;
+  // skip windows that were missed, e.g. while the sketch was blocked
+  if (reached(now, _windowStart)) {
+    _windowStart = _intervalMs == 0 ? now :
+      now + _intervalMs - (now - _windowStart) % _intervalMs;
+  }
+
+  if ((uint32_t)(_windowStart - now) > _warmUpMs) {
+    _pms->sleep();
+    _state = PMS_POWER_SLEEPING;
+  } else {
+    _state = PMS_POWER_WARMING_UP;
+  }
+}
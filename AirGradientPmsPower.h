@@ -0,0 +1,102 @@
+/*
+  AirGradientPmsPower.h - Duty-cycled power management for Plantower PMS sensors
+
+  Keeps the fan and laser off between measurement windows. The sensor is
+  woken STEADY_RESPONSE_TIME ahead of each window, put into passive mode,
+  polled for a number of frames that are averaged, and put back to sleep.
+
+    PmsPowerManager power(pms);
+
+    void setup() {
+      pmsSerial.begin(9600);
+      pms.begin(pmsSerial);
+      power.begin(5 * 60 * 1000UL);
+    }
+
+    void loop() {
+      if (power.update()) {
+        Serial.println(power.getAverage().PM_AE_UG_2_5);
+      }
+    }
+
+  update() never blocks and takes the current time as an argument, so the
+  schedule can be driven from a simulated clock.
+*/
+
+#ifndef AirGradientPmsPower_h
+#define AirGradientPmsPower_h
+
+#include "Arduino.h"
+#include "AirGradientPms.h"
+
+typedef enum {
+  PMS_POWER_SLEEPING,
+  PMS_POWER_WARMING_UP,
+  PMS_POWER_SAMPLING
+} PMS_PowerState;
+
+class PmsPowerManager
+{
+  public:
+    static const uint8_t MAX_SAMPLES = 16;
+
+    // Plantower PMS5003 datasheet: <= 100 mA active, <= 200 uA standby at 5 V,
+    // laser MTTF >= 8000 h of operation.
+    static const uint16_t ACTIVE_CURRENT_MA = 100;
+    static const uint16_t STANDBY_CURRENT_UA = 200;
+    static const uint16_t SUPPLY_MV = 5000;
+    static const uint16_t LASER_LIFE_HOURS = 8000;
+
+    PmsPowerManager(PmsDriver& pms);
+
+    // A window starts every intervalMs; the first one as soon as the sensor
+    // has warmed up. If intervalMs leaves no room to sleep, the sensor stays
+    // awake and only the sampling is scheduled.
+    void begin(uint32_t intervalMs, uint8_t samples = 5,
+               uint32_t warmUpMs = PmsDriver::STEADY_RESPONSE_TIME, uint32_t now = millis());
+
+    // Returns true when a new average is available.
+    bool update(uint32_t now = millis());
+
+    const PmsDriver::DATA& getAverage() const;
+    PMS_PowerState getState() const;
+    uint32_t getFailedWindows() const;
+
+    // Energy and runtime estimate since begin()
+    uint32_t getActiveSeconds() const;
+    uint32_t getSleepSeconds() const;
+    uint8_t getDutyCyclePercent() const;
+    uint32_t getEnergyMilliwattHours() const;
+    uint16_t getLaserHoursRemaining() const;
+
+  private:
+    PmsDriver* _pms;
+    PmsDriver::DATA _frame;
+    PmsDriver::DATA _average;
+    PMS_PowerState _state = PMS_POWER_SLEEPING;
+
+    uint32_t _intervalMs = 0;
+    uint32_t _warmUpMs = 0;
+    uint8_t _samples = 0;
+
+    uint32_t _windowStart = 0;
+    uint32_t _wokenAt = 0;
+    uint32_t _requestedAt = 0;
+    uint32_t _lastUpdate = 0;
+
+    int32_t _sum[sizeof(PmsDriver::DATA) / sizeof(uint16_t)];
+    uint8_t _count = 0;
+    uint8_t _retries = 0;
+    uint32_t _failedWindows = 0;
+
+    uint64_t _activeMs = 0;
+    uint64_t _sleepMs = 0;
+
+    void startSampling(uint32_t now);
+    bool readFrame();
+    void accumulate();
+    void finishWindow(uint32_t now);
+    void scheduleNext(uint32_t now);
+};
+
+#endif
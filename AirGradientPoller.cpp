@@ -0,0 +1,192 @@
+/*
+  AirGradientPoller.cpp - Conditional HTTP polling for the AirGradient library
+*/
+
+#include "AirGradientPoller.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Copies a header value without the leading blanks, or nothing if it does
+// not fit: a cut validator would never match.
+static void copyValue(char* target, uint8_t size, const char* value)
+{
+  while (*value == ' ' || *value == '\t') {
+    value++;
+  }
+  if (strlen(value) < size) {
+    strcpy(target, value);
+  } else {
+    target[0] = '\0';
+  }
+}
+
+ConditionalPoller::ConditionalPoller(Client& client, uint32_t timeoutMs)
+{
+  _client = &client;
+  _timeoutMs = timeoutMs;
+  _etag[0] = '\0';
+  _lastModified[0] = '\0';
+}
+
+POLL_Status ConditionalPoller::poll(const char* host, uint16_t port, const char* path, JsonExtractor& json)
+{
+  POLL_Status status = request(host, port, path, json);
+  _client->stop();
+
+  switch (status) {
+    case POLL_NOT_MODIFIED:
+      _hits++;
+      break;
+    case POLL_UNCHANGED:
+      _unchanged++;
+    // fall through
+    case POLL_CHANGED:
+      _misses++;
+      break;
+    default:
+      _errors++;
+      break;
+  }
+  return status;
+}
+
+void ConditionalPoller::invalidate()
+{
+  _etag[0] = '\0';
+  _lastModified[0] = '\0';
+  _hasHash = false;
+}
+
+POLL_Status ConditionalPoller::request(const char* host, uint16_t port, const char* path, JsonExtractor& json)
+{
+  _httpCode = 0;
+  if (!_client->connect(host, port)) {
+    return POLL_CONNECT_FAILED;
+  }
+
+  // HTTP/1.0: no chunked body, and the server closes when it is done
+  _client->print("GET ");
+  _client->print(path);
+  _client->print(" HTTP/1.0\r\nHost: ");
+  _client->print(host);
+  _client->print("\r\n");
+  if (_etag[0] != '\0') {
+    _client->print("If-None-Match: ");
+    _client->print(_etag);
+    _client->print("\r\n");
+  }
+  if (_lastModified[0] != '\0') {
+    _client->print("If-Modified-Since: ");
+    _client->print(_lastModified);
+    _client->print("\r\n");
+  }
+  _client->print("Connection: close\r\n\r\n");
+
+  char line[LINE_SIZE];
+  if (!readLine(line, sizeof(line))) {
+    return POLL_TIMEOUT;
+  }
+  const char* code = strchr(line, ' ');
+  if (strncmp(line, "HTTP/", 5) != 0 || code == NULL) {
+    return POLL_BAD_RESPONSE;
+  }
+  _httpCode = atoi(code + 1);
+
+  // the validators only replace the stored ones once the body was parsed
+  char etag[ETAG_SIZE] = "";
+  char lastModified[DATE_SIZE] = "";
+  while (true) {
+    if (!readLine(line, sizeof(line))) {
+      return POLL_TIMEOUT;
+    }
+    if (line[0] == '\0') {
+      break;
+    }
+    if (strncasecmp(line, "ETag:", 5) == 0) {
+      copyValue(etag, sizeof(etag), line + 5);
+    } else if (strncasecmp(line, "Last-Modified:", 14) == 0) {
+      copyValue(lastModified, sizeof(lastModified), line + 14);
+    }
+  }
+
+  if (_httpCode == 304) {
+    return _hasHash ? POLL_NOT_MODIFIED : POLL_BAD_RESPONSE;
+  }
+  if (_httpCode != 200) {
+    return POLL_HTTP_ERROR;
+  }
+
+  JSON_Status parsed = json.parse(*_client, _timeoutMs);
+  _bodyBytes += json.getBytes();
+  if (parsed != JSON_OK) {
+    // the fields may be half updated, so the next poll must not get a 304
+    invalidate();
+    return parsed == JSON_TIMEOUT ? POLL_TIMEOUT : POLL_PARSE_ERROR;
+  }
+
+  strcpy(_etag, etag);
+  strcpy(_lastModified, lastModified);
+  uint32_t hash = json.getHash();
+  bool unchanged = _hasHash && hash == _hash;
+  _hash = hash;
+  _hasHash = true;
+  return unchanged ? POLL_UNCHANGED : POLL_CHANGED;
+}
+
+// Reads one header line without the line break; longer lines are cut.
+bool ConditionalPoller::readLine(char* line, uint8_t size)
+{
+  uint8_t length = 0;
+  uint32_t lastData = millis();
+
+  while (true) {
+    if (_client->available() <= 0) {
+      if (!_client->connected() || millis() - lastData >= _timeoutMs) {
+        return false;
+      }
+      yield();
+      continue;
+    }
+    int c = _client->read();
+    lastData = millis();
+    if (c == '\n') {
+      break;
+    }
+    if (c != '\r' && length < size - 1) {
+      line[length++] = c;
+    }
+  }
+  line[length] = '\0';
+  return true;
+}
+
+int ConditionalPoller::getHttpCode() const
+{
+  return _httpCode;
+}
+
+uint32_t ConditionalPoller::getHits() const
+{
+  return _hits;
+}
+
+uint32_t ConditionalPoller::getMisses() const
+{
+  return _misses;
+}
+
+uint32_t ConditionalPoller::getUnchanged() const
+{
+  return _unchanged;
+}
+
+uint32_t ConditionalPoller::getErrors() const
+{
+  return _errors;
+}
+
+uint32_t ConditionalPoller::getBodyBytes() const
+{
+  return _bodyBytes;
+}
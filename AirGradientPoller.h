@@ -0,0 +1,87 @@
+/*
+  AirGradientPoller.h - Conditional HTTP polling for the AirGradient library
+
+  Fetches a JSON document with a plain HTTP/1.0 GET over any Client and
+  remembers the ETag and Last-Modified validators of the last good
+  response. The next request sends them as If-None-Match and
+  If-Modified-Since, so an unchanged document costs a 304 without a body.
+  A 200 is streamed into a JsonExtractor, and the hash of the extracted
+  values is compared with the previous one, so the caller only has to
+  redraw when poll() returns POLL_CHANGED:
+
+    WiFiClient client;
+    ConditionalPoller poller(client);
+
+    void loop() {
+      JsonExtractor json(fields, count);
+      if (poller.poll("hw.airgradient.com", 80, "/displays/abc", json) == POLL_CHANGED) {
+        updateDisplay();
+      }
+    }
+
+  getHits() counts 304 responses, getMisses() full downloads, and
+  getUnchanged() those downloads whose values turned out to be the same.
+*/
+
+#ifndef AirGradientPoller_h
+#define AirGradientPoller_h
+
+#include "Arduino.h"
+#include "Client.h"
+#include "AirGradientJson.h"
+
+typedef enum {
+  POLL_CHANGED = 0,
+  // 304, the fields keep their values
+  POLL_NOT_MODIFIED = 1,
+  // 200 with the same values as before
+  POLL_UNCHANGED = 2,
+  POLL_CONNECT_FAILED = -1,
+  POLL_TIMEOUT = -2,
+  POLL_BAD_RESPONSE = -3,
+  POLL_HTTP_ERROR = -4,
+  POLL_PARSE_ERROR = -5
+} POLL_Status;
+
+class ConditionalPoller
+{
+  public:
+    static const uint8_t ETAG_SIZE = 64;
+    static const uint8_t DATE_SIZE = 32;
+    static const uint8_t LINE_SIZE = 128;
+
+    ConditionalPoller(Client& client, uint32_t timeoutMs = 5000);
+
+    POLL_Status poll(const char* host, uint16_t port, const char* path, JsonExtractor& json);
+    // Forgets the validators and the hash, the next poll() is a full
+    // download reported as POLL_CHANGED.
+    void invalidate();
+
+    int getHttpCode() const;
+    uint32_t getHits() const;
+    uint32_t getMisses() const;
+    uint32_t getUnchanged() const;
+    uint32_t getErrors() const;
+    uint32_t getBodyBytes() const;
+
+  private:
+    Client* _client;
+    uint32_t _timeoutMs;
+
+    char _etag[ETAG_SIZE];
+    char _lastModified[DATE_SIZE];
+    bool _hasHash = false;
+    uint32_t _hash = 0;
+
+    int _httpCode = 0;
+    uint32_t _hits = 0;
+    uint32_t _misses = 0;
+    uint32_t _unchanged = 0;
+    uint32_t _errors = 0;
+    uint32_t _bodyBytes = 0;
+
+    POLL_Status request(const char* host, uint16_t port, const char* path, JsonExtractor& json);
+    bool readLine(char* line, uint8_t size);
+};
+
+#endif
@@ -0,0 +1,352 @@
+/*
+  AirGradientReport.cpp - Measurement records and change driven reporting for the AirGradient library
+*/
+
+#include "AirGradientReport.h"
+
+static const char* const measureKeys[MEASURE_COUNT] = {
+  "wifi", "rco2", "pm01", "pm02", "pm10", "pm003_count",
+  "tvoc_index", "nox_index", "atmp", "rhum", "boot"
+};
+
+void Measures::set(Measure_Field field, float value)
+{
+  values[field] = value;
+  present |= 1 << field;
+}
+
+void Measures::clear(Measure_Field field)
+{
+  present &= ~(1 << field);
+}
+
+bool Measures::has(Measure_Field field) const
+{
+  return present & (1 << field);
+}
+
+float Measures::get(Measure_Field field) const
+{
+  return values[field];
+}
+
+const char* Measures_key(Measure_Field field)
+{
+  return field < MEASURE_COUNT ? measureKeys[field] : "";
+}
+
+// Only the temperature has decimals; it is printed with two like String(float)
+// without going through printf's float support, which AVR lacks.
+static int formatValue(Measure_Field field, float value, char* buf, size_t size)
+{
+  if (field != MEASURE_ATMP) {
+    return snprintf(buf, size, "%ld", (long)lround(value));
+  }
+  long centi = lround(value * 100);
+  unsigned long magnitude = centi < 0 ? -centi : centi;
+  return snprintf(buf, size, "%s%lu.%02lu", centi < 0 ? "-" : "", magnitude / 100, magnitude % 100);
+}
+
+// Advances len past what snprintf() wrote, or fails if it was truncated.
+static bool append(size_t size, size_t& len, int n)
+{
+  if (n < 0 || len + n >= size) {
+    return false;
+  }
+  len += n;
+  return true;
+}
+
+size_t Measures_writeValue(const Measures& measures, Measure_Field field, char* buf, size_t size)
+{
+  size_t len = 0;
+  if (field >= MEASURE_COUNT || !measures.has(field) ||
+      !append(size, len, formatValue(field, measures.get(field), buf, size))) {
+    return 0;
+  }
+  return len;
+}
+
+size_t Measures_writeJson(const Measures& measures, char* buf, size_t size)
+{
+  size_t len = 0;
+  if (size == 0 || !append(size, len, snprintf(buf, size, "{"))) {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+    Measure_Field field = (Measure_Field)i;
+    if (!measures.has(field)) {
+      continue;
+    }
+    if (!append(size, len, snprintf(buf + len, size - len, "%s\"%s\":", len > 1 ? ", " : "", measureKeys[i])) ||
+        !append(size, len, formatValue(field, measures.get(field), buf + len, size - len))) {
+      return 0;
+    }
+  }
+
+  if (!append(size, len, snprintf(buf + len, size - len, "}"))) {
+    return 0;
+  }
+  return len;
+}
+
+static void skipSpace(const char*& p, const char* end)
+{
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+    p++;
+  }
+}
+
+static bool isDigit(const char* p, const char* end)
+{
+  return p < end && *p >= '0' && *p <= '9';
+}
+
+// Moves p past the closing quote of the string it points into.
+static bool skipString(const char*& p, const char* end)
+{
+  while (p < end && *p != '"') {
+    p += *p == '\\' ? 2 : 1;
+  }
+  if (p >= end) {
+    return false;
+  }
+  p++;
+  return true;
+}
+
+static bool parseNumber(const char*& p, const char* end, float& value)
+{
+  bool negative = p < end && *p == '-';
+  if (negative) {
+    p++;
+  }
+  if (!isDigit(p, end)) {
+    return false;
+  }
+  double result = 0;
+  while (isDigit(p, end)) {
+    result = result * 10 + (*p++ - '0');
+  }
+  if (p < end && *p == '.') {
+    p++;
+    if (!isDigit(p, end)) {
+      return false;
+    }
+    double scale = 1;
+    while (isDigit(p, end)) {
+      scale /= 10;
+      result += (*p++ - '0') * scale;
+    }
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool negativeExponent = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+      p++;
+    }
+    if (!isDigit(p, end)) {
+      return false;
+    }
+    uint16_t exponent = 0;
+    while (isDigit(p, end)) {
+      exponent = exponent < 100 ? exponent * 10 + (*p - '0') : exponent;
+      p++;
+    }
+    while (exponent-- > 0) {
+      result = negativeExponent ? result / 10 : result * 10;
+    }
+  }
+  value = negative ? -result : result;
+  return true;
+}
+
+// Skips one value of any type. Nested values are only checked for
+// balanced brackets and closed strings.
+static bool skipValue(const char*& p, const char* end)
+{
+  uint8_t depth = 0;
+  do {
+    skipSpace(p, end);
+    if (p >= end) {
+      return false;
+    }
+    char c = *p++;
+    if (c == '"') {
+      if (!skipString(p, end)) {
+        return false;
+      }
+    } else if (c == '{' || c == '[') {
+      depth++;
+    } else if (c == '}' || c == ']' || c == ',' || c == ':') {
+      if (depth == 0) {
+        return false;
+      }
+      if (c == '}' || c == ']') {
+        depth--;
+      }
+    } else {
+      // number, true, false or null
+      while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ':' && *p != '"' &&
+             *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+        p++;
+      }
+    }
+  } while (depth > 0);
+  return true;
+}
+
+static int8_t findKey(const char* key, size_t length)
+{
+  for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+    if (strncmp(measureKeys[i], key, length) == 0 && measureKeys[i][length] == '\0') {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool Measures_parseJson(const char* buf, size_t len, Measures& measures)
+{
+  const char* p = buf;
+  const char* end = buf + len;
+  measures.present = 0;
+
+  skipSpace(p, end);
+  if (p >= end || *p++ != '{') {
+    return false;
+  }
+  skipSpace(p, end);
+  if (p < end && *p == '}') {
+    p++;
+  } else {
+    while (true) {
+      skipSpace(p, end);
+      if (p >= end || *p++ != '"') {
+        return false;
+      }
+      const char* key = p;
+      if (!skipString(p, end)) {
+        return false;
+      }
+      int8_t field = findKey(key, p - 1 - key);
+      skipSpace(p, end);
+      if (p >= end || *p++ != ':') {
+        return false;
+      }
+      skipSpace(p, end);
+
+      if (field >= 0 && p < end && (*p == '-' || isDigit(p, end))) {
+        float value;
+        if (!parseNumber(p, end, value)) {
+          return false;
+        }
+        measures.set((Measure_Field)field, value);
+      } else if (!skipValue(p, end)) {
+        return false;
+      }
+
+      skipSpace(p, end);
+      if (p >= end) {
+        return false;
+      }
+      if (*p == ',') {
+        p++;
+      } else if (*p++ == '}') {
+        break;
+      } else {
+        return false;
+      }
+    }
+  }
+  skipSpace(p, end);
+  return p == end;
+}
+
+ReportPolicy::ReportPolicy(uint32_t heartbeatMs)
+{
+  _heartbeatMs = heartbeatMs;
+  for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+    _absolute[i] = 0;
+    _relative[i] = 0;
+  }
+  ignore(MEASURE_WIFI);
+  ignore(MEASURE_BOOT);
+}
+
+void ReportPolicy::setDeadband(Measure_Field field, float absolute, float relativePercent)
+{
+  _absolute[field] = absolute;
+  _relative[field] = relativePercent;
+  _ignored &= ~(1 << field);
+}
+
+void ReportPolicy::ignore(Measure_Field field)
+{
+  _ignored |= 1 << field;
+}
+
+void ReportPolicy::setHeartbeat(uint32_t heartbeatMs)
+{
+  _heartbeatMs = heartbeatMs;
+}
+
+bool ReportPolicy::shouldSend(const Measures& measures, uint32_t now)
+{
+  bool send = !_sentOnce || now - _lastSentAt >= _heartbeatMs;
+
+  for (uint8_t i = 0; i < MEASURE_COUNT && !send; i++) {
+    send = changed((Measure_Field)i, measures);
+  }
+
+  if (!send) {
+    _suppressed++;
+  }
+  return send;
+}
+
+void ReportPolicy::markSent(const Measures& measures, uint32_t now)
+{
+  _lastSent = measures;
+  _lastSentAt = now;
+  _sentOnce = true;
+  _sent++;
+}
+
+void ReportPolicy::reset()
+{
+  _sentOnce = false;
+}
+
+uint32_t ReportPolicy::getSentCount() const
+{
+  return _sent;
+}
+
+uint32_t ReportPolicy::getSuppressedCount() const
+{
+  return _suppressed;
+}
+
+bool ReportPolicy::changed(Measure_Field field, const Measures& measures) const
+{
+  if (_ignored & (1 << field)) {
+    return false;
+  }
+  if (measures.has(field) != _lastSent.has(field)) {
+    return true;
+  }
+  if (!measures.has(field)) {
+    return false;
+  }
+
+  float last = _lastSent.get(field);
+  float band = _absolute[field];
+  float relative = fabs(last) * _relative[field] / 100;
+  if (relative > band) {
+    band = relative;
+  }
+  float delta = fabs(measures.get(field) - last);
+  return band == 0 ? delta != 0 : delta > band;
+}
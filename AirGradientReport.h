@@ -0,0 +1,114 @@
+/*
+  AirGradientReport.h - Measurement records and change driven reporting for the AirGradient library
+
+  A Measures record holds one reading of every metric a board reports,
+  each marked present or absent. Measures_writeJson() renders it in the
+  format the AirGradient server accepts on /measures.
+
+  Measures_parseJson() is the reverse, for whatever receives the payload.
+
+  ReportPolicy decides whether a record is worth uploading: only if a
+  metric moved beyond its deadband since the last record that was sent,
+  a metric appeared or disappeared, or the heartbeat interval has passed.
+
+    ReportPolicy policy(5 * 60 * 1000UL);
+
+    void setup() {
+      policy.setDeadband(MEASURE_RCO2, 10);      // ppm
+      policy.setDeadband(MEASURE_PM02, 1, 10);   // 1 ug/m3 or 10 %
+    }
+
+    void sendToServer() {
+      if (!policy.shouldSend(measures)) return;
+      ... POST Measures_writeJson(measures, ...) ...
+      if (httpCode == 200) policy.markSent(measures);
+    }
+*/
+
+#ifndef AirGradientReport_h
+#define AirGradientReport_h
+
+#include "Arduino.h"
+
+// In payload order
+typedef enum {
+  MEASURE_WIFI,
+  MEASURE_RCO2,
+  MEASURE_PM01,
+  MEASURE_PM02,
+  MEASURE_PM10,
+  MEASURE_PM003_COUNT,
+  MEASURE_TVOC_INDEX,
+  MEASURE_NOX_INDEX,
+  MEASURE_ATMP,
+  MEASURE_RHUM,
+  MEASURE_BOOT,
+  MEASURE_COUNT
+} Measure_Field;
+
+struct Measures {
+  float values[MEASURE_COUNT];
+  uint16_t present = 0;
+
+  void set(Measure_Field field, float value);
+  void clear(Measure_Field field);
+  bool has(Measure_Field field) const;
+  float get(Measure_Field field) const;
+};
+
+const char* Measures_key(Measure_Field field);
+
+// Buffer that holds any record Measures_writeJson() renders, NUL included:
+// every metric present and each value as long as a 32 bit long prints.
+#define MEASURES_JSON_SIZE 240
+
+// Returns the length written, or 0 if the payload does not fit in size.
+size_t Measures_writeJson(const Measures& measures, char* buf, size_t size);
+// One value as it appears in the payload; 0 if absent or it does not fit.
+size_t Measures_writeValue(const Measures& measures, Measure_Field field, char* buf, size_t size);
+// Reads a payload back, e.g. on a collector such as the one in
+// extras/tools/measures_collector.cpp. Scans buf in place, which
+// needs no terminating NUL. Unknown keys, such as the "channels" object
+// of the outdoor monitors, are skipped, and so are null values. Returns
+// false if the payload is malformed.
+bool Measures_parseJson(const char* buf, size_t len, Measures& measures);
+
+class ReportPolicy
+{
+  public:
+    // MEASURE_WIFI and MEASURE_BOOT are sent along but never trigger a send
+    // on their own.
+    ReportPolicy(uint32_t heartbeatMs);
+
+    // A field triggers a send once it differs from the last sent value by
+    // more than the larger of both bands. Without a deadband any change does.
+    void setDeadband(Measure_Field field, float absolute, float relativePercent = 0);
+    void ignore(Measure_Field field);
+    void setHeartbeat(uint32_t heartbeatMs);
+
+    bool shouldSend(const Measures& measures, uint32_t now = millis());
+    // Call after the upload succeeded; until then the record stays due.
+    void markSent(const Measures& measures, uint32_t now = millis());
+    // Send the next record regardless of its content
+    void reset();
+
+    uint32_t getSentCount() const;
+    uint32_t getSuppressedCount() const;
+
+  private:
+    uint32_t _heartbeatMs;
+    float _absolute[MEASURE_COUNT];
+    float _relative[MEASURE_COUNT];
+    uint16_t _ignored = 0;
+
+    Measures _lastSent;
+    uint32_t _lastSentAt = 0;
+    bool _sentOnce = false;
+
+    uint32_t _sent = 0;
+    uint32_t _suppressed = 0;
+
+    bool changed(Measure_Field field, const Measures& measures) const;
+};
+
+#endif
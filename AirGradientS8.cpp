@@ -0,0 +1,117 @@
+/*
+  AirGradientS8.cpp - Senseair S8 CO2 driver for the AirGradient library
+*/
+
+#include "AirGradientS8.h"
+
+void S8Driver::begin(Stream& stream)
+{
+  _stream = &stream;
+}
+
+int S8Driver::getCO2(int numberOfSamplesToTake) {
+  int successfulSamplesCounter = 0;
+  int co2AsPpmSum = 0;
+  for (int sample = 0; sample < numberOfSamplesToTake; sample++) {
+    int co2AsPpm = getCO2_Raw();
+    if (co2AsPpm > 300 && co2AsPpm < 10000) {
+      Serial.println("CO2 read success " + String(co2AsPpm));
+      successfulSamplesCounter++;
+      co2AsPpmSum += co2AsPpm;
+    } else {
+      Serial.println("CO2 read failed with " + String(co2AsPpm));
+    }
+
+    // without delay we get a few 10ms spacing, add some more
+    delay(250);
+  }
+
+  if (successfulSamplesCounter <= 0) {
+    // total failure
+    return -5;
+  }
+  Serial.println("# of CO2 reads that worked: " + String(successfulSamplesCounter));
+  Serial.println("CO2 reads sum " + String(co2AsPpmSum));
+  return co2AsPpmSum / successfulSamplesCounter;
+}
+
+int S8Driver::getCO2_Raw() {
+  uint16_t co2;
+  Modbus_Status status = readRegisters(MODBUS_READ_INPUT_REGISTERS, IR_SPACE_CO2, 1, &co2);
+  if (status != MODBUS_OK) {
+    return status;
+  }
+  return co2;
+}
+
+// Meter, alarm and output status together with CO2 cost one round trip,
+// the same as CO2 alone.
+S8_STATUS_RESULT S8Driver::readStatus() {
+  S8_STATUS_RESULT result;
+  uint16_t registers[4];
+
+  if (readRegisters(MODBUS_READ_INPUT_REGISTERS, IR_METER_STATUS, 4, registers) == MODBUS_OK) {
+    result.meterStatus = registers[0];
+    result.alarmStatus = registers[1];
+    result.outputStatus = registers[2];
+    result.co2 = registers[3];
+    result.success = true;
+  }
+  return result;
+}
+
+// ABC (automatic baseline correction) period in hours, 0 if disabled.
+int S8Driver::getABCPeriod() {
+  uint16_t period;
+  Modbus_Status status = readRegisters(MODBUS_READ_HOLDING_REGISTERS, HR_ABC_PERIOD, 1, &period);
+  if (status != MODBUS_OK) {
+    return status;
+  }
+  return period;
+}
+
+Modbus_Status S8Driver::readRegisters(uint8_t function, uint16_t startRegister, uint16_t count,
+                                      uint16_t* registers) {
+  uint8_t request[MODBUS_REQUEST_SIZE];
+  uint8_t response[MODBUS_RESPONSE_SIZE(MAX_REGISTERS)];
+
+  if (count == 0 || count > MAX_REGISTERS) {
+    return MODBUS_BAD_RESPONSE;
+  }
+
+  while(_stream->available())  // flush whatever we might have
+      _stream->read();
+
+  Modbus_buildReadRequest(ADDRESS, function, startRegister, count, request);
+  if (_stream->write(request, sizeof(request)) != sizeof(request)) {
+    // failed to write request
+    return MODBUS_WRITE_FAILED;
+  }
+
+  // attempt to read response, give up after ~500ms without data
+  size_t expected = MODBUS_RESPONSE_SIZE(count);
+  size_t received = 0;
+  int timeoutCounter = 0;
+  while (received < expected) {
+    if (_stream->available()) {
+      uint8_t ch = _stream->read();
+      // skip noise in front of the response
+      if (received == 0 && ch != ADDRESS) {
+        continue;
+      }
+      response[received++] = ch;
+      // exception responses are only 5 bytes long
+      if (received == 2 && (ch & 0x80)) {
+        expected = 5;
+      }
+      continue;
+    }
+    timeoutCounter++;
+    if (timeoutCounter > 10) {
+      return MODBUS_TIMEOUT;
+    }
+    delay(50);
+  }
+
+  return Modbus_decodeReadResponse(response, received, ADDRESS, function, registers, count);
+}
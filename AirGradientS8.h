@@ -0,0 +1,66 @@
+/*
+  AirGradientS8.h - Senseair S8 CO2 driver for the AirGradient library
+*/
+
+#ifndef AirGradientS8_h
+#define AirGradientS8_h
+
+#include "Arduino.h"
+#include "Stream.h"
+#include "AirGradientModbus.h"
+
+// Meter status bits (input register IR1)
+#define S8_STATUS_FATAL_ERROR 0x0001
+#define S8_STATUS_OFFSET_REGULATION_ERROR 0x0002
+#define S8_STATUS_ALGORITHM_ERROR 0x0004
+#define S8_STATUS_OUTPUT_ERROR 0x0008
+#define S8_STATUS_SELF_DIAGNOSTIC_ERROR 0x0010
+#define S8_STATUS_OUT_OF_RANGE 0x0020
+#define S8_STATUS_MEMORY_ERROR 0x0040
+
+//ENUMS STRUCTS FOR CO2 START
+    struct CO2_READ_RESULT {
+    int co2 = -1;
+    bool success = false;
+};
+
+    // Input registers IR1..IR4, read in one transaction.
+    struct S8_STATUS_RESULT {
+    uint16_t meterStatus = 0;
+    uint16_t alarmStatus = 0;
+    uint16_t outputStatus = 0;
+    int co2 = -1;
+    bool success = false;
+};
+//ENUMS STRUCTS FOR CO2 END
+
+class S8Driver
+{
+  public:
+    // 0xFE addresses whichever sensor is on the line
+    static const uint8_t ADDRESS = 0xFE;
+    static const uint8_t MAX_REGISTERS = 8;
+
+    // Register addresses (IRn / HRn in the datasheet are at n - 1)
+    static const uint16_t IR_METER_STATUS = 0x0000;
+    static const uint16_t IR_ALARM_STATUS = 0x0001;
+    static const uint16_t IR_OUTPUT_STATUS = 0x0002;
+    static const uint16_t IR_SPACE_CO2 = 0x0003;
+    static const uint16_t HR_ABC_PERIOD = 0x001F;
+
+    void begin(Stream& stream);
+
+    int getCO2(int numberOfSamplesToTake = 5);
+    int getCO2_Raw();
+
+    S8_STATUS_RESULT readStatus();
+    int getABCPeriod();
+
+    Modbus_Status readRegisters(uint8_t function, uint16_t startRegister, uint16_t count,
+                                uint16_t* registers);
+
+  private:
+    Stream* _stream = NULL;
+};
+
+#endif
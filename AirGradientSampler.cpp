@@ -0,0 +1,101 @@
+/*
+  AirGradientSampler.cpp - Volatility driven sampling interval for the AirGradient library
+*/
+
+#include "AirGradientSampler.h"
+
+// Weight of the newest sample in the running mean and variance. About the
+// last half dozen samples count, so a step is seen within one or two samples.
+static const float ALPHA = 0.3;
+
+// Below THRESHOLD / CALM_DIVISOR a signal counts as flat.
+static const float CALM_DIVISOR = 4;
+
+AdaptiveSampler::AdaptiveSampler(uint32_t minIntervalMs, uint32_t maxIntervalMs)
+{
+  _minIntervalMs = minIntervalMs;
+  _maxIntervalMs = maxIntervalMs < minIntervalMs ? minIntervalMs : maxIntervalMs;
+  _intervalMs = minIntervalMs;
+}
+
+void AdaptiveSampler::setThresholds(float ratePerMinute, float deviation)
+{
+  _rateThreshold = ratePerMinute;
+  _deviationThreshold = deviation;
+}
+
+bool AdaptiveSampler::due(uint32_t now) const
+{
+  return !_attempted || now - _lastAttempt >= _intervalMs;
+}
+
+void AdaptiveSampler::addSample(float value, uint32_t now)
+{
+  _attempted = true;
+  _lastAttempt = now;
+  if (_count == 0) {
+    _firstSample = now;
+    _lastSample = now;
+    _mean = value;
+    _count = 1;
+    return;
+  }
+
+  // rate of the smoothed signal, so sensor noise does not count as change
+  uint32_t elapsed = now - _lastSample;
+  float diff = value - _mean;
+  _rate = elapsed == 0 ? 0 : fabs(ALPHA * diff) * 60000.0 / elapsed;
+  _mean += ALPHA * diff;
+  _variance = (1 - ALPHA) * (_variance + ALPHA * diff * diff);
+
+  _averageInterval = _count == 1 ? elapsed : _averageInterval + ALPHA * (elapsed - _averageInterval);
+  _lastSample = now;
+  _count++;
+
+  float deviation = sqrt(_variance);
+  if (_rate > _rateThreshold || deviation > _deviationThreshold) {
+    // react fast to an event ...
+    _intervalMs = _intervalMs / 2 < _minIntervalMs ? _minIntervalMs : _intervalMs / 2;
+  } else if (_rate < _rateThreshold / CALM_DIVISOR && deviation < _deviationThreshold / CALM_DIVISOR) {
+    // ... and back off slowly once it is over
+    uint32_t longer = _intervalMs + _intervalMs / 4;
+    _intervalMs = longer > _maxIntervalMs ? _maxIntervalMs : longer;
+  }
+}
+
+void AdaptiveSampler::skip(uint32_t now)
+{
+  _attempted = true;
+  _lastAttempt = now;
+}
+
+uint32_t AdaptiveSampler::getInterval() const
+{
+  return _intervalMs;
+}
+
+float AdaptiveSampler::getRatePerMinute() const
+{
+  return _rate;
+}
+
+float AdaptiveSampler::getDeviation() const
+{
+  return sqrt(_variance);
+}
+
+uint32_t AdaptiveSampler::getSampleCount() const
+{
+  return _count;
+}
+
+uint32_t AdaptiveSampler::getAverageIntervalMs() const
+{
+  return _averageInterval;
+}
+
+float AdaptiveSampler::getSamplesPerHour(uint32_t now) const
+{
+  uint32_t elapsed = now - _firstSample;
+  return _count < 2 || elapsed == 0 ? 0 : (_count - 1) * 3600000.0 / elapsed;
+}
@@ -0,0 +1,71 @@
+/*
+  AirGradientSampler.h - Volatility driven sampling interval for the AirGradient library
+
+  Replaces a fixed polling interval. The interval is halved (down to
+  minIntervalMs) as soon as the rate of change or the short term standard
+  deviation of a signal exceeds its threshold, and stretched by a quarter
+  (up to maxIntervalMs) after every sample that is well below both.
+
+    AdaptiveSampler pmSampler(5000, 60000);
+
+    void setup() {
+      pmSampler.setThresholds(5, 3);  // ug/m3 per minute, ug/m3
+    }
+
+    void loop() {
+      if (pmSampler.due()) {
+        pmSampler.addSample(ag.getPM2_Raw());
+      }
+    }
+*/
+
+#ifndef AirGradientSampler_h
+#define AirGradientSampler_h
+
+#include "Arduino.h"
+
+class AdaptiveSampler
+{
+  public:
+    AdaptiveSampler(uint32_t minIntervalMs, uint32_t maxIntervalMs);
+
+    // Rate of change in units per minute, deviation in units.
+    void setThresholds(float ratePerMinute, float deviation);
+
+    bool due(uint32_t now = millis()) const;
+    void addSample(float value, uint32_t now = millis());
+    // A failed read, also before the first sample: wait one interval
+    // before the next attempt
+    void skip(uint32_t now = millis());
+
+    uint32_t getInterval() const;
+    float getRatePerMinute() const;
+    float getDeviation() const;
+
+    // What was actually achieved, as opposed to what was asked for
+    uint32_t getSampleCount() const;
+    uint32_t getAverageIntervalMs() const;
+    float getSamplesPerHour(uint32_t now = millis()) const;
+
+  private:
+    uint32_t _minIntervalMs;
+    uint32_t _maxIntervalMs;
+    uint32_t _intervalMs;
+
+    float _rateThreshold = 0;
+    float _deviationThreshold = 0;
+
+    float _mean = 0;
+    float _variance = 0;
+    float _rate = 0;
+
+    uint32_t _firstSample = 0;
+    uint32_t _lastSample = 0;
+    uint32_t _count = 0;
+    // of a sample or a failed read; due() counts from here
+    bool _attempted = false;
+    uint32_t _lastAttempt = 0;
+    float _averageInterval = 0;
+};
+
+#endif
@@ -0,0 +1,183 @@
+/*
+  AirGradientSgp41.cpp - Non-blocking Sensirion SGP41 VOC/NOx driver for the AirGradient library
+*/
+
+#include "AirGradientSgp41.h"
+
+static const uint16_t SGP41_CMD_EXECUTE_CONDITIONING = 0x2612;
+static const uint16_t SGP41_CMD_MEASURE_RAW_SIGNALS = 0x2619;
+static const uint16_t SGP41_CMD_TURN_HEATER_OFF = 0x3615;
+
+// Sensirion CRC-8: polynomial 0x31, init 0xFF, over each 16 bit word
+static uint8_t crc8(uint8_t msb, uint8_t lsb)
+{
+  uint8_t crc = 0xFF;
+  uint8_t data[2] = { msb, lsb };
+  for (uint8_t i = 0; i < 2; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static bool reached(uint32_t now, uint32_t deadline)
+{
+  return (int32_t)(now - deadline) >= 0;
+}
+
+int Sgp41Driver::begin(I2CBus& bus)
+{
+  _i2c = &bus;
+  _device = bus.addDevice(ADDRESS);
+  if (_device < 0) {
+    _i2c = NULL;
+    _error = SGP41_NOT_CONFIGURED;
+    return _error;
+  }
+  _started = false;
+  _pending = false;
+  _hasNox = false;
+  _error = SGP41_OK;
+  return _error;
+}
+
+void Sgp41Driver::setCompensation(uint16_t rhTicks, uint16_t tTicks)
+{
+  _rhTicks = rhTicks;
+  _tTicks = tTicks;
+}
+
+// The SHT3x raw words are scaled exactly like the SGP41 ticks.
+void Sgp41Driver::setCompensation(const TMP_RH_Fixed& reading)
+{
+  if (reading.error == SHT3XD_NO_ERROR) {
+    setCompensation(reading.rh_raw, reading.t_raw);
+  } else {
+    setCompensation(DEFAULT_RH_TICKS, DEFAULT_T_TICKS);
+  }
+}
+
+bool Sgp41Driver::update(uint32_t now)
+{
+  if (_i2c == NULL) {
+    return false;
+  }
+  if (!_started) {
+    _started = true;
+    _startedAt = now;
+    _nextSampleAt = now;
+  }
+
+  if (!_pending) {
+    if (!reached(now, _nextSampleAt)) {
+      return false;
+    }
+    _nextSampleAt += SAMPLE_INTERVAL;
+    // don't try to catch up on samples missed while loop() was blocked
+    if (reached(now, _nextSampleAt)) {
+      _nextSampleAt = now + SAMPLE_INTERVAL;
+    }
+
+    _pendingConditioning = !reached(now, _startedAt + CONDITIONING_TIME);
+    _error = sendCommand(_pendingConditioning ? SGP41_CMD_EXECUTE_CONDITIONING
+                                              : SGP41_CMD_MEASURE_RAW_SIGNALS, true);
+    if (_error != SGP41_OK) {
+      return false;
+    }
+    _commandAt = now;
+    _pending = true;
+    return false;
+  }
+
+  if (!reached(now, _commandAt + MEASUREMENT_DELAY)) {
+    return false;
+  }
+  _pending = false;
+
+  // conditioning only returns the VOC signal
+  uint16_t words[2];
+  _error = readWords(words, _pendingConditioning ? 1 : 2);
+  if (_error != SGP41_OK) {
+    return false;
+  }
+  _srawVoc = words[0];
+  _hasNox = !_pendingConditioning;
+  if (_hasNox) {
+    _srawNox = words[1];
+  }
+  return true;
+}
+
+bool Sgp41Driver::isConditioning() const
+{
+  return !_hasNox;
+}
+
+bool Sgp41Driver::hasNox() const
+{
+  return _hasNox;
+}
+
+uint16_t Sgp41Driver::getSrawVoc() const
+{
+  return _srawVoc;
+}
+
+uint16_t Sgp41Driver::getSrawNox() const
+{
+  return _srawNox;
+}
+
+int Sgp41Driver::getError() const
+{
+  return _error;
+}
+
+int Sgp41Driver::turnHeaterOff()
+{
+  if (_i2c == NULL) {
+    return SGP41_NOT_CONFIGURED;
+  }
+  _pending = false;
+  return sendCommand(SGP41_CMD_TURN_HEATER_OFF, false);
+}
+
+int Sgp41Driver::sendCommand(uint16_t command, bool withCompensation)
+{
+  uint8_t buf[8];
+  uint8_t len = 0;
+
+  buf[len++] = command >> 8;
+  buf[len++] = command & 0xFF;
+  if (withCompensation) {
+    uint16_t args[2] = { _rhTicks, _tTicks };
+    for (uint8_t i = 0; i < 2; i++) {
+      buf[len++] = args[i] >> 8;
+      buf[len++] = args[i] & 0xFF;
+      buf[len++] = crc8(args[i] >> 8, args[i] & 0xFF);
+    }
+  }
+
+  I2C_Status status = _i2c->write(_device, buf, len);
+  return status == I2C_OK ? (int)SGP41_OK : (int)status;
+}
+
+int Sgp41Driver::readWords(uint16_t* words, uint8_t count)
+{
+  uint8_t buf[6];
+
+  I2C_Status status = _i2c->read(_device, buf, count * 3);
+  if (status != I2C_OK) {
+    return status;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t* word = &buf[i * 3];
+    if (crc8(word[0], word[1]) != word[2]) {
+      return SGP41_CRC_ERROR;
+    }
+    words[i] = (word[0] << 8) | word[1];
+  }
+  return SGP41_OK;
+}
@@ -0,0 +1,99 @@
+/*
+  AirGradientSgp41.h - Non-blocking Sensirion SGP41 VOC/NOx driver for the AirGradient library
+
+  Runs the 10s NOx conditioning from the first update() on (setup() may
+  take longer than that) and then one raw signal measurement per second.
+  Each measurement is split into the command write and, 50ms later, the
+  result read, so update() returns right away and can be called on every
+  loop() pass next to the other sensors.
+
+    I2CBus i2c(Wire);
+    Sgp41Driver sgp41;
+
+    void setup() {
+      Wire.begin(I2C_SDA, I2C_SCL);
+      i2c.begin(I2C_SDA, I2C_SCL);
+      sgp41.begin(i2c);
+    }
+
+    void loop() {
+      sgp41.setCompensation(shtReading);   // latest cached SHT3x result
+      if (sgp41.update()) {
+        TVOC = voc_algorithm.process(sgp41.getSrawVoc());
+        if (sgp41.hasNox()) NOX = nox_algorithm.process(sgp41.getSrawNox());
+      }
+    }
+
+  The raw signals are meant for the Sensirion Gas Index Algorithm, which
+  must see one sample per second.
+*/
+
+#ifndef AirGradientSgp41_h
+#define AirGradientSgp41_h
+
+#include "Arduino.h"
+#include "AirGradientI2C.h"
+#include "AirGradientSht3x.h"
+
+typedef enum {
+  SGP41_OK = 0,
+  // bus errors are reported as I2C_Status (-10 .. -80)
+  SGP41_CRC_ERROR = -101,
+  SGP41_NOT_CONFIGURED = -102
+} SGP41_Status;
+
+class Sgp41Driver
+{
+  public:
+    static const uint8_t ADDRESS = 0x59;
+
+    static const uint16_t CONDITIONING_TIME = 10000;
+    static const uint16_t SAMPLE_INTERVAL = 1000;
+    static const uint8_t MEASUREMENT_DELAY = 50;
+
+    // Compensation defaults from the datasheet: 50 %RH, 25 degrees C
+    static const uint16_t DEFAULT_RH_TICKS = 0x8000;
+    static const uint16_t DEFAULT_T_TICKS = 0x6666;
+
+    int begin(I2CBus& bus);
+
+    void setCompensation(uint16_t rhTicks, uint16_t tTicks);
+    // Falls back to the defaults if the reading failed.
+    void setCompensation(const TMP_RH_Fixed& reading);
+
+    // Returns true when a new raw sample is available.
+    bool update(uint32_t now = millis());
+
+    bool isConditioning() const;
+    bool hasNox() const;
+    uint16_t getSrawVoc() const;
+    uint16_t getSrawNox() const;
+    int getError() const;
+
+    // Stops the hot plate until the next measurement.
+    int turnHeaterOff();
+
+  private:
+    I2CBus* _i2c = NULL;
+    int8_t _device = I2C_NO_DEVICE;
+
+    uint16_t _rhTicks = DEFAULT_RH_TICKS;
+    uint16_t _tTicks = DEFAULT_T_TICKS;
+
+    bool _started = false;
+    uint32_t _startedAt = 0;
+    uint32_t _nextSampleAt = 0;
+    uint32_t _commandAt = 0;
+    bool _pending = false;
+    bool _pendingConditioning = false;
+
+    uint16_t _srawVoc = 0;
+    uint16_t _srawNox = 0;
+    bool _hasNox = false;
+    int _error = SGP41_NOT_CONFIGURED;
+
+    int sendCommand(uint16_t command, bool withCompensation);
+    int readWords(uint16_t* words, uint8_t count);
+};
+
+#endif
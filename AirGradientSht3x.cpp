@@ -0,0 +1,317 @@
+/*
+  AirGradientSht3x.cpp - Sensirion SHT3x temperature/humidity driver for the AirGradient library
+*/
+
+#include "AirGradientSht3x.h"
+
+// Wire errors share their codes with I2C_Status; everything the bus adds on
+// top of Wire (timeouts, stuck bus) is reported as a timeout.
+static TMP_RH_ErrorCode toTMP_RH_Error(I2C_Status status) {
+  if (status >= I2C_UNKNOWN_ERROR)
+    return (TMP_RH_ErrorCode)status;
+  return SHT3XD_TIMEOUT_ERROR;
+}
+
+TMP_RH_ErrorCode Sht3xDriver::begin(uint8_t address) {
+  _address = address;
+  return periodicStart(SHT3XD_REPEATABILITY_HIGH, SHT3XD_FREQUENCY_10HZ);
+}
+
+// Route all TMP_RH traffic through a shared bus so it is coordinated with the
+// other I2C devices and gets timeouts, bus recovery and statistics.
+TMP_RH_ErrorCode Sht3xDriver::begin(uint8_t address, I2CBus& bus) {
+  _i2c = &bus;
+  _i2cDevice = bus.addDevice(address);
+  if (_i2cDevice < 0) {
+    _i2c = NULL;
+    return SHT3XD_WIRE_I2C_UNKNOW_ERROR;
+  }
+  return begin(address);
+}
+
+TMP_RH_ErrorCode Sht3xDriver::reset()
+{
+  return  softReset();
+}
+
+TMP_RH Sht3xDriver::periodicFetchData() //
+{
+  TMP_RH result;
+  TMP_RH_ErrorCode error = writeCommand(SHT3XD_CMD_FETCH_DATA);
+  if (error == SHT3XD_NO_ERROR){
+    result = readTemperatureAndHumidity();
+    return result;
+  }
+  else
+    return returnError(error);
+}
+
+TMP_RH_Fixed Sht3xDriver::periodicFetchDataFixed()
+{
+  TMP_RH_Fixed result;
+  uint16_t buf[2] = { 0, 0 };
+
+  result.error = writeCommand(SHT3XD_CMD_FETCH_DATA);
+  if (result.error == SHT3XD_NO_ERROR)
+    result.error = read_TMP_RH(buf, 2);
+
+  result.t_raw = buf[0];
+  result.rh_raw = buf[1];
+  result.t_centi = result.error == SHT3XD_NO_ERROR ? TMP_RH_rawToCentiCelsius(buf[0]) : 0;
+  result.rh_centi = result.error == SHT3XD_NO_ERROR ? TMP_RH_rawToCentiPercent(buf[1]) : 0;
+  return result;
+}
+
+TMP_RH_ErrorCode Sht3xDriver::periodicStop() {
+  return writeCommand(SHT3XD_CMD_STOP_PERIODIC);
+}
+
+TMP_RH_ErrorCode Sht3xDriver::periodicStart(TMP_RH_Repeatability repeatability, TMP_RH_Frequency frequency) //
+{
+  TMP_RH_ErrorCode error;
+
+  switch (repeatability)
+  {
+  case SHT3XD_REPEATABILITY_LOW:
+    switch (frequency)
+    {
+    case SHT3XD_FREQUENCY_HZ5:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_HALF_L);
+      break;
+    case SHT3XD_FREQUENCY_1HZ:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_1_L);
+      break;
+    case SHT3XD_FREQUENCY_2HZ:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_2_L);
+      break;
+    case SHT3XD_FREQUENCY_4HZ:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_4_L);
+      break;
+    case SHT3XD_FREQUENCY_10HZ:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_10_L);
+      break;
+    default:
+      error = SHT3XD_PARAM_WRONG_FREQUENCY;
+      break;
+    }
+    break;
+  case SHT3XD_REPEATABILITY_MEDIUM:
+    switch (frequency)
+    {
+    case SHT3XD_FREQUENCY_HZ5:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_HALF_M);
+      break;
+    case SHT3XD_FREQUENCY_1HZ:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_1_M);
+      break;
+    case SHT3XD_FREQUENCY_2HZ:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_2_M);
+      break;
+    case SHT3XD_FREQUENCY_4HZ:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_4_M);
+      break;
+    case SHT3XD_FREQUENCY_10HZ:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_10_M);
+      break;
+    default:
+      error = SHT3XD_PARAM_WRONG_FREQUENCY;
+      break;
+    }
+    break;
+
+  case SHT3XD_REPEATABILITY_HIGH:
+    switch (frequency)
+    {
+    case SHT3XD_FREQUENCY_HZ5:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_HALF_H);
+      break;
+    case SHT3XD_FREQUENCY_1HZ:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_1_H);
+      break;
+    case SHT3XD_FREQUENCY_2HZ:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_2_H);
+      break;
+    case SHT3XD_FREQUENCY_4HZ:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_4_H);
+      break;
+    case SHT3XD_FREQUENCY_10HZ:
+      error = writeCommand(SHT3XD_CMD_PERIODIC_10_H);
+      break;
+    default:
+      error = SHT3XD_PARAM_WRONG_FREQUENCY;
+      break;
+    }
+    break;
+  default:
+    error = SHT3XD_PARAM_WRONG_REPEATABILITY;
+    break;
+  }
+
+  delay(100);
+
+  return error;
+}
+
+
+TMP_RH_ErrorCode Sht3xDriver::writeCommand(TMP_RH_Commands command)
+{
+  if (_i2c) {
+    uint8_t cmd[2] = { (uint8_t)(command >> 8), (uint8_t)(command & 0xFF) };
+    I2C_Status status = _i2c->write(_i2cDevice, cmd, sizeof(cmd));
+    return toTMP_RH_Error(status);
+  }
+  Wire.beginTransmission(_address);
+  Wire.write(command >> 8);
+  Wire.write(command & 0xFF);
+  return (TMP_RH_ErrorCode)(-10 * Wire.endTransmission());
+}
+
+TMP_RH_ErrorCode Sht3xDriver::softReset() {
+  return writeCommand(SHT3XD_CMD_SOFT_RESET);
+}
+
+
+uint32_t Sht3xDriver::readSerialNumber()
+{
+  uint32_t result = SHT3XD_NO_ERROR;
+  uint16_t buf[2];
+
+  if (writeCommand(SHT3XD_CMD_READ_SERIAL_NUMBER) == SHT3XD_NO_ERROR) {
+    if (read_TMP_RH(buf, 2) == SHT3XD_NO_ERROR) {
+      result = ((uint32_t)buf[0] << 16) | buf[1];
+    }
+  }
+
+  return result;
+}
+
+TMP_RH_ErrorCode Sht3xDriver::clearAll() {
+  return writeCommand(SHT3XD_CMD_CLEAR_STATUS);
+}
+
+
+TMP_RH Sht3xDriver::readTemperatureAndHumidity()//
+{
+  TMP_RH result;
+
+  result.t = 0;
+  result.rh = 0;
+
+  uint16_t buf[2];
+
+  TMP_RH_ErrorCode error = read_TMP_RH(buf, 2);
+
+  if (error == SHT3XD_NO_ERROR) {
+    result.t = calculateTemperature(buf[0]);
+    result.rh = calculateHumidity(buf[1]);
+  }
+  result.error = error;
+
+  return result;
+}
+
+TMP_RH_ErrorCode Sht3xDriver::read_TMP_RH(uint16_t* data, uint8_t numOfPair)//
+{
+  uint8_t buf[2];
+  uint8_t checksum;
+
+  const uint8_t numOfBytes = numOfPair * 3;
+  uint8_t raw[6];
+
+  if (numOfBytes > sizeof(raw))
+    return SHT3XD_WIRE_I2C_DATA_TOO_LOG;
+
+  if (_i2c) {
+    I2C_Status status = _i2c->read(_i2cDevice, raw, numOfBytes);
+    if (status != I2C_OK)
+      return toTMP_RH_Error(status);
+  } else {
+    Wire.requestFrom(_address, numOfBytes);
+    Wire.readBytes(raw, numOfBytes);
+  }
+
+  int counter = 0;
+
+  for (counter = 0; counter < numOfPair; counter++) {
+    buf[0] = raw[counter * 3];
+    buf[1] = raw[counter * 3 + 1];
+    checksum = raw[counter * 3 + 2];
+
+    if (checkCrc(buf, checksum) != 0)
+      return SHT3XD_CRC_ERROR;
+
+    data[counter] = (buf[0] << 8) | buf[1];
+  }
+
+  return SHT3XD_NO_ERROR;
+}
+
+
+uint8_t Sht3xDriver::checkCrc(uint8_t data[], uint8_t checksum)//
+{
+  return calculateCrc(data) != checksum;
+}
+
+float Sht3xDriver::calculateTemperature(uint16_t rawValue)//
+{
+  float value = 175.0f * (float)rawValue / 65535.0f - 45.0f;
+  return round(value*10)/10;
+}
+
+
+float Sht3xDriver::calculateHumidity(uint16_t rawValue)//
+{
+  return 100.0f * rawValue / 65535.0f;
+}
+
+uint8_t Sht3xDriver::calculateCrc(uint8_t data[])
+{
+  uint8_t bit;
+  uint8_t crc = 0xFF;
+  uint8_t dataCounter = 0;
+
+  for (; dataCounter < 2; dataCounter++)
+  {
+    crc ^= (data[dataCounter]);
+    for (bit = 8; bit > 0; --bit)
+    {
+      if (crc & 0x80)
+        crc = (crc << 1) ^ 0x131;
+      else
+        crc = (crc << 1);
+    }
+  }
+
+  return crc;
+}
+
+TMP_RH Sht3xDriver::returnError(TMP_RH_ErrorCode error) {
+  TMP_RH result;
+  result.t = 0;
+  result.rh = 0;
+  result.error = error;
+  return result;
+}
+
+// Formatting is done on demand into the caller's buffer instead of on every
+// fetch. Temperature is printed from integer tenths so no float printf
+// support is needed. Failed readings print as "NULL".
+size_t TMP_RH_formatTemperature(const TMP_RH& result, char* buf, size_t size)
+{
+  if (result.error != SHT3XD_NO_ERROR)
+    return snprintf(buf, size, "NULL");
+
+  long tenths = lround(result.t * 10);
+  const char* sign = tenths < 0 ? "-" : "";
+  if (tenths < 0)
+    tenths = -tenths;
+  return snprintf(buf, size, "%s%ld.%ld", sign, tenths / 10, tenths % 10);
+}
+
+size_t TMP_RH_formatHumidity(const TMP_RH& result, char* buf, size_t size)
+{
+  if (result.error != SHT3XD_NO_ERROR)
+    return snprintf(buf, size, "NULL");
+
+  return snprintf(buf, size, "%d", result.rh);
+}
@@ -0,0 +1,341 @@
+/*
+  AirGradientTelemetry.cpp - Framed binary telemetry over serial for the AirGradient library
+*/
+
+#include "AirGradientTelemetry.h"
+#include "AirGradientModbus.h"
+
+#include <stdio.h>
+#include <string.h>
+
+struct TelemetryLayout {
+  const char* name;
+  uint8_t count;
+  // bit i set if value i is an int16
+  uint16_t signedMask;
+  // 0 or 2
+  uint8_t decimals;
+  // CSV and JSON names, comma separated
+  const char* fields;
+};
+
+// In TELEMETRY_Type order, starting at TELEMETRY_PMS
+static const TelemetryLayout layouts[] = {
+  { "pms", 12, 0, 0,
+    "pm01_sp,pm02_sp,pm10_sp,pm01,pm02,pm10,"
+    "pm003_count,pm005_count,pm01_count,pm02_count,pm50_count,pm10_count" },
+  { "co2", 1, 0, 0, "rco2" },
+  { "temp_hum", 2, 0x01, 2, "atmp,rhum" },
+  { "sgp41", 4, 0x0C, 0, "sraw_voc,sraw_nox,tvoc_index,nox_index" },
+  { "text", 0, 0, 0, "text" }
+};
+
+static const TelemetryLayout* layout(uint8_t type)
+{
+  if (type < TELEMETRY_PMS || type > TELEMETRY_TEXT) {
+    return NULL;
+  }
+  return &layouts[type - TELEMETRY_PMS];
+}
+
+// Consistent overhead byte stuffing: the output has no 0x00 and is at most
+// one byte longer than the input for inputs below 254 bytes.
+static uint8_t cobsEncode(const uint8_t* data, uint8_t length, uint8_t* out)
+{
+  uint8_t code = 0;
+  uint8_t n = 1;
+  for (uint8_t i = 0; i < length; i++) {
+    if (data[i] == 0) {
+      out[code] = n - code;
+      code = n++;
+    } else {
+      out[n++] = data[i];
+    }
+  }
+  out[code] = n - code;
+  return n;
+}
+
+// In place; returns the decoded length or -1 if the frame is malformed.
+static int cobsDecode(uint8_t* data, uint8_t length)
+{
+  uint8_t in = 0;
+  uint8_t out = 0;
+  while (in < length) {
+    uint8_t code = data[in++];
+    if (code == 0 || in + code - 1 > length) {
+      return -1;
+    }
+    for (uint8_t i = 1; i < code; i++) {
+      data[out++] = data[in++];
+    }
+    if (in < length && code < 0xFF) {
+      data[out++] = 0;
+    }
+  }
+  return out;
+}
+
+TelemetryWriter::TelemetryWriter(Print& out)
+{
+  _out = &out;
+}
+
+void TelemetryWriter::co2(uint16_t ppm, uint32_t now)
+{
+  words(TELEMETRY_CO2, &ppm, 1, now);
+}
+
+void TelemetryWriter::tempHum(int16_t centiCelsius, uint16_t centiPercent, uint32_t now)
+{
+  const uint16_t values[] = { (uint16_t)centiCelsius, centiPercent };
+  words(TELEMETRY_TEMP_HUM, values, 2, now);
+}
+
+void TelemetryWriter::sgp41(uint16_t srawVoc, uint16_t srawNox, int16_t vocIndex, int16_t noxIndex,
+                            uint32_t now)
+{
+  const uint16_t values[] = { srawVoc, srawNox, (uint16_t)vocIndex, (uint16_t)noxIndex };
+  words(TELEMETRY_SGP41, values, 4, now);
+}
+
+void TelemetryWriter::text(const char* text, uint32_t now)
+{
+  size_t length = strlen(text);
+  send(TELEMETRY_TEXT, (const uint8_t*)text, length < TELEMETRY_TEXT_SIZE ? length : TELEMETRY_TEXT_SIZE, now);
+}
+
+uint32_t TelemetryWriter::getRecords() const
+{
+  return _records;
+}
+
+uint32_t TelemetryWriter::getBytes() const
+{
+  return _bytes;
+}
+
+void TelemetryWriter::words(TELEMETRY_Type type, const uint16_t* values, uint8_t count, uint32_t now)
+{
+  uint8_t fields[2 * TELEMETRY_MAX_VALUES];
+  for (uint8_t i = 0; i < count; i++) {
+    fields[2 * i] = values[i] & 0xFF;
+    fields[2 * i + 1] = values[i] >> 8;
+  }
+  send(type, fields, 2 * count, now);
+}
+
+void TelemetryWriter::send(TELEMETRY_Type type, const uint8_t* fields, uint8_t length, uint32_t now)
+{
+  uint8_t record[TELEMETRY_RECORD_SIZE];
+  uint8_t n = 0;
+  record[n++] = type;
+  record[n++] = _seq++;
+  for (uint8_t i = 0; i < 4; i++) {
+    record[n++] = now >> (8 * i);
+  }
+  memcpy(record + n, fields, length);
+  n += length;
+  uint16_t crc = Modbus_crc16(record, n);
+  record[n++] = crc & 0xFF;
+  record[n++] = crc >> 8;
+
+  // delimiter, encoded record, delimiter: one write, so nothing gets between
+  uint8_t frame[TELEMETRY_RECORD_SIZE + 3];
+  frame[0] = 0;
+  uint8_t size = 1 + cobsEncode(record, n, frame + 1);
+  frame[size++] = 0;
+  _out->write(frame, size);
+
+  _records++;
+  _bytes += size;
+}
+
+bool TelemetryDecoder::feed(uint8_t c)
+{
+  if (c != 0) {
+    if (_length < sizeof(_frame)) {
+      _frame[_length++] = c;
+    } else {
+      _overflow = true;
+    }
+    return false;
+  }
+
+  // back to back delimiters enclose nothing
+  if (_length == 0 && !_overflow) {
+    return false;
+  }
+  bool ok = !_overflow && decode();
+  if (!ok) {
+    _errors++;
+  }
+  _length = 0;
+  _overflow = false;
+  return ok;
+}
+
+const TelemetryRecord& TelemetryDecoder::getRecord() const
+{
+  return _record;
+}
+
+uint32_t TelemetryDecoder::getRecords() const
+{
+  return _records;
+}
+
+uint32_t TelemetryDecoder::getErrors() const
+{
+  return _errors;
+}
+
+uint32_t TelemetryDecoder::getLost() const
+{
+  return _lost;
+}
+
+bool TelemetryDecoder::decode()
+{
+  int length = cobsDecode(_frame, _length);
+  if (length < 8) {
+    return false;
+  }
+  uint16_t crc = _frame[length - 2] | (_frame[length - 1] << 8);
+  if (Modbus_crc16(_frame, length - 2) != crc) {
+    return false;
+  }
+
+  const TelemetryLayout* fields = layout(_frame[0]);
+  uint8_t fieldLength = length - 8;
+  if (fields == NULL) {
+    return false;
+  }
+  if (_frame[0] == TELEMETRY_TEXT ? fieldLength > TELEMETRY_TEXT_SIZE : fieldLength != 2 * fields->count) {
+    return false;
+  }
+
+  uint8_t seq = _frame[1];
+  if (_hasSeq && seq != _nextSeq) {
+    _lost += (uint8_t)(seq - _nextSeq);
+  }
+  _hasSeq = true;
+  _nextSeq = seq + 1;
+
+  _record.type = (TELEMETRY_Type)_frame[0];
+  _record.seq = seq;
+  _record.timeMs = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    _record.timeMs |= (uint32_t)_frame[2 + i] << (8 * i);
+  }
+  const uint8_t* data = _frame + 6;
+  _record.count = fields->count;
+  for (uint8_t i = 0; i < fields->count; i++) {
+    uint16_t word = data[2 * i] | (data[2 * i + 1] << 8);
+    _record.values[i] = (fields->signedMask & (1 << i)) ? (int32_t)(int16_t)word : (int32_t)word;
+  }
+  _record.text[0] = '\0';
+  if (_record.type == TELEMETRY_TEXT) {
+    memcpy(_record.text, data, fieldLength);
+    _record.text[fieldLength] = '\0';
+  }
+  _records++;
+  return true;
+}
+
+const char* Telemetry_typeName(TELEMETRY_Type type)
+{
+  const TelemetryLayout* fields = layout(type);
+  return fields != NULL ? fields->name : "";
+}
+
+// Scaled integers without printf's float support, which AVR lacks
+static void printValue(Print& out, int32_t value, uint8_t decimals)
+{
+  char buf[16];
+  if (decimals == 0) {
+    snprintf(buf, sizeof(buf), "%ld", (long)value);
+  } else {
+    uint32_t magnitude = value < 0 ? -value : value;
+    snprintf(buf, sizeof(buf), "%s%lu.%02lu", value < 0 ? "-" : "",
+             (unsigned long)(magnitude / 100), (unsigned long)(magnitude % 100));
+  }
+  out.print(buf);
+}
+
+static void printPrefix(Print& out, const TelemetryRecord& record, const char* format)
+{
+  char buf[48];
+  snprintf(buf, sizeof(buf), format, (unsigned long)record.timeMs, record.seq, Telemetry_typeName(record.type));
+  out.print(buf);
+}
+
+// Quotes and backslashes become ' and control characters blanks, so the
+// quoted text needs no escaping in either format.
+static void printText(Print& out, const char* text)
+{
+  char buf[TELEMETRY_TEXT_SIZE + 3];
+  uint8_t n = 0;
+  buf[n++] = '"';
+  for (const char* c = text; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      buf[n++] = '\'';
+    } else {
+      buf[n++] = (uint8_t)*c < 0x20 ? ' ' : *c;
+    }
+  }
+  buf[n++] = '"';
+  buf[n] = '\0';
+  out.print(buf);
+}
+
+void Telemetry_writeCsvHeader(TELEMETRY_Type type, Print& out)
+{
+  const TelemetryLayout* fields = layout(type);
+  out.print("time_ms,seq,type,");
+  out.print(fields != NULL ? fields->fields : "");
+  out.print("\n");
+}
+
+void Telemetry_writeCsv(const TelemetryRecord& record, Print& out)
+{
+  const TelemetryLayout* fields = layout(record.type);
+  if (fields == NULL) {
+    return;
+  }
+  printPrefix(out, record, "%lu,%u,%s");
+  if (record.type == TELEMETRY_TEXT) {
+    out.print(",");
+    printText(out, record.text);
+  }
+  for (uint8_t i = 0; i < record.count; i++) {
+    out.print(",");
+    printValue(out, record.values[i], fields->decimals);
+  }
+  out.print("\n");
+}
+
+void Telemetry_writeJson(const TelemetryRecord& record, Print& out)
+{
+  const TelemetryLayout* fields = layout(record.type);
+  if (fields == NULL) {
+    return;
+  }
+  printPrefix(out, record, "{\"time_ms\":%lu, \"seq\":%u, \"type\":\"%s\"");
+
+  if (record.type == TELEMETRY_TEXT) {
+    out.print(", \"text\":");
+    printText(out, record.text);
+  }
+  const char* name = fields->fields;
+  char key[24];
+  for (uint8_t i = 0; i < record.count; i++) {
+    const char* end = strchr(name, ',');
+    size_t length = end != NULL ? (size_t)(end - name) : strlen(name);
+    snprintf(key, sizeof(key), ", \"%.*s\":", (int)length, name);
+    out.print(key);
+    printValue(out, record.values[i], fields->decimals);
+    name += length + 1;
+  }
+  out.print("}\n");
+}
@@ -0,0 +1,145 @@
+/*
+  AirGradientTelemetry.h - Framed binary telemetry over serial for the AirGradient library
+
+  A bench logging mode for the USB serial port. Instead of println() of
+  decimal strings, every decoded sample goes out as one small binary
+  record, which takes about a third of the bytes and no formatting:
+
+    TelemetryWriter telemetry(Serial);
+
+    if (pms.readUntil(data)) telemetry.pms(data);
+    telemetry.co2(Co2);
+    telemetry.tempHum(lround(temp * 100), lround(hum * 100));
+    telemetry.sgp41(srawVoc, srawNox, TVOC, NOX);
+    telemetry.text("WiFi connected");
+
+  Record, before framing, integers little endian:
+
+    type  seq  time_ms (4)  fields  crc (2)
+
+  seq counts records modulo 256 so the decoder notices lost ones; crc is
+  Modbus_crc16() over everything before it. The record is COBS encoded,
+  so it contains no 0x00, and sent between two 0x00 delimiters. Stray
+  text on the same port only costs the frame it lands in.
+
+  Fields per type, in record order:
+
+    TELEMETRY_PMS     12 x uint16, the first twelve PmsDriver::DATA words
+    TELEMETRY_CO2     uint16 ppm
+    TELEMETRY_TEMP_HUM  int16 centi degrees C, uint16 centi percent
+    TELEMETRY_SGP41   uint16 SRAW VOC, uint16 SRAW NOx, int16 VOC index,
+                      int16 NOx index (-1 if none)
+    TELEMETRY_TEXT    up to TELEMETRY_TEXT_SIZE characters
+
+  On the receiving end TelemetryDecoder takes the byte stream, checks
+  and decodes the records, and Telemetry_writeCsv() / Telemetry_writeJson()
+  print them, e.g. on a second board forwarding to a PC. On the PC itself
+  extras/tools/telemetry_decode turns a log or the serial port into CSV
+  or JSON.
+*/
+
+#ifndef AirGradientTelemetry_h
+#define AirGradientTelemetry_h
+
+#include "Arduino.h"
+#include "Print.h"
+
+typedef enum {
+  TELEMETRY_PMS = 1,
+  TELEMETRY_CO2 = 2,
+  TELEMETRY_TEMP_HUM = 3,
+  TELEMETRY_SGP41 = 4,
+  TELEMETRY_TEXT = 5
+} TELEMETRY_Type;
+
+#define TELEMETRY_TEXT_SIZE 64
+#define TELEMETRY_MAX_VALUES 12
+// type, seq, time, fields, crc
+#define TELEMETRY_RECORD_SIZE (1 + 1 + 4 + TELEMETRY_TEXT_SIZE + 2)
+
+struct TelemetryRecord {
+  TELEMETRY_Type type;
+  uint8_t seq;
+  uint32_t timeMs;
+  uint8_t count;
+  int32_t values[TELEMETRY_MAX_VALUES];
+  // TELEMETRY_TEXT only
+  char text[TELEMETRY_TEXT_SIZE + 1];
+};
+
+class TelemetryWriter
+{
+  public:
+    TelemetryWriter(Print& out);
+
+    // Takes PmsDriver::DATA or the PMS library's PMS::DATA.
+    template <typename DATA>
+    void pms(const DATA& data, uint32_t now = millis());
+    void co2(uint16_t ppm, uint32_t now = millis());
+    void tempHum(int16_t centiCelsius, uint16_t centiPercent, uint32_t now = millis());
+    void sgp41(uint16_t srawVoc, uint16_t srawNox, int16_t vocIndex, int16_t noxIndex,
+               uint32_t now = millis());
+    // Longer text is cut.
+    void text(const char* text, uint32_t now = millis());
+
+    uint32_t getRecords() const;
+    uint32_t getBytes() const;
+
+  private:
+    Print* _out;
+    uint8_t _seq = 0;
+    uint32_t _records = 0;
+    uint32_t _bytes = 0;
+
+    void words(TELEMETRY_Type type, const uint16_t* values, uint8_t count, uint32_t now);
+    void send(TELEMETRY_Type type, const uint8_t* fields, uint8_t length, uint32_t now);
+};
+
+template <typename DATA>
+void TelemetryWriter::pms(const DATA& data, uint32_t now)
+{
+  const uint16_t values[TELEMETRY_MAX_VALUES] = {
+    data.PM_SP_UG_1_0, data.PM_SP_UG_2_5, data.PM_SP_UG_10_0,
+    data.PM_AE_UG_1_0, data.PM_AE_UG_2_5, data.PM_AE_UG_10_0,
+    data.PM_RAW_0_3, data.PM_RAW_0_5, data.PM_RAW_1_0,
+    data.PM_RAW_2_5, data.PM_RAW_5_0, data.PM_RAW_10_0
+  };
+  words(TELEMETRY_PMS, values, TELEMETRY_MAX_VALUES, now);
+}
+
+class TelemetryDecoder
+{
+  public:
+    // Returns true when c completed a valid record, see getRecord().
+    bool feed(uint8_t c);
+    const TelemetryRecord& getRecord() const;
+
+    uint32_t getRecords() const;
+    // Frames with a bad CRC, length or type, including stray text
+    uint32_t getErrors() const;
+    // Records missing according to seq
+    uint32_t getLost() const;
+
+  private:
+    uint8_t _frame[TELEMETRY_RECORD_SIZE + 2];
+    uint8_t _length = 0;
+    bool _overflow = false;
+    bool _hasSeq = false;
+    uint8_t _nextSeq = 0;
+    TelemetryRecord _record;
+
+    uint32_t _records = 0;
+    uint32_t _errors = 0;
+    uint32_t _lost = 0;
+
+    bool decode();
+};
+
+const char* Telemetry_typeName(TELEMETRY_Type type);
+// The CSV columns for one record type: time_ms,seq,type, then its fields.
+void Telemetry_writeCsvHeader(TELEMETRY_Type type, Print& out);
+void Telemetry_writeCsv(const TelemetryRecord& record, Print& out);
+// One JSON object per line
+void Telemetry_writeJson(const TelemetryRecord& record, Print& out);
+
+#endif
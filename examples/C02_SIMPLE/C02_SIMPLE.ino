@@ -21,19 +21,23 @@ CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
 
 */
 
-#include <AirGradient.h>
-AirGradient ag = AirGradient();
+#include <SoftwareSerial.h>
+#include <AirGradientBoard.h>
+
+// Only the S8 driver is compiled in, see AirGradientBoard.h
+SoftwareSerial co2Serial(D4, D3);
+AirGradientBoard<S8Driver> ag;
 
 void setup(){
   Serial.begin(115200);
-  ag.CO2_Init();
+  co2Serial.begin(9600);
+  ag.get<S8Driver>().begin(co2Serial);
 }
 
 void loop(){
 
-int CO2 = ag.getCO2_Raw();
 Serial.print("C02: ");
-Serial.println(ag.getCO2());
+Serial.println(ag.get<S8Driver>().getCO2());
 
 delay(5000);
 }
@@ -26,6 +26,10 @@ MIT License
 
 
 #include <AirGradient.h>
+#include <AirGradientSampler.h>
+#include <AirGradientReport.h>
+#include <AirGradientMetrics.h>
+#include <AirGradientMqtt.h>
 #include <WiFiManager.h>
 #include <ESP8266WiFi.h>
 #include <ESP8266HTTPClient.h>
@@ -44,6 +48,9 @@ U8G2_SSD1306_64X48_ER_1_HW_I2C u8g2(U8G2_R0, /* reset=*/ U8X8_PIN_NONE); //for D
 //set to the endpoint you would like to use
 String APIROOT = "http://hw.airgradient.com/";
 
+// set to the address of an MQTT broker to also publish there, e.g. "192.168.1.10"; empty disables MQTT
+const char* MQTT_BROKER = "";
+
 // set to true to switch from Celcius to Fahrenheit
 boolean inF = false;
 
@@ -63,13 +70,26 @@ unsigned long previousOled = 0;
 
 const int sendToServerInterval = 10000;
 unsigned long previoussendToServer = 0;
-
-const int co2Interval = 5000;
-unsigned long previousCo2 = 0;
+// only post when a value moved, but at least every 5 minutes
+ReportPolicy reportPolicy(5 * 60 * 1000UL);
+// the broker gets its own, so a failed HTTP upload does not repeat MQTT
+ReportPolicy mqttPolicy(5 * 60 * 1000UL);
+Measures latestMeasures;
+
+// Prometheus can scrape http://<ip>:9926/metrics, answered from latestMeasures
+WiFiServer metricsServer(9926);
+MetricsServer metrics;
+
+// QoS 1 on airgradient/<serial>/..., buffered while the broker is unreachable
+WiFiClient mqttClient;
+MqttPublisher mqtt(mqttClient);
+char mqttClientId[24];
+
+// CO2 and PM2.5 are polled every 5s while they change and up to every 60s when flat
+AdaptiveSampler co2Sampler(5000, 60000);
 int Co2 = 0;
 
-const int pm25Interval = 5000;
-unsigned long previousPm25 = 0;
+AdaptiveSampler pm25Sampler(5000, 60000);
 int pm25 = 0;
 
 const int tempHumInterval = 2500;
@@ -94,6 +114,29 @@ void setup()
   ag.CO2_Init();
   ag.PMS_Init();
   //ag.TMP_RH_Init(0x44);
+  co2Sampler.setThresholds(20, 15);  // ppm per minute, ppm
+  pm25Sampler.setThresholds(5, 3);   // ug/m3 per minute, ug/m3
+  reportPolicy.setDeadband(MEASURE_RCO2, 10);     // ppm
+  reportPolicy.setDeadband(MEASURE_PM02, 1, 10);  // ug/m3 or %
+  reportPolicy.setDeadband(MEASURE_ATMP, 0.3);    // degrees C
+  reportPolicy.setDeadband(MEASURE_RHUM, 2);      // %
+  mqttPolicy.setDeadband(MEASURE_RCO2, 10);
+  mqttPolicy.setDeadband(MEASURE_PM02, 1, 10);
+  mqttPolicy.setDeadband(MEASURE_ATMP, 0.3);
+  mqttPolicy.setDeadband(MEASURE_RHUM, 2);
+
+  metrics.setMeasures(latestMeasures);
+  metrics.setCallback(writeDriverMetrics);
+  metricsServer.begin();
+
+  if (MQTT_BROKER[0] != '\0') {
+    char prefix[32];
+    snprintf(mqttClientId, sizeof(mqttClientId), "airgradient-%x", ESP.getChipId());
+    snprintf(prefix, sizeof(prefix), "airgradient/%x", ESP.getChipId());
+    mqtt.setServer(MQTT_BROKER);
+    mqtt.setClientId(mqttClientId);
+    mqtt.setTopicPrefix(prefix);
+  }
 }
 
 
@@ -105,22 +148,48 @@ void loop()
   updatePm25();
   updateTempHum();
   sendToServer();
+  handleMetrics();
+  if (MQTT_BROKER[0] != '\0') {
+    mqtt.update(currentMillis);
+  }
+}
+
+void handleMetrics()
+{
+  WiFiClient client = metricsServer.available();
+  if (client) {
+    metrics.handle(client);
+  }
+}
+
+// Only counters the drivers keep anyway, a scrape never reads a sensor
+void writeDriverMetrics(MetricsWriter& writer)
+{
+  writer.family("airgradient_reports_sent", "counter", "Measures uploaded");
+  writer.counter("airgradient_reports_sent", reportPolicy.getSentCount());
+  writer.family("airgradient_reports_suppressed", "counter", "Measures not uploaded as nothing changed");
+  writer.counter("airgradient_reports_suppressed", reportPolicy.getSuppressedCount());
+  writer.family("airgradient_sample_interval_seconds", "gauge", "Current adaptive sampling interval");
+  writer.gauge("airgradient_sample_interval_seconds", co2Sampler.getInterval() / 1000.0, 1, "sensor=\"co2\"");
+  writer.gauge("airgradient_sample_interval_seconds", pm25Sampler.getInterval() / 1000.0, 1, "sensor=\"pm2_5\"");
 }
 
 void updateCo2()
 {
-    if (currentMillis - previousCo2 >= co2Interval) {
-      previousCo2 += co2Interval;
+    if (co2Sampler.due(currentMillis)) {
       Co2 = ag.getCO2_Raw();
+      if (Co2 > 0) co2Sampler.addSample(Co2, currentMillis);
+      else co2Sampler.skip(currentMillis);
       Serial.println(String(Co2));
     }
 }
 
 void updatePm25()
 {
-    if (currentMillis - previousPm25 >= pm25Interval) {
-      previousPm25 += pm25Interval;
+    if (pm25Sampler.due(currentMillis)) {
       pm25 = ag.getPM2_Raw();
+      if (pm25 >= 0) pm25Sampler.addSample(pm25, currentMillis);
+      else pm25Sampler.skip(currentMillis);
       Serial.println(String(pm25));
     }
 }
@@ -188,12 +257,26 @@ void sendToServer() {
    if (currentMillis - previoussendToServer >= sendToServerInterval) {
      previoussendToServer += sendToServerInterval;
 
-      String payload = "{\"wifi\":" + String(WiFi.RSSI())
-      + (Co2 < 0 ? "" : ", \"rco2\":" + String(Co2))
-      + (pm25 < 0 ? "" : ", \"pm02\":" + String(pm25))
-      + ", \"atmp\":" + String(temp)
-      + (hum < 0 ? "" : ", \"rhum\":" + String(hum))
-      + "}";
+      Measures measures;
+      measures.set(MEASURE_WIFI, WiFi.RSSI());
+      if (Co2 >= 0) measures.set(MEASURE_RCO2, Co2);
+      if (pm25 >= 0) measures.set(MEASURE_PM02, pm25);
+      measures.set(MEASURE_ATMP, temp);
+      if (hum >= 0) measures.set(MEASURE_RHUM, hum);
+      latestMeasures = measures;
+
+      if (MQTT_BROKER[0] != '\0' && mqttPolicy.shouldSend(measures, currentMillis) &&
+          mqtt.publishMeasures(measures, MQTT_TOPICS_COMBINED | MQTT_TOPICS_PER_METRIC) == MQTT_OK) {
+        // queued; the publisher delivers it once the broker is reachable
+        mqttPolicy.markSent(measures, currentMillis);
+      }
+
+      if (!reportPolicy.shouldSend(measures, currentMillis)) {
+        return;
+      }
+
+      char payload[MEASURES_JSON_SIZE];
+      Measures_writeJson(measures, payload, sizeof(payload));
 
       if(WiFi.status()== WL_CONNECTED){
         Serial.println(payload);
@@ -208,6 +291,9 @@ void sendToServer() {
         Serial.println(httpCode);
         Serial.println(response);
         http.end();
+        if (httpCode >= 200 && httpCode < 300) {
+          reportPolicy.markSent(measures, currentMillis);
+        }
       }
       else {
         Serial.println("WiFi Disconnected");
@@ -232,12 +318,6 @@ void sendToServer() {
 
 // Calculate PM2.5 US AQI
 int PM_TO_AQI_US(int pm02) {
-  if (pm02 <= 12.0) return ((50 - 0) / (12.0 - .0) * (pm02 - .0) + 0);
-  else if (pm02 <= 35.4) return ((100 - 50) / (35.4 - 12.0) * (pm02 - 12.0) + 50);
-  else if (pm02 <= 55.4) return ((150 - 100) / (55.4 - 35.4) * (pm02 - 35.4) + 100);
-  else if (pm02 <= 150.4) return ((200 - 150) / (150.4 - 55.4) * (pm02 - 55.4) + 150);
-  else if (pm02 <= 250.4) return ((300 - 200) / (250.4 - 150.4) * (pm02 - 150.4) + 200);
-  else if (pm02 <= 350.4) return ((400 - 300) / (350.4 - 250.4) * (pm02 - 250.4) + 300);
-  else if (pm02 <= 500.4) return ((500 - 400) / (500.4 - 350.4) * (pm02 - 350.4) + 400);
-  else return 500;
+  // US EPA breakpoints as revised in 2024, see AirGradientAqi.h
+  return AQI_compute(AQI_US_EPA, AQI_PM2_5, pm02 * 10);
 };
@@ -9,7 +9,7 @@ Kits (including a pre-soldered version) are available: https://www.airgradient.c
 
 The codes needs the following libraries installed:
 “WifiManager by tzapu, tablatronix” tested with version 2.0.11-beta
-"Sensirion I2C SGP41" by Sensation Version 0.1.0
+"AirGradient Air Quality Sensor" (this library, for the SGP41 driver)
 "Sensirion Gas Index Algorithm" by Sensation Version 3.2.1
 "Arduino-SHT" by Johannes Winkelmann Version 1.2.2
 “pms” by Markusz Kakl version 1.1.0 (needs to be patched for 5003T model)
@@ -31,7 +31,7 @@ CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
 #include "s8_uart.h"
 #include <HTTPClient.h>
 #include <WiFiManager.h>
-#include <SensirionI2CSgp41.h>
+#include <AirGradientSgp41.h>
 #include <NOxGasIndexAlgorithm.h>
 #include <VOCGasIndexAlgorithm.h>
 
@@ -42,7 +42,8 @@ CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
 
 HTTPClient client;
 
-SensirionI2CSgp41 sgp41;
+I2CBus i2c(Wire);
+Sgp41Driver sgp41;
 VOCGasIndexAlgorithm voc_algorithm;
 NOxGasIndexAlgorithm nox_algorithm;
 
@@ -53,9 +54,6 @@ PMS::DATA data1;
 S8_UART * sensor_S8;
 S8_sensor sensor;
 
-// time in seconds needed for NOx conditioning
-uint16_t conditioning_s = 10;
-
 String APIROOT = "http://hw.airgradient.com/";
 
 // set to true to switch from Celcius to Fahrenheit
@@ -83,8 +81,6 @@ unsigned long previousOled = 0;
 const int sendToServerInterval = 10000;
 unsigned long previoussendToServer = 0;
 
-const int tvocInterval = 1000;
-unsigned long previousTVOC = 0;
 int TVOC = -1;
 int NOX = -1;
 
@@ -100,6 +96,8 @@ int pm10 = -1;
 int pm03PCount = -1;
 float temp;
 int hum;
+// SGP41 compensation; the defaults are used until the first good read
+TMP_RH_Fixed tempHumReading = { 0, 0, 0, 0, SHT3XD_TIMEOUT_ERROR };
 
 //const int tempHumInterval = 2500;
 //unsigned long previousTempHum = 0;
@@ -118,7 +116,8 @@ void setup() {
   Serial1.begin(9600, SERIAL_8N1, 0, 1);
   Serial0.begin(9600);
 
-  sgp41.begin(Wire);
+  i2c.begin(I2C_SDA, I2C_SCL);
+  sgp41.begin(i2c);
 
   //init Watchdog
   pinMode(2, OUTPUT);
@@ -164,41 +163,14 @@ void loop() {
 }
 
 void updateTVOC() {
-  uint16_t error;
-  char errorMessage[256];
-  uint16_t defaultRh = 0x8000;
-  uint16_t defaultT = 0x6666;
-  uint16_t srawVoc = 0;
-  uint16_t srawNox = 0;
-  uint16_t defaultCompenstaionRh = 0x8000; // in ticks as defined by SGP41
-  uint16_t defaultCompenstaionT = 0x6666; // in ticks as defined by SGP41
-  uint16_t compensationRh = 0; // in ticks as defined by SGP41
-  uint16_t compensationT = 0; // in ticks as defined by SGP41
-
-  delay(1000);
-
-  compensationT = static_cast < uint16_t > ((temp + 45) * 65535 / 175);
-  compensationRh = static_cast < uint16_t > (hum * 65535 / 100);
-
-  if (conditioning_s > 0) {
-    error = sgp41.executeConditioning(compensationRh, compensationT, srawVoc);
-    conditioning_s--;
-  } else {
-    error = sgp41.measureRawSignals(compensationRh, compensationT, srawVoc,
-      srawNox);
-  }
-
-  if (currentMillis - previousTVOC >= tvocInterval) {
-previousTVOC += tvocInterval;
-if (error) {
-   TVOC = -1;
+  // takes its turn without blocking, see AirGradientSgp41.h
+  sgp41.setCompensation(tempHumReading);
+  if (sgp41.update(currentMillis)) {
+    TVOC = voc_algorithm.process(sgp41.getSrawVoc());
+    if (sgp41.hasNox()) NOX = nox_algorithm.process(sgp41.getSrawNox());
+  } else if (sgp41.getError() != SGP41_OK) {
+    TVOC = -1;
     NOX = -1;
-    //Serial.println(String(TVOC));
-} else {
-   TVOC = voc_algorithm.process(srawVoc);
-    NOX = nox_algorithm.process(srawNox);
-    //Serial.println(String(TVOC));
-}
   }
 }
 
@@ -220,11 +192,18 @@ void updatePm() {
       pm03PCount = data1.PM_RAW_0_3;
       temp = data1.AMB_TMP;
       hum = data1.AMB_HUM;
+      // the PMS5003T reports tenths
+      tempHumReading.t_centi = data1.AMB_TMP * 10;
+      tempHumReading.rh_centi = data1.AMB_HUM * 10;
+      tempHumReading.t_raw = SGP41_temperatureTicks(tempHumReading.t_centi);
+      tempHumReading.rh_raw = SGP41_humidityTicks(tempHumReading.rh_centi);
+      tempHumReading.error = SHT3XD_NO_ERROR;
     } else {
       pm01 = -1;
       pm25 = -1;
       pm10 = -1;
       pm03PCount = -1;
+      tempHumReading.error = SHT3XD_TIMEOUT_ERROR;
       temp = -10001;
       hum = -10001;
     }
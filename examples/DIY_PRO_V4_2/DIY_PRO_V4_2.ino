@@ -36,6 +36,7 @@ CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
 #include <WiFiClient.h>
 
 #include <EEPROM.h>
+#include <AirGradientConfig.h>
 #include "SHTSensor.h"
 
 //#include "SGP30.h"
@@ -55,10 +56,19 @@ SHTSensor sht;
 // time in seconds needed for NOx conditioning
 uint16_t conditioning_s = 10;
 
-// for peristent saving and loading
+// for peristent saving and loading; older firmware kept buttonConfig as one byte at addr
 int addr = 4;
 byte value;
 
+// saved settings, new fields go at the end with a new SETTINGS_VERSION
+struct Settings {
+  uint8_t buttonConfig = 0;
+};
+const uint8_t SETTINGS_VERSION = 1;
+Settings settings;
+EepromConfigStorage configStorage;
+ConfigStore configStore(configStorage, 8);
+
 // Display bottom right
 U8G2_SH1106_128X64_NONAME_F_HW_I2C u8g2(U8G2_R0, /* reset=*/ U8X8_PIN_NONE);
 
@@ -132,7 +142,12 @@ void setup() {
   EEPROM.begin(512);
   delay(500);
 
-  buttonConfig = String(EEPROM.read(addr)).toInt();
+  if (configStore.begin()) {
+    configStore.load(settings);
+  } else {
+    settings.buttonConfig = EEPROM.read(addr);
+  }
+  buttonConfig = settings.buttonConfig;
   if (buttonConfig>3) buttonConfig=0;
   delay(400);
   setConfig();
@@ -210,8 +225,8 @@ void inConf(){
           delay(1000);
           updateOLED2("Rebooting", "in", "5 seconds");
           delay(5000);
-          EEPROM.write(addr, char(buttonConfig));
-          EEPROM.commit();
+          settings.buttonConfig = buttonConfig;
+          configStore.save(settings, SETTINGS_VERSION);
           delay(1000);
           ESP.restart();
  //       }
@@ -422,12 +437,6 @@ void sendToServer() {
 
 // Calculate PM2.5 US AQI
 int PM_TO_AQI_US(int pm02) {
-  if (pm02 <= 12.0) return ((50 - 0) / (12.0 - .0) * (pm02 - .0) + 0);
-  else if (pm02 <= 35.4) return ((100 - 50) / (35.4 - 12.0) * (pm02 - 12.0) + 50);
-  else if (pm02 <= 55.4) return ((150 - 100) / (55.4 - 35.4) * (pm02 - 35.4) + 100);
-  else if (pm02 <= 150.4) return ((200 - 150) / (150.4 - 55.4) * (pm02 - 55.4) + 150);
-  else if (pm02 <= 250.4) return ((300 - 200) / (250.4 - 150.4) * (pm02 - 150.4) + 200);
-  else if (pm02 <= 350.4) return ((400 - 300) / (350.4 - 250.4) * (pm02 - 250.4) + 300);
-  else if (pm02 <= 500.4) return ((500 - 400) / (500.4 - 350.4) * (pm02 - 350.4) + 400);
-  else return 500;
+  // US EPA breakpoints as revised in 2024, see AirGradientAqi.h
+  return AQI_compute(AQI_US_EPA, AQI_PM2_5, pm02 * 10);
 };
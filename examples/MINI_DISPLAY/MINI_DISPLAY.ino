@@ -26,9 +26,11 @@ CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
 
 #include <WiFiManager.h>
 
-#include <ArduinoJson.h>
+#include <AirGradientJson.h>
 
-#include <ESP8266HTTPClient.h>
+#include <AirGradientPoller.h>
+
+#include <ESP8266WiFi.h>
 
 #include <SPI.h>
 
@@ -49,46 +51,52 @@ CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
 
 Adafruit_ILI9341 tft = Adafruit_ILI9341(TFT_CS, TFT_DC, TFT_RST);
 
-const char * locNameInside;
-const char * locNameOutside;
+// Filled straight from the HTTP stream, see requestData()
+char locNameInside[32];
+char locNameOutside[32];
 
-const char * place_timezone;
-const char * location;
+char place_timezone[32];
+char location[32];
 bool outdoor_offline;
 bool indoor_offline;
-const char * outdoor_policy;
-const char * outdoor_date;
-const char * indoor_date;
+char outdoor_policy[32];
+char outdoor_date[32];
+char indoor_date[32];
 boolean prodMode = true;
 
 String deviceID;
 const char * timex;
 int pm02;
-int pi02;
-int pi02_outside;
-int rco2;
+int32_t pi02;
+int32_t pi02_outside;
+int32_t rco2;
 float atmp;
 float atmp_outside;
-int rhum_outside;
-int rhum;
+int32_t rhum_outside;
+int32_t rhum;
 int heat;
 
-const char * pi02_color;
-const char * pi02_color_outside;
-const char * pi02_category;
+char pi02_color[12];
+char pi02_color_outside[12];
+char pi02_category[40];
 const char * pm02_color;
 const char * pm02_category;
-const char * rco2_color;
-const char * rco2_category;
+char rco2_color[12];
+char rco2_category[40];
 const char * heat_color;
 const char * heat_color_outside;
 const char * heat_category;
 
 // Configuration
-#define API_ROOT "http://hw.airgradient.com/displays/"
+#define API_HOST "hw.airgradient.com"
+#define API_PATH "/displays/"
 boolean inUSaqi = false;
 boolean inF = false;
 
+// Sends the ETag of the last response, so an unchanged display costs a 304
+WiFiClient client;
+ConditionalPoller poller(client);
+
 String getDeviceId() {
   return String(ESP.getChipId(), HEX);
 }
@@ -112,81 +120,67 @@ void setup() {
   Serial.println();
 
   tft.fillScreen(ILI9341_BLACK);
-  delay(2000);
+  tft.setTextColor(ILI9341_WHITE);
+  tft.setFont( & FreeSans12pt7b);
+  tft.setCursor(5, 20);
+  tft.println("requesting data...");
 }
 
 void loop() {
-
-  WiFiClient client;
-  HTTPClient http;
-  http.begin(client, API_ROOT + getDeviceId());
-
-  int httpCode = http.GET();
-  if (httpCode == 200) {
-    String airData = http.getString();
-    payloadToDataInside(airData);
-    Serial.print("airData1 : ");
-    Serial.println(airData);
-  } else {
+  POLL_Status status = requestData();
+  if (status == POLL_CHANGED) {
+    updateDisplay();
+  } else if (status < 0) {
     Serial.println("error");
-    Serial.println(httpCode);
+    Serial.println(status);
+    Serial.println(poller.getHttpCode());
   }
-  http.end();
-
-  delay(1000);
-  updateDisplay();
+  // the screen is only redrawn when a value changed
+  Serial.print("Not modified: ");
+  Serial.print(poller.getHits());
+  Serial.print(", downloaded: ");
+  Serial.print(poller.getMisses());
+  Serial.print(", unchanged: ");
+  Serial.println(poller.getUnchanged());
 
   delay(120000);
-  tft.fillScreen(ILI9341_BLACK);
-  tft.setTextColor(ILI9341_WHITE);
-  tft.setFont( & FreeSans12pt7b);
-  tft.setCursor(5, 20);
-  tft.println("requesting data...");
 }
 
-void payloadToDataInside(String payload) {
-  const size_t capacity = JSON_ARRAY_SIZE(1) + 2 * JSON_OBJECT_SIZE(2) + 2 * JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(4) + JSON_OBJECT_SIZE(10) + JSON_OBJECT_SIZE(13) + 530;
-  DynamicJsonBuffer jsonBuffer(capacity);
-  JsonObject & root = jsonBuffer.parseObject(payload);
-  location = root["place"]["name"];
-  place_timezone = root["place"]["timezone"];
-  JsonObject & outdoor = root["outdoor"];
-  locNameOutside = outdoor["name"];
-  outdoor_offline = outdoor["offline"];
-  outdoor_policy = outdoor["guidelines"][0]["title"];
-  JsonObject & outdoor_current = outdoor["current"];
-
-  atmp_outside = outdoor_current["atmp"];
-  rhum_outside = outdoor_current["rhum"];
-  outdoor_date = outdoor_current["date"];
-  JsonObject & indoor = root["indoor"];
-  locNameInside = indoor["name"];
-  indoor_offline = indoor["offline"];
-  JsonObject & indoor_current = indoor["current"];
-
-  atmp = indoor_current["atmp"];
-  rhum = indoor_current["rhum"];
-  rco2 = indoor_current["rco2"];
-  indoor_date = indoor_current["date"];
-  rco2_color = indoor_current["rco2_clr"];
-  rco2_category = indoor_current["rco2_lbl"];
-
-  if (inUSaqi) {
-    pi02_outside = outdoor_current["pi02"];
-    pi02_color_outside = outdoor_current["pi02_clr"];
-    pi02_category = outdoor_current["pi02_lbl"];
-    pi02 = indoor_current["pi02"];
-    pi02_color = indoor_current["pi02_clr"];
-    pi02_category = indoor_current["pi02_lbl"];
-  } else {
-    pi02_outside = outdoor_current["pm02"];
-    pi02_color_outside = outdoor_current["pm02_clr"];
-    pi02_category = outdoor_current["pm02_lbl"];
-    pi02 = indoor_current["pm02"];
-    pi02_color = indoor_current["pm02_clr"];
-    pi02_category = indoor_current["pm02_lbl"];
-  }
-
+POLL_Status requestData() {
+  const char * pi02Key = inUSaqi ? "pi02" : "pm02";
+  String outdoorPi02 = String("outdoor.current.") + pi02Key;
+  String indoorPi02 = String("indoor.current.") + pi02Key;
+  String outdoorPi02Color = outdoorPi02 + "_clr";
+  String indoorPi02Color = indoorPi02 + "_clr";
+  String indoorPi02Category = indoorPi02 + "_lbl";
+
+  const JsonField fields[] = {
+    JSON_string("place.name", location),
+    JSON_string("place.timezone", place_timezone),
+    JSON_string("outdoor.name", locNameOutside),
+    JSON_bool("outdoor.offline", outdoor_offline),
+    JSON_string("outdoor.guidelines[0].title", outdoor_policy),
+    JSON_float("outdoor.current.atmp", atmp_outside),
+    JSON_int("outdoor.current.rhum", rhum_outside),
+    JSON_string("outdoor.current.date", outdoor_date),
+    JSON_string("indoor.name", locNameInside),
+    JSON_bool("indoor.offline", indoor_offline),
+    JSON_float("indoor.current.atmp", atmp),
+    JSON_int("indoor.current.rhum", rhum),
+    JSON_int("indoor.current.rco2", rco2),
+    JSON_string("indoor.current.date", indoor_date),
+    JSON_string("indoor.current.rco2_clr", rco2_color),
+    JSON_string("indoor.current.rco2_lbl", rco2_category),
+    JSON_int(outdoorPi02.c_str(), pi02_outside),
+    JSON_string(outdoorPi02Color.c_str(), pi02_color_outside),
+    JSON_int(indoorPi02.c_str(), pi02),
+    JSON_string(indoorPi02Color.c_str(), pi02_color),
+    JSON_string(indoorPi02Category.c_str(), pi02_category)
+  };
+  JsonExtractor json(fields, sizeof(fields) / sizeof(fields[0]));
+
+  String path = API_PATH + getDeviceId();
+  return poller.poll(API_HOST, 80, path.c_str(), json);
 }
 
 void updateDisplay() {
@@ -10,7 +10,7 @@ Kits (including a pre-soldered version) are available: https://www.airgradient.c
 The codes needs the following libraries installed:
 “WifiManager by tzapu, tablatronix” tested with version 2.0.11-beta
 “U8g2” by oliver tested with version 2.32.15
-"Sensirion I2C SGP41" by Sensation Version 0.1.0
+"AirGradient Air Quality Sensor" (this library, for the SGP41 driver)
 "Sensirion Gas Index Algorithm" by Sensation Version 3.2.1
 "Arduino-SHT" by Johannes Winkelmann Version 1.2.2
 "Adafruit NeoPixel" by Adafruit Version 1.11.0
@@ -42,10 +42,11 @@ CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
 #include <Adafruit_NeoPixel.h>
 
 #include <EEPROM.h>
+#include <AirGradientConfig.h>
 
 #include "SHTSensor.h"
 
-#include <SensirionI2CSgp41.h>
+#include <AirGradientSgp41.h>
 
 #include <NOxGasIndexAlgorithm.h>
 
@@ -53,18 +54,39 @@ CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
 
 #include <U8g2lib.h>
 
+#include <AirGradientDisplay.h>
+
+#include <AirGradientAqi.h>
+
+#include <AirGradientAverage.h>
+
+#include <AirGradientTelemetry.h>
+
+#include <AirGradientHealth.h>
+
 #define DEBUG true
 
+// log every sample as binary records on Serial instead of text, see AirGradientTelemetry.h
+#define TELEMETRY false
+
 #define I2C_SDA 7
 #define I2C_SCL 6
 
 HTTPClient client;
 
 Adafruit_NeoPixel pixels(11, 10, NEO_GRB + NEO_KHZ800);
-SensirionI2CSgp41 sgp41;
+I2CBus i2c(Wire);
+Sgp41Driver sgp41;
 VOCGasIndexAlgorithm voc_algorithm;
 NOxGasIndexAlgorithm nox_algorithm;
 SHTSensor sht;
+TelemetryWriter telemetry(Serial);
+
+// re-initializes stuck sensors and pulses the external watchdog on pin 2
+HealthSupervisor health;
+int8_t pmsHealth = -1;
+int8_t co2Health = -1;
+int8_t shtHealth = -1;
 
 PMS pms1(Serial0);
 
@@ -73,16 +95,27 @@ PMS::DATA data1;
 S8_UART * sensor_S8;
 S8_sensor sensor;
 
-// time in seconds needed for NOx conditioning
-uint16_t conditioning_s = 10;
-
-// for peristent saving and loading
+// for peristent saving and loading; older firmware kept buttonConfig as one byte at addr
 int addr = 4;
 byte value;
 
+// saved settings, new fields go at the end with a new SETTINGS_VERSION
+struct Settings {
+  uint8_t buttonConfig = 0;
+};
+const uint8_t SETTINGS_VERSION = 1;
+Settings settings;
+EepromConfigStorage configStorage;
+ConfigStore configStore(configStorage, 8);
+
 // Display bottom right
 U8G2_SH1106_128X64_NONAME_F_HW_I2C u8g2(U8G2_R0, /* reset=*/ U8X8_PIN_NONE);
 
+// only redraw what changed and animate the LED bar from loop(), see AirGradientDisplay.h
+OledRenderer<U8G2> oled(u8g2);
+int8_t tempRegion, humRegion, co2Region, pmRegion, tvocRegion, noxRegion;
+LedBarAnimator<Adafruit_NeoPixel> ledBar(pixels);
+
 String APIROOT = "http://hw.airgradient.com/";
 
 // set to true to switch from Celcius to Fahrenheit
@@ -110,14 +143,13 @@ unsigned long previousOled = 0;
 const int sendToServerInterval = 10000;
 unsigned long previoussendToServer = 0;
 
-const int tvocInterval = 1000;
-unsigned long previousTVOC = 0;
 int TVOC = -1;
 int NOX = -1;
 
 const int co2Interval = 5000;
 unsigned long previousCo2 = 0;
 int Co2 = 0;
+RollingAverage co2Average;
 
 const int pmInterval = 5000;
 unsigned long previousPm = 0;
@@ -125,11 +157,15 @@ int pm25 = -1;
 int pm01 = -1;
 int pm10 = -1;
 int pm03PCount = -1;
+RollingAverage pm25Average;
+RollingAverage pm10Average;
 
 const int tempHumInterval = 5000;
 unsigned long previousTempHum = 0;
 float temp;
 int hum;
+// SGP41 compensation; the defaults are used until the first good read
+TMP_RH_Fixed tempHumReading = { 0, 0, 0, 0, SHT3XD_TIMEOUT_ERROR };
 
 int buttonConfig = 0;
 int lastState = LOW;
@@ -138,7 +174,7 @@ unsigned long pressedTime = 0;
 unsigned long releasedTime = 0;
 
 void setup() {
-  if (DEBUG) {
+  if (DEBUG || TELEMETRY) {
     Serial.begin(115200);
     // see https://github.com/espressif/arduino-esp32/issues/6983
     Serial.setTxTimeoutMs(0); // <<<====== solves the delay issue
@@ -151,9 +187,17 @@ void setup() {
   Serial1.begin(9600, SERIAL_8N1, 0, 1);
   Serial0.begin(9600);
   u8g2.begin();
+  oled.setBackground(drawOLED3Frame);
+  tempRegion = oled.addRegion(0, 0, 96, 13, drawOLED3Temp);
+  humRegion = oled.addRegion(96, 0, 32, 13, drawOLED3Hum);
+  co2Region = oled.addRegion(0, 29, 44, 23, drawOLED3Co2);
+  pmRegion = oled.addRegion(46, 29, 36, 23, drawOLED3Pm);
+  tvocRegion = oled.addRegion(83, 29, 45, 12, drawOLED3Tvoc);
+  noxRegion = oled.addRegion(83, 54, 45, 10, drawOLED3Nox);
 
   updateOLED2("Warming Up", "Serial Number:", String(getNormalizedMac()));
-  sgp41.begin(Wire);
+  i2c.begin(I2C_SDA, I2C_SCL);
+  sgp41.begin(i2c);
   delay(300);
 
   sht.init(Wire);
@@ -161,8 +205,7 @@ void setup() {
   delay(300);
 
   //init Watchdog
-  pinMode(2, OUTPUT);
-  digitalWrite(2, LOW);
+  health.setWatchdog(2);
 
   sensor_S8 = new S8_UART(Serial1);
 
@@ -172,7 +215,12 @@ void setup() {
   // push button
   pinMode(9, INPUT_PULLUP);
 
-  buttonConfig = String(EEPROM.read(addr)).toInt();
+  if (configStore.begin()) {
+    configStore.load(settings);
+  } else {
+    settings.buttonConfig = EEPROM.read(addr);
+  }
+  buttonConfig = settings.buttonConfig;
   if (buttonConfig > 3) buttonConfig = 0;
   delay(400);
   setConfig();
@@ -205,10 +253,16 @@ void setup() {
       Serial.println(WiFi.localIP());
     }
   updateOLED2("Warming Up", "Serial Number:", String(getNormalizedMac()));
+
+  pmsHealth = health.add("pms", 30000, recoverPms);
+  co2Health = health.add("co2", 30000, recoverCo2);
+  shtHealth = health.add("sht", 15000, recoverSht);
 }
 
 void loop() {
   currentMillis = millis();
+  health.update(currentMillis);
+  ledBar.update(currentMillis);
   updateTVOC();
   updateOLED();
   updateCo2();
@@ -219,56 +273,28 @@ void loop() {
 
 void ledTest() {
   updateOLED2("LED Test", "running", ".....");
-  setRGBledColor('r');
-  delay(1000);
-  setRGBledColor('g');
-  delay(1000);
-  setRGBledColor('b');
-  delay(1000);
-  setRGBledColor('w');
-  delay(1000);
-  setRGBledColor('n');
-  delay(1000);
+  const char colors[] = { 'r', 'g', 'b', 'w', 'n' };
+  for (uint8_t i = 0; i < sizeof(colors); i++) {
+    setRGBledColor(colors[i]);
+    // the test may block, so run the wipe to the end here
+    while (ledBar.update()) delay(10);
+    delay(1000);
+  }
   //LED Test
 }
 
 void updateTVOC() {
-  uint16_t error;
-  char errorMessage[256];
-  uint16_t defaultRh = 0x8000;
-  uint16_t defaultT = 0x6666;
-  uint16_t srawVoc = 0;
-  uint16_t srawNox = 0;
-  uint16_t defaultCompenstaionRh = 0x8000; // in ticks as defined by SGP41
-  uint16_t defaultCompenstaionT = 0x6666; // in ticks as defined by SGP41
-  uint16_t compensationRh = 0; // in ticks as defined by SGP41
-  uint16_t compensationT = 0; // in ticks as defined by SGP41
-
-  delay(1000);
-
-  compensationT = static_cast < uint16_t > ((temp + 45) * 65535 / 175);
-  compensationRh = static_cast < uint16_t > (hum * 65535 / 100);
-
-  if (conditioning_s > 0) {
-    error = sgp41.executeConditioning(compensationRh, compensationT, srawVoc);
-    conditioning_s--;
-  } else {
-    error = sgp41.measureRawSignals(compensationRh, compensationT, srawVoc,
-      srawNox);
-  }
-
-  if (currentMillis - previousTVOC >= tvocInterval) {
-    previousTVOC += tvocInterval;
-    if (error) {
-      TVOC = -1;
-      NOX = -1;
-      Serial.println(String(TVOC));
-    } else {
-      TVOC = voc_algorithm.process(srawVoc);
-      NOX = nox_algorithm.process(srawNox);
-      Serial.println(String(TVOC));
-    }
-
+  // takes its turn without blocking, see AirGradientSgp41.h
+  sgp41.setCompensation(tempHumReading);
+  if (sgp41.update(currentMillis)) {
+    TVOC = voc_algorithm.process(sgp41.getSrawVoc());
+    if (sgp41.hasNox()) NOX = nox_algorithm.process(sgp41.getSrawNox());
+    // NOX keeps its last value when this sample has none, the record says -1
+    if (TELEMETRY) telemetry.sgp41(sgp41.getSrawVoc(), sgp41.hasNox() ? sgp41.getSrawNox() : 0, TVOC,
+                                   sgp41.hasNox() ? NOX : -1);
+  } else if (sgp41.getError() != SGP41_OK) {
+    TVOC = -1;
+    NOX = -1;
   }
 }
 
@@ -276,7 +302,16 @@ void updateCo2() {
   if (currentMillis - previousCo2 >= co2Interval) {
     previousCo2 += co2Interval;
     Co2 = sensor_S8 -> get_co2();
-    Serial.println(String(Co2));
+    if (Co2 > 0) {
+      health.success(co2Health, currentMillis);
+      co2Average.add(Co2);
+    } else {
+      health.failure(co2Health);
+      // a failed read gives 0, which is no sample; just close ended hours
+      co2Average.update();
+    }
+    if (!TELEMETRY) Serial.println(String(Co2));
+    else if (Co2 >= 0) telemetry.co2(Co2);
   }
 }
 
@@ -288,12 +323,17 @@ void updatePm() {
       pm25 = data1.PM_AE_UG_2_5;
       pm10 = data1.PM_AE_UG_10_0;
       pm03PCount = data1.PM_RAW_0_3;
+      if (TELEMETRY) telemetry.pms(data1);
+      health.success(pmsHealth, currentMillis);
     } else {
+      health.failure(pmsHealth);
       pm01 = -1;
       pm25 = -1;
       pm10 = -1;
       pm03PCount = -1;
     }
+    pm25Average.add(pm25);
+    pm10Average.add(pm10);
   }
 }
 
@@ -304,8 +344,17 @@ void updateTempHum() {
     if (sht.readSample()) {
       temp = sht.getTemperature();
       hum = sht.getHumidity();
+      tempHumReading.t_centi = lround(temp * 100);
+      tempHumReading.rh_centi = lround(sht.getHumidity() * 100);
+      tempHumReading.t_raw = SGP41_temperatureTicks(tempHumReading.t_centi);
+      tempHumReading.rh_raw = SGP41_humidityTicks(tempHumReading.rh_centi);
+      tempHumReading.error = SHT3XD_NO_ERROR;
+      if (TELEMETRY) telemetry.tempHum(lround(temp * 100), lround(hum * 100));
+      health.success(shtHealth, currentMillis);
     } else {
+      health.failure(shtHealth);
       Serial.print("Error in readSample()\n");
+      tempHumReading.error = SHT3XD_TIMEOUT_ERROR;
       temp = -10001;
       hum = -10001;
     }
@@ -366,8 +415,8 @@ void inConf() {
       delay(1000);
       updateOLED2("Rebooting", "in", "5 seconds");
       delay(5000);
-      EEPROM.write(addr, char(buttonConfig));
-      EEPROM.commit();
+      settings.buttonConfig = buttonConfig;
+      configStore.save(settings, SETTINGS_VERSION);
       delay(1000);
       ESP.restart();
     }
@@ -420,100 +469,110 @@ void updateOLED2(String ln1, String ln2, String ln3) {
     u8g2.drawStr(1, 30, String(ln2).c_str());
     u8g2.drawStr(1, 50, String(ln3).c_str());
   } while (u8g2.nextPage());
+  // the measurement screen has been overwritten
+  oled.invalidate();
 }
 
 void updateOLED3() {
+  if (temp > -10001) {
+    oled.set(tempRegion, lround((inF ? (temp * 9 / 5) + 32 : temp) * 10));
+  } else {
+    oled.set(tempRegion, INT32_MIN);
+  }
+  oled.set(humRegion, hum);
+  oled.set(co2Region, Co2 > 0 ? Co2 : -1);
+  if (inUSAQI) {
+    // the regulatory index once there are two hours of data
+    int32_t nowCast = pm25Average.getNowCast();
+    if (nowCast >= 0) {
+      oled.set(pmRegion, AQI_compute(AQI_US_EPA, AQI_PM2_5, nowCast));
+    } else {
+      oled.set(pmRegion, pm25 >= 0 ? PM_TO_AQI_US(pm25) : -1);
+    }
+  } else {
+    oled.set(pmRegion, pm25);
+  }
+  oled.set(tvocRegion, TVOC);
+  oled.set(noxRegion, NOX);
+  oled.render();
+}
+
+void drawOLED3Frame(U8G2& u8g2) {
+  u8g2.drawLine(1, 13, 128, 13);
+  u8g2.setFont(u8g2_font_t0_12_tf);
+  u8g2.drawUTF8(1, 27, "CO2");
+  u8g2.drawStr(1, 61, "ppm");
+  u8g2.drawLine(45, 15, 45, 64);
+  u8g2.drawStr(48, 27, "PM2.5");
+  u8g2.drawUTF8(48, 61, inUSAQI ? "AQI" : "ug/m³");
+  u8g2.drawLine(82, 15, 82, 64);
+  u8g2.drawStr(85, 27, "TVOC:");
+  u8g2.drawStr(85, 53, "NOx:");
+}
+
+// temperature in tenths of the configured unit
+void drawOLED3Temp(U8G2& u8g2, int32_t value) {
   char buf[9];
-  u8g2.firstPage();
-  u8g2.firstPage();
-  do {
+  u8g2.setFont(u8g2_font_t0_16_tf);
+  if (value != INT32_MIN) {
+    sprintf(buf, inF ? "%.1f°F" : "%.1f°C", value / 10.0);
+  } else {
+    sprintf(buf, inF ? "-°F" : "-°C");
+  }
+  u8g2.drawUTF8(1, 10, buf);
+}
 
-    u8g2.setFont(u8g2_font_t0_16_tf);
+void drawOLED3Hum(U8G2& u8g2, int32_t value) {
+  char buf[9];
+  u8g2.setFont(u8g2_font_t0_16_tf);
+  if (value >= 0) {
+    sprintf(buf, "%d%%", (int)value);
+  } else {
+    sprintf(buf, " -%%");
+  }
+  if (value > 99) {
+    u8g2.drawStr(97, 10, buf);
+  } else {
+    u8g2.drawStr(105, 10, buf);
+  }
+}
 
-    if (inF) {
-      if (temp > -10001) {
-        float tempF = (temp * 9 / 5) + 32;
-        sprintf(buf, "%.1f°F", tempF);
-      } else {
-        sprintf(buf, "-°F");
-      }
-      u8g2.drawUTF8(1, 10, buf);
-    } else {
-      if (temp > -10001) {
-        sprintf(buf, "%.1f°C", temp);
-      } else {
-        sprintf(buf, "-°C");
-      }
-      u8g2.drawUTF8(1, 10, buf);
-    }
+void drawOLED3Value(U8G2& u8g2, int x, int y, int32_t value) {
+  char buf[9];
+  if (value >= 0) {
+    sprintf(buf, "%d", (int)value);
+  } else {
+    sprintf(buf, "%s", "-");
+  }
+  u8g2.drawStr(x, y, buf);
+}
 
-    if (hum >= 0) {
-      sprintf(buf, "%d%%", hum);
-    } else {
-      sprintf(buf, " -%%");
-    }
-    if (hum > 99) {
-      u8g2.drawStr(97, 10, buf);
-    } else {
-      u8g2.drawStr(105, 10, buf);
-      // there might also be single digits, not considered, sprintf might actually support a leading space
-    }
+void drawOLED3Co2(U8G2& u8g2, int32_t value) {
+  u8g2.setFont(u8g2_font_t0_22b_tf);
+  drawOLED3Value(u8g2, 1, 48, value);
+}
 
-    u8g2.drawLine(1, 13, 128, 13);
-    u8g2.setFont(u8g2_font_t0_12_tf);
-    u8g2.drawUTF8(1, 27, "CO2");
-    u8g2.setFont(u8g2_font_t0_22b_tf);
-    if (Co2 > 0) {
-      sprintf(buf, "%d", Co2);
-    } else {
-      sprintf(buf, "%s", "-");
-    }
-    u8g2.drawStr(1, 48, buf);
-    u8g2.setFont(u8g2_font_t0_12_tf);
-    u8g2.drawStr(1, 61, "ppm");
-    u8g2.drawLine(45, 15, 45, 64);
-    u8g2.setFont(u8g2_font_t0_12_tf);
-    u8g2.drawStr(48, 27, "PM2.5");
-    u8g2.setFont(u8g2_font_t0_22b_tf);
+void drawOLED3Pm(U8G2& u8g2, int32_t value) {
+  u8g2.setFont(u8g2_font_t0_22b_tf);
+  drawOLED3Value(u8g2, 48, 48, value);
+}
 
-    if (inUSAQI) {
-      if (pm25 >= 0) {
-        sprintf(buf, "%d", PM_TO_AQI_US(pm25));
-      } else {
-        sprintf(buf, "%s", "-");
-      }
-      u8g2.drawStr(48, 48, buf);
-      u8g2.setFont(u8g2_font_t0_12_tf);
-      u8g2.drawUTF8(48, 61, "AQI");
-    } else {
-      if (pm25 >= 0) {
-        sprintf(buf, "%d", pm25);
-      } else {
-        sprintf(buf, "%s", "-");
-      }
-      u8g2.drawStr(48, 48, buf);
-      u8g2.setFont(u8g2_font_t0_12_tf);
-      u8g2.drawUTF8(48, 61, "ug/m³");
-    }
+void drawOLED3Tvoc(U8G2& u8g2, int32_t value) {
+  u8g2.setFont(u8g2_font_t0_12_tf);
+  drawOLED3Value(u8g2, 85, 39, value);
+}
 
-    u8g2.drawLine(82, 15, 82, 64);
-    u8g2.setFont(u8g2_font_t0_12_tf);
-    u8g2.drawStr(85, 27, "TVOC:");
-    if (TVOC >= 0) {
-      sprintf(buf, "%d", TVOC);
-    } else {
-      sprintf(buf, "%s", "-");
-    }
-    u8g2.drawStr(85, 39, buf);
-    u8g2.drawStr(85, 53, "NOx:");
-    if (NOX >= 0) {
-      sprintf(buf, "%d", NOX);
-    } else {
-      sprintf(buf, "%s", "-");
-    }
-    u8g2.drawStr(85, 63, buf);
+void drawOLED3Nox(U8G2& u8g2, int32_t value) {
+  u8g2.setFont(u8g2_font_t0_12_tf);
+  drawOLED3Value(u8g2, 85, 63, value);
+}
 
-  } while (u8g2.nextPage());
+// Averages are kept in tenths; fields without enough data are left out
+String tenthsField(const char* name, int32_t tenths) {
+  if (tenths < 0) {
+    return "";
+  }
+  return ", \"" + String(name) + "\":" + String(tenths / 10) + "." + String(tenths % 10);
 }
 
 void sendToServer() {
@@ -530,6 +589,10 @@ void sendToServer() {
       ", \"atmp\":" + String(temp) +
       (hum < 0 ? "" : ", \"rhum\":" + String(hum)) +
       ", \"boot\":" + loopCount +
+      tenthsField("pm02_nowcast", pm25Average.getNowCast()) +
+      tenthsField("pm10_nowcast", pm10Average.getNowCast()) +
+      tenthsField("pm02_24h", pm25Average.getMean24()) +
+      tenthsField("rco2_1h", co2Average.getRollingHour()) +
       "}";
 
     if (WiFi.status() == WL_CONNECTED) {
@@ -547,6 +610,7 @@ void sendToServer() {
       http.end();
       resetWatchdog();
       loopCount++;
+      if (DEBUG && !TELEMETRY) health.print(Serial);
     } else {
       Serial.println("WiFi Disconnected");
     }
@@ -565,9 +629,28 @@ void countdown(int from) {
 
 void resetWatchdog() {
   Serial.println("Watchdog reset");
-  digitalWrite(2, HIGH);
-  delay(20);
-  digitalWrite(2, LOW);
+  // the pulse ends in health.update()
+  health.feedWatchdog();
+}
+
+// Recovery steps for sensors that stopped answering, see AirGradientHealth.h
+void recoverPms() {
+  debugln("Reinitializing PMS");
+  Serial0.end();
+  Serial0.begin(9600);
+  pms1.wakeUp();
+  pms1.activeMode();
+}
+
+void recoverCo2() {
+  debugln("Reinitializing CO2");
+  Serial1.end();
+  Serial1.begin(9600, SERIAL_8N1, 0, 1);
+}
+
+void recoverSht() {
+  debugln("Reinitializing SHT");
+  sht.init(Wire);
 }
 
 // Wifi Manager
@@ -585,22 +668,30 @@ void connectToWifi() {
 }
 
 void debug(String msg) {
-  if (DEBUG)
+  if (TELEMETRY)
+    telemetry.text(msg.c_str());
+  else if (DEBUG)
     Serial.print(msg);
 }
 
 void debug(int msg) {
-  if (DEBUG)
+  if (TELEMETRY)
+    telemetry.text(String(msg).c_str());
+  else if (DEBUG)
     Serial.print(msg);
 }
 
 void debugln(String msg) {
-  if (DEBUG)
+  if (TELEMETRY)
+    telemetry.text(msg.c_str());
+  else if (DEBUG)
     Serial.println(msg);
 }
 
 void debugln(int msg) {
-  if (DEBUG)
+  if (TELEMETRY)
+    telemetry.text(String(msg).c_str());
+  else if (DEBUG)
     Serial.println(msg);
 }
 
@@ -622,70 +713,33 @@ void setRGBledCO2color(int co2Value) {
 
 void setRGBledColor(char color) {
   if (useRGBledBar) {
-    //pixels.clear();
     switch (color) {
     case 'g':
-      for (int i = 0; i < 11; i++) {
-        pixels.setPixelColor(i, pixels.Color(0, 255, 0));
-        delay(100);
-        pixels.show();
-      }
+      ledBar.setColor(pixels.Color(0, 255, 0));
       break;
     case 'y':
-      for (int i = 0; i < 11; i++) {
-        pixels.setPixelColor(i, pixels.Color(255, 255, 0));
-        delay(100);
-        pixels.show();
-      }
+      ledBar.setColor(pixels.Color(255, 255, 0));
       break;
     case 'o':
-      for (int i = 0; i < 11; i++) {
-        pixels.setPixelColor(i, pixels.Color(255, 128, 0));
-        delay(100);
-        pixels.show();
-      }
+      ledBar.setColor(pixels.Color(255, 128, 0));
       break;
     case 'r':
-      for (int i = 0; i < 11; i++) {
-        pixels.setPixelColor(i, pixels.Color(255, 0, 0));
-        delay(100);
-        pixels.show();
-      }
+      ledBar.setColor(pixels.Color(255, 0, 0));
       break;
     case 'b':
-      for (int i = 0; i < 11; i++) {
-        pixels.setPixelColor(i, pixels.Color(0, 0, 255));
-        delay(100);
-        pixels.show();
-      }
+      ledBar.setColor(pixels.Color(0, 0, 255));
       break;
     case 'w':
-      for (int i = 0; i < 11; i++) {
-        pixels.setPixelColor(i, pixels.Color(255, 255, 255));
-        delay(100);
-        pixels.show();
-      }
+      ledBar.setColor(pixels.Color(255, 255, 255));
       break;
     case 'p':
-      for (int i = 0; i < 11; i++) {
-        pixels.setPixelColor(i, pixels.Color(153, 0, 153));
-        delay(100);
-        pixels.show();
-      }
+      ledBar.setColor(pixels.Color(153, 0, 153));
       break;
     case 'z':
-      for (int i = 0; i < 11; i++) {
-        pixels.setPixelColor(i, pixels.Color(102, 0, 0));
-        delay(100);
-        pixels.show();
-      }
+      ledBar.setColor(pixels.Color(102, 0, 0));
       break;
     case 'n':
-      for (int i = 0; i < 11; i++) {
-        pixels.setPixelColor(i, pixels.Color(0, 0, 0));
-        delay(100);
-        pixels.show();
-      }
+      ledBar.setColor(pixels.Color(0, 0, 0));
       break;
     default:
       // if nothing else matches, do the default
@@ -697,12 +751,6 @@ void setRGBledColor(char color) {
 
 // Calculate PM2.5 US AQI
 int PM_TO_AQI_US(int pm02) {
-  if (pm02 <= 12.0) return ((50 - 0) / (12.0 - .0) * (pm02 - .0) + 0);
-  else if (pm02 <= 35.4) return ((100 - 50) / (35.4 - 12.0) * (pm02 - 12.0) + 50);
-  else if (pm02 <= 55.4) return ((150 - 100) / (55.4 - 35.4) * (pm02 - 35.4) + 100);
-  else if (pm02 <= 150.4) return ((200 - 150) / (150.4 - 55.4) * (pm02 - 55.4) + 150);
-  else if (pm02 <= 250.4) return ((300 - 200) / (250.4 - 150.4) * (pm02 - 150.4) + 200);
-  else if (pm02 <= 350.4) return ((400 - 300) / (350.4 - 250.4) * (pm02 - 250.4) + 300);
-  else if (pm02 <= 500.4) return ((500 - 400) / (500.4 - 350.4) * (pm02 - 350.4) + 400);
-  else return 500;
+  // US EPA breakpoints as revised in 2024, see AirGradientAqi.h
+  return AQI_compute(AQI_US_EPA, AQI_PM2_5, pm02 * 10);
 };
@@ -20,18 +20,29 @@ Kits with all required components are available at https://www.airgradient.com/o
 CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
 */
 
-#include <AirGradient.h>
+#include <SoftwareSerial.h>
+#include <AirGradientBoard.h>
+#include <AirGradientPmsPower.h>
+#include <AirGradientAqi.h>
 
-AirGradient ag = AirGradient();
+// The fan only runs for the 30s warm-up and a few frames every 5 minutes,
+// see AirGradientPmsPower.h
+SoftwareSerial pmsSerial(D5, D6);
+AirGradientBoard<PmsDriver> ag;
+PmsPowerManager pmsPower(ag.get<PmsDriver>());
 
 void setup() {
   Serial.begin(115200);
-  ag.PMS_Init();
+  pmsSerial.begin(9600);
+  ag.get<PmsDriver>().begin(pmsSerial);
+  pmsPower.begin(5 * 60 * 1000UL);
 }
 
 void loop() {
 
-  int PM2 = ag.getPM2_Raw();
+  if (!pmsPower.update()) return;
+
+  int PM2 = pmsPower.getAverage().PM_AE_UG_2_5;
 
   Serial.print("PM2.5 in ug/m3: ");
   Serial.println(String(PM2));
@@ -39,16 +50,11 @@ void loop() {
   Serial.print("PM2.5 in US AQI: ");
   Serial.println(String(PM_TO_AQI_US(PM2)));
 
-  delay(5000);
+  Serial.print("PMS duty cycle in %: ");
+  Serial.println(String(pmsPower.getDutyCyclePercent()));
 }
 
 int PM_TO_AQI_US(int pm02) {
-  if (pm02 <= 12.0) return ((50 - 0) / (12.0 - .0) * (pm02 - .0) + 0);
-  else if (pm02 <= 35.4) return ((100 - 50) / (35.4 - 12.0) * (pm02 - 12.0) + 50);
-  else if (pm02 <= 55.4) return ((150 - 100) / (55.4 - 35.4) * (pm02 - 35.4) + 100);
-  else if (pm02 <= 150.4) return ((200 - 150) / (150.4 - 55.4) * (pm02 - 55.4) + 150);
-  else if (pm02 <= 250.4) return ((300 - 200) / (250.4 - 150.4) * (pm02 - 150.4) + 200);
-  else if (pm02 <= 350.4) return ((400 - 300) / (350.4 - 250.4) * (pm02 - 250.4) + 300);
-  else if (pm02 <= 500.4) return ((500 - 400) / (500.4 - 350.4) * (pm02 - 350.4) + 400);
-  else return 500;
+  // US EPA breakpoints as revised in 2024, see AirGradientAqi.h
+  return AQI_compute(AQI_US_EPA, AQI_PM2_5, pm02 * 10);
 };
@@ -0,0 +1,118 @@
+/*
+This is a bench tool for the AirGradient DIY Air Quality Sensor with an ESP8266 Microcontroller.
+
+It records everything the PMS5003 sends and receives to a capture file in flash, and replays such
+a capture through the same PMS parser, either at the recorded pace or as fast as possible. A capture
+of a misbehaving sensor can so be looked at again and again, and a full speed replay shows how many
+frames per second the parser handles. See AirGradientCapture.h for the file format.
+
+Copy the capture off the board with the LittleFS upload/download tools, or put one there to replay it.
+On a PC, extras/tools/capture_replay replays a capture through the same parser.
+
+Compatible with the following sensors:
+Plantower PMS5003 (Fine Particle Sensor)
+
+Please install ESP8266 board manager (tested with version 3.0.0)
+
+If you have any questions please visit our forum at https://forum.airgradient.com/
+
+CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+*/
+
+#include <SoftwareSerial.h>
+#include <LittleFS.h>
+#include <AirGradientPms.h>
+#include <AirGradientCapture.h>
+
+// CONFIGURATION START
+
+// false records from the sensor, true replays the capture file
+const bool REPLAY = false;
+
+// replay at the recorded pace instead of as fast as possible
+const bool REPLAY_REAL_TIME = false;
+
+// how long to record, in ms
+const unsigned long RECORD_TIME = 10 * 60 * 1000UL;
+
+const char* CAPTURE_FILE = "/pms.agc";
+
+// CONFIGURATION END
+
+SoftwareSerial pmsSerial(D5, D6);
+PmsDriver pms;
+
+void setup() {
+  Serial.begin(115200);
+  LittleFS.begin();
+
+  if (REPLAY) {
+    replay();
+  } else {
+    record();
+  }
+}
+
+void loop() {
+}
+
+void record() {
+  File file = LittleFS.open(CAPTURE_FILE, "w");
+  CaptureWriter capture(file);
+  RecordingStream pmsCapture(pmsSerial, capture, 0);
+
+  pmsSerial.begin(9600);
+  capture.begin();
+  pms.begin(pmsCapture);
+  pms.wakeUp();
+
+  PmsDriver::DATA data;
+  unsigned long frames = 0;
+  unsigned long start = millis();
+  while (millis() - start < RECORD_TIME) {
+    if (pms.read(data)) {
+      frames++;
+    }
+    yield();
+  }
+  capture.flush();
+  file.close();
+
+  Serial.println("Recorded " + String(frames) + " frames, " + String(capture.getBytes()) + " bytes in " +
+                 String(capture.getRecords()) + " records");
+}
+
+void replay() {
+  File file = LittleFS.open(CAPTURE_FILE, "r");
+  if (!file) {
+    Serial.println("No capture file");
+    return;
+  }
+  CaptureReader reader(file);
+  ReplayStream pmsReplay(reader, 0, REPLAY_REAL_TIME);
+  pms.begin(pmsReplay);
+
+  PmsDriver::DATA data;
+  unsigned long frames = 0;
+  unsigned long start = micros();
+  while (!pmsReplay.isFinished()) {
+    if (pms.read(data)) {
+      frames++;
+      if (REPLAY_REAL_TIME) {
+        Serial.println("PM2.5 in ug/m3: " + String(data.PM_AE_UG_2_5));
+      }
+    }
+    yield();
+  }
+  unsigned long elapsed = micros() - start;
+  file.close();
+
+  if (pmsReplay.getStatus() != CAPTURE_END) {
+    Serial.println("Capture file is damaged");
+  }
+  Serial.println("Replayed " + String(frames) + " frames from " + String(pmsReplay.getBytesRead()) +
+                 " bytes in " + String(elapsed / 1000) + " ms");
+  if (elapsed > 0) {
+    Serial.println("Frames per second: " + String(frames * 1000000.0 / elapsed, 0));
+  }
+}
@@ -0,0 +1,62 @@
+/*
+  Arduino.h - Host stand-in for the Arduino core
+
+  Just enough of the core for the library to build and run on a PC, for
+  the tests and tools under extras/. Time is virtual unless a tool asks
+  for the wall clock, see ArduinoHost.h.
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define CHANGE 1
+#define RISING 2
+#define FALLING 3
+
+#define DEC 10
+#define HEX 16
+
+#define F(s) (s)
+#define IRAM_ATTR
+#define digitalPinToInterrupt(pin) (pin)
+#define NOT_AN_INTERRUPT -1
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+void noInterrupts();
+void interrupts();
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode);
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+
+#endif
@@ -0,0 +1,219 @@
+/*
+  ArduinoHost.cpp - Host stand-in for the Arduino core
+*/
+
+#include "Arduino.h"
+#include "ArduinoHost.h"
+#include "EEPROM.h"
+#include "Wire.h"
+
+#include <chrono>
+#include <thread>
+
+#define HOST_PINS 64
+
+static thread_local HostClock threadClock;
+static thread_local HostClock* currentClock = &threadClock;
+static bool realTime = false;
+
+static uint8_t pins[HOST_PINS];
+
+HardwareSerial Serial;
+TwoWire Wire;
+EEPROMClass EEPROM;
+
+static uint64_t nowUs()
+{
+  if (realTime) {
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+  return currentClock->us;
+}
+
+void Host_useClock(HostClock* clock)
+{
+  currentClock = clock != NULL ? clock : &threadClock;
+}
+
+void Host_advance(uint32_t ms)
+{
+  currentClock->us += (uint64_t)ms * 1000;
+}
+
+void Host_setMillis(uint32_t ms)
+{
+  currentClock->us = (uint64_t)ms * 1000;
+}
+
+void Host_useRealTime(bool on)
+{
+  realTime = on;
+}
+
+int Host_getPin(uint8_t pin)
+{
+  return pin < HOST_PINS ? pins[pin] : LOW;
+}
+
+void Host_setPin(uint8_t pin, int level)
+{
+  if (pin < HOST_PINS) {
+    pins[pin] = level;
+  }
+}
+
+uint32_t millis()
+{
+  return (uint32_t)(nowUs() / 1000);
+}
+
+uint32_t micros()
+{
+  return (uint32_t)nowUs();
+}
+
+void delay(uint32_t ms)
+{
+  if (realTime) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  } else {
+    currentClock->us += (uint64_t)ms * 1000;
+  }
+}
+
+void delayMicroseconds(uint32_t us)
+{
+  if (!realTime) {
+    currentClock->us += us;
+  }
+}
+
+void yield()
+{
+  if (realTime) {
+    std::this_thread::yield();
+  }
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (mode == INPUT_PULLUP) {
+    Host_setPin(pin, HIGH);
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  Host_setPin(pin, value);
+}
+
+int digitalRead(uint8_t pin)
+{
+  return Host_getPin(pin);
+}
+
+void noInterrupts()
+{
+}
+
+void interrupts()
+{
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode)
+{
+  (void)pin;
+  (void)handler;
+  (void)mode;
+}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode)
+{
+  (void)pin;
+  (void)handler;
+  (void)arg;
+  (void)mode;
+}
+
+void detachInterrupt(uint8_t pin)
+{
+  (void)pin;
+}
+
+String::String(double value, unsigned char decimals)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+  assign(buf);
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::print(long value, int base)
+{
+  if (base != DEC) {
+    return print((unsigned long)value, base);
+  }
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%ld", value);
+  return write(buf);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+  char buf[24];
+  snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%lu", value);
+  return write(buf);
+}
+
+size_t Print::print(double value, int decimals)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+  return write(buf);
+}
+
+int Stream::timedRead()
+{
+  uint32_t start = millis();
+  do {
+    int c = read();
+    if (c >= 0) {
+      return c;
+    }
+    // a virtual clock has to be moved on, or nothing would ever arrive
+    delay(1);
+  } while (millis() - start < _timeout);
+  return -1;
+}
+
+size_t Stream::readBytes(uint8_t* buffer, size_t length)
+{
+  size_t n = 0;
+  while (n < length) {
+    int c = timedRead();
+    if (c < 0) {
+      break;
+    }
+    buffer[n++] = c;
+  }
+  return n;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+  return fwrite(buffer, 1, size, stdout);
+}
@@ -0,0 +1,40 @@
+/*
+  ArduinoHost.h - Controls of the host Arduino core stand-in
+
+  millis() and micros() read a virtual clock that only moves when the
+  program says so; delay() advances it instead of sleeping, so a test of
+  a 30 s timeout takes no time at all. Every thread starts on a clock of
+  its own; a simulator that moves devices between threads hands each
+  device its own HostClock:
+
+    HostClock clock;
+    Host_useClock(&clock);    // this thread runs on the device's time now
+    device.loop();
+    Host_useClock(NULL);      // back to the thread's own clock
+
+  Tools that talk to real sockets call Host_useRealTime(true); millis()
+  and delay() then follow the wall clock for every thread.
+
+  Pins remember the last level written; an INPUT_PULLUP pin reads HIGH.
+*/
+
+#ifndef ArduinoHost_h
+#define ArduinoHost_h
+
+#include <stdint.h>
+
+struct HostClock {
+  uint64_t us = 0;
+};
+
+// NULL selects the thread's own clock
+void Host_useClock(HostClock* clock);
+void Host_advance(uint32_t ms);
+void Host_setMillis(uint32_t ms);
+void Host_useRealTime(bool realTime);
+
+// Level of an output pin, or what an input reads
+int Host_getPin(uint8_t pin);
+void Host_setPin(uint8_t pin, int level);
+
+#endif
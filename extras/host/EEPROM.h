@@ -0,0 +1,33 @@
+/*
+  EEPROM.h - Host stand-in for the EEPROM library of the ESP cores
+
+  RAM only; FileConfigStorage keeps settings in a file instead.
+*/
+
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include <stdint.h>
+#include <string.h>
+
+class EEPROMClass
+{
+  public:
+    static const uint16_t MAX_SIZE = 4096;
+
+    EEPROMClass() { memset(_data, 0xFF, sizeof(_data)); }
+
+    void begin(uint16_t size) { _size = size < MAX_SIZE ? size : MAX_SIZE; }
+    uint8_t read(int address) { return address >= 0 && address < _size ? _data[address] : 0xFF; }
+    void write(int address, uint8_t value) { if (address >= 0 && address < _size) _data[address] = value; }
+    bool commit() { return true; }
+    uint16_t length() { return _size; }
+
+  private:
+    uint8_t _data[MAX_SIZE];
+    uint16_t _size = 512;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,28 @@
+/*
+  HardwareSerial.h - Host stand-in for the Arduino HardwareSerial class
+
+  Serial writes to stdout and never receives anything.
+*/
+
+#ifndef HardwareSerial_h
+#define HardwareSerial_h
+
+#include "Stream.h"
+
+class HardwareSerial : public Stream
+{
+  public:
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,86 @@
+/*
+  HostFile.cpp - Files as Streams for the host Arduino core stand-in
+*/
+
+#include "HostFile.h"
+
+FileStream::FileStream()
+{
+}
+
+FileStream::~FileStream()
+{
+  close();
+}
+
+bool FileStream::open(const char* path, const char* mode)
+{
+  close();
+  _file = fopen(path, mode);
+  _owned = true;
+  return _file != NULL;
+}
+
+void FileStream::attach(FILE* file)
+{
+  close();
+  _file = file;
+  _owned = false;
+}
+
+void FileStream::close()
+{
+  if (_file != NULL && _owned) {
+    fclose(_file);
+  }
+  _file = NULL;
+}
+
+bool FileStream::isOpen() const
+{
+  return _file != NULL;
+}
+
+int FileStream::available()
+{
+  return peek() >= 0 ? 1 : 0;
+}
+
+int FileStream::read()
+{
+  if (_file == NULL) {
+    return -1;
+  }
+  int c = getc(_file);
+  return c == EOF ? -1 : c;
+}
+
+int FileStream::peek()
+{
+  if (_file == NULL) {
+    return -1;
+  }
+  int c = getc(_file);
+  if (c == EOF) {
+    return -1;
+  }
+  ungetc(c, _file);
+  return c;
+}
+
+void FileStream::flush()
+{
+  if (_file != NULL) {
+    fflush(_file);
+  }
+}
+
+size_t FileStream::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t FileStream::write(const uint8_t* buffer, size_t size)
+{
+  return _file != NULL ? fwrite(buffer, 1, size, _file) : 0;
+}
@@ -0,0 +1,49 @@
+/*
+  HostFile.h - Files as Streams for the host Arduino core stand-in
+
+  FileStream does for the host tools what a LittleFS File does on the
+  board: the library's readers and writers (CaptureReader, CaptureWriter,
+  TelemetryDecoder, ...) take it as their Stream or Print.
+
+    FileStream file;
+    if (file.open("pms.agc", "rb")) {
+      CaptureReader reader(file);
+      ...
+    }
+
+  The stream does not close a FILE handed to attach(), e.g. stdout.
+*/
+
+#ifndef HostFile_h
+#define HostFile_h
+
+#include <stdio.h>
+
+#include "Stream.h"
+
+class FileStream : public Stream
+{
+  public:
+    FileStream();
+    ~FileStream();
+
+    bool open(const char* path, const char* mode);
+    void attach(FILE* file);
+    void close();
+    bool isOpen() const;
+
+    // 1 while there is a byte left; the size of a pipe is not known
+    int available();
+    int read();
+    int peek();
+    void flush();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+
+  private:
+    FILE* _file = NULL;
+    bool _owned = false;
+};
+
+#endif
@@ -0,0 +1,217 @@
+/*
+  HostSocket.cpp - TCP sockets for the host Arduino core stand-in
+*/
+
+#include "HostSocket.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+SocketClient::SocketClient()
+{
+}
+
+SocketClient::~SocketClient()
+{
+  stop();
+}
+
+int SocketClient::connect(const char* host, uint16_t port)
+{
+  stop();
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  addrinfo* result;
+  if (getaddrinfo(host, service, &hints, &result) != 0) {
+    return 0;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  bool ok = fd >= 0 && ::connect(fd, result->ai_addr, result->ai_addrlen) == 0;
+  freeaddrinfo(result);
+  if (!ok) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return 0;
+  }
+  attach(fd);
+  return 1;
+}
+
+void SocketClient::attach(int fd)
+{
+  stop();
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  _fd = fd;
+  _closed = false;
+}
+
+int SocketClient::fd() const
+{
+  return _fd;
+}
+
+size_t SocketClient::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t SocketClient::write(const uint8_t* buffer, size_t size)
+{
+  size_t sent = 0;
+  while (_fd >= 0 && sent < size) {
+    ssize_t n = send(_fd, buffer + sent, size - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      _closed = true;
+      break;
+    }
+    sent += n;
+  }
+  return sent;
+}
+
+int SocketClient::available()
+{
+  if (_fd < 0) {
+    return 0;
+  }
+  int n = 0;
+  ioctl(_fd, FIONREAD, &n);
+  if (n == 0) {
+    char c;
+    ssize_t r = recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      _closed = true;
+    }
+  }
+  return n;
+}
+
+int SocketClient::read()
+{
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int SocketClient::read(uint8_t* buffer, size_t size)
+{
+  if (_fd < 0) {
+    return -1;
+  }
+  ssize_t n = recv(_fd, buffer, size, MSG_DONTWAIT);
+  if (n == 0) {
+    _closed = true;
+  }
+  return n > 0 ? n : -1;
+}
+
+int SocketClient::peek()
+{
+  uint8_t c;
+  if (_fd < 0 || recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) != 1) {
+    return -1;
+  }
+  return c;
+}
+
+void SocketClient::flush()
+{
+}
+
+void SocketClient::stop()
+{
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+  _closed = false;
+}
+
+uint8_t SocketClient::connected()
+{
+  if (_fd < 0) {
+    return 0;
+  }
+  // data that is still buffered counts, like on the WiFi cores
+  return available() > 0 || !_closed;
+}
+
+SocketClient::operator bool()
+{
+  return _fd >= 0;
+}
+
+SocketServer::SocketServer(uint16_t port)
+{
+  _port = port;
+}
+
+SocketServer::~SocketServer()
+{
+  end();
+}
+
+bool SocketServer::begin()
+{
+  _fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (_fd < 0) {
+    return false;
+  }
+  int on = 1;
+  setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(_port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (bind(_fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(_fd, 128) != 0 ||
+      getsockname(_fd, (sockaddr*)&address, &length) != 0) {
+    end();
+    return false;
+  }
+  _port = ntohs(address.sin_port);
+  return true;
+}
+
+void SocketServer::end()
+{
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+}
+
+uint16_t SocketServer::port() const
+{
+  return _port;
+}
+
+bool SocketServer::accept(SocketClient& client, int timeoutMs)
+{
+  if (_fd < 0) {
+    return false;
+  }
+  pollfd waiting = { _fd, POLLIN, 0 };
+  if (poll(&waiting, 1, timeoutMs) <= 0) {
+    return false;
+  }
+  int fd = ::accept(_fd, NULL, NULL);
+  if (fd < 0) {
+    return false;
+  }
+  client.attach(fd);
+  return true;
+}
@@ -0,0 +1,75 @@
+/*
+  HostSocket.h - TCP sockets for the host Arduino core stand-in
+
+  SocketClient is a Client over a POSIX socket, so the network code of
+  the library (ConditionalPoller, MqttPublisher, MetricsServer, ...) can
+  talk to local stand-ins and tools in a host build:
+
+    Host_useRealTime(true);         // timeouts follow the wall clock
+    SocketClient client;
+    ConditionalPoller poller(client);
+    poller.poll("127.0.0.1", port, "/displays/abc", json);
+
+  SocketServer listens on a local port; port 0 picks a free one.
+
+    SocketServer server(0);
+    server.begin();
+    SocketClient connection;
+    if (server.accept(connection, 1000)) metrics.handle(connection);
+*/
+
+#ifndef HostSocket_h
+#define HostSocket_h
+
+#include "Client.h"
+
+class SocketClient : public Client
+{
+  public:
+    SocketClient();
+    ~SocketClient();
+
+    int connect(const char* host, uint16_t port);
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+    int available();
+    int read();
+    int read(uint8_t* buffer, size_t size);
+    int peek();
+    void flush();
+    void stop();
+    uint8_t connected();
+    operator bool();
+
+    // Takes over a connected socket, closing the previous one
+    void attach(int fd);
+    int fd() const;
+
+  private:
+    int _fd = -1;
+    bool _closed = false;
+
+    SocketClient(const SocketClient&);
+    SocketClient& operator=(const SocketClient&);
+};
+
+class SocketServer
+{
+  public:
+    SocketServer(uint16_t port = 0);
+    ~SocketServer();
+
+    bool begin();
+    void end();
+    // The bound port, also after begin() with port 0
+    uint16_t port() const;
+    // Waits up to timeoutMs for a connection; false on timeout.
+    bool accept(SocketClient& client, int timeoutMs);
+
+  private:
+    uint16_t _port;
+    int _fd = -1;
+};
+
+#endif
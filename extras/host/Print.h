@@ -0,0 +1,46 @@
+/*
+  Print.h - Host stand-in for the Arduino Print class
+*/
+
+#ifndef Print_h
+#define Print_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "WString.h"
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* s) { return s == NULL ? 0 : write((const uint8_t*)s, strlen(s)); }
+    size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(const String& s) { return write(s.c_str(), s.length()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char value, int base = DEC_BASE) { return print((unsigned long)value, base); }
+    size_t print(int value, int base = DEC_BASE) { return print((long)value, base); }
+    size_t print(unsigned int value, int base = DEC_BASE) { return print((unsigned long)value, base); }
+    size_t print(long value, int base = DEC_BASE);
+    size_t print(unsigned long value, int base = DEC_BASE);
+    size_t print(double value, int decimals = 2);
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T& value) { size_t n = print(value); return n + println(); }
+    template <typename T>
+    size_t println(const T& value, int format) { size_t n = print(value, format); return n + println(); }
+
+  private:
+    static const int DEC_BASE = 10;
+};
+
+#endif
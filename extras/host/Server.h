@@ -0,0 +1,16 @@
+/*
+  Server.h - Host stand-in for the Arduino Server class
+*/
+
+#ifndef Server_h
+#define Server_h
+
+#include "Print.h"
+
+class Server : public Print
+{
+  public:
+    virtual void begin() = 0;
+};
+
+#endif
@@ -0,0 +1,35 @@
+/*
+  WString.h - Host stand-in for the Arduino String class
+*/
+
+#ifndef WString_h
+#define WString_h
+
+#include <string>
+
+class String : public std::string
+{
+  public:
+    String() {}
+    String(const char* s) : std::string(s) {}
+    String(const std::string& s) : std::string(s) {}
+    String(char c) : std::string(1, c) {}
+    String(int value) : std::string(std::to_string(value)) {}
+    String(unsigned int value) : std::string(std::to_string(value)) {}
+    String(long value) : std::string(std::to_string(value)) {}
+    String(unsigned long value) : std::string(std::to_string(value)) {}
+    String(double value, unsigned char decimals = 2);
+
+    unsigned int length() const { return size(); }
+    long toInt() const { return atol(c_str()); }
+    float toFloat() const { return atof(c_str()); }
+    String substring(unsigned int from) const { return String(substr(from)); }
+    String substring(unsigned int from, unsigned int to) const { return String(substr(from, to - from)); }
+    bool concat(const String& s) { append(s); return true; }
+
+    friend String operator+(const String& a, const String& b) { return String(std::string(a) + std::string(b)); }
+    friend String operator+(const String& a, const char* b) { return String(std::string(a) + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + std::string(b)); }
+};
+
+#endif
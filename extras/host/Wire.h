@@ -0,0 +1,34 @@
+/*
+  Wire.h - Host stand-in for the Arduino Wire library
+
+  A bus without devices: every address NACKs. Tests run the drivers on an
+  I2CEmulator (AirGradientEmulator.h) instead.
+*/
+
+#ifndef Wire_h
+#define Wire_h
+
+#include "Arduino.h"
+
+class TwoWire : public Stream
+{
+  public:
+    void begin() {}
+    void begin(int sdaPin, int sclPin) { (void)sdaPin; (void)sclPin; }
+    void end() {}
+    void setClock(uint32_t frequency) { (void)frequency; }
+
+    void beginTransmission(uint8_t address) { (void)address; }
+    uint8_t endTransmission(bool sendStop = true) { (void)sendStop; return 2; }
+    uint8_t requestFrom(uint8_t address, uint8_t length) { (void)address; (void)length; return 0; }
+
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    size_t write(uint8_t c) { (void)c; return 1; }
+    using Print::write;
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,225 @@
+/*
+  aqi_test.cpp - Every AQI table against a float reference, batch against single calls
+
+  The reference keeps its own breakpoints, in ug/m3 as the standards
+  publish them. The benchmark only prints.
+*/
+
+#include "AirGradientAqi.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#include "test.h"
+
+struct Breakpoint {
+  double cLow, cHigh;
+  int iLow, iHigh;
+};
+
+struct Reference {
+  AQI_Standard standard;
+  AQI_Pollutant pollutant;
+  const char* name;
+  const Breakpoint* breakpoints;
+  size_t count;
+  // reporting step in ug/m3
+  double resolution;
+  bool roundUp;
+};
+
+static const Breakpoint usPm25[] = {
+  { 0.0, 9.0, 0, 50 }, { 9.1, 35.4, 51, 100 }, { 35.5, 55.4, 101, 150 },
+  { 55.5, 125.4, 151, 200 }, { 125.5, 225.4, 201, 300 }, { 225.5, 325.4, 301, 500 }
+};
+static const Breakpoint usPm10[] = {
+  { 0, 54, 0, 50 }, { 55, 154, 51, 100 }, { 155, 254, 101, 150 },
+  { 255, 354, 151, 200 }, { 355, 424, 201, 300 }, { 425, 604, 301, 500 }
+};
+static const Breakpoint euPm25[] = {
+  { 0, 15, 0, 25 }, { 15, 30, 25, 50 }, { 30, 55, 50, 75 }, { 55, 110, 75, 100 }
+};
+static const Breakpoint euPm10[] = {
+  { 0, 25, 0, 25 }, { 25, 50, 25, 50 }, { 50, 90, 50, 75 }, { 90, 180, 75, 100 }
+};
+static const Breakpoint ukPm25[] = {
+  { 0, 11, 1, 1 }, { 12, 23, 2, 2 }, { 24, 35, 3, 3 }, { 36, 41, 4, 4 }, { 42, 47, 5, 5 },
+  { 48, 53, 6, 6 }, { 54, 58, 7, 7 }, { 59, 64, 8, 8 }, { 65, 70, 9, 9 }, { 71, 1e9, 10, 10 }
+};
+static const Breakpoint ukPm10[] = {
+  { 0, 16, 1, 1 }, { 17, 33, 2, 2 }, { 34, 50, 3, 3 }, { 51, 58, 4, 4 }, { 59, 66, 5, 5 },
+  { 67, 75, 6, 6 }, { 76, 83, 7, 7 }, { 84, 91, 8, 8 }, { 92, 100, 9, 9 }, { 101, 1e9, 10, 10 }
+};
+static const Breakpoint inPm25[] = {
+  { 0, 30, 0, 50 }, { 31, 60, 51, 100 }, { 61, 90, 101, 200 },
+  { 91, 120, 201, 300 }, { 121, 250, 301, 400 }, { 251, 380, 401, 500 }
+};
+static const Breakpoint inPm10[] = {
+  { 0, 50, 0, 50 }, { 51, 100, 51, 100 }, { 101, 250, 101, 200 },
+  { 251, 350, 201, 300 }, { 351, 430, 301, 400 }, { 431, 510, 401, 500 }
+};
+static const Breakpoint cnPm25[] = {
+  { 0, 35, 0, 50 }, { 35, 75, 50, 100 }, { 75, 115, 100, 150 }, { 115, 150, 150, 200 },
+  { 150, 250, 200, 300 }, { 250, 350, 300, 400 }, { 350, 500, 400, 500 }
+};
+static const Breakpoint cnPm10[] = {
+  { 0, 50, 0, 50 }, { 50, 150, 50, 100 }, { 150, 250, 100, 150 }, { 250, 350, 150, 200 },
+  { 350, 420, 200, 300 }, { 420, 500, 300, 400 }, { 500, 600, 400, 500 }
+};
+
+#define REFERENCE(standard, pollutant, breakpoints, resolution, roundUp) \
+  { standard, pollutant, #standard " " #pollutant, breakpoints, \
+    sizeof(breakpoints) / sizeof(breakpoints[0]), resolution, roundUp }
+
+static const Reference references[] = {
+  REFERENCE(AQI_US_EPA, AQI_PM2_5, usPm25, 0.1, false),
+  REFERENCE(AQI_US_EPA, AQI_PM10, usPm10, 1, false),
+  REFERENCE(AQI_EU_CAQI, AQI_PM2_5, euPm25, 0.1, false),
+  REFERENCE(AQI_EU_CAQI, AQI_PM10, euPm10, 0.1, false),
+  REFERENCE(AQI_UK_DAQI, AQI_PM2_5, ukPm25, 1, false),
+  REFERENCE(AQI_UK_DAQI, AQI_PM10, ukPm10, 1, false),
+  REFERENCE(AQI_IN_NAQI, AQI_PM2_5, inPm25, 1, false),
+  REFERENCE(AQI_IN_NAQI, AQI_PM10, inPm10, 1, false),
+  REFERENCE(AQI_CN_IAQI, AQI_PM2_5, cnPm25, 1, true),
+  REFERENCE(AQI_CN_IAQI, AQI_PM10, cnPm10, 1, true),
+};
+
+static const size_t REFERENCE_COUNT = sizeof(references) / sizeof(references[0]);
+
+// Ties and exact breakpoints are a rounding error away in double; the
+// nearest value that is not one is 1 / (2 * 65535) away.
+static const double EPSILON = 1e-9;
+
+static int reference(const Reference& ref, int32_t tenths)
+{
+  if (tenths < 0) {
+    return -1;
+  }
+  double c = tenths / 10.0;
+  c = floor(c / ref.resolution + EPSILON) * ref.resolution;
+  const Breakpoint& top = ref.breakpoints[ref.count - 1];
+  if (c > top.cHigh) {
+    return top.iHigh;
+  }
+  for (size_t i = 0; i < ref.count; i++) {
+    const Breakpoint& b = ref.breakpoints[i];
+    if (c <= b.cHigh + EPSILON) {
+      double index = (double)(b.iHigh - b.iLow) / (b.cHigh - b.cLow) * (c - b.cLow) + b.iLow;
+      return ref.roundUp ? (int)ceil(index - EPSILON) : (int)floor(index + 0.5 + EPSILON);
+    }
+  }
+  return -2;
+}
+
+TEST(every_table_matches_the_reference)
+{
+  for (size_t r = 0; r < REFERENCE_COUNT; r++) {
+    const Reference& ref = references[r];
+    uint32_t mismatches = 0;
+    for (int32_t tenths = -10; tenths <= 70000; tenths++) {
+      int expected = reference(ref, tenths);
+      int16_t actual = AQI_compute(ref.standard, ref.pollutant, tenths);
+      if (actual != expected && mismatches++ < 3) {
+        printf("%s at %ld tenths: %d, expected %d\n", ref.name, (long)tenths, actual, expected);
+      }
+    }
+    CHECK_EQUAL(mismatches, 0);
+  }
+}
+
+TEST(published_examples)
+{
+  // 2024 US EPA: 9.0 is the top of Good, 35.5 the start of USG
+  CHECK_EQUAL(AQI_compute(AQI_US_EPA, AQI_PM2_5, 90), 50);
+  CHECK_EQUAL(AQI_compute(AQI_US_EPA, AQI_PM2_5, 91), 51);
+  CHECK_EQUAL(AQI_compute(AQI_US_EPA, AQI_PM2_5, 355), 101);
+  CHECK_EQUAL(AQI_compute(AQI_US_EPA, AQI_PM2_5, 3254), 500);
+  CHECK_EQUAL(AQI_compute(AQI_US_EPA, AQI_PM2_5, 9999), 500);
+  CHECK_EQUAL(AQI_compute(AQI_UK_DAQI, AQI_PM2_5, 0), 1);
+  CHECK_EQUAL(AQI_compute(AQI_UK_DAQI, AQI_PM2_5, 719), 10);
+  // China rounds up: 51.25
+  CHECK_EQUAL(AQI_compute(AQI_CN_IAQI, AQI_PM2_5, 350), 50);
+  CHECK_EQUAL(AQI_compute(AQI_CN_IAQI, AQI_PM2_5, 360), 52);
+  CHECK_EQUAL(AQI_compute(AQI_EU_CAQI, AQI_PM10, 1800), 100);
+  // no reading
+  CHECK_EQUAL(AQI_compute(AQI_IN_NAQI, AQI_PM10, -1), -1);
+  // out of range arguments fall back to US EPA PM2.5
+  CHECK_EQUAL(AQI_compute(AQI_STANDARD_COUNT, AQI_PM2_5, 355), 101);
+}
+
+TEST(batch_equals_single_calls)
+{
+  std::vector<uint16_t> tenths(65536);
+  std::vector<int16_t> index(65536 + 1);
+  for (uint32_t i = 0; i < tenths.size(); i++) {
+    tenths[i] = i;
+  }
+  for (uint8_t s = 0; s < AQI_STANDARD_COUNT; s++) {
+    for (uint8_t p = 0; p < AQI_POLLUTANT_COUNT; p++) {
+      const AQI_Table& table = AQI_table((AQI_Standard)s, (AQI_Pollutant)p);
+      index[tenths.size()] = 12345;
+      AQI_computeBatch(table, tenths.data(), index.data(), tenths.size());
+      uint32_t mismatches = 0;
+      for (uint32_t i = 0; i < tenths.size(); i++) {
+        mismatches += index[i] != AQI_fromTenths(table, tenths[i]);
+      }
+      CHECK_EQUAL(mismatches, 0);
+      // nothing past count
+      CHECK_EQUAL(index[tenths.size()], 12345);
+    }
+  }
+
+  // short and empty arrays
+  const uint16_t some[] = { 355, 12, 2000 };
+  int16_t out[3] = { -5, -5, -5 };
+  AQI_computeBatch(AQI_table(AQI_US_EPA, AQI_PM2_5), some, out, 0);
+  CHECK_EQUAL(out[0], -5);
+  AQI_computeBatch(AQI_table(AQI_US_EPA, AQI_PM2_5), some, out, 3);
+  CHECK_EQUAL(out[0], 101);
+  CHECK_EQUAL(out[1], AQI_compute(AQI_US_EPA, AQI_PM2_5, 12));
+  CHECK_EQUAL(out[2], AQI_compute(AQI_US_EPA, AQI_PM2_5, 2000));
+}
+
+static double nanosecondsSince(std::chrono::steady_clock::time_point start, uint32_t count)
+{
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+}
+
+TEST(benchmark)
+{
+  const uint32_t rounds = 20;
+  std::vector<uint16_t> tenths(65536);
+  std::vector<int16_t> index(65536);
+  for (uint32_t i = 0; i < tenths.size(); i++) {
+    // readings cluster at the low end
+    tenths[i] = (i * 2654435761UL) % 1500;
+  }
+  const AQI_Table& table = AQI_table(AQI_US_EPA, AQI_PM2_5);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t round = 0; round < rounds; round++) {
+    for (uint32_t i = 0; i < tenths.size(); i++) {
+      index[i] = AQI_fromTenths(table, tenths[i]);
+    }
+  }
+  double singleNs = nanosecondsSince(start, rounds * tenths.size());
+
+  start = std::chrono::steady_clock::now();
+  for (uint32_t round = 0; round < rounds; round++) {
+    AQI_computeBatch(table, tenths.data(), index.data(), tenths.size());
+  }
+  double batchNs = nanosecondsSince(start, rounds * tenths.size());
+
+  printf("US EPA PM2.5 per value: AQI_fromTenths %.2f ns, AQI_computeBatch %.2f ns\n", singleNs, batchNs);
+}
+
+int main()
+{
+  RUN(every_table_matches_the_reference);
+  RUN(published_examples);
+  RUN(batch_equals_single_calls);
+  RUN(benchmark);
+  return Test_result();
+}
@@ -0,0 +1,256 @@
+/*
+  average_test.cpp - RollingAverage against a brute-force reference that keeps every sample
+*/
+
+#include "AirGradientAverage.h"
+
+#include <math.h>
+#include <vector>
+
+#include "test.h"
+
+static const uint32_t HOUR = RollingAverage::HOUR;
+static const int32_t NO_VALUE = RollingAverage::NO_VALUE;
+
+// Keeps every sample by hour and rescans them for each result.
+struct Reference {
+  uint32_t start;
+  std::vector<std::vector<int32_t> > samples;
+
+  explicit Reference(uint32_t start) : start(start) {}
+
+  void add(int32_t value, uint32_t now)
+  {
+    size_t hour = (now - start) / HOUR;
+    if (samples.size() <= hour) {
+      samples.resize(hour + 1);
+    }
+    if (value >= 0) {
+      samples[hour].push_back(value);
+    }
+  }
+
+  size_t closed(uint32_t now) const
+  {
+    return (now - start) / HOUR;
+  }
+
+  // the mean of an hour in tenths
+  int32_t hour(uint32_t now, uint8_t hoursAgo) const
+  {
+    size_t closedHours = closed(now);
+    if (hoursAgo >= closedHours || hoursAgo >= RollingAverage::HOURS) {
+      return NO_VALUE;
+    }
+    size_t h = closedHours - 1 - hoursAgo;
+    if (h >= samples.size() || samples[h].empty()) {
+      return NO_VALUE;
+    }
+    double sum = 0;
+    for (size_t i = 0; i < samples[h].size(); i++) {
+      sum += samples[h][i];
+    }
+    return floor(sum * 10 / samples[h].size() + 0.5);
+  }
+
+  int32_t mean(uint32_t now, uint8_t hours, uint8_t needed) const
+  {
+    double sum = 0;
+    uint8_t valid = 0;
+    for (uint8_t i = 0; i < hours; i++) {
+      int32_t c = hour(now, i);
+      if (c != NO_VALUE) {
+        sum += c;
+        valid++;
+      }
+    }
+    return valid >= needed ? (int32_t)floor(sum / valid + 0.5) : NO_VALUE;
+  }
+
+  int32_t nowCast(uint32_t now) const
+  {
+    if ((hour(now, 0) != NO_VALUE) + (hour(now, 1) != NO_VALUE) + (hour(now, 2) != NO_VALUE) < 2) {
+      return NO_VALUE;
+    }
+    double lowest = 1e9;
+    double highest = 0;
+    for (uint8_t i = 0; i < 12; i++) {
+      int32_t c = hour(now, i);
+      if (c != NO_VALUE) {
+        lowest = fmin(lowest, c);
+        highest = fmax(highest, c);
+      }
+    }
+    if (highest == 0) {
+      return 0;
+    }
+    double w = fmax(lowest / highest, 0.5);
+    double sum = 0;
+    double weights = 0;
+    for (uint8_t i = 0; i < 12; i++) {
+      int32_t c = hour(now, i);
+      if (c != NO_VALUE) {
+        sum += pow(w, i) * c;
+        weights += pow(w, i);
+      }
+    }
+    return floor(sum / weights + 1e-9);
+  }
+};
+
+static uint32_t mismatches = 0;
+
+static void compare(const char* what, int32_t actual, int32_t expected, uint32_t at)
+{
+  if (actual != expected && mismatches++ < 5) {
+    printf("%s at %lu: %ld, expected %ld\n", what, (unsigned long)at, (long)actual, (long)expected);
+  }
+}
+
+static void compareAll(const RollingAverage& average, const Reference& reference, uint32_t now)
+{
+  size_t closed = reference.closed(now);
+  compare("closed", average.getClosedHours(), closed < 24 ? closed : 24, now);
+  for (uint8_t i = 0; i < RollingAverage::HOURS; i++) {
+    compare("hour", average.getHour(i), reference.hour(now, i), now);
+  }
+  compare("mean8", average.getMean8(), reference.mean(now, 8, 6), now);
+  compare("mean24", average.getMean24(), reference.mean(now, 24, 18), now);
+  compare("nowcast", average.getNowCast(), reference.nowCast(now), now);
+}
+
+// Three days of a sample a minute from start, with failed reads and the
+// hours skip() picks left without samples; compares every result each
+// time an hour closes and returns how many closed.
+static uint32_t runDays(uint32_t start, bool (*skip)(uint32_t hour), int32_t (*value)(uint32_t minute))
+{
+  RollingAverage average;
+  Reference reference(start);
+  mismatches = 0;
+  uint32_t closings = 0;
+  for (uint32_t minute = 0; minute < 3 * 24 * 60; minute++) {
+    uint32_t now = start + minute * 60000 + minute % 7;
+    bool closed;
+    if (skip(minute / 60)) {
+      closed = average.update(now);
+    } else {
+      int32_t v = minute % 17 == 5 ? -1 : value(minute);
+      closed = average.add(v, now);
+      reference.add(v, now);
+    }
+    if (closed) {
+      closings++;
+      compareAll(average, reference, now);
+    }
+  }
+  return closings;
+}
+
+static bool noOutage(uint32_t)
+{
+  return false;
+}
+
+// one hour, then three, then six in a row, then every fourth for a while
+static bool outages(uint32_t hour)
+{
+  return hour == 5 || (hour >= 14 && hour < 17) || (hour >= 30 && hour < 36) ||
+         (hour >= 50 && hour < 62 && hour % 4 == 0);
+}
+
+static int32_t noisy(uint32_t minute)
+{
+  return (minute * 2654435761UL >> 16) % 120 + minute / 60 % 24 * 10;
+}
+
+// hours alternating between clean and smoky air, min / max far below 0.5
+static int32_t alternating(uint32_t minute)
+{
+  return minute / 60 % 2 ? 300 + minute % 3 : 10 + minute % 2;
+}
+
+TEST(matches_the_reference)
+{
+  CHECK_EQUAL(runDays(1000, noOutage, noisy), 3 * 24 - 1);
+  CHECK_EQUAL(mismatches, 0);
+}
+
+TEST(missing_hours_match_the_reference)
+{
+  runDays(1000, outages, noisy);
+  CHECK_EQUAL(mismatches, 0);
+  runDays(1000, outages, alternating);
+  CHECK_EQUAL(mismatches, 0);
+}
+
+TEST(millis_wrap_matches_the_reference)
+{
+  // the clock wraps in the first hour, in the middle of the day, and at an
+  // hour boundary
+  const uint32_t starts[] = { 0xFFFFFFFFUL - 1800000UL, 0xFFFFFFFFUL - 13 * HOUR, 0xFFFFFFFFUL - 20 * HOUR + 1 };
+  for (uint8_t i = 0; i < 3; i++) {
+    CHECK_EQUAL(runDays(starts[i], noOutage, noisy), 3 * 24 - 1);
+    CHECK_EQUAL(mismatches, 0);
+    runDays(starts[i], outages, alternating);
+    CHECK_EQUAL(mismatches, 0);
+  }
+}
+
+TEST(weight_floor)
+{
+  RollingAverage average;
+  average.add(10, 0);
+  average.add(100, HOUR);
+  average.update(2 * HOUR);
+  // min / max is 0.1: (1000 + 0.5 * 100) / 1.5, not (1000 + 0.1 * 100) / 1.1
+  CHECK_EQUAL(average.getNowCast(), 700);
+
+  // above the floor the ratio itself is the weight: (1000 + 0.8 * 800) / 1.8
+  RollingAverage steady;
+  steady.add(80, 0);
+  steady.add(100, HOUR);
+  steady.update(2 * HOUR);
+  CHECK_EQUAL(steady.getNowCast(), 911);
+
+  // clean air throughout
+  RollingAverage clean;
+  clean.add(0, 0);
+  clean.add(0, HOUR);
+  clean.update(2 * HOUR);
+  CHECK_EQUAL(clean.getNowCast(), 0);
+}
+
+TEST(missing_hours_thresholds)
+{
+  RollingAverage average;
+  average.add(20, 0);
+  average.update(HOUR);
+  // one hour is not enough for a NowCast
+  CHECK_EQUAL(average.getNowCast(), NO_VALUE);
+  average.update(2 * HOUR);
+  CHECK_EQUAL(average.getHour(0), NO_VALUE);
+  CHECK_EQUAL(average.getNowCast(), NO_VALUE);
+  average.add(30, 2 * HOUR);
+  average.update(3 * HOUR);
+  // 2 of the last 3 hours, the gap still counts in the weights:
+  // (300 + (2/3)^2 * 200) / (1 + (2/3)^2)
+  CHECK_EQUAL(average.getNowCast(), 269);
+  average.update(4 * HOUR);
+  CHECK_EQUAL(average.getNowCast(), NO_VALUE);
+  CHECK_EQUAL(average.getMean8(), NO_VALUE);
+
+  // a day without update() leaves nothing
+  average.update(4 * HOUR + 25 * HOUR);
+  CHECK_EQUAL(average.getClosedHours(), 0);
+  CHECK_EQUAL(average.getNowCast(), NO_VALUE);
+}
+
+int main()
+{
+  RUN(matches_the_reference);
+  RUN(missing_hours_match_the_reference);
+  RUN(millis_wrap_matches_the_reference);
+  RUN(weight_floor);
+  RUN(missing_hours_thresholds);
+  return Test_result();
+}
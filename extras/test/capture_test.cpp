@@ -0,0 +1,228 @@
+/*
+  capture_test.cpp - Recording PMS and I2C traffic and replaying it through the parsers
+*/
+
+#include "AirGradientCapture.h"
+#include "AirGradientEmulator.h"
+#include "ArduinoHost.h"
+
+#include <string.h>
+#include <vector>
+
+#include "test.h"
+
+// A capture file in memory
+class BufferStream : public Stream
+{
+  public:
+    std::vector<uint8_t> data;
+    size_t position = 0;
+
+    int available() { return data.size() - position; }
+    int read() { return position < data.size() ? data[position++] : -1; }
+    int peek() { return position < data.size() ? data[position] : -1; }
+    void flush() {}
+    size_t write(uint8_t c) { data.push_back(c); return 1; }
+    using Print::write;
+};
+
+// Records frames of the emulator through PmsDriver, one step per 10 ms.
+// read() takes one byte, so each step reads all that arrived.
+static uint32_t recordPms(BufferStream& file, uint32_t frames, std::vector<uint16_t>& pm25)
+{
+  Host_setMillis(0);
+  PmsEmulator sensor;
+  sensor.setCorruptEvery(7);
+  CaptureWriter capture(file);
+  RecordingStream recording(sensor, capture, 0);
+  PmsDriver pms;
+  capture.begin();
+  pms.begin(recording, PMS_VARIANT_PMS5003);
+
+  PmsDriver::DATA data;
+  uint32_t decoded = 0;
+  while (sensor.getFrames() < frames) {
+    sensor.setPm(sensor.getFrames() % 200);
+    sensor.update();
+    while (recording.available() > 0) {
+      if (pms.read(data)) {
+        pm25.push_back(data.PM_AE_UG_2_5);
+        decoded++;
+      }
+    }
+    Host_advance(10);
+  }
+  capture.flush();
+  return decoded;
+}
+
+TEST(max_speed_replay_decodes_the_same_frames)
+{
+  BufferStream file;
+  std::vector<uint16_t> recorded;
+  uint32_t decoded = recordPms(file, 100, recorded);
+  // every 7th frame has a bad checksum
+  CHECK_EQUAL(decoded, 100 - 100 / 7);
+
+  CaptureReader reader(file);
+  ReplayStream replay(reader, 0);
+  PmsDriver pms;
+  pms.begin(replay, PMS_VARIANT_PMS5003);
+  PmsDriver::DATA data;
+  std::vector<uint16_t> replayed;
+  while (!replay.isFinished()) {
+    if (pms.read(data)) {
+      replayed.push_back(data.PM_AE_UG_2_5);
+    }
+  }
+  CHECK_EQUAL(replay.getStatus(), CAPTURE_END);
+  CHECK(replayed == recorded);
+  CHECK_EQUAL(replay.getBytesRead(), 100 * 32);
+}
+
+TEST(real_time_replay_keeps_the_recorded_pace)
+{
+  BufferStream file;
+  std::vector<uint16_t> recorded;
+  recordPms(file, 5, recorded);
+
+  Host_setMillis(0);
+  CaptureReader reader(file);
+  ReplayStream replay(reader, 0, true);
+  // the first frame was sent a second into the recording
+  CHECK_EQUAL(replay.available(), 0);
+  Host_advance(999);
+  CHECK_EQUAL(replay.available(), 0);
+  Host_advance(1);
+  CHECK_EQUAL(replay.available(), 32);
+  for (int i = 0; i < 32; i++) {
+    replay.read();
+  }
+  CHECK_EQUAL(replay.available(), 0);
+  Host_advance(1000);
+  CHECK_EQUAL(replay.available(), 32);
+}
+
+TEST(records_coalesce_and_stay_compact)
+{
+  BufferStream file;
+  std::vector<uint16_t> recorded;
+  recordPms(file, 50, recorded);
+  // a 32 byte frame per record: tag, 3 byte delta, length
+  CHECK(file.data.size() < 50 * 32 * 1.2);
+
+  CaptureReader reader(file);
+  CaptureRecord record;
+  uint32_t records = 0;
+  CAPTURE_Status status;
+  while ((status = reader.next(record)) == CAPTURE_OK) {
+    CHECK_EQUAL(record.type, CAPTURE_RX);
+    CHECK_EQUAL(record.length, 32);
+    records++;
+  }
+  CHECK_EQUAL(status, CAPTURE_END);
+  CHECK_EQUAL(records, 50);
+}
+
+TEST(damaged_capture_is_reported)
+{
+  BufferStream file;
+  std::vector<uint16_t> recorded;
+  recordPms(file, 3, recorded);
+  // type 0 is not a record type
+  file.data[4] = 0x00;
+
+  CaptureReader reader(file);
+  ReplayStream replay(reader, 0);
+  CHECK(replay.isFinished());
+  CHECK_EQUAL(replay.getStatus(), CAPTURE_BAD_FORMAT);
+
+  BufferStream other;
+  other.write((const uint8_t*)"XYZ", 3);
+  CaptureReader wrongMagic(other);
+  CaptureRecord record;
+  CHECK_EQUAL(wrongMagic.next(record), CAPTURE_BAD_FORMAT);
+}
+
+TEST(commands_are_recorded_as_tx)
+{
+  BufferStream file;
+  PmsEmulator sensor;
+  CaptureWriter capture(file);
+  RecordingStream recording(sensor, capture, 2);
+  PmsDriver pms;
+  capture.begin();
+  pms.begin(recording, PMS_VARIANT_PMS5003);
+  pms.passiveMode();
+  capture.flush();
+
+  CaptureReader reader(file);
+  CaptureRecord record;
+  CHECK_EQUAL(reader.next(record), CAPTURE_OK);
+  CHECK_EQUAL(record.type, CAPTURE_TX);
+  CHECK_EQUAL(record.channel, 2);
+  CHECK_EQUAL(record.length, 7);
+  CHECK_EQUAL(record.data[2], 0xE1);
+  CHECK(sensor.isPassive());
+}
+
+class EchoDevice : public I2CDeviceEmulator
+{
+  public:
+    bool receive(const uint8_t*, uint8_t) { return true; }
+    uint8_t send(uint8_t* data, uint8_t len) { memset(data, 0x5A, len); return len; }
+};
+
+static CaptureWriter* traceCapture;
+
+static void traceI2C(uint8_t address, const I2C_Transaction& transaction)
+{
+  traceCapture->i2c(address, transaction);
+}
+
+TEST(i2c_transactions_are_recorded)
+{
+  BufferStream file;
+  CaptureWriter capture(file);
+  traceCapture = &capture;
+  I2CEmulator emulator;
+  EchoDevice device;
+  emulator.attach(0x44, device);
+  I2CBus bus(emulator);
+  bus.begin();
+  int8_t sht = bus.addDevice(0x44);
+  int8_t missing = bus.addDevice(0x45);
+  bus.setTraceCallback(traceI2C);
+  capture.begin();
+
+  const uint8_t command[] = { 0x24, 0x00 };
+  uint8_t rx[6];
+  CHECK_EQUAL(bus.writeRead(sht, command, sizeof(command), rx, sizeof(rx)), I2C_OK);
+  CHECK(bus.writeRead(missing, command, sizeof(command), rx, sizeof(rx)) != I2C_OK);
+
+  CaptureReader reader(file);
+  CaptureRecord record;
+  CHECK_EQUAL(reader.next(record), CAPTURE_OK);
+  CHECK_EQUAL(record.type, CAPTURE_I2C);
+  CHECK_EQUAL(record.data[0], 0x44);
+  CHECK_EQUAL(record.data[1], 0);
+  CHECK_EQUAL(record.data[2], 2);
+  CHECK_EQUAL(record.length, 3 + 2 + 6);
+  CHECK_EQUAL(record.data[5], 0x5A);
+  CHECK_EQUAL(reader.next(record), CAPTURE_OK);
+  CHECK_EQUAL(record.data[0], 0x45);
+  CHECK(record.data[1] != 0);
+  CHECK_EQUAL(record.length, 3 + 2);
+  CHECK_EQUAL(reader.next(record), CAPTURE_END);
+}
+
+int main()
+{
+  RUN(max_speed_replay_decodes_the_same_frames);
+  RUN(real_time_replay_keeps_the_recorded_pace);
+  RUN(records_coalesce_and_stay_compact);
+  RUN(damaged_capture_is_reported);
+  RUN(commands_are_recorded_as_tx);
+  RUN(i2c_transactions_are_recorded);
+  return Test_result();
+}
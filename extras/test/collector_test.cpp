@@ -0,0 +1,267 @@
+/*
+  collector_test.cpp - CollectorStore files and CollectorServer over a local socket
+*/
+
+#include "ArduinoHost.h"
+#include "Collector.h"
+#include "HostSocket.h"
+
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "test.h"
+
+struct Row {
+  int64_t timeMs;
+  Measures measures;
+};
+
+static void collect(int64_t timeMs, const Measures& measures, void* context)
+{
+  Row row = { timeMs, measures };
+  ((std::vector<Row>*)context)->push_back(row);
+}
+
+static std::string tempDir()
+{
+  char dir[] = "/tmp/collector_test_XXXXXX";
+  return mkdtemp(dir) != NULL ? dir : "/tmp";
+}
+
+static std::string readFile(const std::string& path)
+{
+  std::string text;
+  FILE* file = fopen(path.c_str(), "r");
+  if (file != NULL) {
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+      text.append(buf, n);
+    }
+    fclose(file);
+  }
+  return text;
+}
+
+static void removeDir(const std::string& dir)
+{
+  std::string command = "rm -rf " + dir;
+  CHECK_EQUAL(system(command.c_str()), 0);
+}
+
+TEST(rows_come_back_from_the_segments)
+{
+  std::string dir = tempDir();
+  {
+    CollectorStore store(dir.c_str());
+    // a full block and a partial one
+    for (int i = 0; i < CollectorStore::SEGMENT_ROWS + 10; i++) {
+      Measures measures;
+      measures.set(MEASURE_RCO2, 400 + i);
+      if (i % 2 == 0) {
+        measures.set(MEASURE_ATMP, 20.25f);
+      }
+      CHECK(store.append("abc123", 6, measures, 1000 * i));
+    }
+    CHECK_EQUAL(store.getBlocks(), 1);
+    store.rollup(1000000);
+    CHECK_EQUAL(store.getBlocks(), 2);
+    CHECK_EQUAL(store.getRows(), CollectorStore::SEGMENT_ROWS + 10);
+  }
+
+  std::vector<Row> rows;
+  CHECK(Collector_readSegments((dir + "/abc123.seg").c_str(), collect, &rows));
+  CHECK_EQUAL(rows.size(), CollectorStore::SEGMENT_ROWS + 10);
+  if (rows.size() == CollectorStore::SEGMENT_ROWS + 10) {
+    CHECK_EQUAL(rows[265].timeMs, 265000);
+    CHECK_EQUAL(rows[265].measures.get(MEASURE_RCO2), 665);
+    CHECK(!rows[265].measures.has(MEASURE_ATMP));
+    CHECK(rows[264].measures.has(MEASURE_ATMP));
+    CHECK(rows[264].measures.get(MEASURE_ATMP) == 20.25f);
+    CHECK(!rows[264].measures.has(MEASURE_PM02));
+  }
+  removeDir(dir);
+}
+
+TEST(absent_metrics_take_no_column)
+{
+  std::string dir = tempDir();
+  {
+    CollectorStore store(dir.c_str());
+    Measures measures;
+    measures.set(MEASURE_RCO2, 612);
+    for (int i = 0; i < 100; i++) {
+      store.append("one", 3, measures, i);
+    }
+  }
+  // magic, rows, fields, then time, present and one float column
+  CHECK_EQUAL(readFile(dir + "/one.seg").size(), 8 + 100 * (8 + 2 + 4));
+  removeDir(dir);
+}
+
+TEST(rollup_lines_per_metric)
+{
+  std::string dir = tempDir();
+  CollectorStore store(dir.c_str());
+  // rollup() has written every row, so the destructor writes nothing
+  for (int i = 0; i < 4; i++) {
+    Measures measures;
+    measures.set(MEASURE_PM02, 10 * (i + 1));
+    store.append("dev", 3, measures, 5000 + i);
+  }
+  store.rollup(60000);
+  // nothing new, no lines
+  store.rollup(120000);
+  Measures measures;
+  measures.set(MEASURE_PM02, 7);
+  store.append("dev", 3, measures, 130000);
+  store.rollup(180000);
+
+  CHECK(readFile(dir + "/dev.rollup.csv") ==
+        "window_start_ms,window_end_ms,metric,count,min,max,mean\n"
+        "5000,60000,pm02,4,10.00,40.00,25.00\n"
+        "120000,180000,pm02,1,7.00,7.00,7.00\n");
+  removeDir(dir);
+}
+
+TEST(ids_must_be_file_names)
+{
+  std::string dir = tempDir();
+  {
+    CollectorStore store(dir.c_str());
+    Measures measures;
+    CHECK(!store.append("../x", 4, measures, 0));
+    CHECK(!store.append("a/b", 3, measures, 0));
+    CHECK(!store.append("", 0, measures, 0));
+    CHECK(store.append("a-b_c.1", 7, measures, 0));
+    CHECK_EQUAL(store.getDevices(), 1);
+  }
+  removeDir(dir);
+}
+
+// Reads until count responses are in; returns their status codes
+static std::vector<int> readResponses(SocketClient& client, size_t count)
+{
+  std::vector<int> statuses;
+  std::string data;
+  uint32_t start = millis();
+  while (statuses.size() < count && millis() - start < 2000) {
+    int c = client.read();
+    if (c < 0) {
+      if (!client.connected()) {
+        break;
+      }
+      delay(1);
+      continue;
+    }
+    data += (char)c;
+    size_t end = data.find("\r\n\r\n");
+    if (end != std::string::npos) {
+      statuses.push_back(atoi(data.c_str() + 9));
+      data.erase(0, end + 4);
+    }
+  }
+  return statuses;
+}
+
+static std::string post(const std::string& path, const std::string& body, bool close = false)
+{
+  return "POST " + path + " HTTP/1.1\r\nHost: test\r\nContent-Type: application/json\r\n" +
+         (close ? "Connection: close\r\n" : "") + "Content-Length: " + std::to_string(body.size()) +
+         "\r\n\r\n" + body;
+}
+
+TEST(server_keeps_the_connection_and_pipelines)
+{
+  Host_useRealTime(true);
+  std::string dir = tempDir();
+  CollectorStore store(dir.c_str());
+  CollectorServer server(store, 0, 2);
+  CHECK(server.begin());
+
+  SocketClient client;
+  CHECK(client.connect("127.0.0.1", server.port()));
+  std::string requests =
+    post("/sensors/airgradient:abc123/measures", "{\"wifi\":-60, \"rco2\":612, \"atmp\":21.50}") +
+    post("/sensors/abc123/measures", "{\"rco2\":613}") +
+    post("/sensors/abc123/measures", "{\"rco2\":") +
+    "GET /sensors/abc123/measures HTTP/1.1\r\n\r\n" +
+    post("/other", "{}");
+  client.write((const uint8_t*)requests.data(), requests.size());
+  std::vector<int> statuses = readResponses(client, 5);
+  CHECK_EQUAL(statuses.size(), 5);
+  if (statuses.size() == 5) {
+    CHECK_EQUAL(statuses[0], 200);
+    CHECK_EQUAL(statuses[1], 200);
+    CHECK_EQUAL(statuses[2], 400);
+    CHECK_EQUAL(statuses[3], 405);
+    CHECK_EQUAL(statuses[4], 404);
+  }
+  CHECK(client.connected());
+
+  // one request split over two writes
+  std::string request = post("/sensors/abc123/measures", "{\"rco2\":614}");
+  client.write((const uint8_t*)request.data(), 20);
+  delay(20);
+  client.write((const uint8_t*)request.data() + 20, request.size() - 20);
+  statuses = readResponses(client, 1);
+  CHECK(statuses.size() == 1 && statuses[0] == 200);
+
+  request = post("/sensors/abc123/measures", "{\"rco2\":615}", true);
+  client.write((const uint8_t*)request.data(), request.size());
+  statuses = readResponses(client, 1);
+  CHECK(statuses.size() == 1 && statuses[0] == 200);
+  delay(50);
+  CHECK(client.read() < 0 && !client.connected());
+
+  CHECK_EQUAL(server.getRequests(), 7);
+  CHECK_EQUAL(server.getErrors(), 3);
+  CHECK_EQUAL(server.getConnections(), 1);
+  server.end();
+  store.rollup(Collector_nowMs());
+
+  std::vector<Row> rows;
+  CHECK(Collector_readSegments((dir + "/abc123.seg").c_str(), collect, &rows));
+  CHECK_EQUAL(rows.size(), 4);
+  if (rows.size() == 4) {
+    CHECK_EQUAL(rows[0].measures.get(MEASURE_WIFI), -60);
+    CHECK(rows[0].measures.get(MEASURE_ATMP) == 21.5f);
+    CHECK_EQUAL(rows[3].measures.get(MEASURE_RCO2), 615);
+  }
+  removeDir(dir);
+  Host_useRealTime(false);
+}
+
+TEST(oversized_body_is_refused)
+{
+  Host_useRealTime(true);
+  std::string dir = tempDir();
+  CollectorStore store(dir.c_str());
+  CollectorServer server(store, 0, 1);
+  CHECK(server.begin());
+
+  SocketClient client;
+  CHECK(client.connect("127.0.0.1", server.port()));
+  std::string request = "POST /sensors/x/measures HTTP/1.1\r\nContent-Length: 100000\r\n\r\n";
+  client.write((const uint8_t*)request.data(), request.size());
+  std::vector<int> statuses = readResponses(client, 1);
+  CHECK(statuses.size() == 1 && statuses[0] == 413);
+  delay(50);
+  CHECK(client.read() < 0 && !client.connected());
+  server.end();
+  removeDir(dir);
+  Host_useRealTime(false);
+}
+
+int main()
+{
+  RUN(rows_come_back_from_the_segments);
+  RUN(absent_metrics_take_no_column);
+  RUN(rollup_lines_per_metric);
+  RUN(ids_must_be_file_names);
+  RUN(server_keeps_the_connection_and_pipelines);
+  RUN(oversized_body_is_refused);
+  return Test_result();
+}
@@ -0,0 +1,285 @@
+/*
+  config_test.cpp - ConfigStore records in a FileConfigStorage image
+*/
+
+#include "AirGradientConfig.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+
+#include "test.h"
+
+struct SettingsV1 {
+  uint8_t buttonConfig = 0;
+  uint8_t co2Offset = 0;
+};
+
+// what a newer firmware appends
+struct SettingsV2 {
+  uint8_t buttonConfig = 0;
+  uint8_t co2Offset = 0;
+  uint16_t reportSeconds = 300;
+};
+
+// Counts how often each byte is written, for the wear
+class MemoryStorage : public ConfigStorage
+{
+  public:
+    uint8_t data[256];
+    uint32_t writes[256];
+
+    MemoryStorage()
+    {
+      memset(data, 0xFF, sizeof(data));
+      memset(writes, 0, sizeof(writes));
+    }
+
+    uint8_t read(uint16_t address) { return data[address]; }
+    void write(uint16_t address, uint8_t value) { data[address] = value; writes[address]++; }
+    bool commit() { return true; }
+    uint16_t length() { return sizeof(data); }
+};
+
+static std::string tempFile()
+{
+  char dir[] = "/tmp/config_test_XXXXXX";
+  return std::string(mkdtemp(dir) != NULL ? dir : "/tmp") + "/eeprom.bin";
+}
+
+static void removeFile(const std::string& path)
+{
+  unlink(path.c_str());
+  rmdir(path.substr(0, path.rfind('/')).c_str());
+}
+
+TEST(empty_storage_keeps_the_defaults)
+{
+  std::string path = tempFile();
+  FileConfigStorage storage(path.c_str(), 128);
+  ConfigStore config(storage);
+  CHECK(!config.begin());
+  SettingsV1 settings;
+  settings.co2Offset = 7;
+  CHECK(!config.load(settings));
+  CHECK_EQUAL(settings.co2Offset, 7);
+  CHECK_EQUAL(config.getVersion(), 0);
+  removeFile(path);
+}
+
+TEST(settings_survive_a_restart)
+{
+  std::string path = tempFile();
+  {
+    FileConfigStorage storage(path.c_str(), 128);
+    ConfigStore config(storage, 8);
+    config.begin();
+    SettingsV1 settings;
+    settings.buttonConfig = 3;
+    settings.co2Offset = 42;
+    CHECK_EQUAL(config.save(settings, 1), CONFIG_OK);
+    settings.co2Offset = 43;
+    CHECK_EQUAL(config.save(settings, 1), CONFIG_OK);
+    CHECK_EQUAL(config.getSequence(), 1);
+  }
+
+  FileConfigStorage storage(path.c_str(), 128);
+  ConfigStore config(storage, 8);
+  CHECK(config.begin());
+  SettingsV1 settings;
+  CHECK(config.load(settings));
+  CHECK_EQUAL(settings.buttonConfig, 3);
+  CHECK_EQUAL(settings.co2Offset, 43);
+  CHECK_EQUAL(config.getVersion(), 1);
+  CHECK_EQUAL(config.getSequence(), 1);
+  // the bytes before the region are not touched
+  for (uint16_t i = 0; i < 8; i++) {
+    CHECK_EQUAL(storage.read(i), 0xFF);
+  }
+  removeFile(path);
+}
+
+TEST(unchanged_settings_are_not_written)
+{
+  MemoryStorage storage;
+  ConfigStore config(storage);
+  config.begin();
+  SettingsV1 settings;
+  settings.co2Offset = 5;
+  CHECK_EQUAL(config.save(settings, 1), CONFIG_OK);
+  uint32_t written = config.getBytesWritten();
+  CHECK_EQUAL(config.save(settings, 1), CONFIG_UNCHANGED);
+  CHECK_EQUAL(config.getBytesWritten(), written);
+  // the same bytes under another layout version are a change
+  CHECK_EQUAL(config.save(settings, 2), CONFIG_OK);
+  CHECK(config.getBytesWritten() > written);
+}
+
+TEST(records_wrap_around_the_region)
+{
+  std::string path = tempFile();
+  // room for four records of 9 bytes
+  const uint16_t length = 4 * (CONFIG_OVERHEAD + sizeof(SettingsV1));
+  for (uint8_t i = 0; i < 30; i++) {
+    FileConfigStorage storage(path.c_str(), 16 + length);
+    ConfigStore config(storage, 16, length);
+    config.begin();
+    SettingsV1 settings;
+    config.load(settings);
+    CHECK_EQUAL(settings.co2Offset, i);
+    settings.co2Offset = i + 1;
+    CHECK_EQUAL(config.save(settings, 1), CONFIG_OK);
+  }
+
+  FileConfigStorage storage(path.c_str(), 16 + length);
+  ConfigStore config(storage, 16, length);
+  CHECK(config.begin());
+  SettingsV1 settings;
+  config.load(settings);
+  CHECK_EQUAL(settings.co2Offset, 30);
+  CHECK_EQUAL(config.getSequence(), 29);
+  removeFile(path);
+}
+
+TEST(a_lap_rewrites_only_what_differs)
+{
+  MemoryStorage storage;
+  // three records of 9 bytes
+  ConfigStore config(storage, 0, 3 * (CONFIG_OVERHEAD + sizeof(SettingsV1)));
+  config.begin();
+  SettingsV1 settings;
+  for (uint8_t i = 0; i < 3; i++) {
+    settings.co2Offset = i;
+    config.save(settings, 1);
+  }
+  uint32_t written = config.getBytesWritten();
+  // back at offset 0, over a record with the same magic, version, size
+  // and buttonConfig
+  settings.co2Offset = 3;
+  CHECK_EQUAL(config.save(settings, 1), CONFIG_OK);
+  CHECK(config.getBytesWritten() - written < CONFIG_OVERHEAD + sizeof(SettingsV1));
+  CHECK_EQUAL(storage.writes[0], 1);
+}
+
+TEST(wear_spreads_over_the_region)
+{
+  MemoryStorage storage;
+  ConfigStore config(storage);
+  config.begin();
+  SettingsV1 settings;
+  for (uint32_t i = 0; i < 70000; i++) {
+    settings.co2Offset = i;
+    settings.buttonConfig = i >> 8;
+    CHECK_EQUAL(config.save(settings, 1), CONFIG_OK);
+  }
+  // 28 records fit in 256 bytes, so no byte saw every save
+  uint32_t most = 0;
+  for (uint16_t i = 0; i < sizeof(storage.data); i++) {
+    most = storage.writes[i] > most ? storage.writes[i] : most;
+  }
+  CHECK(most < 70000 / 20);
+
+  // the sequence number wrapped at 65536 and the newest is still found
+  ConfigStore restarted(storage);
+  CHECK(restarted.begin());
+  CHECK_EQUAL(restarted.getSequence(), (70000 - 1) & 0xFFFF);
+  SettingsV1 loaded;
+  restarted.load(loaded);
+  CHECK_EQUAL(loaded.co2Offset, (uint8_t)69999);
+  CHECK_EQUAL(loaded.buttonConfig, (uint8_t)(69999 >> 8));
+}
+
+TEST(torn_record_falls_back_to_the_previous_one)
+{
+  std::string path = tempFile();
+  {
+    FileConfigStorage storage(path.c_str(), 128);
+    ConfigStore config(storage);
+    config.begin();
+    SettingsV1 settings;
+    settings.co2Offset = 1;
+    config.save(settings, 1);
+    settings.co2Offset = 2;
+    config.save(settings, 1);
+    // power cut halfway through the second record: its CRC is still 0xFF
+    uint16_t second = CONFIG_OVERHEAD + sizeof(SettingsV1);
+    storage.write(second + CONFIG_OVERHEAD + sizeof(SettingsV1) - 1, 0xFF);
+    storage.write(second + CONFIG_OVERHEAD + sizeof(SettingsV1) - 2, 0xFF);
+    storage.commit();
+  }
+
+  FileConfigStorage storage(path.c_str(), 128);
+  ConfigStore config(storage);
+  CHECK(config.begin());
+  SettingsV1 settings;
+  config.load(settings);
+  CHECK_EQUAL(settings.co2Offset, 1);
+  CHECK_EQUAL(config.getSequence(), 0);
+  // the next save goes after the record that is valid
+  settings.co2Offset = 3;
+  CHECK_EQUAL(config.save(settings, 1), CONFIG_OK);
+  CHECK_EQUAL(config.getSequence(), 1);
+  removeFile(path);
+}
+
+TEST(older_layout_loads_into_newer_settings)
+{
+  MemoryStorage storage;
+  ConfigStore config(storage);
+  config.begin();
+  SettingsV1 old;
+  old.buttonConfig = 2;
+  config.save(old, 1);
+
+  ConfigStore upgraded(storage);
+  upgraded.begin();
+  SettingsV2 settings;
+  CHECK(upgraded.load(settings));
+  CHECK_EQUAL(settings.buttonConfig, 2);
+  CHECK_EQUAL(settings.reportSeconds, 300);
+  CHECK_EQUAL(upgraded.getVersion(), 1);
+  CHECK_EQUAL(upgraded.save(settings, 2), CONFIG_OK);
+  CHECK_EQUAL(upgraded.getVersion(), 2);
+}
+
+TEST(oversized_settings_are_refused)
+{
+  MemoryStorage storage;
+  ConfigStore config(storage, 0, 3 * (CONFIG_OVERHEAD + 8) - 1);
+  config.begin();
+  uint8_t settings[CONFIG_MAX_SIZE + 1] = { 0 };
+  // a record may take a third of the region at most
+  CHECK_EQUAL(config.save(settings, 8, 1), CONFIG_TOO_LARGE);
+  CHECK_EQUAL(config.save(settings, 7, 1), CONFIG_OK);
+
+  ConfigStore whole(storage);
+  whole.begin();
+  CHECK_EQUAL(whole.save(settings, CONFIG_MAX_SIZE + 1, 1), CONFIG_TOO_LARGE);
+  CHECK_EQUAL(whole.save(settings, CONFIG_MAX_SIZE, 1), CONFIG_OK);
+}
+
+TEST(failed_commit_is_reported)
+{
+  FileConfigStorage storage("/nonexistent/dir/eeprom.bin", 128);
+  ConfigStore config(storage);
+  config.begin();
+  SettingsV1 settings;
+  CHECK_EQUAL(config.save(settings, 1), CONFIG_WRITE_FAILED);
+}
+
+int main()
+{
+  RUN(empty_storage_keeps_the_defaults);
+  RUN(settings_survive_a_restart);
+  RUN(unchanged_settings_are_not_written);
+  RUN(records_wrap_around_the_region);
+  RUN(a_lap_rewrites_only_what_differs);
+  RUN(wear_spreads_over_the_region);
+  RUN(torn_record_falls_back_to_the_previous_one);
+  RUN(older_layout_loads_into_newer_settings);
+  RUN(oversized_settings_are_refused);
+  RUN(failed_commit_is_reported);
+  return Test_result();
+}
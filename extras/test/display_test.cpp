@@ -0,0 +1,336 @@
+/*
+  display_test.cpp - LedBarAnimator and OledRenderer on stub pixels and display
+*/
+
+#include "AirGradientDisplay.h"
+
+#include <string.h>
+#include <vector>
+
+#include "test.h"
+
+// The part of Adafruit_NeoPixel the animator uses
+class StubPixels
+{
+  public:
+    uint32_t colors[11];
+    uint32_t shows = 0;
+
+    StubPixels() { memset(colors, 0, sizeof(colors)); }
+
+    uint16_t numPixels() const { return 11; }
+    void setPixelColor(uint16_t n, uint32_t color) { colors[n] = color; }
+    void show() { shows++; }
+
+    bool all(uint32_t color) const
+    {
+      for (uint8_t i = 0; i < 11; i++) {
+        if (colors[i] != color) {
+          return false;
+        }
+      }
+      return true;
+    }
+};
+
+// The part of U8G2 the renderer uses; records what was drawn and sent
+class StubDisplay
+{
+  public:
+    struct Area {
+      uint8_t x, y, w, h;
+    };
+
+    uint32_t clears = 0;
+    uint32_t fullSends = 0;
+    std::vector<Area> boxes;
+    std::vector<Area> areas;
+    std::vector<int32_t> drawn;
+    uint8_t color = 1;
+
+    void clearBuffer() { clears++; }
+    void sendBuffer() { fullSends++; }
+    uint8_t getBufferTileWidth() { return 16; }
+    uint8_t getBufferTileHeight() { return 8; }
+    void setDrawColor(uint8_t c) { color = c; }
+    void drawBox(uint8_t x, uint8_t y, uint8_t w, uint8_t h)
+    {
+      Area box = { x, y, w, h };
+      boxes.push_back(box);
+    }
+    void updateDisplayArea(uint8_t x, uint8_t y, uint8_t w, uint8_t h)
+    {
+      Area area = { x, y, w, h };
+      areas.push_back(area);
+    }
+
+    void reset()
+    {
+      clears = fullSends = 0;
+      boxes.clear();
+      areas.clear();
+      drawn.clear();
+    }
+};
+
+static uint32_t backgrounds = 0;
+
+static void drawBackground(StubDisplay&)
+{
+  backgrounds++;
+}
+
+static void drawValue(StubDisplay& display, int32_t value)
+{
+  // cleared with color 0, drawn with 1
+  if (display.color == 1) {
+    display.drawn.push_back(value);
+  }
+}
+
+static const uint32_t RED = 0xFF0000;
+static const uint32_t GREEN = 0x00FF00;
+
+TEST(led_wipe_one_pixel_per_step)
+{
+  StubPixels pixels;
+  LedBarAnimator<StubPixels> bar(pixels, 100);
+  bar.setColor(RED);
+  // the first pixel right away, then one per 100 ms
+  CHECK(bar.update(1000));
+  CHECK_EQUAL(pixels.colors[0], RED);
+  CHECK_EQUAL(pixels.colors[1], 0);
+  CHECK(bar.update(1099));
+  CHECK_EQUAL(pixels.shows, 1);
+  for (uint32_t i = 1; i < 11; i++) {
+    CHECK_EQUAL(bar.update(1000 + i * 100), i < 10);
+    CHECK_EQUAL(pixels.colors[i], RED);
+  }
+  CHECK(pixels.all(RED));
+  CHECK_EQUAL(pixels.shows, 11);
+  CHECK_EQUAL(bar.getShowCount(), 11);
+  CHECK(!bar.isAnimating());
+}
+
+TEST(led_unchanged_color_shows_nothing)
+{
+  StubPixels pixels;
+  LedBarAnimator<StubPixels> bar(pixels, 100);
+  bar.setColor(GREEN);
+  for (uint32_t t = 0; t < 2000; t += 10) {
+    bar.update(t);
+  }
+  CHECK_EQUAL(pixels.shows, 11);
+  // an hour of loop() passes setting the same color
+  for (uint32_t t = 2000; t < 3600000; t += 10) {
+    bar.setColor(GREEN);
+    bar.setBrightness(255);
+    CHECK(!bar.update(t));
+  }
+  CHECK_EQUAL(pixels.shows, 11);
+}
+
+TEST(led_new_color_restarts_the_wipe)
+{
+  StubPixels pixels;
+  LedBarAnimator<StubPixels> bar(pixels, 100);
+  bar.setColor(RED);
+  for (uint32_t t = 0; t < 500; t += 100) {
+    bar.update(t);
+  }
+  CHECK_EQUAL(pixels.colors[4], RED);
+  CHECK_EQUAL(pixels.colors[5], 0);
+  // heading to red already: no restart
+  bar.setColor(RED);
+  bar.update(500);
+  CHECK_EQUAL(pixels.colors[5], RED);
+
+  bar.setColor(GREEN);
+  bar.update(510);
+  CHECK_EQUAL(pixels.colors[0], GREEN);
+  CHECK_EQUAL(pixels.colors[1], RED);
+  for (uint32_t t = 600; t < 2000; t += 100) {
+    bar.update(t);
+  }
+  CHECK(pixels.all(GREEN));
+  CHECK_EQUAL(pixels.shows, 6 + 11);
+}
+
+TEST(led_brightness_ramps_per_step)
+{
+  StubPixels pixels;
+  LedBarAnimator<StubPixels> bar(pixels, 100);
+  bar.setColor(0x80FF40);
+  for (uint32_t t = 0; t < 1100; t += 100) {
+    bar.update(t);
+  }
+  CHECK(pixels.all(0x80FF40));
+  uint32_t shows = pixels.shows;
+
+  bar.setBrightness(0);
+  uint8_t last = 255;
+  uint32_t t = 2000;
+  while (bar.update(t)) {
+    CHECK_EQUAL(bar.getBrightness(), last - LedBarAnimator<StubPixels>::BRIGHTNESS_STEP);
+    last = bar.getBrightness();
+    uint32_t expected = (0x80 * last / 255) << 16 | (0xFF * last / 255) << 8 | (0x40 * last / 255);
+    CHECK(pixels.all(expected));
+    t += 100;
+  }
+  // 255 to 15 in 15 steps, then the rest
+  CHECK_EQUAL(pixels.shows - shows, 16);
+  CHECK_EQUAL(bar.getBrightness(), 0);
+  CHECK(pixels.all(0));
+
+  // back up without losing the color on the way
+  bar.setBrightness(255);
+  for (t += 100; bar.update(t); t += 100) {
+  }
+  CHECK_EQUAL(pixels.shows - shows, 32);
+  CHECK(pixels.all(0x80FF40));
+}
+
+TEST(led_wipe_and_fade_share_the_steps)
+{
+  StubPixels pixels;
+  LedBarAnimator<StubPixels> bar(pixels, 100);
+  bar.setBrightness(255 - 4 * LedBarAnimator<StubPixels>::BRIGHTNESS_STEP);
+  bar.setColor(0xFFFFFF);
+  uint32_t t = 0;
+  while (bar.update(t)) {
+    t += 100;
+  }
+  // the wipe is the longer of the two
+  CHECK_EQUAL(pixels.shows, 11);
+  CHECK(pixels.all(0xBFBFBF));
+}
+
+TEST(oled_first_render_is_full)
+{
+  StubDisplay display;
+  OledRenderer<StubDisplay, 3> oled(display);
+  backgrounds = 0;
+  oled.setBackground(drawBackground);
+  int8_t a = oled.addRegion(0, 0, 96, 13, drawValue);
+  int8_t b = oled.addRegion(0, 29, 44, 23, drawValue);
+  int8_t c = oled.addRegion(83, 54, 45, 10, drawValue);
+  CHECK_EQUAL(oled.addRegion(0, 0, 8, 8, drawValue), -1);
+  oled.set(a, 215);
+  oled.set(b, 612);
+  oled.set(c, 3);
+
+  CHECK_EQUAL(oled.render(), 3);
+  CHECK_EQUAL(display.clears, 1);
+  CHECK_EQUAL(display.fullSends, 1);
+  CHECK_EQUAL(backgrounds, 1);
+  CHECK_EQUAL(display.drawn.size(), 3);
+  CHECK_EQUAL(display.drawn[1], 612);
+  CHECK(display.areas.empty());
+  CHECK_EQUAL(oled.getTilesSent(), 16 * 8);
+}
+
+TEST(oled_redraws_only_changed_regions)
+{
+  StubDisplay display;
+  OledRenderer<StubDisplay> oled(display);
+  int8_t a = oled.addRegion(0, 0, 96, 13, drawValue);
+  int8_t b = oled.addRegion(0, 29, 44, 23, drawValue);
+  int8_t c = oled.addRegion(83, 54, 45, 10, drawValue);
+  oled.set(a, 215);
+  oled.set(b, 612);
+  oled.set(c, 3);
+  oled.render();
+  display.reset();
+
+  oled.set(b, 640);
+  CHECK_EQUAL(oled.render(), 1);
+  CHECK_EQUAL(display.clears, 0);
+  CHECK_EQUAL(display.fullSends, 0);
+  CHECK_EQUAL(display.drawn.size(), 1);
+  CHECK_EQUAL(display.drawn[0], 640);
+  // cleared first, then sent as whole 8x8 tiles
+  CHECK_EQUAL(display.boxes.size(), 1);
+  CHECK_EQUAL(display.boxes[0].y, 29);
+  CHECK_EQUAL(display.boxes[0].h, 23);
+  CHECK_EQUAL(display.areas.size(), 1);
+  CHECK_EQUAL(display.areas[0].x, 0);
+  CHECK_EQUAL(display.areas[0].y, 3);
+  CHECK_EQUAL(display.areas[0].w, 6);
+  CHECK_EQUAL(display.areas[0].h, 4);
+  CHECK_EQUAL(oled.getTilesSent(), 16 * 8 + 6 * 4);
+
+  display.reset();
+  oled.set(a, 216);
+  oled.set(c, 4);
+  CHECK_EQUAL(oled.render(), 2);
+  CHECK_EQUAL(display.areas.size(), 2);
+  // 83..127 x 54..63
+  CHECK_EQUAL(display.areas[1].x, 10);
+  CHECK_EQUAL(display.areas[1].y, 6);
+  CHECK_EQUAL(display.areas[1].w, 6);
+  CHECK_EQUAL(display.areas[1].h, 2);
+}
+
+TEST(oled_unchanged_values_draw_nothing)
+{
+  StubDisplay display;
+  OledRenderer<StubDisplay> oled(display);
+  int8_t a = oled.addRegion(0, 0, 96, 13, drawValue);
+  oled.set(a, 215);
+  oled.render();
+  uint32_t tiles = oled.getTilesSent();
+  display.reset();
+
+  for (int i = 0; i < 720; i++) {
+    oled.set(a, 215);
+    CHECK_EQUAL(oled.render(), 0);
+  }
+  CHECK_EQUAL(oled.getSkippedRenders(), 720);
+  CHECK_EQUAL(oled.getTilesSent(), tiles);
+  CHECK(display.drawn.empty());
+  CHECK(display.boxes.empty());
+  CHECK_EQUAL(display.fullSends, 0);
+
+  // out of range regions are ignored
+  oled.set(-1, 1);
+  oled.set(5, 1);
+  CHECK_EQUAL(oled.render(), 0);
+}
+
+TEST(oled_invalidate_redraws_everything)
+{
+  StubDisplay display;
+  OledRenderer<StubDisplay> oled(display);
+  backgrounds = 0;
+  oled.setBackground(drawBackground);
+  int8_t a = oled.addRegion(0, 0, 64, 32, drawValue);
+  int8_t b = oled.addRegion(64, 32, 64, 32, drawValue);
+  oled.set(a, 1);
+  oled.set(b, 2);
+  oled.render();
+  display.reset();
+
+  // another screen took the buffer
+  oled.invalidate();
+  CHECK_EQUAL(oled.render(), 2);
+  CHECK_EQUAL(display.clears, 1);
+  CHECK_EQUAL(display.fullSends, 1);
+  CHECK_EQUAL(backgrounds, 2);
+  CHECK_EQUAL(display.drawn[0], 1);
+  CHECK_EQUAL(display.drawn[1], 2);
+  CHECK_EQUAL(oled.render(), 0);
+}
+
+int main()
+{
+  RUN(led_wipe_one_pixel_per_step);
+  RUN(led_unchanged_color_shows_nothing);
+  RUN(led_new_color_restarts_the_wipe);
+  RUN(led_brightness_ramps_per_step);
+  RUN(led_wipe_and_fade_share_the_steps);
+  RUN(oled_first_render_is_full);
+  RUN(oled_redraws_only_changed_regions);
+  RUN(oled_unchanged_values_draw_nothing);
+  RUN(oled_invalidate_redraws_everything);
+  return Test_result();
+}
@@ -0,0 +1,132 @@
+/*
+  fixed_test.cpp - Integer conversion kernels against the float formulas
+
+  Every raw SHT3x word and every centi value in and around the SGP41 tick
+  range is checked against the formula evaluated in double, which is
+  exact to well below the rounding step. The benchmark at the end prints
+  the time per conversion of both versions; it checks nothing.
+*/
+
+#include "AirGradientFixed.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+
+#include "test.h"
+
+TEST(centi_celsius_matches_the_float_formula)
+{
+  for (uint32_t raw = 0; raw <= 65535; raw++) {
+    long expected = lround(100.0 * (175.0 * raw / 65535.0 - 45.0));
+    if (TMP_RH_rawToCentiCelsius(raw) != expected) {
+      CHECK_EQUAL(TMP_RH_rawToCentiCelsius(raw), expected);
+      break;
+    }
+  }
+  CHECK_EQUAL(TMP_RH_rawToCentiCelsius(0), -4500);
+  CHECK_EQUAL(TMP_RH_rawToCentiCelsius(65535), 13000);
+}
+
+TEST(centi_percent_matches_the_float_formula)
+{
+  for (uint32_t raw = 0; raw <= 65535; raw++) {
+    long expected = lround(100.0 * 100.0 * raw / 65535.0);
+    if (TMP_RH_rawToCentiPercent(raw) != expected) {
+      CHECK_EQUAL(TMP_RH_rawToCentiPercent(raw), expected);
+      break;
+    }
+  }
+  CHECK_EQUAL(TMP_RH_rawToCentiPercent(0), 0);
+  CHECK_EQUAL(TMP_RH_rawToCentiPercent(65535), 10000);
+}
+
+TEST(temperature_ticks_match_the_float_formula)
+{
+  for (int32_t centi = -5000; centi <= 13500; centi++) {
+    double ticks = (centi / 100.0 + 45.0) * 65535.0 / 175.0;
+    long expected = ticks <= 0 ? 0 : ticks >= 65535 ? 65535 : lround(ticks);
+    if (SGP41_temperatureTicks(centi) != expected) {
+      CHECK_EQUAL(SGP41_temperatureTicks(centi), expected);
+      break;
+    }
+  }
+  CHECK_EQUAL(SGP41_temperatureTicks(-100000), 0);
+  CHECK_EQUAL(SGP41_temperatureTicks(100000), 65535);
+  // the SGP41 default for 25 C
+  CHECK_EQUAL(SGP41_temperatureTicks(2500), 0x6666);
+}
+
+TEST(humidity_ticks_match_the_float_formula)
+{
+  for (int32_t centi = -500; centi <= 10500; centi++) {
+    double ticks = centi / 100.0 * 65535.0 / 100.0;
+    long expected = ticks <= 0 ? 0 : ticks >= 65535 ? 65535 : lround(ticks);
+    if (SGP41_humidityTicks(centi) != expected) {
+      CHECK_EQUAL(SGP41_humidityTicks(centi), expected);
+      break;
+    }
+  }
+  // the SGP41 default for 50 %RH
+  CHECK_EQUAL(SGP41_humidityTicks(5000), 0x8000);
+}
+
+// A raw word converted to centi values and back lands within a tick of
+// the rounding step, so the driver may pass either on to the SGP41.
+TEST(ticks_round_trip_through_centi_values)
+{
+  for (uint32_t raw = 0; raw <= 65535; raw++) {
+    long t = SGP41_temperatureTicks(TMP_RH_rawToCentiCelsius(raw));
+    long rh = SGP41_humidityTicks(TMP_RH_rawToCentiPercent(raw));
+    // 0.01 C is 3.7 ticks, 0.01 %RH is 6.6 ticks
+    if (labs(t - (long)raw) > 2 || labs(rh - (long)raw) > 4) {
+      CHECK_EQUAL(t, raw);
+      CHECK_EQUAL(rh, raw);
+      break;
+    }
+  }
+}
+
+static double nanosecondsSince(std::chrono::steady_clock::time_point start, uint32_t count)
+{
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+}
+
+TEST(benchmark)
+{
+  const uint32_t rounds = 50;
+  volatile int32_t sink = 0;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t round = 0; round < rounds; round++) {
+    for (uint32_t raw = 0; raw <= 65535; raw++) {
+      // what the drivers did before, single precision like on the ESP8266
+      float t = 175.0f * (float)raw / 65535.0f - 45.0f;
+      float rh = 100.0f * raw / 65535.0f;
+      sink = sink + (int32_t)roundf(t * 100) + (int32_t)roundf(rh * 100);
+    }
+  }
+  double floatNs = nanosecondsSince(start, rounds * 65536);
+
+  start = std::chrono::steady_clock::now();
+  for (uint32_t round = 0; round < rounds; round++) {
+    for (uint32_t raw = 0; raw <= 65535; raw++) {
+      sink = sink + TMP_RH_rawToCentiCelsius(raw) + TMP_RH_rawToCentiPercent(raw);
+    }
+  }
+  double fixedNs = nanosecondsSince(start, rounds * 65536);
+
+  printf("raw to centi C and %%RH: float %.2f ns, fixed %.2f ns\n", floatNs, fixedNs);
+  (void)sink;
+}
+
+int main()
+{
+  RUN(centi_celsius_matches_the_float_formula);
+  RUN(centi_percent_matches_the_float_formula);
+  RUN(temperature_ticks_match_the_float_formula);
+  RUN(humidity_ticks_match_the_float_formula);
+  RUN(ticks_round_trip_through_centi_values);
+  RUN(benchmark);
+  return Test_result();
+}
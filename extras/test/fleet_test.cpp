@@ -0,0 +1,216 @@
+/*
+  fleet_test.cpp - WorkPool, and a small fleet against the collector
+*/
+
+#include "ArduinoHost.h"
+#include "Collector.h"
+#include "Fleet.h"
+#include "WorkPool.h"
+
+#include <atomic>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+#include "test.h"
+
+struct PoolRun {
+  std::atomic<uint32_t> runs[1000];
+  uint8_t workers[1000];
+  bool slow;
+};
+
+static void countRun(size_t index, uint8_t worker, void* context)
+{
+  PoolRun* run = (PoolRun*)context;
+  run->runs[index]++;
+  run->workers[index] = worker;
+  // worker 0 starts on index 0, the others are done long before it is
+  if (run->slow && index == 0) {
+    usleep(20000);
+  }
+}
+
+TEST(pool_runs_every_index_once)
+{
+  WorkPool pool(4);
+  static PoolRun run;
+  run.slow = false;
+  const size_t counts[] = { 1000, 0, 1, 3, 4, 5, 999 };
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    for (size_t i = 0; i < 1000; i++) {
+      run.runs[i] = 0;
+    }
+    // many rounds, so the workers see each one start
+    for (int round = 0; round < 20; round++) {
+      pool.run(counts[c], countRun, &run);
+    }
+    for (size_t i = 0; i < 1000; i++) {
+      CHECK_EQUAL(run.runs[i], i < counts[c] ? 20 : 0);
+    }
+  }
+
+  // short runs back to back, so workers still stealing from the last
+  // one meet the next
+  for (size_t i = 0; i < 8; i++) {
+    run.runs[i] = 0;
+  }
+  for (int round = 0; round < 5000; round++) {
+    pool.run(8, countRun, &run);
+  }
+  for (size_t i = 0; i < 8; i++) {
+    CHECK_EQUAL(run.runs[i], 5000);
+  }
+}
+
+TEST(pool_steals_from_a_slow_worker)
+{
+  WorkPool pool(4);
+  static PoolRun run;
+  run.slow = true;
+  for (size_t i = 0; i < 1000; i++) {
+    run.runs[i] = 0;
+  }
+  pool.run(1000, countRun, &run);
+  CHECK(pool.getSteals() > 0);
+  // the back of worker 0's share went to the others
+  CHECK(run.workers[249] != 0);
+  CHECK_EQUAL(run.workers[0], 0);
+  for (size_t i = 0; i < 1000; i++) {
+    CHECK_EQUAL(run.runs[i], 1);
+  }
+
+  WorkPool single(1);
+  single.run(10, countRun, &run);
+  CHECK_EQUAL(single.getThreads(), 1);
+  CHECK_EQUAL(single.getSteals(), 0);
+}
+
+TEST(histogram_percentiles)
+{
+  FleetHistogram histogram;
+  for (uint64_t i = 1; i <= 1000; i++) {
+    histogram.add(i);
+  }
+  CHECK_EQUAL(histogram.count, 1000);
+  CHECK_EQUAL(histogram.max, 1000);
+  CHECK(histogram.percentile(0.5) >= 500 * 7 / 8 && histogram.percentile(0.5) <= 500 * 9 / 8);
+  CHECK(histogram.percentile(0.99) >= 990 * 7 / 8 && histogram.percentile(0.99) <= 1000);
+  CHECK_EQUAL(histogram.percentile(1), 1000);
+
+  FleetHistogram small;
+  small.add(3);
+  small.add(5);
+  CHECK_EQUAL(small.percentile(0), 3);
+  CHECK_EQUAL(small.percentile(1), 5);
+  small.merge(histogram);
+  CHECK_EQUAL(small.count, 1002);
+}
+
+TEST(devices_run_on_their_own_clocks)
+{
+  FleetOptions options;
+  options.devices = 50;
+  options.threads = 3;
+  Fleet fleet(options);
+  fleet.begin();
+  uint32_t start[50];
+  for (uint32_t i = 0; i < 50; i++) {
+    start[i] = fleet.getDevice(i).getMillis();
+  }
+  CHECK(start[0] != start[1] || start[1] != start[2]);
+  fleet.run(120000);
+
+  FleetStats stats = fleet.getStats();
+  CHECK_EQUAL(stats.deviceMs, 120000);
+  CHECK_EQUAL(stats.loops, 50 * 1200);
+  CHECK_EQUAL(stats.loopNs.count, stats.loops);
+  CHECK_EQUAL(stats.deviceMeanNs.count, 50);
+  CHECK_EQUAL(stats.sensorErrors, 0);
+  CHECK_EQUAL(stats.uploadErrors, 0);
+  for (uint32_t i = 0; i < 50; i++) {
+    FleetDevice& device = fleet.getDevice(i);
+    CHECK_EQUAL(device.getMillis() - start[i], 120000);
+    CHECK_EQUAL(device.getStats().loops, 1200);
+    // a PMS frame a second
+    CHECK(device.getStats().pmsFrames >= 119 && device.getStats().pmsFrames <= 121);
+    // the first record after 10 s, then whatever the deadbands let through
+    CHECK(device.getStats().uploads >= 1 && device.getStats().uploads <= 12);
+  }
+}
+
+TEST(faults_cost_readings_not_uploads)
+{
+  FleetOptions options;
+  options.devices = 20;
+  options.threads = 2;
+  options.faults = true;
+  Fleet fleet(options);
+  fleet.begin();
+  fleet.run(300000);
+
+  FleetStats stats = fleet.getStats();
+  CHECK(stats.sensorErrors > 0);
+  // every 50th PMS frame is corrupt
+  CHECK(stats.pmsFrames < 20 * 300 * 49 / 50 + 20);
+  CHECK(stats.uploads >= 20);
+  CHECK_EQUAL(stats.uploadErrors, 0);
+}
+
+static void countRows(int64_t, const Measures& measures, void* context)
+{
+  if (measures.has(MEASURE_RCO2) && measures.has(MEASURE_PM02) && measures.has(MEASURE_ATMP)) {
+    (*(uint32_t*)context)++;
+  }
+}
+
+TEST(uploads_reach_the_collector)
+{
+  char dir[] = "/tmp/fleet_test_XXXXXX";
+  CHECK(mkdtemp(dir) != NULL);
+  FleetStats stats;
+  uint32_t deviceUploads = 0;
+  {
+    CollectorStore store(dir);
+    CollectorServer server(store, 0, 2);
+    CHECK(server.begin());
+
+    FleetOptions options;
+    options.devices = 30;
+    options.threads = 2;
+    options.port = server.port();
+    Fleet fleet(options);
+    fleet.begin();
+    fleet.run(120000);
+    stats = fleet.getStats();
+    deviceUploads = fleet.getDevice(0).getStats().uploads;
+    server.end();
+
+    CHECK(stats.uploads >= 30);
+    CHECK_EQUAL(stats.uploadErrors, 0);
+    CHECK_EQUAL(stats.uploadUs.count, stats.uploads);
+    // one kept-alive connection per worker
+    CHECK_EQUAL(stats.connects, 2);
+    CHECK_EQUAL(server.getRequests(), stats.uploads);
+    CHECK_EQUAL(server.getErrors(), 0);
+    CHECK_EQUAL(store.getDevices(), 30);
+    CHECK_EQUAL(store.getRows(), stats.uploads);
+  }
+
+  uint32_t rows = 0;
+  CHECK(Collector_readSegments((std::string(dir) + "/a00000.seg").c_str(), countRows, &rows));
+  CHECK_EQUAL(rows, deviceUploads);
+  std::string command = std::string("rm -rf ") + dir;
+  CHECK_EQUAL(system(command.c_str()), 0);
+}
+
+int main()
+{
+  RUN(pool_runs_every_index_once);
+  RUN(pool_steals_from_a_slow_worker);
+  RUN(histogram_percentiles);
+  RUN(devices_run_on_their_own_clocks);
+  RUN(faults_cost_readings_not_uploads);
+  RUN(uploads_reach_the_collector);
+  return Test_result();
+}
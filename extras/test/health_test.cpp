@@ -0,0 +1,221 @@
+/*
+  health_test.cpp - HealthSupervisor recovering a PmsDriver on a PmsEmulator that hangs
+*/
+
+#include "ArduinoHost.h"
+#include "AirGradientEmulator.h"
+#include "AirGradientHealth.h"
+
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+class BufferPrint : public Print
+{
+  public:
+    std::string data;
+
+    size_t write(uint8_t c) { data += (char)c; return 1; }
+    using Print::write;
+};
+
+static const uint32_t DAY = 24 * 3600000UL;
+static const uint32_t STEP_MS = 100;
+static const uint32_t POLL_MS = 5000;
+// 53 hangs a day, half way between two
+static const uint32_t HANG_EVERY = 1630000;
+
+static PmsDriver* recovering = NULL;
+
+// What a sketch does: wake it and turn the frames back on
+static void recoverPms()
+{
+  recovering->wakeUp();
+  recovering->activeMode();
+}
+
+struct DayResult {
+  uint32_t hangs;
+  uint32_t polls;
+  uint32_t good;
+};
+
+// A day of polls every POLL_MS, each good if a frame came since the last
+// one; every HANG_EVERY the sensor stops sending, as after a brown-out.
+static DayResult runDay(HealthSupervisor& health, int8_t id, PmsDriver& pms, PmsEmulator& emulator)
+{
+  DayResult result = { 0, 0, 0 };
+  PmsDriver::DATA data;
+  bool fresh = false;
+  for (uint32_t t = 0; t < DAY; t += STEP_MS) {
+    emulator.update();
+    Host_advance(STEP_MS);
+    health.update(millis());
+    while (emulator.available() > 0) {
+      fresh |= pms.read(data);
+    }
+    if (t % POLL_MS == 0) {
+      result.polls++;
+      if (fresh) {
+        result.good++;
+        health.success(id, millis());
+      } else {
+        health.failure(id);
+      }
+      fresh = false;
+    }
+    if (t % HANG_EVERY == HANG_EVERY / 2) {
+      pms.sleep();
+      result.hangs++;
+    }
+  }
+  return result;
+}
+
+TEST(recovers_every_hang_in_a_day)
+{
+  PmsEmulator emulator;
+  emulator.setPm(12);
+  PmsDriver pms;
+  pms.begin(emulator, PMS_VARIANT_PMS5003);
+  recovering = &pms;
+  HealthSupervisor health;
+  int8_t id = health.add("pms", 30000, recoverPms, millis());
+
+  DayResult result = runDay(health, id, pms, emulator);
+  CHECK_EQUAL(result.hangs, 53);
+  CHECK_EQUAL(health.getRecoveries(id), 53);
+  // the poll that sees the first frame comes with the second attempt
+  CHECK_EQUAL(health.getRecoveryAttempts(id), 2 * 53);
+  CHECK_EQUAL(health.getState(id), HEALTH_OK);
+  CHECK(!emulator.isSleeping());
+
+  // stuckMs, then the first frame and the poll that sees it
+  CHECK(health.getMttrMs(id) >= 30000);
+  CHECK(health.getMttrMs(id) <= 30000 + PmsEmulator::FRAME_INTERVAL_MS + POLL_MS);
+  CHECK_EQUAL(health.getCompletenessPercent(id), 100ULL * result.good / result.polls);
+  CHECK(health.getCompletenessPercent(id) >= 98);
+  printf("%lu of %lu polls with data, mttr %lu ms\n", (unsigned long)result.good,
+         (unsigned long)result.polls, (unsigned long)health.getMttrMs(id));
+}
+
+TEST(without_recovery_the_data_stops)
+{
+  PmsEmulator emulator;
+  emulator.setPm(12);
+  PmsDriver pms;
+  pms.begin(emulator, PMS_VARIANT_PMS5003);
+  HealthSupervisor health;
+  int8_t id = health.add("pms", 30000, NULL, millis());
+
+  DayResult result = runDay(health, id, pms, emulator);
+  CHECK_EQUAL(health.getRecoveries(id), 0);
+  CHECK_EQUAL(health.getState(id), HEALTH_FAILED);
+  CHECK(emulator.isSleeping());
+  // only the polls before the first hang, but the one at 0
+  CHECK_EQUAL(result.good, HANG_EVERY / 2 / POLL_MS);
+  CHECK(health.getCompletenessPercent(id) < 2);
+}
+
+static std::vector<uint32_t> attempts;
+static uint32_t attemptAt = 0;
+
+static void recordAttempt()
+{
+  attempts.push_back(attemptAt);
+}
+
+TEST(backoff_doubles_to_the_maximum)
+{
+  // the millis() wrap falls between attempts
+  const uint32_t start = 0xFFFFFFFFUL - 40000;
+  HealthSupervisor health(5000, 300000);
+  int8_t id = health.add("s8", 30000, recordAttempt, start);
+  attempts.clear();
+  for (uint32_t t = 0; t <= 1000000; t += STEP_MS) {
+    attemptAt = t;
+    health.update(start + t);
+  }
+  const uint32_t expected[] = { 30000, 35000, 45000, 65000, 105000, 185000, 345000, 645000, 945000 };
+  CHECK_EQUAL(attempts.size(), 9);
+  for (size_t i = 0; i < attempts.size() && i < 9; i++) {
+    CHECK_EQUAL(attempts[i], expected[i]);
+  }
+  CHECK_EQUAL(health.getState(id), HEALTH_FAILED);
+
+  // a good read ends the outage and resets the backoff
+  health.success(id, start + 1000000);
+  CHECK_EQUAL(health.getState(id), HEALTH_OK);
+  CHECK_EQUAL(health.getRecoveries(id), 1);
+  CHECK_EQUAL(health.getMttrMs(id), 1000000);
+  attempts.clear();
+  for (uint32_t t = 1000000; t <= 1040000; t += STEP_MS) {
+    attemptAt = t;
+    health.update(start + t);
+  }
+  CHECK_EQUAL(attempts.size(), 2);
+  CHECK_EQUAL(attempts[0], 1030000);
+  CHECK_EQUAL(attempts[1], 1035000);
+}
+
+TEST(degraded_and_print)
+{
+  HealthSupervisor health;
+  int8_t pms = health.add("pms", 30000, NULL, 0);
+  int8_t sht = health.add("sht", 30000, NULL, 0);
+  for (uint8_t i = 0; i < 40; i++) {
+    health.success(pms, 1000 * i);
+    if (i % 2) {
+      health.success(sht, 1000 * i);
+    } else {
+      health.failure(sht);
+    }
+  }
+  health.update(40000);
+  CHECK_EQUAL(health.getState(pms), HEALTH_OK);
+  CHECK_EQUAL(health.getErrorRatePercent(sht), 50);
+  CHECK_EQUAL(health.getState(sht), HEALTH_DEGRADED);
+
+  BufferPrint out;
+  health.print(out);
+  CHECK(out.data == "pms ok, 100% complete, 0 recoveries, mttr 0 s\n"
+                    "sht degraded, 50% complete, 0 recoveries, mttr 0 s\n");
+
+  // unknown ids
+  CHECK_EQUAL(health.getState(-1), HEALTH_FAILED);
+  CHECK_EQUAL(health.getState(2), HEALTH_FAILED);
+  CHECK_EQUAL(health.getMttrMs(HealthSupervisor::MAX_SENSORS), 0);
+  for (uint8_t i = 2; i < HealthSupervisor::MAX_SENSORS; i++) {
+    CHECK_EQUAL(health.add("x", 1000, NULL, 0), i);
+  }
+  CHECK_EQUAL(health.add("x", 1000, NULL, 0), -1);
+}
+
+TEST(watchdog_pulse_does_not_block)
+{
+  HealthSupervisor health;
+  health.setWatchdog(14, 20);
+  CHECK_EQUAL(Host_getPin(14), LOW);
+  health.feedWatchdog(1000);
+  CHECK_EQUAL(Host_getPin(14), HIGH);
+  // a second feed during the pulse is not a second pulse
+  health.feedWatchdog(1005);
+  health.update(1019);
+  CHECK_EQUAL(Host_getPin(14), HIGH);
+  health.update(1020);
+  CHECK_EQUAL(Host_getPin(14), LOW);
+  health.feedWatchdog(2000);
+  health.update(2020);
+  CHECK_EQUAL(health.getWatchdogPulses(), 2);
+}
+
+int main()
+{
+  RUN(recovers_every_hang_in_a_day);
+  RUN(without_recovery_the_data_stops);
+  RUN(backoff_doubles_to_the_maximum);
+  RUN(degraded_and_print);
+  RUN(watchdog_pulse_does_not_block);
+  return Test_result();
+}
@@ -0,0 +1,294 @@
+/*
+  i2c_test.cpp - I2CBus against the scripted I2CEmulator bus
+*/
+
+#include "AirGradientEmulator.h"
+#include "AirGradientI2C.h"
+#include "AirGradientSht3x.h"
+#include "ArduinoHost.h"
+
+#include "test.h"
+
+// Reads back what was written last, like a register pointer
+class EchoDevice : public I2CDeviceEmulator
+{
+  public:
+    uint8_t data[8];
+    uint8_t length = 0;
+
+    bool receive(const uint8_t* buffer, uint8_t len)
+    {
+      length = len < sizeof(data) ? len : sizeof(data);
+      memcpy(data, buffer, length);
+      return true;
+    }
+
+    uint8_t send(uint8_t* buffer, uint8_t len)
+    {
+      uint8_t n = len < length ? len : length;
+      memcpy(buffer, data, n);
+      return n;
+    }
+};
+
+TEST(round_trip)
+{
+  I2CEmulator wire;
+  EchoDevice echo;
+  wire.attach(0x44, echo);
+  I2CBus bus(wire);
+  bus.begin();
+  int8_t device = bus.addDevice(0x44);
+
+  const uint8_t tx[] = { 1, 2, 3 };
+  uint8_t rx[3] = { 0 };
+  CHECK_EQUAL(bus.writeRead(device, tx, 3, rx, 3), I2C_OK);
+  CHECK(memcmp(tx, rx, 3) == 0);
+  CHECK_EQUAL(bus.getStats(device).transactions, 1);
+  CHECK_EQUAL(bus.getStats(device).errors, 0);
+}
+
+TEST(missing_device_nacks_address)
+{
+  I2CEmulator wire;
+  I2CBus bus(wire);
+  int8_t device = bus.addDevice(0x50);
+
+  uint8_t buf[2] = { 0 };
+  CHECK_EQUAL(bus.write(device, buf, 2), I2C_NACK_ON_ADDRESS);
+  CHECK_EQUAL(bus.read(device, buf, 2), I2C_NACK_ON_ADDRESS);
+  CHECK_EQUAL(bus.getStats(device).errors, 2);
+  CHECK_EQUAL(bus.getRecoveryCount(), 0);
+}
+
+TEST(scripted_nack_on_data)
+{
+  I2CEmulator wire;
+  EchoDevice echo;
+  wire.attach(0x44, echo);
+  I2CBus bus(wire);
+  int8_t device = bus.addDevice(0x44);
+
+  const uint8_t tx[] = { 1 };
+  wire.failNext(0x44, 3);
+  CHECK_EQUAL(bus.write(device, tx, 1), I2C_NACK_ON_DATA);
+  CHECK_EQUAL(bus.write(device, tx, 1), I2C_OK);
+}
+
+TEST(stretch_within_timeout)
+{
+  I2CEmulator wire;
+  EchoDevice echo;
+  wire.attach(0x44, echo);
+  I2CBus bus(wire);
+  int8_t device = bus.addDevice(0x44, 50);
+
+  const uint8_t tx[] = { 1 };
+  wire.stretchNext(0x44, 20);
+  CHECK_EQUAL(bus.write(device, tx, 1), I2C_OK);
+  CHECK(bus.getStats(device).lastLatencyUs >= 20000);
+  CHECK_EQUAL(bus.getStats(device).timeouts, 0);
+}
+
+TEST(write_times_out)
+{
+  I2CEmulator wire;
+  EchoDevice echo;
+  wire.attach(0x44, echo);
+  I2CBus bus(wire);
+  int8_t device = bus.addDevice(0x44, 50);
+
+  const uint8_t tx[] = { 1 };
+  uint32_t start = millis();
+  wire.stretchNext(0x44, 80);
+  CHECK_EQUAL(bus.write(device, tx, 1), I2C_TIMEOUT);
+  // gives up at the timeout instead of waiting for the device
+  CHECK_EQUAL(millis() - start, 50);
+  CHECK_EQUAL(bus.getStats(device).timeouts, 1);
+  CHECK_EQUAL(bus.getStats(device).maxLatencyUs, 50000);
+  CHECK_EQUAL(bus.write(device, tx, 1), I2C_OK);
+}
+
+TEST(read_times_out)
+{
+  I2CEmulator wire;
+  EchoDevice echo;
+  wire.attach(0x44, echo);
+  I2CBus bus(wire);
+  int8_t device = bus.addDevice(0x44, 30);
+
+  uint8_t rx[2];
+  wire.stretchNext(0x44, 100);
+  CHECK_EQUAL(bus.read(device, rx, 2), I2C_TIMEOUT);
+  CHECK_EQUAL(bus.getStats(device).timeouts, 1);
+}
+
+TEST(begin_recovers_stuck_bus)
+{
+  I2CEmulator wire;
+  I2CBus bus(wire);
+  wire.holdSda(2);
+  CHECK(bus.isStuck());
+  bus.begin();
+  CHECK(!bus.isStuck());
+  CHECK_EQUAL(bus.getRecoveryCount(), 1);
+  CHECK_EQUAL(wire.getPulses(), 2);
+}
+
+TEST(failed_transfer_recovers_stuck_bus)
+{
+  I2CEmulator wire;
+  EchoDevice echo;
+  wire.attach(0x44, echo);
+  I2CBus bus(wire);
+  bus.begin();
+  int8_t device = bus.addDevice(0x44);
+
+  const uint8_t tx[] = { 1 };
+  wire.holdSda(5);
+  CHECK_EQUAL(bus.write(device, tx, 1), I2C_UNKNOWN_ERROR);
+  CHECK_EQUAL(bus.getRecoveryCount(), 1);
+  CHECK_EQUAL(wire.getPulses(), 5);
+  CHECK(!bus.isStuck());
+  CHECK_EQUAL(bus.write(device, tx, 1), I2C_OK);
+}
+
+TEST(recovery_gives_up_after_nine_pulses)
+{
+  I2CEmulator wire;
+  EchoDevice echo;
+  wire.attach(0x44, echo);
+  I2CBus bus(wire);
+  int8_t device = bus.addDevice(0x44);
+
+  const uint8_t tx[] = { 1 };
+  wire.holdSda(12);
+  CHECK(!bus.recover());
+  CHECK_EQUAL(wire.getPulses(), 9);
+  CHECK(bus.isStuck());
+  // the next failure tries again and gets the slave the rest of its pulses
+  CHECK_EQUAL(bus.write(device, tx, 1), I2C_UNKNOWN_ERROR);
+  CHECK_EQUAL(bus.getRecoveryCount(), 2);
+  CHECK_EQUAL(wire.getPulses(), 12);
+  CHECK_EQUAL(bus.write(device, tx, 1), I2C_OK);
+}
+
+TEST(flush_waits_once_for_slowest_device)
+{
+  I2CEmulator wire;
+  EchoDevice a, b;
+  wire.attach(0x44, a);
+  wire.attach(0x59, b);
+  I2CBus bus(wire);
+  int8_t deviceA = bus.addDevice(0x44);
+  int8_t deviceB = bus.addDevice(0x59);
+
+  const uint8_t txA[] = { 0xA }, txB[] = { 0xB };
+  uint8_t rxA = 0, rxB = 0;
+  I2C_Transaction ta, tb;
+  ta.device = deviceA;
+  ta.txData = txA;
+  ta.txLen = 1;
+  ta.rxData = &rxA;
+  ta.rxLen = 1;
+  ta.delayMs = 10;
+  tb = ta;
+  tb.device = deviceB;
+  tb.txData = txB;
+  tb.rxData = &rxB;
+  tb.delayMs = 30;
+
+  CHECK_EQUAL(bus.queue(ta), I2C_OK);
+  CHECK_EQUAL(bus.queue(tb), I2C_OK);
+  uint32_t start = millis();
+  CHECK_EQUAL(bus.flush(), 0);
+  CHECK_EQUAL(millis() - start, 30);
+  CHECK_EQUAL(rxA, 0xA);
+  CHECK_EQUAL(rxB, 0xB);
+
+  I2C_Transaction many[I2CBus::QUEUE_SIZE + 1];
+  for (uint8_t i = 0; i < I2CBus::QUEUE_SIZE; i++) {
+    many[i] = ta;
+    CHECK_EQUAL(bus.queue(many[i]), I2C_OK);
+  }
+  many[I2CBus::QUEUE_SIZE] = ta;
+  CHECK_EQUAL(bus.queue(many[I2CBus::QUEUE_SIZE]), I2C_QUEUE_FULL);
+  CHECK_EQUAL(bus.flush(), 0);
+}
+
+TEST(wire_without_pins_does_not_recover)
+{
+  I2CBus bus;
+  bus.begin();
+  int8_t device = bus.addDevice(0x44);
+
+  const uint8_t tx[] = { 1 };
+  CHECK_EQUAL(bus.write(device, tx, 1), I2C_NACK_ON_ADDRESS);
+  CHECK(!bus.recover());
+  CHECK_EQUAL(bus.getRecoveryCount(), 0);
+}
+
+TEST(sht3x_driver_reads_the_emulator)
+{
+  I2CEmulator wire;
+  Sht3xEmulator emulator;
+  wire.attach(0x44, emulator);
+  I2CBus bus(wire);
+  bus.begin();
+  emulator.setTemperature(-1250);
+  emulator.setHumidity(4550);
+
+  Sht3xDriver sht;
+  // periodic at 10 Hz, then waits 100 ms for the first measurement
+  CHECK_EQUAL(sht.begin(0x44, bus), SHT3XD_NO_ERROR);
+  CHECK(emulator.isPeriodic());
+  TMP_RH_Fixed result = sht.periodicFetchDataFixed();
+  CHECK_EQUAL(result.error, SHT3XD_NO_ERROR);
+  CHECK(result.t_centi >= -1251 && result.t_centi <= -1249);
+  CHECK(result.rh_centi >= 4549 && result.rh_centi <= 4551);
+
+  // nothing new yet: the read is NACKed
+  CHECK(sht.periodicFetchDataFixed().error != SHT3XD_NO_ERROR);
+  delay(100);
+  CHECK_EQUAL(sht.periodicFetchData().error, SHT3XD_NO_ERROR);
+  CHECK_EQUAL(emulator.getReadings(), 2);
+  CHECK_EQUAL(sht.readSerialNumber(), 0x12345678);
+
+  CHECK_EQUAL(sht.periodicStop(), SHT3XD_NO_ERROR);
+  CHECK(!emulator.isPeriodic());
+}
+
+TEST(sht3x_corrupt_reading_fails_the_crc)
+{
+  I2CEmulator wire;
+  Sht3xEmulator emulator;
+  wire.attach(0x44, emulator);
+  I2CBus bus(wire);
+  Sht3xDriver sht;
+  sht.begin(0x44, bus);
+  emulator.setCorruptEvery(2);
+
+  CHECK_EQUAL(sht.periodicFetchDataFixed().error, SHT3XD_NO_ERROR);
+  delay(100);
+  CHECK_EQUAL(sht.periodicFetchDataFixed().error, SHT3XD_CRC_ERROR);
+  delay(100);
+  CHECK_EQUAL(sht.periodicFetchDataFixed().error, SHT3XD_NO_ERROR);
+}
+
+int main()
+{
+  RUN(round_trip);
+  RUN(missing_device_nacks_address);
+  RUN(scripted_nack_on_data);
+  RUN(stretch_within_timeout);
+  RUN(write_times_out);
+  RUN(read_times_out);
+  RUN(begin_recovers_stuck_bus);
+  RUN(failed_transfer_recovers_stuck_bus);
+  RUN(recovery_gives_up_after_nine_pulses);
+  RUN(flush_waits_once_for_slowest_device);
+  RUN(wire_without_pins_does_not_recover);
+  RUN(sht3x_driver_reads_the_emulator);
+  RUN(sht3x_corrupt_reading_fails_the_crc);
+  return Test_result();
+}
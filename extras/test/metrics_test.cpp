@@ -0,0 +1,228 @@
+/*
+  metrics_test.cpp - MetricsServer output against the OpenMetrics text format
+*/
+
+#include "AirGradientEmulator.h"
+#include "AirGradientMetrics.h"
+#include "ArduinoHost.h"
+
+#include "test.h"
+
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// A Client with a canned request that keeps what is written to it
+class BufferClient : public Client
+{
+  public:
+    std::string request;
+    size_t position = 0;
+    std::string response;
+    std::vector<size_t> writes;
+    bool stopped = false;
+
+    BufferClient(const std::string& text) : request(text) {}
+
+    int connect(const char*, uint16_t) { return 1; }
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size)
+    {
+      writes.push_back(size);
+      response.append((const char*)buffer, size);
+      return size;
+    }
+    using Print::write;
+    int available()
+    {
+      // time passes while nothing arrives, so the request timeout is reached
+      if (position == request.size()) {
+        delay(1);
+      }
+      return request.size() - position;
+    }
+    int read() { return position < request.size() ? (uint8_t)request[position++] : -1; }
+    int read(uint8_t* buffer, size_t size)
+    {
+      size_t n = 0;
+      while (n < size && position < request.size()) {
+        buffer[n++] = request[position++];
+      }
+      return n;
+    }
+    int peek() { return position < request.size() ? (uint8_t)request[position] : -1; }
+    void flush() {}
+    void stop() { stopped = true; }
+    uint8_t connected() { return !stopped; }
+    operator bool() { return true; }
+
+    std::string body() const
+    {
+      size_t end = response.find("\r\n\r\n");
+      return end == std::string::npos ? "" : response.substr(end + 4);
+    }
+};
+
+// Spends a fixed time on every transfer
+class SlowDevice : public I2CDeviceEmulator
+{
+  public:
+    uint32_t us;
+    SlowDevice(uint32_t microseconds) : us(microseconds) {}
+    bool receive(const uint8_t*, uint8_t) { delayMicroseconds(us); return true; }
+    uint8_t send(uint8_t* data, uint8_t len) { memset(data, 0, len); delayMicroseconds(us); return len; }
+};
+
+// Checks the body against the OpenMetrics text grammar for what the
+// server writes: families declared before their samples, counters
+// sampled as _total, one # EOF at the very end. Returns the samples.
+static bool parse(const std::string& body, std::map<std::string, std::string>& samples)
+{
+  static const std::regex sampleLine("([a-zA-Z_:][a-zA-Z0-9_:]*)(\\{[a-zA-Z_][a-zA-Z0-9_]*=\"[^\"]*\"\\})? (-?[0-9]+(\\.[0-9]+)?)");
+  std::map<std::string, std::string> types;
+  std::istringstream in(body);
+  std::string line;
+  bool eof = false;
+  while (std::getline(in, line)) {
+    if (eof) {
+      printf("text after # EOF: %s\n", line.c_str());
+      return false;
+    }
+    if (line == "# EOF") {
+      eof = true;
+      continue;
+    }
+    if (line.compare(0, 7, "# TYPE ") == 0) {
+      std::string rest = line.substr(7);
+      size_t space = rest.find(' ');
+      types[rest.substr(0, space)] = rest.substr(space + 1);
+      continue;
+    }
+    if (line.compare(0, 7, "# HELP ") == 0) {
+      continue;
+    }
+    std::smatch match;
+    if (!std::regex_match(line, match, sampleLine)) {
+      printf("bad line: %s\n", line.c_str());
+      return false;
+    }
+    std::string name = match[1];
+    std::string family = name;
+    if (name.size() > 6 && name.compare(name.size() - 6, 6, "_total") == 0) {
+      family = name.substr(0, name.size() - 6);
+      if (types[family] != "counter") {
+        printf("_total without a counter family: %s\n", line.c_str());
+        return false;
+      }
+    } else if (types[family] != "gauge") {
+      printf("sample without a gauge family: %s\n", line.c_str());
+      return false;
+    }
+    samples[name + std::string(match[2])] = match[3];
+  }
+  return eof && body.size() > 0 && body[body.size() - 1] == '\n';
+}
+
+TEST(gauge_decimals)
+{
+  std::string text;
+  BufferClient out("");
+  char buffer[64];
+  MetricsWriter writer(out, buffer, sizeof(buffer));
+  writer.gauge("a", -3.456, 2);
+  writer.gauge("b", 0.000123, 6);
+  writer.gauge("c", 0.0005, 3);
+  writer.gauge("d", 12, 0);
+  // 4e6 scaled by 10^6 or 10^3 would not fit a 32 bit long
+  writer.gauge("e", 4000000, 6);
+  writer.flush();
+  CHECK(out.response == "a -3.46\nb 0.000123\nc 0.001\nd 12\ne 4000000.00\n");
+}
+
+TEST(render_is_valid_openmetrics)
+{
+  Measures measures;
+  measures.set(MEASURE_WIFI, -61);
+  measures.set(MEASURE_RCO2, 712);
+  measures.set(MEASURE_PM02, 12);
+  measures.set(MEASURE_ATMP, -3.456);
+  measures.set(MEASURE_RHUM, 52);
+  measures.set(MEASURE_BOOT, 42);
+
+  I2CEmulator wire;
+  SlowDevice sht(250), sgp(80);
+  wire.attach(0x44, sht);
+  wire.attach(0x59, sgp);
+  I2CBus bus(wire);
+  int8_t shtDevice = bus.addDevice(0x44);
+  int8_t sgpDevice = bus.addDevice(0x59);
+  const uint8_t command[] = { 0x24, 0x00 };
+  uint8_t rx[6];
+  bus.writeRead(shtDevice, command, 2, rx, 6);
+  bus.write(sgpDevice, command, 2);
+  wire.failNext(0x59, 3);
+  bus.write(sgpDevice, command, 2);
+
+  MetricsServer metrics;
+  metrics.setMeasures(measures);
+  metrics.setI2CBus(bus);
+  metrics.setCallback([](MetricsWriter& writer) {
+    writer.family("airgradient_reports_sent", "counter", "Measures uploaded");
+    writer.counter("airgradient_reports_sent", 17);
+  });
+
+  BufferClient client("GET /metrics HTTP/1.1\r\nHost: sensor\r\nAccept: */*\r\n\r\n");
+  CHECK_EQUAL(metrics.handle(client), 200);
+  CHECK(client.stopped);
+  CHECK(client.response.compare(0, 17, "HTTP/1.0 200 OK\r\n") == 0);
+
+  std::map<std::string, std::string> samples;
+  CHECK(parse(client.body(), samples));
+  CHECK(samples["airgradient_co2_ppm"] == "712");
+  CHECK(samples["airgradient_temperature_celsius"] == "-3.46");
+  CHECK(samples["airgradient_i2c_transactions_total{device=\"0x44\"}"] == "1");
+  CHECK(samples["airgradient_i2c_errors_total{device=\"0x59\"}"] == "1");
+  CHECK(samples["airgradient_reports_sent_total"] == "17");
+  // sub-millisecond latencies are not rounded away
+  CHECK(samples["airgradient_i2c_max_latency_seconds{device=\"0x44\"}"] == "0.000500");
+  CHECK(samples["airgradient_i2c_max_latency_seconds{device=\"0x59\"}"] == "0.000080");
+  CHECK(samples.count("airgradient_nox_index") == 0);
+
+  // sent in pieces of the fixed buffer, never as one string
+  for (size_t n : client.writes) {
+    CHECK(n < MetricsServer::BUFFER_SIZE);
+  }
+  CHECK(client.writes.size() > 3);
+}
+
+TEST(other_paths_get_404)
+{
+  MetricsServer metrics;
+  BufferClient client("GET / HTTP/1.1\r\n\r\n");
+  CHECK_EQUAL(metrics.handle(client), 404);
+  CHECK(client.response.compare(0, 22, "HTTP/1.0 404 Not Found") == 0);
+  CHECK_EQUAL(metrics.getErrors(), 1);
+  CHECK_EQUAL(metrics.getRequests(), 0);
+}
+
+TEST(incomplete_request_times_out)
+{
+  MetricsServer metrics;
+  BufferClient client("GET /metrics HTTP/1.1\r\nHost: sens");
+  uint32_t start = millis();
+  CHECK_EQUAL(metrics.handle(client), 0);
+  CHECK(millis() - start >= MetricsServer::REQUEST_TIMEOUT_MS);
+  CHECK(client.response.empty());
+  CHECK(client.stopped);
+}
+
+int main()
+{
+  RUN(gauge_decimals);
+  RUN(render_is_valid_openmetrics);
+  RUN(other_paths_get_404);
+  RUN(incomplete_request_times_out);
+  return Test_result();
+}
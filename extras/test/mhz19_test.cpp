@@ -0,0 +1,160 @@
+/*
+  mhz19_test.cpp - Mhz19PwmDecoder on synthetic edge traces
+*/
+
+#include "AirGradientMhz19Pwm.h"
+
+#include "test.h"
+
+// One PWM cycle from the rising edge at start: 2ms high, the active part,
+// the rest low. Returns the timestamp of the next rising edge.
+static uint32_t cycle(Mhz19PwmDecoder& decoder, uint32_t start, int ppm, uint16_t range = 5000,
+                      uint32_t length = Mhz19PwmDecoder::CYCLE_US)
+{
+  uint32_t active = (uint32_t)((uint64_t)ppm * (length - 4000) / range);
+  decoder.onEdge(true, start);
+  decoder.onEdge(false, start + 2000 + active);
+  return start + length;
+}
+
+TEST(steady_trace_decodes)
+{
+  Mhz19PwmDecoder decoder;
+  uint32_t t = 12345;
+  t = cycle(decoder, t, 400);
+  // a cycle ends with the next rising edge
+  CHECK_EQUAL(decoder.ppm(), -1);
+  CHECK_EQUAL(decoder.cycles(), 0);
+  for (int i = 0; i < 5; i++) {
+    t = cycle(decoder, t, 400);
+    CHECK_EQUAL(decoder.ppm(), 400);
+  }
+  CHECK_EQUAL(decoder.cycles(), 5);
+  CHECK_EQUAL(decoder.invalidCycles(), 0);
+  CHECK_EQUAL(decoder.lastCycleUs(), t - Mhz19PwmDecoder::CYCLE_US);
+}
+
+TEST(each_cycle_updates_the_value)
+{
+  Mhz19PwmDecoder decoder;
+  const int values[] = { 400, 1234, 0, 5000, 800 };
+  uint32_t t = cycle(decoder, 0, values[0]);
+  for (int i = 1; i < 5; i++) {
+    t = cycle(decoder, t, values[i]);
+    CHECK_EQUAL(decoder.ppm(), values[i - 1]);
+  }
+
+  // a 2000 ppm range stretches the active part
+  Mhz19PwmDecoder narrow(2000);
+  t = cycle(narrow, 0, 1500, 2000);
+  cycle(narrow, t, 1500, 2000);
+  CHECK_EQUAL(narrow.ppm(), 1500);
+}
+
+TEST(cycle_length_drift_is_tolerated)
+{
+  Mhz19PwmDecoder decoder;
+  uint32_t length = Mhz19PwmDecoder::CYCLE_US + 30000;
+  uint32_t t = cycle(decoder, 0, 1000, 5000, length);
+  cycle(decoder, t, 1000, 5000, length);
+  CHECK_EQUAL(decoder.ppm(), 1000);
+}
+
+TEST(implausible_timing_is_rejected)
+{
+  CHECK_EQUAL(Mhz19PwmDecoder::ppmFromTiming(2000 + 80000, 1004000 - 82000, 5000), 400);
+  CHECK_EQUAL(Mhz19PwmDecoder::ppmFromTiming(500000, 400000, 5000), -1);
+  CHECK_EQUAL(Mhz19PwmDecoder::ppmFromTiming(600000, 500000, 5000), -1);
+  CHECK_EQUAL(Mhz19PwmDecoder::ppmFromTiming(1500, 1002500, 5000), -1);
+  // high for longer than the span clamps to the range
+  CHECK_EQUAL(Mhz19PwmDecoder::ppmFromTiming(1003000, 1000, 5000), 5000);
+
+  // a glitch inside a cycle costs that cycle and keeps the value
+  Mhz19PwmDecoder decoder;
+  uint32_t t = cycle(decoder, 0, 400);
+  t = cycle(decoder, t, 400);
+  decoder.onEdge(true, t);
+  decoder.onEdge(false, t + 50000);
+  decoder.onEdge(true, t + 50100);
+  CHECK_EQUAL(decoder.ppm(), 400);
+  CHECK_EQUAL(decoder.invalidCycles(), 1);
+}
+
+TEST(trace_across_the_micros_wrap)
+{
+  Mhz19PwmDecoder decoder;
+  uint32_t t = 0xFFFFFFFFUL - 2500000UL;
+  uint32_t cycles = 0;
+  // the third cycle starts before the wrap and ends after it
+  for (int i = 0; i < 6; i++) {
+    t = cycle(decoder, t, 600 + 100 * i);
+    if (i > 0) {
+      CHECK_EQUAL(decoder.ppm(), 600 + 100 * (i - 1));
+      CHECK_EQUAL(decoder.cycles(), ++cycles);
+      CHECK(!decoder.isStale(t + 10000));
+    }
+  }
+  CHECK(t < 0x80000000UL);
+  CHECK_EQUAL(decoder.invalidCycles(), 0);
+}
+
+TEST(stuck_line_goes_stale)
+{
+  Mhz19PwmDecoder decoder;
+  uint32_t t = cycle(decoder, 0, 400);
+  t = cycle(decoder, t, 400);
+  t = cycle(decoder, t, 400);
+  // the line goes high on the rising edge and stays there
+  decoder.onEdge(true, t);
+  uint32_t last = decoder.lastCycleUs();
+  CHECK_EQUAL(last, t);
+  CHECK(!decoder.isStale(last + Mhz19PwmDecoder::STALE_US));
+  CHECK(decoder.isStale(last + Mhz19PwmDecoder::STALE_US + 1));
+  CHECK_EQUAL(decoder.ppm(), 400);
+
+  // polled once a minute for two hours: after 71 minutes micros() is back
+  // near the last cycle, which would look recent again without the latch
+  uint32_t now = last;
+  for (int minute = 1; minute <= 120; minute++) {
+    now += 60000000UL;
+    CHECK(decoder.isStale(now));
+  }
+  CHECK(decoder.isStale(last + 1000));
+
+  // the line comes back: the stuck cycle is invalid, the next one counts
+  t = last + 900000000UL;
+  decoder.onEdge(false, t);
+  t = cycle(decoder, t + 500000, 700);
+  CHECK(decoder.isStale(t));
+  CHECK_EQUAL(decoder.invalidCycles(), 1);
+  cycle(decoder, t, 700);
+  CHECK_EQUAL(decoder.ppm(), 700);
+  CHECK(!decoder.isStale(t + 1000));
+}
+
+TEST(stuck_before_the_first_cycle)
+{
+  Mhz19PwmDecoder decoder;
+  decoder.onEdge(true, 1000);
+  decoder.onEdge(false, 3000);
+  CHECK_EQUAL(decoder.cycles(), 0);
+  CHECK_EQUAL(decoder.ppm(), -1);
+
+  decoder.reset();
+  uint32_t t = cycle(decoder, 5000, 400);
+  cycle(decoder, t, 400);
+  CHECK_EQUAL(decoder.ppm(), 400);
+  CHECK_EQUAL(decoder.cycles(), 1);
+}
+
+int main()
+{
+  RUN(steady_trace_decodes);
+  RUN(each_cycle_updates_the_value);
+  RUN(cycle_length_drift_is_tolerated);
+  RUN(implausible_timing_is_rejected);
+  RUN(trace_across_the_micros_wrap);
+  RUN(stuck_line_goes_stale);
+  RUN(stuck_before_the_first_cycle);
+  return Test_result();
+}
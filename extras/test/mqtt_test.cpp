@@ -0,0 +1,339 @@
+/*
+  mqtt_test.cpp - MqttPublisher message sizes, pipelining and acks
+
+  BrokerClient is the publisher's Client and a broker in one: it parses
+  the packets written to it, answers CONNECT with CONNACK and, unless
+  held, each QoS 1 PUBLISH with a PUBACK.
+*/
+
+#include "AirGradientMqtt.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+class BrokerClient : public Client
+{
+  public:
+    struct Publish {
+      std::string topic;
+      std::string payload;
+      uint16_t packetId;
+      bool dup;
+    };
+
+    std::vector<Publish> publishes;
+    bool holdAcks = false;
+    std::vector<uint16_t> held;
+    uint32_t writes = 0;
+
+    int connect(const char*, uint16_t)
+    {
+      _connected = true;
+      _in.clear();
+      _out.clear();
+      return 1;
+    }
+
+    size_t write(uint8_t c)
+    {
+      return write(&c, 1);
+    }
+
+    size_t write(const uint8_t* buffer, size_t size)
+    {
+      if (!_connected) {
+        return 0;
+      }
+      writes++;
+      _in.insert(_in.end(), buffer, buffer + size);
+      parse();
+      return size;
+    }
+
+    int available()
+    {
+      return _out.size();
+    }
+
+    int read()
+    {
+      if (_out.empty()) {
+        return -1;
+      }
+      int c = _out.front();
+      _out.erase(_out.begin());
+      return c;
+    }
+
+    int read(uint8_t* buffer, size_t size)
+    {
+      size_t n = 0;
+      while (n < size && !_out.empty()) {
+        buffer[n++] = read();
+      }
+      return n;
+    }
+
+    int peek()
+    {
+      return _out.empty() ? -1 : _out.front();
+    }
+
+    void flush() {}
+
+    void stop()
+    {
+      _connected = false;
+    }
+
+    uint8_t connected()
+    {
+      return _connected;
+    }
+
+    operator bool()
+    {
+      return _connected;
+    }
+
+    void releaseAcks()
+    {
+      for (size_t i = 0; i < held.size(); i++) {
+        ack(held[i]);
+      }
+      held.clear();
+    }
+
+  private:
+    bool _connected = false;
+    std::vector<uint8_t> _in;
+    std::vector<uint8_t> _out;
+
+    void ack(uint16_t packetId)
+    {
+      const uint8_t puback[] = { 0x40, 2, (uint8_t)(packetId >> 8), (uint8_t)(packetId & 0xFF) };
+      _out.insert(_out.end(), puback, puback + sizeof(puback));
+    }
+
+    // Takes every complete packet off the front of _in
+    void parse()
+    {
+      for (;;) {
+        size_t n = 1;
+        uint32_t length = 0;
+        uint8_t shift = 0;
+        for (;;) {
+          if (n >= _in.size()) {
+            return;
+          }
+          uint8_t c = _in[n++];
+          length |= (uint32_t)(c & 0x7F) << shift;
+          shift += 7;
+          if (!(c & 0x80)) {
+            break;
+          }
+        }
+        if (_in.size() < n + length) {
+          return;
+        }
+        handle(_in[0], &_in[n], length);
+        _in.erase(_in.begin(), _in.begin() + n + length);
+      }
+    }
+
+    void handle(uint8_t type, const uint8_t* body, uint32_t length)
+    {
+      if ((type & 0xF0) == 0x10) {
+        const uint8_t connack[] = { 0x20, 2, 0, 0 };
+        _out.insert(_out.end(), connack, connack + sizeof(connack));
+      } else if ((type & 0xF0) == 0x30) {
+        Publish publish;
+        uint16_t topicLength = (body[0] << 8) | body[1];
+        publish.topic.assign((const char*)body + 2, topicLength);
+        publish.packetId = (body[2 + topicLength] << 8) | body[3 + topicLength];
+        publish.payload.assign((const char*)body + 4 + topicLength, length - 4 - topicLength);
+        publish.dup = type & 0x08;
+        publishes.push_back(publish);
+        if (holdAcks) {
+          held.push_back(publish.packetId);
+        } else {
+          ack(publish.packetId);
+        }
+      } else if ((type & 0xF0) == 0xC0) {
+        const uint8_t pingresp[] = { 0xD0, 0 };
+        _out.insert(_out.end(), pingresp, pingresp + sizeof(pingresp));
+      }
+    }
+};
+
+// Every metric at the longest value a 32 bit long prints
+static Measures fullRecord()
+{
+  Measures measures;
+  for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+    measures.set((Measure_Field)i, -2000000000.0f);
+  }
+  measures.set(MEASURE_ATMP, -20000000.0f);
+  return measures;
+}
+
+static void run(MqttPublisher& mqtt, uint32_t& now, int steps)
+{
+  for (int i = 0; i < steps; i++) {
+    mqtt.update(now);
+    now += 10;
+  }
+}
+
+TEST(full_record_fits_json_buffer)
+{
+  char payload[MEASURES_JSON_SIZE];
+  size_t length = Measures_writeJson(fullRecord(), payload, sizeof(payload));
+  CHECK(length > 200);
+  CHECK(length < sizeof(payload));
+}
+
+TEST(full_record_with_long_prefix_is_published)
+{
+  BrokerClient broker;
+  MqttPublisher mqtt(broker);
+  // as long as setTopicPrefix() keeps
+  char prefix[MqttPublisher::TOPIC_SIZE];
+  memset(prefix, 'p', sizeof(prefix) - 1);
+  prefix[sizeof(prefix) - 1] = '\0';
+  mqtt.setServer("broker");
+  mqtt.setTopicPrefix(prefix);
+
+  Measures measures = fullRecord();
+  CHECK_EQUAL(mqtt.publishMeasures(measures, MQTT_TOPICS_COMBINED | MQTT_TOPICS_PER_METRIC), MQTT_OK);
+  CHECK_EQUAL(mqtt.getQueued(), 1 + MEASURE_COUNT);
+
+  uint32_t now = 0;
+  run(mqtt, now, 20);
+  CHECK_EQUAL(broker.publishes.size(), 1 + MEASURE_COUNT);
+  CHECK_EQUAL(mqtt.getAcked(), 1 + MEASURE_COUNT);
+  CHECK_EQUAL(mqtt.getQueued(), 0);
+
+  char payload[MEASURES_JSON_SIZE];
+  Measures_writeJson(measures, payload, sizeof(payload));
+  CHECK(broker.publishes[0].topic == std::string(prefix) + "/measures");
+  CHECK(broker.publishes[0].payload == payload);
+  CHECK(broker.publishes[1].topic == std::string(prefix) + "/wifi");
+  CHECK(broker.publishes[1].payload == "-2000000000");
+}
+
+TEST(typical_record_is_published)
+{
+  BrokerClient broker;
+  MqttPublisher mqtt(broker);
+  mqtt.setServer("broker");
+  mqtt.setTopicPrefix("airgradient/abc123");
+
+  Measures measures;
+  measures.set(MEASURE_RCO2, 612);
+  measures.set(MEASURE_ATMP, 21.5);
+  CHECK_EQUAL(mqtt.publishMeasures(measures), MQTT_OK);
+
+  uint32_t now = 0;
+  run(mqtt, now, 10);
+  CHECK_EQUAL(broker.publishes.size(), 1);
+  CHECK(broker.publishes[0].topic == "airgradient/abc123/measures");
+  CHECK(broker.publishes[0].payload == "{\"rco2\":612, \"atmp\":21.50}");
+}
+
+TEST(too_long_message_is_rejected)
+{
+  BrokerClient broker;
+  MqttPublisher mqtt(broker);
+  std::string payload(MqttPublisher::MESSAGE_SIZE, 'x');
+  CHECK_EQUAL(mqtt.publish("t", payload.c_str()), MQTT_TOO_LONG);
+  CHECK_EQUAL(mqtt.publish("", "x"), MQTT_TOO_LONG);
+  CHECK_EQUAL(mqtt.getQueued(), 0);
+}
+
+TEST(window_limits_unacked_messages)
+{
+  BrokerClient broker;
+  broker.holdAcks = true;
+  MqttPublisher mqtt(broker);
+  mqtt.setServer("broker");
+  for (int i = 0; i < 10; i++) {
+    CHECK_EQUAL(mqtt.publish("t", "1"), MQTT_OK);
+  }
+
+  uint32_t now = 0;
+  run(mqtt, now, 10);
+  CHECK_EQUAL(broker.publishes.size(), MqttPublisher::WINDOW);
+  CHECK_EQUAL(mqtt.getInFlight(), MqttPublisher::WINDOW);
+
+  broker.releaseAcks();
+  run(mqtt, now, 1);
+  CHECK_EQUAL(mqtt.getAcked(), MqttPublisher::WINDOW);
+  CHECK_EQUAL(broker.publishes.size(), 2 * MqttPublisher::WINDOW);
+
+  broker.holdAcks = false;
+  broker.releaseAcks();
+  run(mqtt, now, 10);
+  CHECK_EQUAL(mqtt.getAcked(), 10);
+  CHECK_EQUAL(mqtt.getQueued(), 0);
+}
+
+TEST(unacked_messages_resent_after_reconnect)
+{
+  BrokerClient broker;
+  broker.holdAcks = true;
+  MqttPublisher mqtt(broker);
+  mqtt.setServer("broker");
+  mqtt.publish("t", "1");
+  mqtt.publish("t", "2");
+
+  uint32_t now = 0;
+  run(mqtt, now, 5);
+  CHECK_EQUAL(broker.publishes.size(), 2);
+
+  broker.stop();
+  broker.holdAcks = false;
+  broker.held.clear();
+  run(mqtt, now, 200);
+  CHECK(mqtt.isConnected());
+  CHECK_EQUAL(mqtt.getResent(), 2);
+  CHECK_EQUAL(mqtt.getReconnects(), 1);
+  CHECK_EQUAL(broker.publishes.size(), 4);
+  CHECK(broker.publishes[2].dup);
+  CHECK_EQUAL(broker.publishes[2].packetId, broker.publishes[0].packetId);
+  CHECK_EQUAL(mqtt.getQueued(), 0);
+}
+
+TEST(full_queue_drops_oldest)
+{
+  BrokerClient broker;
+  MqttPublisher mqtt(broker);
+  for (int i = 0; i < MqttPublisher::QUEUE_SIZE + 3; i++) {
+    char payload[8];
+    snprintf(payload, sizeof(payload), "%d", i);
+    mqtt.publish("t", payload);
+  }
+  CHECK_EQUAL(mqtt.getQueued(), MqttPublisher::QUEUE_SIZE);
+  CHECK_EQUAL(mqtt.getDropped(), 3);
+
+  mqtt.setServer("broker");
+  uint32_t now = 0;
+  run(mqtt, now, 20);
+  CHECK_EQUAL(broker.publishes.size(), MqttPublisher::QUEUE_SIZE);
+  CHECK(broker.publishes[0].payload == "3");
+}
+
+int main()
+{
+  RUN(full_record_fits_json_buffer);
+  RUN(full_record_with_long_prefix_is_published);
+  RUN(typical_record_is_published);
+  RUN(too_long_message_is_rejected);
+  RUN(window_limits_unacked_messages);
+  RUN(unacked_messages_resent_after_reconnect);
+  RUN(full_queue_drops_oldest);
+  return Test_result();
+}
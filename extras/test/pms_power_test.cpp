@@ -0,0 +1,178 @@
+/*
+  pms_power_test.cpp - PmsPowerManager windows on a PmsEmulator that settles after wake-up
+*/
+
+#include "ArduinoHost.h"
+#include "AirGradientEmulator.h"
+#include "AirGradientPmsPower.h"
+
+#include <vector>
+
+#include "test.h"
+
+static const uint32_t STEP_MS = 100;
+
+// Runs the manager for ms in STEP_MS steps and returns when each average
+// came, relative to start.
+static std::vector<uint32_t> run(PmsPowerManager& power, uint32_t start, uint32_t ms)
+{
+  std::vector<uint32_t> averages;
+  for (uint32_t t = 0; t < ms; t += STEP_MS) {
+    Host_advance(STEP_MS);
+    if (power.update(millis())) {
+      averages.push_back(millis() - start);
+    }
+  }
+  return averages;
+}
+
+TEST(windows_follow_the_schedule)
+{
+  PmsEmulator emulator;
+  emulator.setPm(20);
+  PmsDriver pms;
+  pms.begin(emulator, PMS_VARIANT_PMS5003);
+  PmsPowerManager power(pms);
+  uint32_t start = millis();
+  power.begin(5 * 60 * 1000UL, 5, 30000, start);
+  CHECK(emulator.isSleeping());
+
+  // woken on the first update, sampled once warmed up
+  run(power, start, STEP_MS);
+  CHECK(!emulator.isSleeping());
+  CHECK(emulator.isPassive());
+  CHECK_EQUAL(power.getState(), PMS_POWER_WARMING_UP);
+
+  std::vector<uint32_t> averages = run(power, start, 20000 - STEP_MS);
+  CHECK(averages.empty());
+  CHECK_EQUAL(emulator.getFrames(), 0);
+
+  averages = run(power, start, 100000);
+  // one request per frame from 30.1 s
+  CHECK_EQUAL(averages.size(), 1);
+  CHECK_EQUAL(averages[0], 30100 + 5 * STEP_MS);
+  CHECK_EQUAL(emulator.getFrames(), 5);
+  CHECK(emulator.isSleeping());
+  CHECK_EQUAL(power.getState(), PMS_POWER_SLEEPING);
+  CHECK_EQUAL(power.getAverage().PM_AE_UG_2_5, 20);
+
+  // the next windows start on the interval, woken 30 s ahead
+  averages = run(power, start, 900000);
+  CHECK_EQUAL(averages.size(), 3);
+  for (size_t i = 0; i < averages.size(); i++) {
+    CHECK_EQUAL(averages[i], (i + 1) * 300000 + 30000 + 5 * STEP_MS);
+  }
+  CHECK_EQUAL(emulator.getFrames(), 4 * 5);
+  CHECK_EQUAL(power.getFailedWindows(), 0);
+
+  // about 30.5 s of 300 s awake
+  CHECK_EQUAL(power.getActiveSeconds() + power.getSleepSeconds(), 1020);
+  CHECK(power.getActiveSeconds() >= 4 * 30 && power.getActiveSeconds() <= 4 * 31);
+  CHECK_EQUAL(power.getDutyCyclePercent(), 12);
+  CHECK_EQUAL(power.getLaserHoursRemaining(), PmsPowerManager::LASER_LIFE_HOURS);
+  // 122 s at 500 mW, 898 s at 1 mW
+  CHECK_EQUAL(power.getEnergyMilliwattHours(), 17);
+}
+
+TEST(window_averages_its_frames)
+{
+  PmsEmulator emulator(PMS_VARIANT_PMS5003T);
+  PmsDriver pms;
+  pms.begin(emulator, PMS_VARIANT_PMS5003T);
+  PmsPowerManager power(pms);
+  uint32_t start = millis();
+  power.begin(60000, 4, 10000, start);
+
+  const uint16_t pm25[] = { 10, 11, 13, 14 };
+  const int16_t temperature[] = { -3, -3, -4, -4 };
+  const uint16_t humidity[] = { 40, 41, 40, 41 };
+  uint32_t averages = 0;
+  for (uint32_t t = 0; t < 30000 && averages == 0; t += STEP_MS) {
+    // what the next frame will carry
+    uint32_t frame = emulator.getFrames() % 4;
+    PmsDriver::DATA data = PmsDriver::DATA();
+    data.PM_AE_UG_2_5 = pm25[frame];
+    data.PM_TMP = temperature[frame];
+    data.PM_HUM = humidity[frame];
+    emulator.setData(data);
+    Host_advance(STEP_MS);
+    averages += power.update(millis());
+  }
+  CHECK_EQUAL(averages, 1);
+  CHECK_EQUAL(emulator.getFrames(), 4);
+  CHECK_EQUAL(power.getAverage().PM_AE_UG_2_5, 12);
+  // halves round away from zero
+  CHECK_EQUAL(power.getAverage().PM_TMP, -4);
+  CHECK_EQUAL(power.getAverage().PM_HUM, 41);
+}
+
+// The sensor reads low until its fan is up to speed. Here the passive mode
+// command after wake-up is lost, so it sends those frames on its own.
+TEST(settling_frames_are_discarded)
+{
+  const uint8_t activeMode[] = { 0x42, 0x4D, 0xE1, 0x00, 0x01, 0x01, 0x71 };
+  for (int warmUp = 0; warmUp < 2; warmUp++) {
+    PmsEmulator emulator;
+    emulator.setPm(50);
+    emulator.setSettling(PmsDriver::STEADY_RESPONSE_TIME);
+    PmsDriver pms;
+    pms.begin(emulator, PMS_VARIANT_PMS5003);
+    PmsPowerManager power(pms);
+    uint32_t start = millis();
+    power.begin(5 * 60 * 1000UL, 5, warmUp ? PmsDriver::STEADY_RESPONSE_TIME : 5000, start);
+
+    run(power, start, STEP_MS);
+    CHECK_EQUAL(power.getState(), PMS_POWER_WARMING_UP);
+    emulator.write(activeMode, sizeof(activeMode));
+    std::vector<uint32_t> averages = run(power, start, 60000);
+    CHECK_EQUAL(averages.size(), 1);
+    CHECK_EQUAL(power.getFailedWindows(), 0);
+    if (warmUp) {
+      // a frame a second came while warming up
+      CHECK_EQUAL(emulator.getFrames(), 29 + 5);
+      CHECK_EQUAL(power.getAverage().PM_AE_UG_2_5, 50);
+      CHECK_EQUAL(power.getAverage().PM_RAW_0_3, 150 + 50 * 60);
+    } else {
+      // too short a warm-up for this sensor
+      CHECK(power.getAverage().PM_AE_UG_2_5 < 50 * 10 / 30);
+    }
+  }
+}
+
+TEST(failed_window_sleeps_until_the_next)
+{
+  PmsEmulator emulator;
+  emulator.setPm(30);
+  // every frame has a bad checksum
+  emulator.setCorruptEvery(1);
+  PmsDriver pms;
+  pms.begin(emulator, PMS_VARIANT_PMS5003);
+  PmsPowerManager power(pms);
+  uint32_t start = millis();
+  power.begin(120000, 3, 30000, start);
+
+  std::vector<uint32_t> averages = run(power, start, 40000);
+  CHECK(averages.empty());
+  CHECK_EQUAL(power.getFailedWindows(), 1);
+  // the first request and three more
+  CHECK_EQUAL(emulator.getFrames(), 4);
+  CHECK(emulator.isSleeping());
+  CHECK_EQUAL(power.getState(), PMS_POWER_SLEEPING);
+  CHECK_EQUAL(power.getAverage().PM_AE_UG_2_5, 0);
+
+  emulator.setCorruptEvery(0);
+  averages = run(power, start, 120000);
+  CHECK_EQUAL(averages.size(), 1);
+  CHECK_EQUAL(averages[0], 120000 + 30000 + 3 * STEP_MS);
+  CHECK_EQUAL(power.getAverage().PM_AE_UG_2_5, 30);
+  CHECK_EQUAL(power.getFailedWindows(), 1);
+}
+
+int main()
+{
+  RUN(windows_follow_the_schedule);
+  RUN(window_averages_its_frames);
+  RUN(settling_frames_are_discarded);
+  RUN(failed_window_sleeps_until_the_next);
+  return Test_result();
+}
@@ -0,0 +1,237 @@
+/*
+  pms_test.cpp - PmsDriver layouts and variant detection on PmsEmulator frames
+*/
+
+#include "ArduinoHost.h"
+#include "AirGradientEmulator.h"
+
+#include <string.h>
+
+#include "test.h"
+
+// Lets the emulator send one frame a second and returns the frames read.
+static uint8_t readFrames(PmsDriver& pms, PmsEmulator& emulator, uint8_t frames, PmsDriver::DATA& data)
+{
+  uint8_t read = 0;
+  for (uint8_t i = 0; i < frames; i++) {
+    // the first call starts the emulator's frame clock
+    emulator.update();
+    Host_advance(PmsEmulator::FRAME_INTERVAL_MS);
+    // read() takes one byte per call
+    while (emulator.available() > 0) {
+      if (pms.read(data)) {
+        read++;
+      }
+    }
+  }
+  return read;
+}
+
+static PmsDriver::DATA sample()
+{
+  PmsDriver::DATA data;
+  uint16_t* words = &data.PM_SP_UG_1_0;
+  for (uint8_t i = 0; i < 12; i++) {
+    words[i] = 100 * (i + 1) + i;
+  }
+  data.AMB_HCHO = 3;
+  data.PM_TMP = -7;
+  data.PM_HUM = 64;
+  return data;
+}
+
+TEST(fixed_variants_decode_their_layouts)
+{
+  const PMS_Variant variants[] = { PMS_VARIANT_PMS5003, PMS_VARIANT_PMS5003T, PMS_VARIANT_PMS5003ST };
+  for (uint8_t v = 0; v < 3; v++) {
+    PmsEmulator emulator(variants[v]);
+    emulator.setData(sample());
+    PmsDriver pms;
+    pms.begin(emulator, variants[v]);
+    PmsDriver::DATA data;
+    memset(&data, 0xAA, sizeof(data));
+    CHECK_EQUAL(readFrames(pms, emulator, 2, data), 2);
+    CHECK_EQUAL(pms.getVariant(), variants[v]);
+
+    const uint16_t* words = &data.PM_SP_UG_1_0;
+    uint8_t bulkWords = pmsLayout(variants[v]).bulkWords;
+    for (uint8_t i = 0; i < 12; i++) {
+      CHECK_EQUAL(words[i], i < bulkWords ? 100 * (i + 1) + i : 0);
+    }
+    bool st = variants[v] == PMS_VARIANT_PMS5003ST;
+    bool trh = variants[v] != PMS_VARIANT_PMS5003;
+    CHECK_EQUAL(data.AMB_HCHO, st ? 3 : 0);
+    CHECK_EQUAL(data.PM_TMP, trh ? -7 : 0);
+    CHECK_EQUAL(data.PM_HUM, trh ? 64 : 0);
+  }
+}
+
+TEST(fixed_variant_skips_other_frame_lengths)
+{
+  PmsEmulator emulator(PMS_VARIANT_PMS5003ST);
+  emulator.setData(sample());
+  PmsDriver pms;
+  pms.begin(emulator, PMS_VARIANT_PMS5003);
+  PmsDriver::DATA data;
+  CHECK_EQUAL(readFrames(pms, emulator, 3, data), 0);
+}
+
+TEST(template_and_runtime_decode_agree)
+{
+  uint8_t payload[2 * 17];
+  for (uint8_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = i * 37 + 11;
+  }
+  PmsDriver::DATA a, b;
+  PmsDriver::decode<PMS_VARIANT_PMS5003T>(payload, a);
+  PmsDriver::decode(PMS_VARIANT_PMS5003T, payload, b);
+  CHECK(memcmp(&a, &b, sizeof(a)) == 0);
+  PmsDriver::decode<PMS_VARIANT_PMS5003ST>(payload, a);
+  PmsDriver::decode(PMS_VARIANT_PMS5003ST, payload, b);
+  CHECK(memcmp(&a, &b, sizeof(a)) == 0);
+  // the PMS7003 shares the PMS5003 layout
+  PmsDriver::decode<PMS_VARIANT_PMS5003>(payload, a);
+  PmsDriver::decode(PMS_VARIANT_PMS7003, payload, b);
+  CHECK(memcmp(&a, &b, sizeof(a)) == 0);
+}
+
+TEST(auto_detects_the_frame_length)
+{
+  PmsEmulator emulator(PMS_VARIANT_PMS5003ST);
+  emulator.setData(sample());
+  PmsDriver pms;
+  pms.begin(emulator);
+  CHECK_EQUAL(pms.getVariant(), PMS_VARIANT_AUTO);
+  PmsDriver::DATA data;
+  CHECK_EQUAL(readFrames(pms, emulator, 1, data), 1);
+  CHECK_EQUAL(pms.getVariant(), PMS_VARIANT_PMS5003ST);
+  CHECK_EQUAL(data.AMB_HCHO, 3);
+  CHECK_EQUAL(data.PM_TMP, -7);
+}
+
+TEST(auto_detects_a_pms5003t)
+{
+  PmsEmulator emulator(PMS_VARIANT_PMS5003T);
+  PmsDriver::DATA data = sample();
+  data.PM_AE_UG_2_5 = 12;
+  // small counts, then 22.0 C and 45.0 %RH: not in decreasing order
+  data.PM_RAW_2_5 = 4;
+  data.PM_TMP = 22;
+  data.PM_HUM = 45;
+  emulator.setData(data);
+
+  PmsDriver pms;
+  pms.begin(emulator);
+  PmsDriver::DATA read;
+  CHECK_EQUAL(readFrames(pms, emulator, PmsDriver::DETECT_FRAMES - 1, read), PmsDriver::DETECT_FRAMES - 1);
+  CHECK_EQUAL(pms.getVariant(), PMS_VARIANT_AUTO);
+  // until then the words are decoded as PMS5003 counts
+  CHECK_EQUAL(read.PM_RAW_5_0, 220);
+  CHECK_EQUAL(read.PM_TMP, 0);
+
+  CHECK_EQUAL(readFrames(pms, emulator, 1, read), 1);
+  CHECK_EQUAL(pms.getVariant(), PMS_VARIANT_PMS5003T);
+  CHECK_EQUAL(read.PM_TMP, 22);
+  CHECK_EQUAL(read.PM_HUM, 45);
+  CHECK_EQUAL(read.PM_RAW_5_0, 0);
+  CHECK_EQUAL(read.PM_AE_UG_2_5, 12);
+}
+
+TEST(auto_detects_a_pms5003_by_its_counts)
+{
+  PmsEmulator emulator(PMS_VARIANT_PMS5003);
+  PmsDriver::DATA data = sample();
+  // decreasing, and more than 100.0 C in the temperature word
+  data.PM_RAW_0_3 = 9000;
+  data.PM_RAW_0_5 = 6000;
+  data.PM_RAW_1_0 = 4000;
+  data.PM_RAW_2_5 = 2500;
+  data.PM_RAW_5_0 = 1500;
+  data.PM_RAW_10_0 = 1200;
+  emulator.setData(data);
+
+  PmsDriver pms;
+  pms.begin(emulator);
+  PmsDriver::DATA read;
+  CHECK_EQUAL(readFrames(pms, emulator, PmsDriver::DETECT_FRAMES, read), PmsDriver::DETECT_FRAMES);
+  CHECK_EQUAL(pms.getVariant(), PMS_VARIANT_PMS5003);
+  CHECK_EQUAL(read.PM_RAW_10_0, 1200);
+}
+
+TEST(clean_air_pms5003_stays_undecided)
+{
+  PmsEmulator emulator(PMS_VARIANT_PMS5003);
+  emulator.setPm(8);
+  PmsDriver pms;
+  pms.begin(emulator);
+  PmsDriver::DATA read;
+  CHECK_EQUAL(readFrames(pms, emulator, 20, read), 20);
+  CHECK_EQUAL(pms.getVariant(), PMS_VARIANT_AUTO);
+  CHECK_EQUAL(read.PM_AE_UG_2_5, 8);
+  CHECK_EQUAL(read.PM_RAW_0_3, 150 + 8 * 60);
+}
+
+// A PMS5003T in dusty air: the counts up to 2.5um are larger than the
+// temperature, which is larger than the humidity, so the frame reads as
+// a PMS5003 as well.
+TEST(ambiguous_pms5003t_frames_do_not_vote)
+{
+  PmsEmulator emulator(PMS_VARIANT_PMS5003T);
+  PmsDriver::DATA ambiguous = sample();
+  ambiguous.PM_RAW_0_3 = 60000;
+  ambiguous.PM_RAW_0_5 = 21640;
+  ambiguous.PM_RAW_1_0 = 3605;
+  ambiguous.PM_RAW_2_5 = 400;
+  ambiguous.PM_TMP = 30;
+  ambiguous.PM_HUM = 25;
+  PmsDriver::DATA clear = ambiguous;
+  clear.PM_RAW_2_5 = 200;
+
+  PmsDriver pms;
+  pms.begin(emulator);
+  PmsDriver::DATA read;
+  emulator.setData(ambiguous);
+  CHECK_EQUAL(readFrames(pms, emulator, 10, read), 10);
+  CHECK_EQUAL(pms.getVariant(), PMS_VARIANT_AUTO);
+
+  // nor do they break a run of frames that do
+  for (uint8_t i = 0; i < PmsDriver::DETECT_FRAMES; i++) {
+    emulator.setData(clear);
+    readFrames(pms, emulator, 1, read);
+    emulator.setData(ambiguous);
+    readFrames(pms, emulator, 1, read);
+  }
+  CHECK_EQUAL(pms.getVariant(), PMS_VARIANT_PMS5003T);
+  CHECK_EQUAL(read.PM_TMP, 30);
+  CHECK_EQUAL(read.PM_HUM, 25);
+}
+
+TEST(corrupt_frames_are_dropped)
+{
+  PmsEmulator emulator(PMS_VARIANT_PMS5003T);
+  PmsDriver::DATA data = sample();
+  data.PM_TMP = 21;
+  data.PM_HUM = 40;
+  data.PM_RAW_2_5 = 1;
+  emulator.setData(data);
+  emulator.setCorruptEvery(2);
+  PmsDriver pms;
+  pms.begin(emulator);
+  PmsDriver::DATA read;
+  CHECK_EQUAL(readFrames(pms, emulator, 10, read), 5);
+  CHECK_EQUAL(pms.getVariant(), PMS_VARIANT_PMS5003T);
+}
+
+int main()
+{
+  RUN(fixed_variants_decode_their_layouts);
+  RUN(fixed_variant_skips_other_frame_lengths);
+  RUN(template_and_runtime_decode_agree);
+  RUN(auto_detects_the_frame_length);
+  RUN(auto_detects_a_pms5003t);
+  RUN(auto_detects_a_pms5003_by_its_counts);
+  RUN(clean_air_pms5003_stays_undecided);
+  RUN(ambiguous_pms5003t_frames_do_not_vote);
+  RUN(corrupt_frames_are_dropped);
+  return Test_result();
+}
@@ -0,0 +1,271 @@
+/*
+  poller_test.cpp - ConditionalPoller against a local HTTP stand-in
+
+  The stand-in serves the fixtures/display_*.json documents like the
+  display API: with an ETag and Last-Modified, a 304 for a matching
+  If-None-Match, a 500 on /fail and no ETag on /noetag.
+*/
+
+#include "AirGradientPoller.h"
+#include "ArduinoHost.h"
+#include "HostSocket.h"
+
+#include "test.h"
+
+#include <atomic>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+class HttpStandIn
+{
+  public:
+    std::atomic<int> fixture;
+    std::atomic<int> requests;
+
+    HttpStandIn() : fixture(0), requests(0), _stopping(false) {}
+
+    bool start()
+    {
+      for (const char* name : { "display_a.json", "display_b.json", "display_c.json" }) {
+        std::string path = std::string(FIXTURE_DIR) + "/" + name;
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == NULL) {
+          return false;
+        }
+        std::string body;
+        char buf[512];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+          body.append(buf, n);
+        }
+        fclose(file);
+        _fixtures.push_back(body);
+      }
+      if (!_server.begin()) {
+        return false;
+      }
+      _thread = std::thread(&HttpStandIn::run, this);
+      return true;
+    }
+
+    void stop()
+    {
+      _stopping = true;
+      _thread.join();
+    }
+
+    uint16_t port() const
+    {
+      return _server.port();
+    }
+
+  private:
+    std::vector<std::string> _fixtures;
+    SocketServer _server;
+    std::thread _thread;
+    std::atomic<bool> _stopping;
+
+    void run()
+    {
+      while (!_stopping) {
+        SocketClient connection;
+        if (_server.accept(connection, 50)) {
+          serve(connection.fd());
+        }
+      }
+    }
+
+    void serve(int fd)
+    {
+      std::string request;
+      char buf[256];
+      while (request.find("\r\n\r\n") == std::string::npos) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+          return;
+        }
+        request.append(buf, n);
+      }
+      requests++;
+      std::string path = request.substr(4, request.find(' ', 4) - 4);
+      const std::string& body = _fixtures[fixture];
+
+      // FNV-1a of the body, so every fixture has its own ETag
+      uint32_t hash = 2166136261u;
+      for (char c : body) {
+        hash = (hash ^ (uint8_t)c) * 16777619u;
+      }
+      char etag[16];
+      snprintf(etag, sizeof(etag), "\"%08x\"", hash);
+
+      std::string response;
+      if (path == "/fail") {
+        response = "HTTP/1.0 500 Internal Server Error\r\n\r\n";
+      } else if (path != "/noetag" && request.find(std::string("If-None-Match: ") + etag) != std::string::npos) {
+        response = std::string("HTTP/1.0 304 Not Modified\r\nETag: ") + etag + "\r\n\r\n";
+      } else {
+        response = "HTTP/1.0 200 OK\r\n";
+        if (path != "/noetag") {
+          response += std::string("ETag: ") + etag + "\r\n";
+        }
+        response += "Last-Modified: Fri, 01 Mar 2024 10:16:00 GMT\r\n"
+                    "Content-Type: application/json\r\n\r\n" + body;
+      }
+      send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+    }
+};
+
+static HttpStandIn standIn;
+
+struct Display {
+  int32_t rco2 = 0;
+  int32_t tvoc = 0;
+  char place[32] = "";
+};
+
+static POLL_Status poll(ConditionalPoller& poller, const char* path, Display& display)
+{
+  JsonField fields[] = {
+    JSON_int("indoor.current.rco2", display.rco2),
+    JSON_int("indoor.current.tvoc", display.tvoc),
+    JSON_string("place.name", display.place),
+  };
+  JsonExtractor json(fields, 3);
+  return poller.poll("127.0.0.1", standIn.port(), path, json);
+}
+
+TEST(first_poll_downloads)
+{
+  standIn.fixture = 0;
+  SocketClient client;
+  ConditionalPoller poller(client, 2000);
+  Display display;
+  CHECK_EQUAL(poll(poller, "/d", display), POLL_CHANGED);
+  CHECK_EQUAL(poller.getHttpCode(), 200);
+  CHECK_EQUAL(display.rco2, 712);
+  CHECK_EQUAL(display.tvoc, 95);
+  CHECK(strcmp(display.place, "AirGradient HQ Chiang Mai") == 0);
+  CHECK_EQUAL(poller.getMisses(), 1);
+  CHECK(poller.getBodyBytes() > 1000);
+}
+
+TEST(not_modified_is_a_hit)
+{
+  standIn.fixture = 0;
+  SocketClient client;
+  ConditionalPoller poller(client, 2000);
+  Display display;
+  CHECK_EQUAL(poll(poller, "/d", display), POLL_CHANGED);
+  uint32_t bodyBytes = poller.getBodyBytes();
+  CHECK_EQUAL(poll(poller, "/d", display), POLL_NOT_MODIFIED);
+  CHECK_EQUAL(poll(poller, "/d", display), POLL_NOT_MODIFIED);
+  CHECK_EQUAL(poller.getHttpCode(), 304);
+  CHECK_EQUAL(poller.getHits(), 2);
+  CHECK_EQUAL(poller.getMisses(), 1);
+  // no body for a 304, and the fields keep their values
+  CHECK_EQUAL(poller.getBodyBytes(), bodyBytes);
+  CHECK_EQUAL(display.rco2, 712);
+}
+
+TEST(new_document_with_new_values_changes)
+{
+  standIn.fixture = 0;
+  SocketClient client;
+  ConditionalPoller poller(client, 2000);
+  Display display;
+  poll(poller, "/d", display);
+  standIn.fixture = 1;
+  CHECK_EQUAL(poll(poller, "/d", display), POLL_CHANGED);
+  CHECK_EQUAL(display.rco2, 713);
+  CHECK_EQUAL(poll(poller, "/d", display), POLL_NOT_MODIFIED);
+}
+
+TEST(new_document_with_same_values_is_unchanged)
+{
+  // display_c only differs from display_b in a field nobody extracts
+  standIn.fixture = 1;
+  SocketClient client;
+  ConditionalPoller poller(client, 2000);
+  Display display;
+  JsonField fields[] = { JSON_int("indoor.current.rco2", display.rco2) };
+  JsonExtractor first(fields, 1);
+  CHECK_EQUAL(poller.poll("127.0.0.1", standIn.port(), "/d", first), POLL_CHANGED);
+  standIn.fixture = 2;
+  JsonExtractor second(fields, 1);
+  CHECK_EQUAL(poller.poll("127.0.0.1", standIn.port(), "/d", second), POLL_UNCHANGED);
+  CHECK_EQUAL(poller.getUnchanged(), 1);
+  CHECK_EQUAL(poller.getMisses(), 2);
+}
+
+TEST(server_error_keeps_fields)
+{
+  standIn.fixture = 0;
+  SocketClient client;
+  ConditionalPoller poller(client, 2000);
+  Display display;
+  poll(poller, "/d", display);
+  CHECK_EQUAL(poll(poller, "/fail", display), POLL_HTTP_ERROR);
+  CHECK_EQUAL(poller.getHttpCode(), 500);
+  CHECK_EQUAL(poller.getErrors(), 1);
+  CHECK_EQUAL(display.rco2, 712);
+}
+
+TEST(without_etag_downloads_every_time)
+{
+  standIn.fixture = 0;
+  SocketClient client;
+  ConditionalPoller poller(client, 2000);
+  Display display;
+  CHECK_EQUAL(poll(poller, "/noetag", display), POLL_CHANGED);
+  // If-Modified-Since alone is not honoured by the stand-in
+  CHECK_EQUAL(poll(poller, "/noetag", display), POLL_UNCHANGED);
+  CHECK_EQUAL(poller.getHits(), 0);
+  CHECK_EQUAL(poller.getMisses(), 2);
+}
+
+TEST(invalidate_forces_download)
+{
+  standIn.fixture = 0;
+  SocketClient client;
+  ConditionalPoller poller(client, 2000);
+  Display display;
+  poll(poller, "/d", display);
+  poller.invalidate();
+  CHECK_EQUAL(poll(poller, "/d", display), POLL_CHANGED);
+  CHECK_EQUAL(poller.getHits(), 0);
+}
+
+TEST(connect_failure)
+{
+  SocketServer closed(0);
+  closed.begin();
+  uint16_t port = closed.port();
+  closed.end();
+
+  SocketClient client;
+  ConditionalPoller poller(client, 2000);
+  JsonExtractor json(NULL, 0);
+  CHECK_EQUAL(poller.poll("127.0.0.1", port, "/d", json), POLL_CONNECT_FAILED);
+  CHECK_EQUAL(poller.getErrors(), 1);
+}
+
+int main()
+{
+  Host_useRealTime(true);
+  if (!standIn.start()) {
+    printf("cannot start the HTTP stand-in\n");
+    return 1;
+  }
+  RUN(first_poll_downloads);
+  RUN(not_modified_is_a_hit);
+  RUN(new_document_with_new_values_changes);
+  RUN(new_document_with_same_values_is_unchanged);
+  RUN(server_error_keeps_fields);
+  RUN(without_etag_downloads_every_time);
+  RUN(invalidate_forces_download);
+  RUN(connect_failure);
+  standIn.stop();
+  return Test_result();
+}
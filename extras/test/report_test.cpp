@@ -0,0 +1,275 @@
+/*
+  report_test.cpp - ReportPolicy decisions and the Measures payload
+*/
+
+#include "AirGradientReport.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "test.h"
+
+static Measures indoor(float co2, float pm25)
+{
+  Measures measures;
+  measures.set(MEASURE_WIFI, -60);
+  measures.set(MEASURE_RCO2, co2);
+  measures.set(MEASURE_PM02, pm25);
+  measures.set(MEASURE_ATMP, 21.5);
+  measures.set(MEASURE_BOOT, 1);
+  return measures;
+}
+
+TEST(first_record_is_sent)
+{
+  ReportPolicy policy(60000);
+  Measures measures = indoor(400, 5);
+  CHECK(policy.shouldSend(measures, 1000));
+  policy.markSent(measures, 1000);
+  CHECK(!policy.shouldSend(measures, 2000));
+  CHECK_EQUAL(policy.getSentCount(), 1);
+  CHECK_EQUAL(policy.getSuppressedCount(), 1);
+}
+
+TEST(absolute_deadband)
+{
+  ReportPolicy policy(60000);
+  policy.setDeadband(MEASURE_RCO2, 10);
+  Measures sent = indoor(400, 5);
+  policy.markSent(sent, 0);
+  CHECK(!policy.shouldSend(indoor(410, 5), 1000));
+  CHECK(!policy.shouldSend(indoor(390, 5), 1000));
+  CHECK(policy.shouldSend(indoor(411, 5), 1000));
+  CHECK(policy.shouldSend(indoor(389, 5), 1000));
+  // measured from the last record sent, not the last one seen
+  for (int co2 = 401; co2 <= 410; co2++) {
+    CHECK(!policy.shouldSend(indoor(co2, 5), 1000));
+  }
+  CHECK_EQUAL(policy.getSuppressedCount(), 12);
+}
+
+TEST(relative_deadband_wins_when_larger)
+{
+  ReportPolicy policy(60000);
+  policy.setDeadband(MEASURE_PM02, 1, 10);
+  policy.markSent(indoor(400, 5), 0);
+  // 10 % of 5 is below 1 ug/m3
+  CHECK(!policy.shouldSend(indoor(400, 6), 1000));
+  CHECK(policy.shouldSend(indoor(400, 6.5), 1000));
+
+  policy.markSent(indoor(400, 80), 1000);
+  CHECK(!policy.shouldSend(indoor(400, 88), 2000));
+  CHECK(!policy.shouldSend(indoor(400, 72), 2000));
+  CHECK(policy.shouldSend(indoor(400, 88.5), 2000));
+}
+
+TEST(any_change_without_a_deadband)
+{
+  ReportPolicy policy(60000);
+  policy.markSent(indoor(400, 5), 0);
+  CHECK(!policy.shouldSend(indoor(400, 5), 1000));
+  CHECK(policy.shouldSend(indoor(401, 5), 1000));
+}
+
+TEST(appearing_and_disappearing_fields)
+{
+  ReportPolicy policy(60000);
+  policy.setDeadband(MEASURE_RCO2, 1000);
+  Measures measures = indoor(400, 5);
+  policy.markSent(measures, 0);
+
+  Measures without = measures;
+  without.clear(MEASURE_RCO2);
+  CHECK(policy.shouldSend(without, 1000));
+  policy.markSent(without, 1000);
+  CHECK(!policy.shouldSend(without, 2000));
+  CHECK(policy.shouldSend(measures, 2000));
+
+  Measures with = measures;
+  with.set(MEASURE_NOX_INDEX, 1);
+  CHECK(policy.shouldSend(with, 2000));
+}
+
+TEST(ignored_fields_never_trigger)
+{
+  ReportPolicy policy(60000);
+  policy.ignore(MEASURE_ATMP);
+  Measures measures = indoor(400, 5);
+  policy.markSent(measures, 0);
+
+  Measures other = measures;
+  other.set(MEASURE_WIFI, -80);
+  other.set(MEASURE_BOOT, 2);
+  other.set(MEASURE_ATMP, 30);
+  CHECK(!policy.shouldSend(other, 1000));
+  other.clear(MEASURE_WIFI);
+  other.clear(MEASURE_ATMP);
+  CHECK(!policy.shouldSend(other, 1000));
+
+  // a deadband makes a field count again
+  policy.setDeadband(MEASURE_BOOT, 0);
+  CHECK(policy.shouldSend(other, 1000));
+}
+
+TEST(heartbeat)
+{
+  ReportPolicy policy(60000);
+  Measures measures = indoor(400, 5);
+  policy.markSent(measures, 5000);
+  CHECK(!policy.shouldSend(measures, 64999));
+  CHECK(policy.shouldSend(measures, 65000));
+
+  // across the millis() wrap
+  policy.markSent(measures, 0xFFFFFFFFUL - 30000);
+  CHECK(!policy.shouldSend(measures, 29000));
+  CHECK(policy.shouldSend(measures, 29999));
+
+  policy.setHeartbeat(10000);
+  policy.markSent(measures, 100);
+  CHECK(policy.shouldSend(measures, 10100));
+}
+
+// markSent() only follows a successful upload, so a failed one is retried
+// with the next record, and with the heartbeat still measured from the
+// last one that arrived.
+TEST(failed_upload_stays_due)
+{
+  ReportPolicy policy(60000);
+  policy.setDeadband(MEASURE_RCO2, 10);
+  policy.markSent(indoor(400, 5), 0);
+  CHECK(policy.shouldSend(indoor(450, 5), 10000));
+  CHECK(policy.shouldSend(indoor(450, 5), 20000));
+  CHECK(policy.shouldSend(indoor(405, 5), 61000));
+  policy.markSent(indoor(450, 5), 30000);
+  CHECK(!policy.shouldSend(indoor(450, 5), 40000));
+  CHECK_EQUAL(policy.getSentCount(), 2);
+}
+
+TEST(reset_sends_the_next_record)
+{
+  ReportPolicy policy(60000);
+  Measures measures = indoor(400, 5);
+  policy.markSent(measures, 0);
+  policy.reset();
+  CHECK(policy.shouldSend(measures, 1000));
+  policy.markSent(measures, 1000);
+  CHECK(!policy.shouldSend(measures, 2000));
+}
+
+TEST(json_has_the_server_format)
+{
+  Measures measures;
+  measures.set(MEASURE_WIFI, -62.4);
+  measures.set(MEASURE_RCO2, 612.5);
+  measures.set(MEASURE_ATMP, -3.456);
+  measures.set(MEASURE_RHUM, 48);
+  char buf[MEASURES_JSON_SIZE];
+  size_t len = Measures_writeJson(measures, buf, sizeof(buf));
+  CHECK_EQUAL(len, strlen(buf));
+  CHECK(strcmp(buf, "{\"wifi\":-62, \"rco2\":613, \"atmp\":-3.46, \"rhum\":48}") == 0);
+
+  Measures empty;
+  CHECK_EQUAL(Measures_writeJson(empty, buf, sizeof(buf)), 2);
+  CHECK(strcmp(buf, "{}") == 0);
+  // too small a buffer writes nothing
+  CHECK_EQUAL(Measures_writeJson(measures, buf, 20), 0);
+
+  CHECK_EQUAL(Measures_writeValue(measures, MEASURE_ATMP, buf, sizeof(buf)), 5);
+  CHECK(strcmp(buf, "-3.46") == 0);
+  CHECK_EQUAL(Measures_writeValue(measures, MEASURE_PM02, buf, sizeof(buf)), 0);
+}
+
+// Every subset of some fields, each written and read back
+TEST(json_round_trip_with_absent_fields)
+{
+  const float values[MEASURE_COUNT] = { -71, 1234, 3, 12, 17, 2450, 104, 1, 23.75, 61, 42 };
+  for (uint16_t mask = 0; mask < (1 << MEASURE_COUNT); mask += 7) {
+    Measures measures;
+    for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+      if (mask & (1 << i)) {
+        measures.set((Measure_Field)i, values[i] * (mask % 3 == 0 ? -1 : 1));
+      }
+    }
+    char buf[MEASURES_JSON_SIZE];
+    size_t len = Measures_writeJson(measures, buf, sizeof(buf));
+    CHECK(len > 0);
+
+    Measures read;
+    read.set(MEASURE_RCO2, 999);
+    CHECK(Measures_parseJson(buf, len, read));
+    CHECK_EQUAL(read.present, measures.present);
+    for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+      if (measures.has((Measure_Field)i)) {
+        CHECK(read.get((Measure_Field)i) == measures.get((Measure_Field)i));
+      }
+    }
+  }
+}
+
+TEST(largest_record_fits)
+{
+  Measures measures;
+  for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+    measures.set((Measure_Field)i, i == MEASURE_ATMP ? -21474836.47 : -2147483647.0);
+  }
+  char buf[MEASURES_JSON_SIZE];
+  size_t len = Measures_writeJson(measures, buf, sizeof(buf));
+  CHECK(len > 0);
+  CHECK(len < sizeof(buf));
+  Measures read;
+  CHECK(Measures_parseJson(buf, len, read));
+  CHECK_EQUAL(read.present, measures.present);
+}
+
+TEST(parse_skips_what_it_does_not_know)
+{
+  const char* payload = " { \"rco2\" : 5e2, \"channels\": {\"1\": {\"pm02\": 7, \"x\": [1, \"]\"]}},"
+                        " \"pm02\": null, \"serialno\": \"ab\\\"c\", \"atmp\": -1.25E+1 } ";
+  Measures read;
+  CHECK(Measures_parseJson(payload, strlen(payload), read));
+  CHECK(read.has(MEASURE_RCO2));
+  CHECK(read.get(MEASURE_RCO2) == 500);
+  CHECK(!read.has(MEASURE_PM02));
+  CHECK(read.has(MEASURE_ATMP));
+  CHECK(read.get(MEASURE_ATMP) == -12.5f);
+
+  // not NUL terminated: only len counts
+  char buf[] = { '{', '"', 'r', 'h', 'u', 'm', '"', ':', '4', '0', '}', 'x' };
+  CHECK(Measures_parseJson(buf, sizeof(buf) - 1, read));
+  CHECK(read.has(MEASURE_RHUM));
+  CHECK(!read.has(MEASURE_RCO2));
+}
+
+TEST(parse_rejects_malformed_payloads)
+{
+  const char* bad[] = {
+    "", "[]", "{", "{\"rco2\"}", "{\"rco2\":}", "{\"rco2\":1,}", "{\"rco2\":1 \"pm02\":2}",
+    "{\"rco2\":-}", "{\"rco2\":1.}", "{\"rco2\":1e}", "{\"x\":{\"a\":1}", "{\"x\":\"abc}", "{} x"
+  };
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    Measures read;
+    if (Measures_parseJson(bad[i], strlen(bad[i]), read)) {
+      printf("accepted: %s\n", bad[i]);
+      CHECK(false);
+    }
+  }
+}
+
+int main()
+{
+  RUN(first_record_is_sent);
+  RUN(absolute_deadband);
+  RUN(relative_deadband_wins_when_larger);
+  RUN(any_change_without_a_deadband);
+  RUN(appearing_and_disappearing_fields);
+  RUN(ignored_fields_never_trigger);
+  RUN(heartbeat);
+  RUN(failed_upload_stays_due);
+  RUN(reset_sends_the_next_record);
+  RUN(json_has_the_server_format);
+  RUN(json_round_trip_with_absent_fields);
+  RUN(largest_record_fits);
+  RUN(parse_skips_what_it_does_not_know);
+  RUN(parse_rejects_malformed_payloads);
+  return Test_result();
+}
@@ -0,0 +1,76 @@
+/*
+  sampler_test.cpp - AdaptiveSampler intervals and failed reads
+*/
+
+#include "AirGradientSampler.h"
+
+#include "test.h"
+
+TEST(first_sample_is_due)
+{
+  AdaptiveSampler sampler(5000, 60000);
+  CHECK(sampler.due(0));
+  sampler.addSample(10, 0);
+  CHECK(!sampler.due(4999));
+  CHECK(sampler.due(5000));
+}
+
+TEST(skip_before_first_sample_waits)
+{
+  // a sensor that never answers is not polled on every loop
+  AdaptiveSampler sampler(5000, 60000);
+  sampler.skip(100);
+  CHECK(!sampler.due(101));
+  CHECK(!sampler.due(5099));
+  CHECK(sampler.due(5100));
+  CHECK_EQUAL(sampler.getSampleCount(), 0);
+}
+
+TEST(skip_after_samples_waits)
+{
+  AdaptiveSampler sampler(5000, 60000);
+  sampler.addSample(10, 0);
+  sampler.skip(5000);
+  CHECK(!sampler.due(9999));
+  CHECK(sampler.due(10000));
+}
+
+TEST(skip_does_not_skew_rate)
+{
+  AdaptiveSampler sampler(5000, 60000);
+  sampler.setThresholds(100, 100);
+  sampler.addSample(10, 0);
+  sampler.skip(5000);
+  sampler.addSample(20, 10000);
+  // 0.3 * 10 over the 10 s since the last sample, not the 5 s since the skip
+  CHECK_EQUAL(sampler.getRatePerMinute() * 10, 180);
+  CHECK_EQUAL(sampler.getAverageIntervalMs(), 10000);
+}
+
+TEST(volatile_signal_shortens_interval)
+{
+  AdaptiveSampler sampler(5000, 60000);
+  sampler.setThresholds(5, 3);
+  uint32_t now = 0;
+  for (int i = 0; i < 20; i++) {
+    sampler.addSample(10, now);
+    now += sampler.getInterval();
+  }
+  CHECK(sampler.getInterval() > 5000);
+  sampler.addSample(200, now);
+  CHECK(sampler.getInterval() < 60000);
+  uint32_t before = sampler.getInterval();
+  now += before;
+  sampler.addSample(400, now);
+  CHECK(sampler.getInterval() <= before / 2 || sampler.getInterval() == 5000);
+}
+
+int main()
+{
+  RUN(first_sample_is_due);
+  RUN(skip_before_first_sample_waits);
+  RUN(skip_after_samples_waits);
+  RUN(skip_does_not_skew_rate);
+  RUN(volatile_signal_shortens_interval);
+  return Test_result();
+}
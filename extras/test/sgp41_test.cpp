@@ -0,0 +1,247 @@
+/*
+  sgp41_test.cpp - Sgp41Driver through I2CBus against an emulated SGP41
+*/
+
+#include "AirGradientEmulator.h"
+#include "AirGradientFixed.h"
+#include "AirGradientSgp41.h"
+#include "ArduinoHost.h"
+
+#include <vector>
+
+#include "test.h"
+
+static uint8_t crc8(uint8_t msb, uint8_t lsb)
+{
+  uint8_t crc = 0xFF;
+  uint8_t data[2] = { msb, lsb };
+  for (uint8_t i = 0; i < 2; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// Conditioning answers the VOC signal, a measurement VOC and NOx, each
+// 50 ms after the command; a read before that is NACKed.
+class Sgp41Device : public I2CDeviceEmulator
+{
+  public:
+    struct Command {
+      uint16_t code;
+      uint32_t at;
+      uint16_t rhTicks;
+      uint16_t tTicks;
+    };
+
+    std::vector<Command> commands;
+    uint16_t voc = 28000;
+    uint16_t nox = 16000;
+    bool corruptNext = false;
+
+    bool receive(const uint8_t* data, uint8_t len)
+    {
+      if (len != 2 && len != 8) {
+        return false;
+      }
+      Command command = { (uint16_t)(data[0] << 8 | data[1]), millis(), 0, 0 };
+      if (len == 8) {
+        if (crc8(data[2], data[3]) != data[4] || crc8(data[5], data[6]) != data[7]) {
+          return false;
+        }
+        command.rhTicks = data[2] << 8 | data[3];
+        command.tTicks = data[5] << 8 | data[6];
+      }
+      commands.push_back(command);
+      _words = command.code == 0x2612 ? 1 : command.code == 0x2619 ? 2 : 0;
+      return true;
+    }
+
+    uint8_t send(uint8_t* data, uint8_t len)
+    {
+      if (_words == 0 || millis() - commands.back().at < 50 || len != 3 * _words) {
+        return 0;
+      }
+      uint16_t words[2] = { voc, nox };
+      for (uint8_t i = 0; i < _words; i++) {
+        data[3 * i] = words[i] >> 8;
+        data[3 * i + 1] = words[i] & 0xFF;
+        data[3 * i + 2] = crc8(words[i] >> 8, words[i] & 0xFF);
+      }
+      if (corruptNext) {
+        corruptNext = false;
+        data[3 * _words - 1] ^= 0x01;
+      }
+      _words = 0;
+      return len;
+    }
+
+  private:
+    uint8_t _words = 0;
+};
+
+struct Sgp41Bench {
+  I2CEmulator wire;
+  Sgp41Device device;
+  I2CBus bus;
+  Sgp41Driver sgp41;
+
+  Sgp41Bench() : bus(wire)
+  {
+    wire.attach(Sgp41Driver::ADDRESS, device);
+  }
+
+  // Updates every 10 ms, like a busy loop(); returns the samples.
+  uint32_t run(uint32_t ms)
+  {
+    uint32_t samples = 0;
+    for (uint32_t t = 0; t < ms; t += 10) {
+      samples += sgp41.update(millis());
+      Host_advance(10);
+    }
+    return samples;
+  }
+};
+
+TEST(conditions_for_ten_seconds)
+{
+  Sgp41Bench bench;
+  uint32_t start = millis();
+  CHECK_EQUAL(bench.sgp41.begin(bench.bus), SGP41_OK);
+
+  CHECK_EQUAL(bench.run(Sgp41Driver::CONDITIONING_TIME), 10);
+  CHECK(bench.sgp41.isConditioning());
+  CHECK(!bench.sgp41.hasNox());
+  CHECK_EQUAL(bench.sgp41.getSrawVoc(), 28000);
+
+  bench.device.voc = 29000;
+  CHECK_EQUAL(bench.run(5000), 5);
+  CHECK(!bench.sgp41.isConditioning());
+  CHECK(bench.sgp41.hasNox());
+  CHECK_EQUAL(bench.sgp41.getSrawVoc(), 29000);
+  CHECK_EQUAL(bench.sgp41.getSrawNox(), 16000);
+  CHECK_EQUAL(bench.sgp41.getError(), SGP41_OK);
+
+  // one command a second: ten conditioning, then measurements
+  std::vector<Sgp41Device::Command>& commands = bench.device.commands;
+  CHECK_EQUAL(commands.size(), 15);
+  for (size_t i = 0; i < commands.size(); i++) {
+    CHECK_EQUAL(commands[i].code, i < 10 ? 0x2612 : 0x2619);
+    CHECK_EQUAL(commands[i].at - start, i * 1000);
+  }
+}
+
+TEST(bad_crc_drops_the_sample)
+{
+  Sgp41Bench bench;
+  bench.sgp41.begin(bench.bus);
+  bench.run(12000);
+  CHECK(bench.sgp41.hasNox());
+
+  bench.device.voc = 31000;
+  bench.device.nox = 17000;
+  bench.device.corruptNext = true;
+  CHECK_EQUAL(bench.run(1000), 0);
+  CHECK_EQUAL(bench.sgp41.getError(), SGP41_CRC_ERROR);
+  CHECK_EQUAL(bench.sgp41.getSrawVoc(), 28000);
+  CHECK_EQUAL(bench.sgp41.getSrawNox(), 16000);
+
+  // the next second reads again
+  CHECK_EQUAL(bench.run(1000), 1);
+  CHECK_EQUAL(bench.sgp41.getError(), SGP41_OK);
+  CHECK_EQUAL(bench.sgp41.getSrawVoc(), 31000);
+  CHECK_EQUAL(bench.sgp41.getSrawNox(), 17000);
+}
+
+TEST(bus_errors_are_reported_and_recovered)
+{
+  Sgp41Bench bench;
+  bench.sgp41.begin(bench.bus);
+  bench.run(11000);
+  // the command write is NACKed
+  bench.wire.failNext(Sgp41Driver::ADDRESS, 3);
+  CHECK_EQUAL(bench.run(1000), 0);
+  CHECK_EQUAL(bench.sgp41.getError(), I2C_NACK_ON_DATA);
+  CHECK_EQUAL(bench.run(1000), 1);
+  CHECK_EQUAL(bench.sgp41.getError(), SGP41_OK);
+}
+
+TEST(compensation_ticks_reach_the_sensor)
+{
+  Sgp41Bench bench;
+  bench.sgp41.begin(bench.bus);
+  std::vector<Sgp41Device::Command>& commands = bench.device.commands;
+
+  // the datasheet defaults until told otherwise
+  bench.run(1000);
+  CHECK_EQUAL(commands.back().rhTicks, 0x8000);
+  CHECK_EQUAL(commands.back().tTicks, 0x6666);
+
+  bench.sgp41.setCompensation(SGP41_humidityTicks(4500), SGP41_temperatureTicks(2150));
+  bench.run(1000);
+  CHECK_EQUAL(commands.back().rhTicks, SGP41_humidityTicks(4500));
+  CHECK_EQUAL(commands.back().tTicks, SGP41_temperatureTicks(2150));
+
+  // an SHT3x reading passes its raw words on
+  TMP_RH_Fixed reading;
+  reading.t_raw = 0x5A3C;
+  reading.rh_raw = 0x7011;
+  reading.t_centi = TMP_RH_rawToCentiCelsius(reading.t_raw);
+  reading.rh_centi = TMP_RH_rawToCentiPercent(reading.rh_raw);
+  reading.error = SHT3XD_NO_ERROR;
+  bench.sgp41.setCompensation(reading);
+  bench.run(10000);
+  CHECK_EQUAL(commands.back().code, 0x2619);
+  CHECK_EQUAL(commands.back().rhTicks, 0x7011);
+  CHECK_EQUAL(commands.back().tTicks, 0x5A3C);
+
+  // a failed one falls back to the defaults
+  reading.error = SHT3XD_CRC_ERROR;
+  bench.sgp41.setCompensation(reading);
+  bench.run(1000);
+  CHECK_EQUAL(commands.back().rhTicks, 0x8000);
+  CHECK_EQUAL(commands.back().tTicks, 0x6666);
+}
+
+TEST(heater_off_cancels_the_pending_read)
+{
+  Sgp41Bench bench;
+  bench.sgp41.begin(bench.bus);
+  bench.run(11000);
+  // the measurement command goes out, its result is due in 50 ms
+  CHECK_EQUAL(bench.run(10), 0);
+  CHECK_EQUAL(bench.device.commands.back().code, 0x2619);
+  CHECK_EQUAL(bench.sgp41.turnHeaterOff(), SGP41_OK);
+  CHECK_EQUAL(bench.device.commands.back().code, 0x3615);
+  CHECK_EQUAL(bench.run(100), 0);
+  // the next second measures again
+  CHECK_EQUAL(bench.run(1000), 1);
+}
+
+TEST(missing_sensor)
+{
+  Sgp41Driver unconfigured;
+  CHECK(!unconfigured.update(0));
+  CHECK_EQUAL(unconfigured.getError(), SGP41_NOT_CONFIGURED);
+  CHECK_EQUAL(unconfigured.turnHeaterOff(), SGP41_NOT_CONFIGURED);
+
+  I2CEmulator wire;
+  I2CBus bus(wire);
+  Sgp41Driver sgp41;
+  CHECK_EQUAL(sgp41.begin(bus), SGP41_OK);
+  CHECK(!sgp41.update(millis()));
+  CHECK_EQUAL(sgp41.getError(), I2C_NACK_ON_ADDRESS);
+}
+
+int main()
+{
+  RUN(conditions_for_ten_seconds);
+  RUN(bad_crc_drops_the_sample);
+  RUN(bus_errors_are_reported_and_recovered);
+  RUN(compensation_ticks_reach_the_sensor);
+  RUN(heater_off_cancels_the_pending_read);
+  RUN(missing_sensor);
+  return Test_result();
+}
@@ -0,0 +1,192 @@
+/*
+  telemetry_test.cpp - TelemetryWriter records through TelemetryDecoder, CSV and JSON
+*/
+
+#include "AirGradientPms.h"
+#include "AirGradientTelemetry.h"
+
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+class BufferPrint : public Print
+{
+  public:
+    std::vector<uint8_t> data;
+
+    size_t write(uint8_t c) { data.push_back(c); return 1; }
+    using Print::write;
+
+    std::string str() const { return std::string(data.begin(), data.end()); }
+};
+
+// Feeds everything written so far; returns the records decoded
+static std::vector<TelemetryRecord> decodeAll(const std::vector<uint8_t>& data, TelemetryDecoder& decoder)
+{
+  std::vector<TelemetryRecord> records;
+  for (size_t i = 0; i < data.size(); i++) {
+    if (decoder.feed(data[i])) {
+      records.push_back(decoder.getRecord());
+    }
+  }
+  return records;
+}
+
+TEST(records_round_trip)
+{
+  BufferPrint out;
+  TelemetryWriter telemetry(out);
+  PmsDriver::DATA data;
+  uint16_t* words = &data.PM_SP_UG_1_0;
+  for (uint8_t i = 0; i < 12; i++) {
+    // 0x00 and 0xFF bytes exercise the COBS codes
+    words[i] = i % 2 == 0 ? 0 : 0xFF00 + i;
+  }
+  telemetry.pms(data, 1000);
+  telemetry.co2(612, 2000);
+  telemetry.tempHum(-512, 4550, 3000);
+  telemetry.sgp41(31000, 16000, 120, -1, 4000);
+  telemetry.text("WiFi connected", 0xFFFFFFFF);
+
+  TelemetryDecoder decoder;
+  std::vector<TelemetryRecord> records = decodeAll(out.data, decoder);
+  CHECK_EQUAL(records.size(), 5);
+  CHECK_EQUAL(decoder.getErrors(), 0);
+  CHECK_EQUAL(decoder.getLost(), 0);
+  if (records.size() != 5) {
+    return;
+  }
+
+  CHECK_EQUAL(records[0].type, TELEMETRY_PMS);
+  CHECK_EQUAL(records[0].timeMs, 1000);
+  CHECK_EQUAL(records[0].count, 12);
+  for (uint8_t i = 0; i < 12; i++) {
+    CHECK_EQUAL(records[0].values[i], words[i]);
+  }
+  CHECK_EQUAL(records[1].values[0], 612);
+  CHECK_EQUAL(records[2].values[0], -512);
+  CHECK_EQUAL(records[2].values[1], 4550);
+  CHECK_EQUAL(records[3].values[1], 16000);
+  CHECK_EQUAL(records[3].values[3], -1);
+  CHECK_EQUAL(records[4].type, TELEMETRY_TEXT);
+  CHECK_EQUAL(records[4].timeMs, 0xFFFFFFFF);
+  CHECK(std::string(records[4].text) == "WiFi connected");
+  CHECK_EQUAL(records[4].seq, 4);
+}
+
+TEST(corrupt_frame_is_counted_not_decoded)
+{
+  BufferPrint out;
+  TelemetryWriter telemetry(out);
+  telemetry.co2(612, 1000);
+  size_t first = out.data.size();
+  telemetry.co2(700, 2000);
+  telemetry.co2(800, 3000);
+  // a bit flip in the payload of the second record
+  out.data[first + 4] ^= 0x10;
+
+  TelemetryDecoder decoder;
+  std::vector<TelemetryRecord> records = decodeAll(out.data, decoder);
+  CHECK_EQUAL(records.size(), 2);
+  CHECK_EQUAL(decoder.getErrors(), 1);
+  CHECK_EQUAL(decoder.getLost(), 1);
+  CHECK_EQUAL(records[1].values[0], 800);
+}
+
+TEST(stray_text_costs_one_frame)
+{
+  BufferPrint out;
+  TelemetryWriter telemetry(out);
+  telemetry.co2(612, 1000);
+  out.print("debug output\r\n");
+  telemetry.co2(700, 2000);
+
+  TelemetryDecoder decoder;
+  std::vector<TelemetryRecord> records = decodeAll(out.data, decoder);
+  CHECK_EQUAL(records.size(), 2);
+  CHECK_EQUAL(decoder.getErrors(), 1);
+  CHECK_EQUAL(decoder.getLost(), 0);
+}
+
+TEST(dropped_bytes_count_as_lost)
+{
+  BufferPrint out;
+  TelemetryWriter telemetry(out);
+  telemetry.co2(612, 1000);
+  size_t first = out.data.size();
+  telemetry.co2(700, 2000);
+  size_t second = out.data.size();
+  telemetry.co2(800, 3000);
+  // the whole second frame went missing
+  out.data.erase(out.data.begin() + first, out.data.begin() + second);
+
+  TelemetryDecoder decoder;
+  std::vector<TelemetryRecord> records = decodeAll(out.data, decoder);
+  CHECK_EQUAL(records.size(), 2);
+  CHECK_EQUAL(decoder.getErrors(), 0);
+  CHECK_EQUAL(decoder.getLost(), 1);
+}
+
+TEST(csv_and_json_output)
+{
+  BufferPrint out;
+  TelemetryWriter telemetry(out);
+  telemetry.tempHum(-512, 4550, 3000);
+  telemetry.sgp41(31000, 16000, 120, -1, 4000);
+  telemetry.text("say \"hi\"", 5000);
+  TelemetryDecoder decoder;
+  std::vector<TelemetryRecord> records = decodeAll(out.data, decoder);
+  CHECK_EQUAL(records.size(), 3);
+  if (records.size() != 3) {
+    return;
+  }
+
+  BufferPrint csv;
+  Telemetry_writeCsvHeader(TELEMETRY_TEMP_HUM, csv);
+  Telemetry_writeCsv(records[0], csv);
+  CHECK(csv.str() == "time_ms,seq,type,atmp,rhum\n3000,0,temp_hum,-5.12,45.50\n");
+
+  BufferPrint json;
+  Telemetry_writeJson(records[1], json);
+  Telemetry_writeJson(records[2], json);
+  CHECK(json.str() ==
+        "{\"time_ms\":4000, \"seq\":1, \"type\":\"sgp41\", \"sraw_voc\":31000, \"sraw_nox\":16000, "
+        "\"tvoc_index\":120, \"nox_index\":-1}\n"
+        "{\"time_ms\":5000, \"seq\":2, \"type\":\"text\", \"text\":\"say 'hi'\"}\n");
+}
+
+TEST(binary_is_smaller_than_csv)
+{
+  BufferPrint out;
+  TelemetryWriter telemetry(out);
+  BufferPrint csv;
+  PmsDriver::DATA data;
+  uint16_t* words = &data.PM_SP_UG_1_0;
+  for (uint8_t i = 0; i < 12; i++) {
+    words[i] = 100 + 97 * i;
+  }
+  for (uint32_t i = 0; i < 100; i++) {
+    telemetry.pms(data, 1000 * i);
+  }
+  TelemetryDecoder decoder;
+  std::vector<TelemetryRecord> records = decodeAll(out.data, decoder);
+  for (size_t i = 0; i < records.size(); i++) {
+    Telemetry_writeCsv(records[i], csv);
+  }
+  CHECK_EQUAL(records.size(), 100);
+  CHECK_EQUAL(telemetry.getBytes(), out.data.size());
+  // 35 bytes per PMS record against about 70 as a CSV line
+  CHECK(3 * out.data.size() < 2 * csv.data.size());
+}
+
+int main()
+{
+  RUN(records_round_trip);
+  RUN(corrupt_frame_is_counted_not_decoded);
+  RUN(stray_text_costs_one_frame);
+  RUN(dropped_bytes_count_as_lost);
+  RUN(csv_and_json_output);
+  RUN(binary_is_smaller_than_csv);
+  return Test_result();
+}
@@ -0,0 +1,46 @@
+/*
+  test.h - Minimal checks for the host tests
+
+    TEST(name) { CHECK(x == 1); CHECK_EQUAL(y, 2); }
+    int main() { RUN(name); return Test_result(); }
+*/
+
+#ifndef AirGradientTest_h
+#define AirGradientTest_h
+
+#include <stdio.h>
+
+static int Test_failures = 0;
+
+#define TEST(name) static void test_##name()
+
+#define RUN(name) \
+  do { \
+    int before = Test_failures; \
+    test_##name(); \
+    printf("%s %s\n", Test_failures == before ? "ok  " : "FAIL", #name); \
+  } while (0)
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      Test_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQUAL(actual, expected) \
+  do { \
+    long long a_ = (long long)(actual), e_ = (long long)(expected); \
+    if (a_ != e_) { \
+      printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_); \
+      Test_failures++; \
+    } \
+  } while (0)
+
+static int Test_result()
+{
+  return Test_failures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,620 @@
+/*
+  Collector.cpp - Host stand-in for the measures upload endpoint
+*/
+
+#include "Collector.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <unordered_set>
+
+static const char SEGMENT_MAGIC[] = { 'A', 'G', 'S', '1' };
+
+int64_t Collector_nowMs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static bool validId(const char* id, size_t length)
+{
+  if (length == 0 || length > CollectorStore::MAX_ID_LENGTH || id[0] == '.') {
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    char c = id[i];
+    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+          c == '_' || c == '-' || c == '.')) {
+      return false;
+    }
+  }
+  return true;
+}
+
+CollectorStore::CollectorStore(const char* dir, uint8_t shards)
+  : _dir(dir), _devices(0), _rows(0), _blocks(0)
+{
+  for (uint8_t i = 0; i < (shards > 0 ? shards : 1); i++) {
+    _shards.push_back(new Shard());
+  }
+}
+
+CollectorStore::~CollectorStore()
+{
+  for (size_t i = 0; i < _shards.size(); i++) {
+    for (auto& entry : _shards[i]->devices) {
+      writeBlock(*entry.second);
+      delete entry.second;
+    }
+    delete _shards[i];
+  }
+}
+
+bool CollectorStore::append(const char* id, size_t idLength, const Measures& measures, int64_t timeMs)
+{
+  if (!validId(id, idLength)) {
+    return false;
+  }
+  std::string key(id, idLength);
+  Shard& shard = *_shards[std::hash<std::string>()(key) % _shards.size()];
+  std::lock_guard<std::mutex> guard(shard.lock);
+
+  Device*& slot = shard.devices[key];
+  if (slot == NULL) {
+    slot = new Device();
+    slot->id = key;
+    slot->windowStart = timeMs;
+    memset(slot->aggregates, 0, sizeof(slot->aggregates));
+    _devices++;
+  }
+  Device& device = *slot;
+
+  device.times.push_back(timeMs);
+  device.present.push_back(measures.present);
+  device.fields |= measures.present;
+  for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+    Measure_Field field = (Measure_Field)i;
+    float value = measures.has(field) ? measures.get(field) : 0;
+    device.values[i].push_back(value);
+    if (!measures.has(field)) {
+      continue;
+    }
+    Aggregate& aggregate = device.aggregates[i];
+    if (aggregate.count == 0 || value < aggregate.min) {
+      aggregate.min = value;
+    }
+    if (aggregate.count == 0 || value > aggregate.max) {
+      aggregate.max = value;
+    }
+    aggregate.count++;
+    aggregate.sum += value;
+  }
+  _rows++;
+
+  if (device.times.size() >= SEGMENT_ROWS) {
+    writeBlock(device);
+  }
+  return true;
+}
+
+void CollectorStore::rollup(int64_t nowMs)
+{
+  for (size_t i = 0; i < _shards.size(); i++) {
+    std::lock_guard<std::mutex> guard(_shards[i]->lock);
+    for (auto& entry : _shards[i]->devices) {
+      writeBlock(*entry.second);
+      writeRollup(*entry.second, nowMs);
+    }
+  }
+}
+
+uint32_t CollectorStore::getDevices() const
+{
+  return _devices;
+}
+
+uint64_t CollectorStore::getRows() const
+{
+  return _rows;
+}
+
+uint64_t CollectorStore::getBlocks() const
+{
+  return _blocks;
+}
+
+static void put(std::vector<uint8_t>& out, const void* data, size_t length)
+{
+  const uint8_t* bytes = (const uint8_t*)data;
+  out.insert(out.end(), bytes, bytes + length);
+}
+
+// Host byte order, which is little endian on every target of the host build
+void CollectorStore::writeBlock(Device& device)
+{
+  uint16_t rows = device.times.size();
+  if (rows == 0) {
+    return;
+  }
+  std::vector<uint8_t> block;
+  put(block, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+  put(block, &rows, 2);
+  put(block, &device.fields, 2);
+  put(block, device.times.data(), 8 * rows);
+  put(block, device.present.data(), 2 * rows);
+  for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+    if (device.fields & (1 << i)) {
+      put(block, device.values[i].data(), 4 * rows);
+    }
+  }
+
+  std::string path = _dir + "/" + device.id + ".seg";
+  FILE* file = fopen(path.c_str(), "ab");
+  if (file != NULL) {
+    fwrite(block.data(), 1, block.size(), file);
+    fclose(file);
+    _blocks++;
+  } else {
+    fprintf(stderr, "cannot write %s\n", path.c_str());
+  }
+
+  device.times.clear();
+  device.present.clear();
+  for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+    device.values[i].clear();
+  }
+  device.fields = 0;
+}
+
+void CollectorStore::writeRollup(Device& device, int64_t nowMs)
+{
+  bool any = false;
+  for (uint8_t i = 0; i < MEASURE_COUNT && !any; i++) {
+    any = device.aggregates[i].count > 0;
+  }
+  if (any) {
+    std::string path = _dir + "/" + device.id + ".rollup.csv";
+    FILE* file = fopen(path.c_str(), "a");
+    if (file != NULL) {
+      if (ftell(file) == 0) {
+        fprintf(file, "window_start_ms,window_end_ms,metric,count,min,max,mean\n");
+      }
+      for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+        const Aggregate& aggregate = device.aggregates[i];
+        if (aggregate.count == 0) {
+          continue;
+        }
+        fprintf(file, "%lld,%lld,%s,%lu,%.2f,%.2f,%.2f\n", (long long)device.windowStart, (long long)nowMs,
+                Measures_key((Measure_Field)i), (unsigned long)aggregate.count, aggregate.min, aggregate.max,
+                aggregate.sum / aggregate.count);
+      }
+      fclose(file);
+    } else {
+      fprintf(stderr, "cannot write %s\n", path.c_str());
+    }
+  }
+  memset(device.aggregates, 0, sizeof(device.aggregates));
+  device.windowStart = nowMs;
+}
+
+bool Collector_readSegments(const char* path, Collector_RowCallback callback, void* context)
+{
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t chunk[65536];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    data.insert(data.end(), chunk, chunk + n);
+  }
+  fclose(file);
+
+  size_t offset = 0;
+  while (offset < data.size()) {
+    if (data.size() - offset < 8 || memcmp(&data[offset], SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0) {
+      return false;
+    }
+    uint16_t rows;
+    uint16_t fields;
+    memcpy(&rows, &data[offset + 4], 2);
+    memcpy(&fields, &data[offset + 6], 2);
+    uint8_t columns = 0;
+    for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+      columns += (fields >> i) & 1;
+    }
+    size_t size = 8 + (size_t)rows * (8 + 2 + 4 * columns);
+    if (data.size() - offset < size) {
+      return false;
+    }
+
+    const uint8_t* times = &data[offset + 8];
+    const uint8_t* present = times + 8 * rows;
+    for (uint16_t row = 0; row < rows; row++) {
+      int64_t timeMs;
+      Measures measures;
+      memcpy(&timeMs, times + 8 * row, 8);
+      memcpy(&measures.present, present + 2 * row, 2);
+      const uint8_t* column = present + 2 * rows;
+      for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+        measures.values[i] = 0;
+        if (fields & (1 << i)) {
+          memcpy(&measures.values[i], column + 4 * row, 4);
+          column += 4 * rows;
+        }
+      }
+      callback(timeMs, measures, context);
+    }
+    offset += size;
+  }
+  return true;
+}
+
+struct CollectorServer::Connection {
+  int fd;
+  std::vector<char> in;
+  // bytes of in already handled
+  size_t start = 0;
+  std::string out;
+  size_t outStart = 0;
+  bool closing = false;
+  bool watchingWrite = false;
+};
+
+struct CollectorServer::Worker {
+  int epollFd;
+  std::thread thread;
+  // also touched by the acceptor
+  std::mutex lock;
+  std::unordered_set<Connection*> connections;
+};
+
+CollectorServer::CollectorServer(CollectorStore& store, uint16_t port, uint8_t threads)
+  : _store(&store), _port(port), _threads(threads > 0 ? threads : 1), _running(false),
+    _requests(0), _errors(0), _connections(0)
+{
+}
+
+CollectorServer::~CollectorServer()
+{
+  end();
+}
+
+bool CollectorServer::begin()
+{
+  _listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (_listenFd < 0) {
+    return false;
+  }
+  int on = 1;
+  setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(_port);
+  socklen_t length = sizeof(address);
+  if (bind(_listenFd, (const sockaddr*)&address, sizeof(address)) != 0 || listen(_listenFd, 1024) != 0 ||
+      getsockname(_listenFd, (sockaddr*)&address, &length) != 0) {
+    close(_listenFd);
+    _listenFd = -1;
+    return false;
+  }
+  _port = ntohs(address.sin_port);
+
+  _running = true;
+  for (uint8_t i = 0; i < _threads; i++) {
+    Worker* worker = new Worker();
+    worker->epollFd = epoll_create1(0);
+    _workers.push_back(worker);
+    worker->thread = std::thread(&CollectorServer::workerLoop, this, std::ref(*worker));
+  }
+  _acceptor = std::thread(&CollectorServer::acceptLoop, this);
+  return true;
+}
+
+void CollectorServer::end()
+{
+  if (!_running) {
+    return;
+  }
+  _running = false;
+  _acceptor.join();
+  close(_listenFd);
+  _listenFd = -1;
+  for (size_t i = 0; i < _workers.size(); i++) {
+    Worker* worker = _workers[i];
+    worker->thread.join();
+    for (Connection* connection : worker->connections) {
+      close(connection->fd);
+      delete connection;
+    }
+    close(worker->epollFd);
+    delete worker;
+  }
+  _workers.clear();
+}
+
+uint16_t CollectorServer::port() const
+{
+  return _port;
+}
+
+uint64_t CollectorServer::getRequests() const
+{
+  return _requests;
+}
+
+uint64_t CollectorServer::getErrors() const
+{
+  return _errors;
+}
+
+uint64_t CollectorServer::getConnections() const
+{
+  return _connections;
+}
+
+// Hands the connections to the workers in turn
+void CollectorServer::acceptLoop()
+{
+  size_t next = 0;
+  while (_running) {
+    pollfd listener = { _listenFd, POLLIN, 0 };
+    if (poll(&listener, 1, 100) <= 0) {
+      continue;
+    }
+    int fd;
+    while ((fd = accept4(_listenFd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+      int on = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+      Connection* connection = new Connection();
+      connection->fd = fd;
+      Worker& worker = *_workers[next++ % _workers.size()];
+      {
+        std::lock_guard<std::mutex> guard(worker.lock);
+        worker.connections.insert(connection);
+      }
+      epoll_event event;
+      event.events = EPOLLIN;
+      event.data.ptr = connection;
+      epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, fd, &event);
+      _connections++;
+    }
+  }
+}
+
+void CollectorServer::workerLoop(Worker& worker)
+{
+  epoll_event events[64];
+  while (_running) {
+    int n = epoll_wait(worker.epollFd, events, 64, 100);
+    for (int i = 0; i < n; i++) {
+      Connection& connection = *(Connection*)events[i].data.ptr;
+      bool open = true;
+      if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        open = onReadable(worker, connection);
+      }
+      if (open && (events[i].events & EPOLLOUT)) {
+        open = onWritable(worker, connection);
+      }
+      if (!open) {
+        epoll_ctl(worker.epollFd, EPOLL_CTL_DEL, connection.fd, NULL);
+        close(connection.fd);
+        std::lock_guard<std::mutex> guard(worker.lock);
+        worker.connections.erase(&connection);
+        delete &connection;
+      }
+    }
+  }
+}
+
+bool CollectorServer::onReadable(Worker& worker, Connection& connection)
+{
+  bool peerClosed = false;
+  for (;;) {
+    size_t used = connection.in.size();
+    connection.in.resize(used + 16384);
+    ssize_t n = recv(connection.fd, connection.in.data() + used, 16384, 0);
+    connection.in.resize(used + (n > 0 ? n : 0));
+    if (n > 0) {
+      continue;
+    }
+    if (n == 0) {
+      peerClosed = true;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      return false;
+    }
+    break;
+  }
+
+  bool open = handleRequests(connection) && !peerClosed;
+  return onWritable(worker, connection) && open;
+}
+
+bool CollectorServer::onWritable(Worker& worker, Connection& connection)
+{
+  while (connection.outStart < connection.out.size()) {
+    ssize_t n = send(connection.fd, connection.out.data() + connection.outStart,
+                     connection.out.size() - connection.outStart, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        return false;
+      }
+      break;
+    }
+    connection.outStart += n;
+  }
+
+  bool pending = connection.outStart < connection.out.size();
+  if (!pending) {
+    connection.out.clear();
+    connection.outStart = 0;
+  }
+  if (pending != connection.watchingWrite) {
+    epoll_event event;
+    event.events = EPOLLIN | (pending ? (uint32_t)EPOLLOUT : 0);
+    event.data.ptr = &connection;
+    epoll_ctl(worker.epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+    connection.watchingWrite = pending;
+  }
+  return pending || !connection.closing;
+}
+
+static bool equalsIgnoreCase(const char* a, size_t length, const char* b)
+{
+  if (strlen(b) != length) {
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    char c = a[i] >= 'A' && a[i] <= 'Z' ? a[i] + 'a' - 'A' : a[i];
+    if (c != b[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool containsIgnoreCase(const char* a, size_t length, const char* b)
+{
+  size_t n = strlen(b);
+  for (size_t i = 0; i + n <= length; i++) {
+    if (equalsIgnoreCase(a + i, n, b)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CollectorServer::handleRequests(Connection& connection)
+{
+  while (!connection.closing) {
+    const char* data = connection.in.data() + connection.start;
+    size_t available = connection.in.size() - connection.start;
+    const char* headerEnd = (const char*)memmem(data, available, "\r\n\r\n", 4);
+    if (headerEnd == NULL) {
+      if (available > MAX_HEADER) {
+        respond(connection, 400, true);
+      }
+      break;
+    }
+    size_t headerLength = headerEnd + 4 - data;
+
+    // request line: method path version
+    const char* lineEnd = (const char*)memchr(data, '\r', headerLength);
+    const char* method = data;
+    const char* space = (const char*)memchr(method, ' ', lineEnd - method);
+    const char* path = space != NULL ? space + 1 : NULL;
+    const char* pathEnd = path != NULL ? (const char*)memchr(path, ' ', lineEnd - path) : NULL;
+    if (pathEnd == NULL) {
+      respond(connection, 400, true);
+      break;
+    }
+    const char* version = pathEnd + 1;
+    bool http11 = lineEnd - version == 8 && memcmp(version, "HTTP/1.1", 8) == 0;
+
+    size_t contentLength = 0;
+    bool keepAlive = http11;
+    const char* line = lineEnd + 2;
+    while (line < headerEnd) {
+      const char* end = (const char*)memchr(line, '\r', headerEnd + 2 - line);
+      const char* colon = (const char*)memchr(line, ':', end - line);
+      if (colon != NULL) {
+        const char* value = colon + 1;
+        while (value < end && *value == ' ') {
+          value++;
+        }
+        if (equalsIgnoreCase(line, colon - line, "content-length")) {
+          contentLength = strtoul(value, NULL, 10);
+        } else if (equalsIgnoreCase(line, colon - line, "connection")) {
+          if (containsIgnoreCase(value, end - value, "close")) {
+            keepAlive = false;
+          } else if (containsIgnoreCase(value, end - value, "keep-alive")) {
+            keepAlive = true;
+          }
+        }
+      }
+      line = end + 2;
+    }
+
+    if (contentLength > MAX_BODY) {
+      respond(connection, 413, true);
+      break;
+    }
+    if (available < headerLength + contentLength) {
+      break;
+    }
+    int status = handle(method, space - method, path, pathEnd - path, data + headerLength, contentLength);
+    respond(connection, status, !keepAlive);
+    connection.start += headerLength + contentLength;
+  }
+
+  // keep the buffer from growing with every pipelined request
+  if (connection.start == connection.in.size()) {
+    connection.in.clear();
+    connection.start = 0;
+  } else if (connection.start > 65536) {
+    connection.in.erase(connection.in.begin(), connection.in.begin() + connection.start);
+    connection.start = 0;
+  }
+  return !connection.closing || connection.outStart < connection.out.size();
+}
+
+// POST .../sensors/<id>/measures, with or without the "airgradient:" of the examples
+int CollectorServer::handle(const char* method, size_t methodLength, const char* path, size_t pathLength,
+                            const char* body, size_t bodyLength)
+{
+  const char* sensors = (const char*)memmem(path, pathLength, "/sensors/", 9);
+  const char* suffix = "/measures";
+  size_t suffixLength = strlen(suffix);
+  if (sensors == NULL || pathLength < suffixLength ||
+      memcmp(path + pathLength - suffixLength, suffix, suffixLength) != 0) {
+    return 404;
+  }
+  const char* id = sensors + 9;
+  const char* idEnd = path + pathLength - suffixLength;
+  if (idEnd - id > 12 && memcmp(id, "airgradient:", 12) == 0) {
+    id += 12;
+  }
+  if (idEnd <= id || memchr(id, '/', idEnd - id) != NULL) {
+    return 404;
+  }
+  if (methodLength != 4 || memcmp(method, "POST", 4) != 0) {
+    return 405;
+  }
+
+  Measures measures;
+  if (!Measures_parseJson(body, bodyLength, measures) ||
+      !_store->append(id, idEnd - id, measures, Collector_nowMs())) {
+    return 400;
+  }
+  return 200;
+}
+
+void CollectorServer::respond(Connection& connection, int status, bool close)
+{
+  const char* reason = status == 200 ? "OK" : status == 400 ? "Bad Request" : status == 404 ? "Not Found" :
+                       status == 405 ? "Method Not Allowed" : "Payload Too Large";
+  char header[128];
+  snprintf(header, sizeof(header), "HTTP/1.1 %d %s\r\nContent-Length: 0\r\n%s\r\n", status, reason,
+           close ? "Connection: close\r\n" : "");
+  connection.out += header;
+  _requests++;
+  if (status != 200) {
+    _errors++;
+  }
+  if (close) {
+    connection.closing = true;
+  }
+}
@@ -0,0 +1,158 @@
+/*
+  Collector.h - Host stand-in for the measures upload endpoint
+
+  What the examples POST to sensors/airgradient:<id>/measures, received
+  and stored on a PC, for as many devices as a bench or the fleet
+  simulator throws at it:
+
+    CollectorStore store("data");
+    CollectorServer server(store, 8080, 4);   // 4 worker threads
+    server.begin();
+    for (;;) {
+      sleep(60);
+      store.rollup(Collector_nowMs());
+    }
+
+  CollectorServer speaks HTTP/1.1 with keep-alive and pipelining. One
+  thread accepts and hands each connection to a worker, which serves all
+  of its connections from one epoll loop. The payload is parsed with
+  Measures_parseJson() where it lies in the connection's buffer. Answers:
+  200 for a stored record, 400 for a payload that does not parse, 404
+  for another path, 405 for another method, 413 for more than
+  MAX_BODY bytes.
+
+  CollectorStore keeps the rows of each device in columns and appends
+  them as a block to <dir>/<id>.seg once SEGMENT_ROWS are together, or
+  at the next rollup. Block, integers little endian:
+
+    "AGS1"  rows (2)  fields (2)  time_ms (8 x rows)  present (2 x rows)
+    then for each bit set in fields, in Measure_Field order: float x rows
+
+  fields is the union of the present masks, so a metric a device does
+  not have costs nothing. rollup() also appends one line per metric to
+  <dir>/<id>.rollup.csv for the rows since the previous rollup:
+
+    window_start_ms,window_end_ms,metric,count,min,max,mean
+
+  Devices are spread over shards by the hash of their id, each with its
+  own lock, so workers only wait for each other on the same shard.
+*/
+
+#ifndef Collector_h
+#define Collector_h
+
+#include "AirGradientReport.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+int64_t Collector_nowMs();
+
+class CollectorStore
+{
+  public:
+    static const uint16_t SEGMENT_ROWS = 256;
+    static const uint8_t MAX_ID_LENGTH = 64;
+
+    CollectorStore(const char* dir, uint8_t shards = 16);
+    ~CollectorStore();
+
+    // false for an id that is empty, too long or not a file name
+    bool append(const char* id, size_t idLength, const Measures& measures, int64_t timeMs);
+    // Writes the rows not written yet and the rollup lines of every device
+    // with rows since the previous call.
+    void rollup(int64_t nowMs);
+
+    uint32_t getDevices() const;
+    uint64_t getRows() const;
+    uint64_t getBlocks() const;
+
+  private:
+    struct Aggregate {
+      uint32_t count;
+      float min;
+      float max;
+      double sum;
+    };
+
+    struct Device {
+      std::string id;
+      std::vector<int64_t> times;
+      std::vector<uint16_t> present;
+      std::vector<float> values[MEASURE_COUNT];
+      uint16_t fields = 0;
+      int64_t windowStart = 0;
+      Aggregate aggregates[MEASURE_COUNT];
+    };
+
+    struct Shard {
+      std::mutex lock;
+      std::unordered_map<std::string, Device*> devices;
+    };
+
+    std::string _dir;
+    std::vector<Shard*> _shards;
+    std::atomic<uint32_t> _devices;
+    std::atomic<uint64_t> _rows;
+    std::atomic<uint64_t> _blocks;
+
+    void writeBlock(Device& device);
+    void writeRollup(Device& device, int64_t nowMs);
+};
+
+// Calls back once per row of a segment file; false if the file is damaged.
+typedef void (*Collector_RowCallback)(int64_t timeMs, const Measures& measures, void* context);
+bool Collector_readSegments(const char* path, Collector_RowCallback callback, void* context);
+
+class CollectorServer
+{
+  public:
+    static const uint16_t MAX_HEADER = 8192;
+    static const uint16_t MAX_BODY = 4096;
+
+    CollectorServer(CollectorStore& store, uint16_t port, uint8_t threads);
+    ~CollectorServer();
+
+    bool begin();
+    void end();
+    // The bound port, also after begin() with port 0
+    uint16_t port() const;
+
+    uint64_t getRequests() const;
+    // Answers other than 200
+    uint64_t getErrors() const;
+    uint64_t getConnections() const;
+
+  private:
+    struct Connection;
+    struct Worker;
+
+    CollectorStore* _store;
+    uint16_t _port;
+    uint8_t _threads;
+    int _listenFd = -1;
+    std::vector<Worker*> _workers;
+    std::thread _acceptor;
+    std::atomic<bool> _running;
+
+    std::atomic<uint64_t> _requests;
+    std::atomic<uint64_t> _errors;
+    std::atomic<uint64_t> _connections;
+
+    void acceptLoop();
+    void workerLoop(Worker& worker);
+    // false once the connection is to be closed
+    bool onReadable(Worker& worker, Connection& connection);
+    bool onWritable(Worker& worker, Connection& connection);
+    // Handles the complete requests in the buffer
+    bool handleRequests(Connection& connection);
+    int handle(const char* method, size_t methodLength, const char* path, size_t pathLength,
+               const char* body, size_t bodyLength);
+    void respond(Connection& connection, int status, bool close);
+};
+
+#endif
@@ -0,0 +1,491 @@
+/*
+  Fleet.cpp - Many virtual AirGradient devices on one host
+*/
+
+#include "Fleet.h"
+
+#include <chrono>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static uint64_t nowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Values below 8 get a bucket each, above that every power of two is
+// split in 8.
+static uint16_t bucketOf(uint64_t value)
+{
+  if (value < 8) {
+    return value;
+  }
+  uint8_t msb = 63 - __builtin_clzll(value);
+  uint16_t bucket = (msb - 2) * 8 + ((value >> (msb - 3)) & 7);
+  return bucket < FleetHistogram::BUCKETS ? bucket : FleetHistogram::BUCKETS - 1;
+}
+
+// The middle of the bucket
+static uint64_t bucketValue(uint16_t bucket)
+{
+  if (bucket < 8) {
+    return bucket;
+  }
+  uint8_t msb = bucket / 8 + 2;
+  uint64_t width = 1ULL << (msb - 3);
+  return (8 + bucket % 8) * width + width / 2;
+}
+
+void FleetHistogram::add(uint64_t value)
+{
+  counts[bucketOf(value)]++;
+  count++;
+  if (value > max) {
+    max = value;
+  }
+}
+
+void FleetHistogram::merge(const FleetHistogram& other)
+{
+  for (uint16_t i = 0; i < BUCKETS; i++) {
+    counts[i] += other.counts[i];
+  }
+  count += other.count;
+  if (other.max > max) {
+    max = other.max;
+  }
+}
+
+uint64_t FleetHistogram::percentile(double p) const
+{
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(p * (count - 1)) + 1;
+  // the largest is known exactly
+  if (rank >= count) {
+    return max;
+  }
+  uint64_t seen = 0;
+  for (uint16_t i = 0; i < BUCKETS; i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      uint64_t value = bucketValue(i);
+      return value < max ? value : max;
+    }
+  }
+  return max;
+}
+
+FleetUploader::FleetUploader(const std::string& host, uint16_t port) : _host(host), _port(port)
+{
+}
+
+FleetUploader::~FleetUploader()
+{
+  disconnect();
+}
+
+// A kept-alive connection the server has since closed only shows when
+// it is used, so a request that gets no answer on one is sent once more
+// on a new connection.
+int FleetUploader::post(const char* path, const char* body, size_t length)
+{
+  char header[256];
+  int headerLength = snprintf(header, sizeof(header),
+                              "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\n"
+                              "Content-Length: %u\r\n\r\n",
+                              path, _host.c_str(), (unsigned)length);
+  if (headerLength <= 0 || headerLength >= (int)sizeof(header)) {
+    return 0;
+  }
+  std::string request(header, headerLength);
+  request.append(body, length);
+
+  for (uint8_t attempt = 0; attempt < 2; attempt++) {
+    bool reused = _fd >= 0;
+    if (!reused && !connect()) {
+      return 0;
+    }
+    bool closed = true;
+    int status = 0;
+    if (send(_fd, request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t)request.size()) {
+      status = readResponse(closed);
+    }
+    if (closed || status == 0) {
+      disconnect();
+    }
+    if (status != 0 || !reused) {
+      return status;
+    }
+  }
+  return 0;
+}
+
+uint32_t FleetUploader::getConnects() const
+{
+  return _connects;
+}
+
+bool FleetUploader::connect()
+{
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* address = NULL;
+  char port[8];
+  snprintf(port, sizeof(port), "%u", _port);
+  if (getaddrinfo(_host.c_str(), port, &hints, &address) != 0) {
+    return false;
+  }
+  _fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (_fd >= 0 && ::connect(_fd, address->ai_addr, address->ai_addrlen) != 0) {
+    close(_fd);
+    _fd = -1;
+  }
+  freeaddrinfo(address);
+  if (_fd < 0) {
+    return false;
+  }
+  int on = 1;
+  setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  timeval timeout = { TIMEOUT_MS / 1000, (TIMEOUT_MS % 1000) * 1000 };
+  setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  _connects++;
+  return true;
+}
+
+void FleetUploader::disconnect()
+{
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+  _pending.clear();
+}
+
+int FleetUploader::readResponse(bool& closed)
+{
+  char buf[1024];
+  size_t headerEnd;
+  while ((headerEnd = _pending.find("\r\n\r\n")) == std::string::npos) {
+    ssize_t n = recv(_fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      return 0;
+    }
+    _pending.append(buf, n);
+  }
+  int status = _pending.compare(0, 5, "HTTP/") == 0 && headerEnd > 12 ? atoi(_pending.c_str() + 9) : 0;
+  std::string headers = _pending.substr(0, headerEnd);
+  for (size_t i = 0; i < headers.size(); i++) {
+    headers[i] = tolower(headers[i]);
+  }
+  closed = headers.find("connection: close") != std::string::npos;
+
+  size_t at = headers.find("content-length:");
+  size_t length = at != std::string::npos ? strtoul(headers.c_str() + at + 15, NULL, 10) : 0;
+  _pending.erase(0, headerEnd + 4);
+  while (_pending.size() < length) {
+    ssize_t n = recv(_fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      return 0;
+    }
+    _pending.append(buf, n);
+  }
+  _pending.erase(0, length);
+  return status;
+}
+
+// A small hash, so each device gets its own, repeatable, air
+static uint32_t mix(uint32_t value)
+{
+  value ^= value >> 16;
+  value *= 0x7FEB352D;
+  value ^= value >> 15;
+  value *= 0x846CA68B;
+  value ^= value >> 16;
+  return value;
+}
+
+FleetDevice::FleetDevice(uint32_t index, const FleetOptions& options)
+  : _index(index), _loopMs(options.loopMs < 1 ? 1 : options.loopMs), _bus(_wire),
+    _co2Sampler(5000, 60000), _pm25Sampler(5000, 60000), _reportPolicy(5 * 60 * 1000UL)
+{
+  uint32_t random = mix(index * 2654435761U + options.seed);
+  _chipId = 0xA00000 + index;
+  _pmBase = 2 + random % 40;
+  _co2Base = 420 + (random >> 6) % 600;
+  _tempBase = 1800 + (random >> 12) % 800;
+  _humBase = 3000 + (random >> 20) % 3000;
+  _phase = random >> 26;
+  // the devices were switched on during the same send interval
+  _clock.us = (uint64_t)(mix(random) % SEND_INTERVAL_MS) * 1000;
+
+  if (options.faults) {
+    _pmsEmulator.setCorruptEvery(50);
+    _co2Emulator.setFailEvery(40);
+    _shtEmulator.setCorruptEvery(60);
+  }
+}
+
+void FleetDevice::setup()
+{
+  Host_useClock(&_clock);
+  uint32_t now = millis();
+  updateEmulators(now);
+  _wire.attach(0x44, _shtEmulator);
+  _bus.begin();
+  _sht.begin(0x44, _bus);
+  _pms.begin(_pmsEmulator);
+  _co2.begin(_co2Emulator);
+
+  _co2Sampler.setThresholds(20, 15);
+  _pm25Sampler.setThresholds(5, 3);
+  _reportPolicy.setDeadband(MEASURE_RCO2, 10);
+  _reportPolicy.setDeadband(MEASURE_PM02, 1, 10);
+  _reportPolicy.setDeadband(MEASURE_ATMP, 0.3);
+  _reportPolicy.setDeadband(MEASURE_RHUM, 2);
+  _previousTempHum = now;
+  _previousSend = now;
+  Host_useClock(NULL);
+}
+
+void FleetDevice::run(uint32_t ms, FleetUploader* uploader, FleetHistogram& loopNs, FleetHistogram& uploadUs)
+{
+  Host_useClock(&_clock);
+  uint32_t until = millis() + ms;
+  while ((int32_t)(millis() - until) < 0) {
+    uint64_t start = nowNs();
+    loop(uploader, uploadUs);
+    uint64_t ns = nowNs() - start;
+    loopNs.add(ns);
+    _stats.loops++;
+    _stats.loopNs += ns;
+    if (ns > _stats.maxLoopNs) {
+      _stats.maxLoopNs = ns;
+    }
+    delay(_loopMs);
+  }
+  Host_useClock(NULL);
+}
+
+uint32_t FleetDevice::getChipId() const
+{
+  return _chipId;
+}
+
+uint32_t FleetDevice::getMillis() const
+{
+  return _clock.us / 1000;
+}
+
+const FleetDeviceStats& FleetDevice::getStats() const
+{
+  return _stats;
+}
+
+const ReportPolicy& FleetDevice::getReportPolicy() const
+{
+  return _reportPolicy;
+}
+
+// What DIY_BASIC does in loop(), with the sensors read as in its
+// updateCo2(), updatePm25() and updateTempHum()
+void FleetDevice::loop(FleetUploader* uploader, FleetHistogram& uploadUs)
+{
+  uint32_t now = millis();
+  updateEmulators(now);
+
+  PmsDriver::DATA data;
+  while (_pmsEmulator.available() > 0) {
+    if (_pms.read(data)) {
+      _pm25 = data.PM_AE_UG_2_5;
+      _pmsAt = now;
+      _stats.pmsFrames++;
+    }
+  }
+
+  if (_co2Sampler.due(now)) {
+    int co2 = _co2.getCO2_Raw();
+    if (co2 > 0) {
+      _co2Value = co2;
+      _co2Sampler.addSample(co2, now);
+    } else {
+      _co2Sampler.skip(now);
+      _stats.sensorErrors++;
+    }
+  }
+
+  if (_pm25Sampler.due(now)) {
+    if (_pm25 >= 0 && now - _pmsAt <= 2 * PmsEmulator::FRAME_INTERVAL_MS) {
+      _pm25Sampler.addSample(_pm25, now);
+    } else {
+      _pm25Sampler.skip(now);
+    }
+  }
+
+  if (now - _previousTempHum >= TEMP_HUM_INTERVAL_MS) {
+    _previousTempHum += TEMP_HUM_INTERVAL_MS;
+    TMP_RH_Fixed result = _sht.periodicFetchDataFixed();
+    if (result.error == SHT3XD_NO_ERROR) {
+      _temp = result.t_centi;
+      _hum = result.rh_centi / 100;
+    } else {
+      _stats.sensorErrors++;
+    }
+  }
+
+  if (now - _previousSend >= SEND_INTERVAL_MS) {
+    _previousSend += SEND_INTERVAL_MS;
+    sendToServer(now, uploader, uploadUs);
+  }
+}
+
+// Slow ramps, so the adaptive samplers and the report policy see changes;
+// each device around its own levels and at its own phase
+void FleetDevice::updateEmulators(uint32_t now)
+{
+  uint32_t minutes = now / 60000 + _phase;
+  _pmsEmulator.setPm(_pmBase + minutes % 10);
+  _co2Emulator.setCo2(_co2Base + 15 * (minutes % 12));
+  _shtEmulator.setTemperature(_tempBase + 10 * (minutes % 6));
+  _shtEmulator.setHumidity(_humBase + 50 * (minutes % 8));
+}
+
+void FleetDevice::sendToServer(uint32_t now, FleetUploader* uploader, FleetHistogram& uploadUs)
+{
+  Measures measures;
+  measures.set(MEASURE_WIFI, -50 - (int)(_index % 40));
+  if (_co2Value >= 0) measures.set(MEASURE_RCO2, _co2Value);
+  if (_pm25 >= 0) measures.set(MEASURE_PM02, _pm25);
+  measures.set(MEASURE_ATMP, _temp / 100.0f);
+  if (_hum >= 0) measures.set(MEASURE_RHUM, _hum);
+
+  if (!_reportPolicy.shouldSend(measures, now)) {
+    return;
+  }
+
+  char payload[MEASURES_JSON_SIZE];
+  size_t length = Measures_writeJson(measures, payload, sizeof(payload));
+  int httpCode = 200;
+  if (uploader != NULL) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sensors/airgradient:%x/measures", (unsigned)_chipId);
+    uint64_t start = nowNs();
+    httpCode = uploader->post(path, payload, length);
+    uploadUs.add((nowNs() - start) / 1000);
+  }
+  _stats.uploads++;
+  if (httpCode >= 200 && httpCode < 300) {
+    _reportPolicy.markSent(measures, now);
+  } else {
+    _stats.uploadErrors++;
+  }
+}
+
+Fleet::Fleet(const FleetOptions& options) : _options(options), _pool(options.threads)
+{
+  for (uint32_t i = 0; i < options.devices; i++) {
+    _devices.push_back(new FleetDevice(i, options));
+  }
+  for (uint8_t i = 0; i < _pool.getThreads(); i++) {
+    Worker* worker = new Worker();
+    worker->uploader = options.port != 0 ? new FleetUploader(options.host, options.port) : NULL;
+    _workers.push_back(worker);
+  }
+}
+
+Fleet::~Fleet()
+{
+  for (size_t i = 0; i < _devices.size(); i++) {
+    delete _devices[i];
+  }
+  for (size_t i = 0; i < _workers.size(); i++) {
+    delete _workers[i]->uploader;
+    delete _workers[i];
+  }
+}
+
+void Fleet::begin()
+{
+  for (size_t i = 0; i < _devices.size(); i++) {
+    _devices[i]->setup();
+  }
+}
+
+void Fleet::run(uint32_t ms)
+{
+  uint64_t start = nowNs();
+  for (uint32_t done = 0; done < ms; done += _roundMs) {
+    _roundMs = ms - done < ROUND_MS ? ms - done : ROUND_MS;
+    _pool.run(_devices.size(), runDevice, this);
+    _deviceMs += _roundMs;
+    if (_options.speed > 0) {
+      uint64_t due = start + (uint64_t)((done + _roundMs) * 1e6 / _options.speed);
+      uint64_t now = nowNs();
+      if (due > now) {
+        usleep((due - now) / 1000);
+      }
+    }
+  }
+  _wallSeconds += (nowNs() - start) / 1e9;
+}
+
+FleetStats Fleet::getStats() const
+{
+  FleetStats stats;
+  stats.devices = _devices.size();
+  stats.threads = _pool.getThreads();
+  stats.deviceMs = _deviceMs;
+  stats.wallSeconds = _wallSeconds;
+  stats.steals = _pool.getSteals();
+
+  uint64_t slowestMeanNs = 0;
+  for (size_t i = 0; i < _devices.size(); i++) {
+    const FleetDeviceStats& device = _devices[i]->getStats();
+    stats.loops += device.loops;
+    stats.uploads += device.uploads;
+    stats.uploadErrors += device.uploadErrors;
+    stats.pmsFrames += device.pmsFrames;
+    stats.sensorErrors += device.sensorErrors;
+    stats.suppressed += _devices[i]->getReportPolicy().getSuppressedCount();
+    if (device.loops > 0) {
+      uint64_t meanNs = device.loopNs / device.loops;
+      stats.deviceMeanNs.add(meanNs);
+      if (meanNs > slowestMeanNs) {
+        slowestMeanNs = meanNs;
+        stats.slowestDevice = i;
+      }
+    }
+  }
+  for (size_t i = 0; i < _workers.size(); i++) {
+    stats.loopNs.merge(_workers[i]->loopNs);
+    stats.uploadUs.merge(_workers[i]->uploadUs);
+    if (_workers[i]->uploader != NULL) {
+      stats.connects += _workers[i]->uploader->getConnects();
+    }
+  }
+  return stats;
+}
+
+FleetDevice& Fleet::getDevice(uint32_t index)
+{
+  return *_devices[index];
+}
+
+void Fleet::runDevice(size_t index, uint8_t worker, void* context)
+{
+  Fleet* fleet = (Fleet*)context;
+  Worker& own = *fleet->_workers[worker];
+  fleet->_devices[index]->run(fleet->_roundMs, own.uploader, own.loopNs, own.uploadUs);
+}
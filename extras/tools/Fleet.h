@@ -0,0 +1,229 @@
+/*
+  Fleet.h - Many virtual AirGradient devices on one host
+
+  Every FleetDevice is a DIY_BASIC board on emulated sensors: the real
+  PmsDriver, S8Driver and Sht3xDriver (over an I2CBus) talk to a
+  PmsEmulator, an S8Emulator and an Sht3xEmulator, and its loop samples
+  and reports like the sketch does, with AdaptiveSampler and
+  ReportPolicy. Each device runs on a HostClock of its own, started at a
+  random point of the send interval so the uploads spread out.
+
+    FleetOptions options;
+    options.devices = 10000;
+    options.port = 8080;               // a measures_collector on this host
+    Fleet fleet(options);
+    fleet.begin();
+    fleet.run(10 * 60 * 1000UL);       // ten minutes of device time
+    FleetStats stats = fleet.getStats();
+
+  run() goes in rounds of ROUND_MS device time, one WorkPool task per
+  device and round. With a speed set, each round also waits for the wall
+  clock, e.g. 1 for devices in real time.
+
+  Every worker thread keeps one connection to the endpoint alive and a
+  device's upload is a blocking POST on it, as on the board, so a slow
+  server shows in the loop times. Those are wall time per call of the
+  device's loop, per device and in histograms over the fleet. Without a
+  port the uploads are counted but not sent, which times the firmware
+  alone.
+*/
+
+#ifndef Fleet_h
+#define Fleet_h
+
+#include "AirGradientEmulator.h"
+#include "AirGradientI2C.h"
+#include "AirGradientPms.h"
+#include "AirGradientReport.h"
+#include "AirGradientS8.h"
+#include "AirGradientSampler.h"
+#include "AirGradientSht3x.h"
+#include "ArduinoHost.h"
+#include "WorkPool.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FleetOptions {
+  uint32_t devices = 1000;
+  uint8_t threads = std::thread::hardware_concurrency();
+  std::string host = "127.0.0.1";
+  // 0 counts the uploads without sending them
+  uint16_t port = 0;
+  // device time per call of loop()
+  uint16_t loopMs = 100;
+  // device time per wall time; 0 runs as fast as the host can
+  float speed = 0;
+  // corrupt PMS frames and SHT3x readings, drop S8 answers
+  bool faults = false;
+  uint32_t seed = 1;
+};
+
+// Durations in buckets of an eighth of a power of two, so a percentile
+// is within 12.5 % of the exact one.
+struct FleetHistogram {
+  static const uint16_t BUCKETS = 8 * 40;
+
+  uint64_t counts[BUCKETS] = {};
+  uint64_t count = 0;
+  uint64_t max = 0;
+
+  void add(uint64_t value);
+  void merge(const FleetHistogram& other);
+  // p from 0 to 1
+  uint64_t percentile(double p) const;
+};
+
+struct FleetDeviceStats {
+  uint64_t loops = 0;
+  uint64_t loopNs = 0;
+  uint64_t maxLoopNs = 0;
+  uint32_t uploads = 0;
+  uint32_t uploadErrors = 0;
+  uint32_t pmsFrames = 0;
+  uint32_t sensorErrors = 0;
+};
+
+struct FleetStats {
+  uint32_t devices = 0;
+  uint8_t threads = 0;
+  uint64_t deviceMs = 0;
+  double wallSeconds = 0;
+  uint64_t loops = 0;
+  uint64_t uploads = 0;
+  uint64_t uploadErrors = 0;
+  uint64_t suppressed = 0;
+  uint64_t connects = 0;
+  uint64_t pmsFrames = 0;
+  uint64_t sensorErrors = 0;
+  uint64_t steals = 0;
+
+  // every loop() call, in ns
+  FleetHistogram loopNs;
+  // the mean loop() time of each device, in ns
+  FleetHistogram deviceMeanNs;
+  uint32_t slowestDevice = 0;
+  // every upload, in us
+  FleetHistogram uploadUs;
+};
+
+// HTTP/1.1 POSTs on a kept-alive connection, reconnecting when the
+// server closed it.
+class FleetUploader
+{
+  public:
+    static const uint16_t TIMEOUT_MS = 5000;
+
+    FleetUploader(const std::string& host, uint16_t port);
+    ~FleetUploader();
+
+    // The status code, 0 without an answer
+    int post(const char* path, const char* body, size_t length);
+    uint32_t getConnects() const;
+
+  private:
+    std::string _host;
+    uint16_t _port;
+    int _fd = -1;
+    std::string _pending;
+    uint32_t _connects = 0;
+
+    bool connect();
+    void disconnect();
+    // Reads one response; closed is set if the server ends the connection
+    int readResponse(bool& closed);
+};
+
+class FleetDevice
+{
+  public:
+    static const uint16_t SEND_INTERVAL_MS = 10000;
+    static const uint16_t TEMP_HUM_INTERVAL_MS = 2500;
+
+    FleetDevice(uint32_t index, const FleetOptions& options);
+
+    void setup();
+    // Calls loop() until the device's clock is ms further; uploader may
+    // be NULL.
+    void run(uint32_t ms, FleetUploader* uploader, FleetHistogram& loopNs, FleetHistogram& uploadUs);
+
+    uint32_t getChipId() const;
+    uint32_t getMillis() const;
+    const FleetDeviceStats& getStats() const;
+    const ReportPolicy& getReportPolicy() const;
+
+  private:
+    uint32_t _index;
+    uint32_t _chipId;
+    uint16_t _loopMs;
+    HostClock _clock;
+
+    PmsEmulator _pmsEmulator;
+    S8Emulator _co2Emulator;
+    Sht3xEmulator _shtEmulator;
+    I2CEmulator _wire;
+    I2CBus _bus;
+    PmsDriver _pms;
+    S8Driver _co2;
+    Sht3xDriver _sht;
+
+    // what the sensors see, see updateEmulators()
+    uint16_t _pmBase;
+    uint16_t _co2Base;
+    int16_t _tempBase;
+    uint16_t _humBase;
+    uint8_t _phase;
+
+    AdaptiveSampler _co2Sampler;
+    AdaptiveSampler _pm25Sampler;
+    ReportPolicy _reportPolicy;
+    int _co2Value = -1;
+    int _pm25 = -1;
+    uint32_t _pmsAt = 0;
+    int16_t _temp = 0;
+    int16_t _hum = -1;
+    uint32_t _previousTempHum = 0;
+    uint32_t _previousSend = 0;
+
+    FleetDeviceStats _stats;
+
+    void loop(FleetUploader* uploader, FleetHistogram& uploadUs);
+    void updateEmulators(uint32_t now);
+    void sendToServer(uint32_t now, FleetUploader* uploader, FleetHistogram& uploadUs);
+};
+
+class Fleet
+{
+  public:
+    static const uint16_t ROUND_MS = 1000;
+
+    Fleet(const FleetOptions& options);
+    ~Fleet();
+
+    void begin();
+    // Advances every device by ms of its own time
+    void run(uint32_t ms);
+
+    FleetStats getStats() const;
+    FleetDevice& getDevice(uint32_t index);
+
+  private:
+    struct Worker {
+      FleetUploader* uploader;
+      FleetHistogram loopNs;
+      FleetHistogram uploadUs;
+    };
+
+    FleetOptions _options;
+    std::vector<FleetDevice*> _devices;
+    std::vector<Worker*> _workers;
+    WorkPool _pool;
+    uint32_t _roundMs = 0;
+    uint64_t _deviceMs = 0;
+    double _wallSeconds = 0;
+
+    static void runDevice(size_t index, uint8_t worker, void* context);
+};
+
+#endif
@@ -0,0 +1,147 @@
+/*
+  WorkPool.cpp - Work-stealing thread pool for the host tools
+*/
+
+#include "WorkPool.h"
+
+WorkPool::WorkPool(uint8_t threads) : _remaining(0), _steals(0)
+{
+  if (threads < 1) {
+    threads = 1;
+  }
+  for (uint8_t i = 0; i < threads; i++) {
+    _ranges.push_back(new Range());
+  }
+  for (uint8_t i = 1; i < threads; i++) {
+    _threads.push_back(std::thread(&WorkPool::workerLoop, this, i));
+  }
+}
+
+WorkPool::~WorkPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _stopping = true;
+  }
+  _started.notify_all();
+  for (size_t i = 0; i < _threads.size(); i++) {
+    _threads[i].join();
+  }
+  for (size_t i = 0; i < _ranges.size(); i++) {
+    delete _ranges[i];
+  }
+}
+
+// A worker still looking for work of the previous run would steal into
+// a range set up for this one and lose it, so the ranges are only set
+// once every worker is out of work(). The task and context are read
+// only after an index was taken under a range lock.
+void WorkPool::run(size_t count, Task task, void* context)
+{
+  if (count == 0) {
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+    _finished.wait(lock, [this] { return _busy == 0; });
+    _task = task;
+    _context = context;
+    _remaining = count;
+    size_t workers = _ranges.size();
+    for (size_t i = 0; i < workers; i++) {
+      std::lock_guard<std::mutex> rangeLock(_ranges[i]->lock);
+      _ranges[i]->begin = count * i / workers;
+      _ranges[i]->end = count * (i + 1) / workers;
+    }
+    _generation++;
+  }
+  _started.notify_all();
+
+  work(0);
+  std::unique_lock<std::mutex> lock(_lock);
+  _finished.wait(lock, [this] { return _remaining == 0; });
+}
+
+uint8_t WorkPool::getThreads() const
+{
+  return _ranges.size();
+}
+
+uint64_t WorkPool::getSteals() const
+{
+  return _steals;
+}
+
+void WorkPool::workerLoop(uint8_t worker)
+{
+  uint64_t generation = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      _started.wait(lock, [&] { return _stopping || _generation != generation; });
+      if (_stopping) {
+        return;
+      }
+      generation = _generation;
+      _busy++;
+    }
+    work(worker);
+    std::lock_guard<std::mutex> lock(_lock);
+    _busy--;
+    _finished.notify_all();
+  }
+}
+
+void WorkPool::work(uint8_t worker)
+{
+  size_t index;
+  for (;;) {
+    if (!take(worker, index) && !(steal(worker) && take(worker, index))) {
+      return;
+    }
+    _task(index, worker, _context);
+    if (_remaining.fetch_sub(1) == 1) {
+      std::lock_guard<std::mutex> lock(_lock);
+      _finished.notify_all();
+    }
+  }
+}
+
+bool WorkPool::take(uint8_t worker, size_t& index)
+{
+  Range& own = *_ranges[worker];
+  std::lock_guard<std::mutex> lock(own.lock);
+  if (own.begin == own.end) {
+    return false;
+  }
+  index = own.begin++;
+  return true;
+}
+
+// Takes the back half of the first range that is not empty, looking at
+// the workers after this one first so thieves spread over the victims.
+bool WorkPool::steal(uint8_t worker)
+{
+  size_t workers = _ranges.size();
+  for (size_t i = 1; i < workers; i++) {
+    Range& victim = *_ranges[(worker + i) % workers];
+    size_t begin, end;
+    {
+      std::lock_guard<std::mutex> lock(victim.lock);
+      size_t left = victim.end - victim.begin;
+      if (left == 0) {
+        continue;
+      }
+      end = victim.end;
+      begin = end - (left + 1) / 2;
+      victim.end = begin;
+    }
+    Range& own = *_ranges[worker];
+    std::lock_guard<std::mutex> lock(own.lock);
+    own.begin = begin;
+    own.end = end;
+    _steals++;
+    return true;
+  }
+  return false;
+}
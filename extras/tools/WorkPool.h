@@ -0,0 +1,69 @@
+/*
+  WorkPool.h - Work-stealing thread pool for the host tools
+
+    WorkPool pool(4);
+    pool.run(10000, task, context);    // task(index, worker, context) for each index
+
+  run() hands every worker an equal share of the indexes as a range. A
+  worker takes from the front of its own range and, once that is empty,
+  steals the back half of the range of another worker, so tasks that
+  turn out slow (a device waiting on its upload, ...) do not hold up the
+  ones queued behind them on the same thread. The calling thread is
+  worker 0; run() returns when every index is done.
+*/
+
+#ifndef WorkPool_h
+#define WorkPool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class WorkPool
+{
+  public:
+    typedef void (*Task)(size_t index, uint8_t worker, void* context);
+
+    WorkPool(uint8_t threads);
+    ~WorkPool();
+
+    void run(size_t count, Task task, void* context);
+
+    uint8_t getThreads() const;
+    // Ranges taken from another worker
+    uint64_t getSteals() const;
+
+  private:
+    struct Range {
+      std::mutex lock;
+      size_t begin = 0;
+      size_t end = 0;
+    };
+
+    std::vector<Range*> _ranges;
+    std::vector<std::thread> _threads;
+
+    std::mutex _lock;
+    std::condition_variable _started;
+    std::condition_variable _finished;
+    uint64_t _generation = 0;
+    // workers inside work(); run() only sets the ranges while it is 0
+    uint8_t _busy = 0;
+    bool _stopping = false;
+
+    Task _task = NULL;
+    void* _context = NULL;
+    std::atomic<size_t> _remaining;
+    std::atomic<uint64_t> _steals;
+
+    void workerLoop(uint8_t worker);
+    void work(uint8_t worker);
+    bool take(uint8_t worker, size_t& index);
+    bool steal(uint8_t worker);
+};
+
+#endif
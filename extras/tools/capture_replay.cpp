@@ -0,0 +1,229 @@
+/*
+  capture_replay.cpp - Replays a sensor bus capture through the PMS parser
+
+  Feeds the CAPTURE_RX bytes of one channel of a capture (see
+  AirGradientCapture.h), e.g. one copied off a board running the
+  PMS_CAPTURE example, through PmsDriver and reports what it decoded:
+
+    capture_replay pms.agc              as fast as the parser reads
+    capture_replay -r pms.agc           at the recorded pace, one line per frame
+    capture_replay -c 1 pms.agc         channel 1 instead of 0
+
+  Before the replay it lists the records per type and channel, and the
+  I2C transactions and failures per address.
+
+    capture_replay -g 5000 bench.agc
+
+  writes a benchmark capture instead: 5000 PMS5003 frames of an emulated
+  sensor, every 19th with a bad checksum and a burst of noise bytes every
+  97 frames, recorded through PmsDriver on the virtual clock.
+*/
+
+#include "AirGradientCapture.h"
+#include "AirGradientEmulator.h"
+#include "ArduinoHost.h"
+#include "HostFile.h"
+
+#include <chrono>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Puts a burst of random bytes in front of what the sensor sends, like a
+// loose connector does
+class NoisyStream : public Stream
+{
+  public:
+    NoisyStream(Stream& stream) : _stream(&stream) {}
+
+    void burst(uint8_t length)
+    {
+      _noise = length;
+    }
+
+    int available() { return _noise + _stream->available(); }
+    int read()
+    {
+      if (_noise > 0) {
+        _noise--;
+        return rand() & 0xFF;
+      }
+      return _stream->read();
+    }
+    int peek() { return _noise > 0 ? 0x00 : _stream->peek(); }
+    void flush() { _stream->flush(); }
+    size_t write(uint8_t c) { return _stream->write(c); }
+    using Print::write;
+
+  private:
+    Stream* _stream;
+    uint8_t _noise = 0;
+};
+
+static int generate(uint32_t frames, const char* path)
+{
+  FileStream file;
+  if (!file.open(path, "wb")) {
+    fprintf(stderr, "cannot write %s\n", path);
+    return 1;
+  }
+  srand(1);
+  PmsEmulator sensor;
+  sensor.setCorruptEvery(19);
+  NoisyStream serial(sensor);
+  CaptureWriter capture(file);
+  RecordingStream recording(serial, capture, 0);
+  PmsDriver pms;
+  capture.begin();
+  pms.begin(recording, PMS_VARIANT_PMS5003);
+
+  PmsDriver::DATA data;
+  uint32_t decoded = 0;
+  uint32_t lastFrames = 0;
+  while (sensor.getFrames() < frames) {
+    sensor.setPm(5 + sensor.getFrames() % 150);
+    sensor.update();
+    if (sensor.getFrames() != lastFrames) {
+      lastFrames = sensor.getFrames();
+      if (lastFrames % 97 == 0) {
+        serial.burst(1 + rand() % 40);
+      }
+    }
+    while (recording.available() > 0) {
+      decoded += pms.read(data);
+    }
+    Host_advance(10);
+  }
+  capture.flush();
+  printf("%lu frames sent, %lu decoded, %lu bytes in %lu records\n",
+         (unsigned long)frames, (unsigned long)decoded,
+         (unsigned long)capture.getBytes(), (unsigned long)capture.getRecords());
+  return 0;
+}
+
+static const char* const typeNames[] = { "", "rx", "tx", "i2c" };
+
+// Counts the records; false if the capture is damaged
+static bool summarize(const char* path)
+{
+  FileStream file;
+  if (!file.open(path, "rb")) {
+    return false;
+  }
+  CaptureReader reader(file);
+  CaptureRecord record;
+  uint32_t records[4][16] = {};
+  uint32_t bytes[4][16] = {};
+  uint32_t transactions[128] = {};
+  uint32_t failures[128] = {};
+  // record times wrap after 71 minutes, the differences do not
+  uint32_t lastUs = 0;
+  uint64_t totalUs = 0;
+  CAPTURE_Status status;
+  while ((status = reader.next(record)) == CAPTURE_OK) {
+    records[record.type][record.channel]++;
+    bytes[record.type][record.channel] += record.length;
+    totalUs += record.timeUs - lastUs;
+    lastUs = record.timeUs;
+    if (record.type == CAPTURE_I2C && record.length >= 3) {
+      transactions[record.data[0] & 0x7F]++;
+      failures[record.data[0] & 0x7F] += record.data[1] != 0;
+    }
+  }
+
+  printf("%s: %.3f s\n", path, totalUs / 1e6);
+  for (uint8_t type = CAPTURE_RX; type <= CAPTURE_TX; type++) {
+    for (uint8_t channel = 0; channel < 16; channel++) {
+      if (records[type][channel] > 0) {
+        printf("  channel %u %s: %lu records, %lu bytes\n", channel, typeNames[type],
+               (unsigned long)records[type][channel], (unsigned long)bytes[type][channel]);
+      }
+    }
+  }
+  for (uint8_t address = 0; address < 128; address++) {
+    if (transactions[address] > 0) {
+      printf("  i2c 0x%02x: %lu transactions, %lu failed\n", address,
+             (unsigned long)transactions[address], (unsigned long)failures[address]);
+    }
+  }
+  if (status != CAPTURE_END) {
+    printf("  damaged after %.6f s\n", totalUs / 1e6);
+  }
+  return status == CAPTURE_END;
+}
+
+static int replay(const char* path, uint8_t channel, bool realTime)
+{
+  FileStream file;
+  if (!file.open(path, "rb")) {
+    fprintf(stderr, "cannot read %s\n", path);
+    return 1;
+  }
+  // the recorded pace needs the wall clock
+  Host_useRealTime(realTime);
+  CaptureReader reader(file);
+  ReplayStream stream(reader, channel, realTime);
+  PmsDriver pms;
+  pms.begin(stream);
+
+  PmsDriver::DATA data;
+  uint32_t frames = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (!stream.isFinished()) {
+    if (pms.read(data)) {
+      frames++;
+      if (realTime) {
+        printf("%.3f s  PM2.5 %u ug/m3\n", millis() / 1e3, data.PM_AE_UG_2_5);
+      }
+    } else if (realTime && stream.available() == 0) {
+      usleep(1000);
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("replayed %lu frames from %lu bytes in %.3f ms\n", (unsigned long)frames,
+         (unsigned long)stream.getBytesRead(), seconds * 1e3);
+  if (!realTime && seconds > 0) {
+    printf("%.0f frames/s, %.1f MB/s of serial data\n", frames / seconds,
+           stream.getBytesRead() / seconds / 1e6);
+  }
+  if (stream.getStatus() != CAPTURE_END) {
+    printf("capture is damaged\n");
+    return 1;
+  }
+  return 0;
+}
+
+static int usage()
+{
+  fprintf(stderr, "usage: capture_replay [-r] [-c channel] file.agc\n"
+                  "       capture_replay -g frames file.agc\n");
+  return 2;
+}
+
+int main(int argc, char** argv)
+{
+  bool realTime = false;
+  int channel = 0;
+  long frames = 0;
+  int option;
+  while ((option = getopt(argc, argv, "rc:g:")) != -1) {
+    switch (option) {
+      case 'r': realTime = true; break;
+      case 'c': channel = atoi(optarg); break;
+      case 'g': frames = atol(optarg); break;
+      default: return usage();
+    }
+  }
+  if (optind != argc - 1 || channel < 0 || channel > 15) {
+    return usage();
+  }
+  const char* path = argv[optind];
+
+  if (frames > 0) {
+    return generate(frames, path);
+  }
+  if (!summarize(path)) {
+    fprintf(stderr, "%s is not a readable capture\n", path);
+  }
+  return replay(path, channel, realTime);
+}
@@ -0,0 +1,100 @@
+/*
+  fleet_simulator.cpp - Runs many virtual AirGradient devices on one host
+
+    fleet_simulator [-n devices] [-t threads] [-s seconds] [-x speed]
+                    [-l loop_ms] [-f] [host:port]
+
+  Runs -n devices (default 10000) for -s seconds of device time (default
+  600), see Fleet.h. They upload to the measures endpoint at host:port,
+  e.g. a measures_collector; without it the uploads are only counted.
+  -x 1 runs the devices in real time, the default as fast as the host
+  can. -f adds sensor faults. Every minute of device time it prints a
+  line, and at the end the loop timing of the fleet:
+
+    measures_collector -p 8080 -d /tmp/collector &
+    fleet_simulator -n 10000 -s 600 127.0.0.1:8080
+*/
+
+#include "Fleet.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int usage()
+{
+  fprintf(stderr, "usage: fleet_simulator [-n devices] [-t threads] [-s seconds] [-x speed] [-l loop_ms] [-f] "
+                  "[host:port]\n");
+  return 2;
+}
+
+static void printProgress(const FleetStats& stats)
+{
+  fprintf(stderr, "%6llu s: %llu loops, %llu uploads, %llu failed, loop p99 %.2f us, %.1fx real time\n",
+          (unsigned long long)(stats.deviceMs / 1000), (unsigned long long)stats.loops,
+          (unsigned long long)stats.uploads, (unsigned long long)stats.uploadErrors,
+          stats.loopNs.percentile(0.99) / 1000.0, stats.deviceMs / 1000.0 / stats.wallSeconds);
+}
+
+int main(int argc, char** argv)
+{
+  FleetOptions options;
+  options.devices = 10000;
+  int threads = options.threads > 0 ? options.threads : 1;
+  uint32_t seconds = 600;
+  int option;
+  while ((option = getopt(argc, argv, "n:t:s:x:l:f")) != -1) {
+    switch (option) {
+      case 'n': options.devices = atoi(optarg); break;
+      case 't': threads = atoi(optarg); break;
+      case 's': seconds = atoi(optarg); break;
+      case 'x': options.speed = atof(optarg); break;
+      case 'l': options.loopMs = atoi(optarg); break;
+      case 'f': options.faults = true; break;
+      default: return usage();
+    }
+  }
+  if (optind < argc) {
+    const char* colon = strrchr(argv[optind], ':');
+    if (colon == NULL) {
+      return usage();
+    }
+    options.host.assign(argv[optind], colon - argv[optind]);
+    options.port = atoi(colon + 1);
+    optind++;
+  }
+  if (optind != argc || options.devices < 1 || threads < 1 || threads > 255 || seconds < 1 || options.loopMs < 1) {
+    return usage();
+  }
+  options.threads = threads;
+
+  Fleet fleet(options);
+  fleet.begin();
+  fprintf(stderr, "%u devices on %u threads, uploading to %s\n", options.devices, options.threads,
+          options.port != 0 ? (options.host + ":" + std::to_string(options.port)).c_str() : "nowhere");
+  for (uint32_t done = 0; done < seconds; done += 60) {
+    fleet.run((seconds - done < 60 ? seconds - done : 60) * 1000);
+    printProgress(fleet.getStats());
+  }
+
+  FleetStats stats = fleet.getStats();
+  printf("%u devices, %u threads, %llu s of device time in %.1f s (%.1fx real time)\n", stats.devices,
+         stats.threads, (unsigned long long)(stats.deviceMs / 1000), stats.wallSeconds,
+         stats.deviceMs / 1000.0 / stats.wallSeconds);
+  printf("loop:    %llu calls, p50 %.2f us, p99 %.2f us, max %.1f us\n", (unsigned long long)stats.loops,
+         stats.loopNs.percentile(0.5) / 1000.0, stats.loopNs.percentile(0.99) / 1000.0,
+         stats.loopNs.max / 1000.0);
+  printf("device:  mean loop p50 %.2f us, p99 %.2f us, slowest %x at %.2f us\n",
+         stats.deviceMeanNs.percentile(0.5) / 1000.0, stats.deviceMeanNs.percentile(0.99) / 1000.0,
+         fleet.getDevice(stats.slowestDevice).getChipId(), stats.deviceMeanNs.max / 1000.0);
+  printf("upload:  %llu sent, %llu failed, %llu suppressed", (unsigned long long)stats.uploads,
+         (unsigned long long)stats.uploadErrors, (unsigned long long)stats.suppressed);
+  if (options.port != 0) {
+    printf(", p50 %llu us, p99 %llu us, %llu connections", (unsigned long long)stats.uploadUs.percentile(0.5),
+           (unsigned long long)stats.uploadUs.percentile(0.99), (unsigned long long)stats.connects);
+  }
+  printf("\nsensors: %llu PMS frames, %llu read errors; %llu steals\n", (unsigned long long)stats.pmsFrames,
+         (unsigned long long)stats.sensorErrors, (unsigned long long)stats.steals);
+  return stats.uploadErrors > 0 ? 1 : 0;
+}
@@ -0,0 +1,246 @@
+/*
+  http_load.cpp - HTTP load generator for the host tools
+
+    http_load [-c connections] [-n requests] [-k] [-b body.json] host:port path
+
+  Runs one thread per connection (default: one per core) that sends its
+  share of the requests back to back and reports requests per second and
+  the latency percentiles of all of them. -k keeps connections alive
+  (HTTP/1.1) as long as the server does; without it every request opens
+  a new one, like the sensors do. -b sends the file as a POST body
+  instead of a GET. A "%d" in the path is replaced by a device number
+  that runs over -d devices, e.g. /sensors/airgradient:%d/measures.
+*/
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+struct Options {
+  unsigned connections = std::max(1u, std::thread::hardware_concurrency());
+  unsigned requests = 1000;
+  unsigned devices = 1;
+  bool keepAlive = false;
+  std::string body;
+  sockaddr_in address;
+  std::string host;
+  std::string path;
+};
+
+struct Result {
+  std::vector<uint32_t> latencyUs;
+  unsigned errors = 0;
+  unsigned connects = 0;
+  unsigned status[6] = { 0 };
+};
+
+static int openConnection(const Options& options)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (const sockaddr*)&options.address, sizeof(options.address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  return fd;
+}
+
+// Reads one response; returns the status code, 0 on failure. closed is
+// set if the server ends the connection after it.
+static int readResponse(int fd, std::string& pending, bool& closed)
+{
+  char buf[4096];
+  size_t headerEnd;
+  while ((headerEnd = pending.find("\r\n\r\n")) == std::string::npos) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      return 0;
+    }
+    pending.append(buf, n);
+  }
+  int status = pending.size() > 12 ? atoi(pending.c_str() + 9) : 0;
+  std::string headers = pending.substr(0, headerEnd);
+  for (char& c : headers) {
+    c = tolower(c);
+  }
+  closed = headers.find("connection: close") != std::string::npos || headers.compare(0, 8, "http/1.0") == 0;
+
+  size_t length = 0;
+  size_t at = headers.find("content-length:");
+  bool hasLength = at != std::string::npos;
+  if (hasLength) {
+    length = strtoul(headers.c_str() + at + 15, NULL, 10);
+  }
+  pending.erase(0, headerEnd + 4);
+  while (hasLength ? pending.size() < length : true) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      if (hasLength) {
+        return 0;
+      }
+      closed = true;
+      break;
+    }
+    pending.append(buf, n);
+  }
+  pending.erase(0, hasLength ? length : pending.size());
+  return status;
+}
+
+static void run(const Options& options, unsigned first, unsigned count, Result& result)
+{
+  result.latencyUs.reserve(count);
+  int fd = -1;
+  std::string pending;
+  for (unsigned i = 0; i < count; i++) {
+    std::string path = options.path;
+    size_t device = path.find("%d");
+    if (device != std::string::npos) {
+      path.replace(device, 2, std::to_string((first + i) % options.devices));
+    }
+    std::string request = std::string(options.body.empty() ? "GET " : "POST ") + path +
+                          (options.keepAlive ? " HTTP/1.1\r\n" : " HTTP/1.0\r\n") +
+                          "Host: " + options.host + "\r\n";
+    if (!options.body.empty()) {
+      request += "Content-Type: application/json\r\nContent-Length: " + std::to_string(options.body.size()) + "\r\n";
+    }
+    request += "\r\n" + options.body;
+
+    auto start = std::chrono::steady_clock::now();
+    if (fd < 0) {
+      fd = openConnection(options);
+      result.connects++;
+    }
+    bool closed = true;
+    int status = 0;
+    if (fd >= 0 && send(fd, request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t)request.size()) {
+      status = readResponse(fd, pending, closed);
+    }
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    result.latencyUs.push_back(us);
+    if (status >= 100 && status < 600) {
+      result.status[status / 100]++;
+    } else {
+      result.errors++;
+    }
+    if (closed || status == 0 || !options.keepAlive) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      fd = -1;
+      pending.clear();
+    }
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+static uint32_t percentile(const std::vector<uint32_t>& sorted, double p)
+{
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    char flag = argv[arg][1];
+    if (flag == 'k') {
+      options.keepAlive = true;
+      continue;
+    }
+    if (arg + 1 >= argc) {
+      break;
+    }
+    const char* value = argv[++arg];
+    if (flag == 'c') {
+      options.connections = std::max(1, atoi(value));
+    } else if (flag == 'n') {
+      options.requests = std::max(1, atoi(value));
+    } else if (flag == 'd') {
+      options.devices = std::max(1, atoi(value));
+    } else if (flag == 'b') {
+      FILE* file = fopen(value, "rb");
+      if (file == NULL) {
+        fprintf(stderr, "cannot read %s\n", value);
+        return 1;
+      }
+      char buf[4096];
+      size_t n;
+      while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        options.body.append(buf, n);
+      }
+      fclose(file);
+    }
+  }
+  if (argc - arg != 2) {
+    fprintf(stderr, "usage: http_load [-c connections] [-n requests] [-k] [-d devices] [-b body.json] host:port path\n");
+    return 2;
+  }
+
+  options.host = argv[arg];
+  options.path = argv[arg + 1];
+  size_t colon = options.host.find(':');
+  memset(&options.address, 0, sizeof(options.address));
+  options.address.sin_family = AF_INET;
+  options.address.sin_port = htons(colon == std::string::npos ? 80 : atoi(options.host.c_str() + colon + 1));
+  if (inet_pton(AF_INET, options.host.substr(0, colon).c_str(), &options.address.sin_addr) != 1) {
+    fprintf(stderr, "%s is not an IPv4 address\n", options.host.c_str());
+    return 2;
+  }
+
+  std::vector<Result> results(options.connections);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  unsigned first = 0;
+  for (unsigned i = 0; i < options.connections; i++) {
+    unsigned count = options.requests / options.connections + (i < options.requests % options.connections ? 1 : 0);
+    threads.push_back(std::thread(run, std::cref(options), first, count, std::ref(results[i])));
+    first += count;
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  Result total;
+  for (const Result& result : results) {
+    total.latencyUs.insert(total.latencyUs.end(), result.latencyUs.begin(), result.latencyUs.end());
+    total.errors += result.errors;
+    total.connects += result.connects;
+    for (int i = 0; i < 6; i++) {
+      total.status[i] += result.status[i];
+    }
+  }
+  std::sort(total.latencyUs.begin(), total.latencyUs.end());
+
+  printf("%zu requests in %.2f s over %u connections (%u opened), %.0f requests/s\n",
+         total.latencyUs.size(), seconds, options.connections, total.connects, total.latencyUs.size() / seconds);
+  printf("status 2xx %u, 3xx %u, 4xx %u, 5xx %u, failed %u\n",
+         total.status[2], total.status[3], total.status[4], total.status[5], total.errors);
+  printf("latency p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+         percentile(total.latencyUs, 0.5) / 1000.0, percentile(total.latencyUs, 0.99) / 1000.0,
+         percentile(total.latencyUs, 1.0) / 1000.0);
+  return total.errors == 0 && total.status[5] == 0 ? 0 : 1;
+}
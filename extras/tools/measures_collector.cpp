@@ -0,0 +1,130 @@
+/*
+  measures_collector.cpp - Collector service for the measures upload
+
+  Receives what the examples POST to sensors/airgradient:<id>/measures
+  and stores it per device, see Collector.h for the files:
+
+    measures_collector [-p port] [-t threads] [-d dir] [-r rollup_s]
+
+  Point APIROOT of a sketch, or the fleet simulator, at
+  http://<pc>:8080/. Every rollup interval (default 60 s) it writes the
+  rollups and prints the devices, rows and requests per second of the
+  interval. Ctrl-C writes what is buffered and stops.
+
+    measures_collector -q dir/abc123.seg
+
+  prints a segment file as CSV instead.
+
+  Load test with http_load, 10000 devices on kept-alive connections:
+
+    echo '{"wifi":-60, "rco2":612, "pm02":8, "atmp":21.50, "rhum":45}' > body.json
+    http_load -c 64 -n 200000 -k -d 10000 -b body.json \
+        127.0.0.1:8080 /sensors/airgradient:%d/measures
+*/
+
+#include "Collector.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t stopping = 0;
+
+static void onSignal(int)
+{
+  stopping = 1;
+}
+
+static void printRow(int64_t timeMs, const Measures& measures, void*)
+{
+  printf("%lld", (long long)timeMs);
+  for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+    char value[24];
+    if (Measures_writeValue(measures, (Measure_Field)i, value, sizeof(value)) > 0) {
+      printf(",%s", value);
+    } else {
+      printf(",");
+    }
+  }
+  printf("\n");
+}
+
+static int dump(const char* path)
+{
+  printf("time_ms");
+  for (uint8_t i = 0; i < MEASURE_COUNT; i++) {
+    printf(",%s", Measures_key((Measure_Field)i));
+  }
+  printf("\n");
+  if (!Collector_readSegments(path, printRow, NULL)) {
+    fprintf(stderr, "%s is missing or damaged\n", path);
+    return 1;
+  }
+  return 0;
+}
+
+static int usage()
+{
+  fprintf(stderr, "usage: measures_collector [-p port] [-t threads] [-d dir] [-r rollup_s]\n"
+                  "       measures_collector -q file.seg\n");
+  return 2;
+}
+
+int main(int argc, char** argv)
+{
+  int port = 8080;
+  int threads = std::thread::hardware_concurrency();
+  const char* dir = "collector";
+  int rollupSeconds = 60;
+  int option;
+  while ((option = getopt(argc, argv, "p:t:d:r:q:")) != -1) {
+    switch (option) {
+      case 'p': port = atoi(optarg); break;
+      case 't': threads = atoi(optarg); break;
+      case 'd': dir = optarg; break;
+      case 'r': rollupSeconds = atoi(optarg); break;
+      case 'q': return dump(optarg);
+      default: return usage();
+    }
+  }
+  if (optind != argc || port < 0 || port > 65535 || threads < 1 || threads > 255 || rollupSeconds < 1) {
+    return usage();
+  }
+
+  mkdir(dir, 0755);
+  CollectorStore store(dir);
+  CollectorServer server(store, port, threads);
+  if (!server.begin()) {
+    fprintf(stderr, "cannot listen on port %d\n", port);
+    return 1;
+  }
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  fprintf(stderr, "listening on port %u with %d threads, writing to %s/\n", server.port(), threads, dir);
+
+  int64_t lastRollup = Collector_nowMs();
+  uint64_t lastRequests = 0;
+  while (!stopping) {
+    usleep(100000);
+    int64_t now = Collector_nowMs();
+    if (now - lastRollup < rollupSeconds * 1000LL) {
+      continue;
+    }
+    store.rollup(now);
+    uint64_t requests = server.getRequests();
+    fprintf(stderr, "%u devices, %llu rows, %llu errors, %.0f requests/s\n", store.getDevices(),
+            (unsigned long long)store.getRows(), (unsigned long long)server.getErrors(),
+            (requests - lastRequests) * 1000.0 / (now - lastRollup));
+    lastRequests = requests;
+    lastRollup = now;
+  }
+
+  server.end();
+  store.rollup(Collector_nowMs());
+  fprintf(stderr, "%u devices, %llu rows in %llu blocks, %llu requests, %llu errors\n", store.getDevices(),
+          (unsigned long long)store.getRows(), (unsigned long long)store.getBlocks(),
+          (unsigned long long)server.getRequests(), (unsigned long long)server.getErrors());
+  return 0;
+}
@@ -0,0 +1,113 @@
+/*
+  metrics_host.cpp - MetricsServer of a synthetic sensor on a local port
+
+  Serves GET /metrics the way DIY_BASIC does, from a cached Measures
+  record and the statistics of an I2C bus with an emulated SHT3x and
+  SGP41, so the endpoint can be scraped and load tested without a board:
+
+    metrics_host 9926 &
+    curl -s localhost:9926/metrics
+    http_load -c 4 -n 4000 127.0.0.1:9926 /metrics
+
+  Like the board it answers one request at a time and closes the
+  connection after each. Every 1000 requests it prints the requests,
+  errors, render time and the largest single write to stderr.
+*/
+
+#include "AirGradientEmulator.h"
+#include "AirGradientMetrics.h"
+#include "ArduinoHost.h"
+#include "HostSocket.h"
+
+// Counts the bytes of the largest write, to show the response goes out
+// in pieces of the fixed buffer
+class CountingClient : public SocketClient
+{
+  public:
+    size_t largestWrite = 0;
+
+    size_t write(const uint8_t* buffer, size_t size)
+    {
+      if (size > largestWrite) {
+        largestWrite = size;
+      }
+      return SocketClient::write(buffer, size);
+    }
+    using SocketClient::write;
+};
+
+class EchoDevice : public I2CDeviceEmulator
+{
+  public:
+    bool receive(const uint8_t*, uint8_t) { return true; }
+    uint8_t send(uint8_t* data, uint8_t len) { memset(data, 0x66, len); return len; }
+};
+
+static uint32_t reportsSent = 0;
+
+static void addCounters(MetricsWriter& writer)
+{
+  writer.family("airgradient_reports_sent", "counter", "Measures uploaded");
+  writer.counter("airgradient_reports_sent", reportsSent);
+}
+
+int main(int argc, char** argv)
+{
+  Host_useRealTime(true);
+  SocketServer server(argc > 1 ? atoi(argv[1]) : 9926);
+  if (!server.begin()) {
+    fprintf(stderr, "cannot listen\n");
+    return 1;
+  }
+  fprintf(stderr, "serving http://127.0.0.1:%u/metrics\n", server.port());
+
+  Measures measures;
+  measures.set(MEASURE_WIFI, -61);
+  measures.set(MEASURE_RCO2, 712);
+  measures.set(MEASURE_PM01, 8);
+  measures.set(MEASURE_PM02, 12);
+  measures.set(MEASURE_PM10, 16);
+  measures.set(MEASURE_PM003_COUNT, 870);
+  measures.set(MEASURE_TVOC_INDEX, 95);
+  measures.set(MEASURE_NOX_INDEX, 1);
+  measures.set(MEASURE_ATMP, 24.56);
+  measures.set(MEASURE_RHUM, 52);
+  measures.set(MEASURE_BOOT, 42);
+
+  I2CEmulator wire;
+  EchoDevice sht, sgp;
+  wire.attach(0x44, sht);
+  wire.attach(0x59, sgp);
+  I2CBus bus(wire);
+  int8_t devices[] = { bus.addDevice(0x44), bus.addDevice(0x59) };
+
+  MetricsServer metrics;
+  metrics.setMeasures(measures);
+  metrics.setI2CBus(bus);
+  metrics.setCallback(addCounters);
+
+  size_t largestWrite = 0;
+  while (true) {
+    CountingClient client;
+    if (!server.accept(client, 1000)) {
+      continue;
+    }
+    // some bus traffic between scrapes, like the sensor loop
+    const uint8_t command[] = { 0x24, 0x00 };
+    uint8_t rx[6];
+    for (int8_t device : devices) {
+      bus.writeRead(device, command, 2, rx, 6);
+    }
+    reportsSent++;
+
+    metrics.handle(client);
+    if (client.largestWrite > largestWrite) {
+      largestWrite = client.largestWrite;
+    }
+    uint32_t handled = metrics.getRequests() + metrics.getErrors();
+    if (handled % 1000 == 0) {
+      fprintf(stderr, "%u requests, %u errors, render %u us, largest write %zu bytes\n",
+              metrics.getRequests(), metrics.getErrors(), metrics.getLastRenderUs(), largestWrite);
+    }
+  }
+}
@@ -0,0 +1,183 @@
+/*
+  telemetry_decode.cpp - Turns a binary telemetry stream into CSV or JSON
+
+  Reads what a board with TELEMETRY on sends (see AirGradientTelemetry.h)
+  from a file or stdin, e.g. a serial port:
+
+    stty -F /dev/ttyUSB0 115200 raw
+    telemetry_decode /dev/ttyUSB0               CSV, all record types
+    telemetry_decode -t pms log.bin > pms.csv   only the PMS records
+    telemetry_decode -j log.bin                 one JSON object per line
+
+  Records of different types have different columns, so a CSV of more
+  than one type gets a header line before the first record of each type;
+  -t picks one type for a plain table. The records, errors and lost
+  records go to stderr at the end, with the decoding rate.
+
+    telemetry_decode -g 20000 > bench.bin
+
+  writes a synthetic stream instead: 20000 records in the mix ONE_V9
+  sends (PMS, CO2, temperature/humidity, SGP41, some text), and reports
+  its size next to the same samples as CSV lines.
+*/
+
+#include "AirGradientPms.h"
+#include "AirGradientTelemetry.h"
+#include "HostFile.h"
+
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Counts what would have been printed
+class CountingPrint : public Print
+{
+  public:
+    size_t count = 0;
+
+    size_t write(uint8_t) { count++; return 1; }
+    size_t write(const uint8_t*, size_t size) { count += size; return size; }
+};
+
+// Passes the stream on and renders every record it carries as a CSV line,
+// to compare the sizes
+class CsvSizePrint : public Print
+{
+  public:
+    CsvSizePrint(Print& out) : _out(&out) {}
+
+    size_t write(uint8_t c)
+    {
+      if (_decoder.feed(c)) {
+        Telemetry_writeCsv(_decoder.getRecord(), csv);
+      }
+      return _out->write(c);
+    }
+    using Print::write;
+
+    CountingPrint csv;
+
+  private:
+    Print* _out;
+    TelemetryDecoder _decoder;
+};
+
+static int generate(uint32_t records)
+{
+  FileStream out;
+  out.attach(stdout);
+  CsvSizePrint sized(out);
+  TelemetryWriter telemetry(sized);
+  srand(1);
+
+  // a PMS frame a second, the other sensors less often, like ONE_V9
+  uint32_t now = 0;
+  for (uint32_t i = 0; i < records; i++) {
+    now += 1000;
+    switch (i % 8) {
+      case 0: case 2: case 4: {
+        PmsDriver::DATA data;
+        uint16_t* words = &data.PM_SP_UG_1_0;
+        for (uint8_t j = 0; j < 12; j++) {
+          words[j] = rand() % (j < 6 ? 200 : 5000);
+        }
+        telemetry.pms(data, now);
+        break;
+      }
+      case 1:
+        telemetry.co2(400 + rand() % 1600, now);
+        break;
+      case 3: case 5:
+        telemetry.tempHum(1500 + rand() % 1500, 3000 + rand() % 5000, now);
+        break;
+      case 6:
+        telemetry.sgp41(25000 + rand() % 10000, 14000 + rand() % 4000, rand() % 500, 1 + rand() % 50, now);
+        break;
+      default:
+        telemetry.text(i % 16 == 7 ? "WiFi connected" : "Sensor data sent", now);
+        break;
+    }
+  }
+  out.flush();
+
+  fprintf(stderr, "%lu records, %lu bytes, %lu bytes as CSV lines\n", (unsigned long)telemetry.getRecords(),
+          (unsigned long)telemetry.getBytes(), (unsigned long)sized.csv.count);
+  return 0;
+}
+
+static int usage()
+{
+  fprintf(stderr, "usage: telemetry_decode [-j] [-t type] [file]\n"
+                  "       telemetry_decode -g records > file\n");
+  return 2;
+}
+
+int main(int argc, char** argv)
+{
+  bool json = false;
+  const char* only = NULL;
+  long records = 0;
+  int option;
+  while ((option = getopt(argc, argv, "jt:g:")) != -1) {
+    switch (option) {
+      case 'j': json = true; break;
+      case 't': only = optarg; break;
+      case 'g': records = atol(optarg); break;
+      default: return usage();
+    }
+  }
+  if (records > 0) {
+    return generate(records);
+  }
+  if (optind < argc - 1) {
+    return usage();
+  }
+
+  FileStream in;
+  if (optind == argc - 1) {
+    if (!in.open(argv[optind], "rb")) {
+      fprintf(stderr, "cannot read %s\n", argv[optind]);
+      return 1;
+    }
+  } else {
+    in.attach(stdin);
+  }
+  FileStream out;
+  out.attach(stdout);
+
+  TelemetryDecoder decoder;
+  bool headers[TELEMETRY_TEXT + 1] = {};
+  uint64_t bytes = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  int c;
+  while ((c = in.read()) >= 0) {
+    bytes++;
+    if (!decoder.feed(c)) {
+      continue;
+    }
+    const TelemetryRecord& record = decoder.getRecord();
+    if (only != NULL && strcmp(only, Telemetry_typeName(record.type)) != 0) {
+      continue;
+    }
+    if (json) {
+      Telemetry_writeJson(record, out);
+      continue;
+    }
+    if (!headers[record.type]) {
+      headers[record.type] = true;
+      Telemetry_writeCsvHeader(record.type, out);
+    }
+    Telemetry_writeCsv(record, out);
+  }
+  out.flush();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  fprintf(stderr, "%lu records, %lu errors, %lu lost, %llu bytes", (unsigned long)decoder.getRecords(),
+          (unsigned long)decoder.getErrors(), (unsigned long)decoder.getLost(), (unsigned long long)bytes);
+  if (seconds > 0) {
+    fprintf(stderr, ", %.0f records/s", decoder.getRecords() / seconds);
+  }
+  fprintf(stderr, "\n");
+  return decoder.getErrors() > 0 || decoder.getLost() > 0 ? 1 : 0;
+}